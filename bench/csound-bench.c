@@ -0,0 +1,654 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/* Throughput of csoundfilter, csoundsrc and csoundsink.
+ *
+ * Every reference csd in the csd directory is run for each combination of
+ * ksmps, channel count, buffer size and sample format asked for. The csd
+ * name tells the element: filter-*.csd go through a GstHarness, src-*.csd
+ * into a fakesink and sink-*.csd are fed by an appsrc. @SR@, @KSMPS@ and
+ * @NCHNLS@ in the csd are replaced for each run.
+ *
+ * Each run prints one JSON object per line. Timing and allocation counting
+ * start after a few warm up buffers, so compiling the csd and negotiating
+ * are left out. Allocations are counted process wide and include the
+ * harness or appsrc queue, about one per buffer.
+ *
+ * MYFLT is fixed when csound is built, so single and double precision are
+ * compared by running the bench against each build, "myflt" tells them
+ * apart in the output. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
+#include <gst/check/gstharness.h>
+#include <csound/csound.h>
+
+#define WARMUP_BUFFERS 16
+
+#ifndef BENCH_CSD_DIR
+#define BENCH_CSD_DIR "csd"
+#endif
+
+/* allocation counter, glibc lets the program replace malloc for every
+ * library it loads */
+static gint counting;
+static gint allocs;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t n, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+extern void *__libc_memalign (size_t alignment, size_t size);
+
+#define COUNT_ALLOC() \
+  G_STMT_START { \
+    if (g_atomic_int_get (&counting)) \
+      g_atomic_int_inc (&allocs); \
+  } G_STMT_END
+
+void *
+malloc (size_t size)
+{
+  COUNT_ALLOC ();
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t n, size_t size)
+{
+  COUNT_ALLOC ();
+  return __libc_calloc (n, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+  COUNT_ALLOC ();
+  return __libc_realloc (ptr, size);
+}
+
+int
+posix_memalign (void **ptr, size_t alignment, size_t size)
+{
+  COUNT_ALLOC ();
+  *ptr = __libc_memalign (alignment, size);
+  return *ptr ? 0 : ENOMEM;
+}
+#define ALLOCS_COUNTED TRUE
+#else
+#define ALLOCS_COUNTED FALSE
+#endif
+
+typedef struct
+{
+  const gchar *element;
+  const gchar *csd;
+  const gchar *csd_path;
+  gint rate;
+  gint ksmps;
+  gint channels;
+  gint frames;                  /* per buffer pushed, unused for csoundsrc */
+  GstAudioFormat format;
+} BenchCase;
+
+typedef struct
+{
+  /* after the warm up */
+  guint64 buffers;
+  guint64 frames;
+  GstClockTime start;
+  GstClockTime wall;
+  gint allocs;
+
+  guint64 seen;
+  gint bpf;
+  GstStructure *stats;
+
+  /* a source is stopped with an eos once this many frames are counted */
+  GstElement *source;
+  guint64 target;
+} BenchResult;
+
+static gchar *opt_csd_dir = NULL;
+static gchar *opt_match = NULL;
+static gchar *opt_ksmps = NULL;
+static gchar *opt_channels = NULL;
+static gchar *opt_frames = NULL;
+static gchar *opt_formats = NULL;
+static gint opt_rate = 48000;
+static gdouble opt_seconds = 5.0;
+
+static GOptionEntry entries[] = {
+  {"csd-dir", 0, 0, G_OPTION_ARG_FILENAME, &opt_csd_dir,
+      "Directory of the reference csds", "DIR"},
+  {"match", 'm', 0, G_OPTION_ARG_STRING, &opt_match,
+      "Only run the csds whose name contains TEXT", "TEXT"},
+  {"ksmps", 'k', 0, G_OPTION_ARG_STRING, &opt_ksmps,
+      "ksmps values, comma separated (16,64,256)", "LIST"},
+  {"channels", 'c', 0, G_OPTION_ARG_STRING, &opt_channels,
+      "Channel counts, comma separated (1,2,8)", "LIST"},
+  {"frames", 'f', 0, G_OPTION_ARG_STRING, &opt_frames,
+      "Frames per buffer, comma separated (256,1024,4096)", "LIST"},
+  {"formats", 0, 0, G_OPTION_ARG_STRING, &opt_formats,
+      "Sample formats, comma separated (F32LE,F64LE,S16LE)", "LIST"},
+  {"rate", 'r', 0, G_OPTION_ARG_INT, &opt_rate, "Sample rate", "RATE"},
+  {"seconds", 's', 0, G_OPTION_ARG_DOUBLE, &opt_seconds,
+      "Seconds of audio per run", "SECONDS"},
+  {NULL}
+};
+
+static GArray *
+bench_parse_ints (const gchar * list)
+{
+  GArray *values = g_array_new (FALSE, FALSE, sizeof (gint));
+  gchar **items = g_strsplit (list, ",", -1);
+  gchar **item;
+
+  for (item = items; *item; item++) {
+    gint value = atoi (*item);
+
+    if (value > 0)
+      g_array_append_val (values, value);
+    else
+      g_printerr ("ignoring %s\n", *item);
+  }
+  g_strfreev (items);
+
+  return values;
+}
+
+static GArray *
+bench_parse_formats (const gchar * list)
+{
+  GArray *values = g_array_new (FALSE, FALSE, sizeof (GstAudioFormat));
+  gchar **items = g_strsplit (list, ",", -1);
+  gchar **item;
+
+  for (item = items; *item; item++) {
+    GstAudioFormat format = gst_audio_format_from_string (*item);
+
+    if (format != GST_AUDIO_FORMAT_UNKNOWN)
+      g_array_append_val (values, format);
+    else
+      g_printerr ("ignoring %s\n", *item);
+  }
+  g_strfreev (items);
+
+  return values;
+}
+
+static gchar *
+bench_replace (gchar * text, const gchar * name, gint value)
+{
+  gchar **parts = g_strsplit (text, name, -1);
+  gchar *with = g_strdup_printf ("%d", value);
+  gchar *res = g_strjoinv (with, parts);
+
+  g_strfreev (parts);
+  g_free (with);
+  g_free (text);
+
+  return res;
+}
+
+/* the reference csd with the case values in, in a temporary file */
+static gchar *
+bench_write_csd (const BenchCase * bc)
+{
+  gchar *text, *path = NULL;
+  gint fd;
+
+  if (!g_file_get_contents (bc->csd_path, &text, NULL, NULL))
+    return NULL;
+
+  text = bench_replace (text, "@SR@", bc->rate);
+  text = bench_replace (text, "@KSMPS@", bc->ksmps);
+  text = bench_replace (text, "@NCHNLS@", bc->channels);
+
+  fd = g_file_open_tmp ("csound-bench-XXXXXX.csd", &path, NULL);
+  if (fd >= 0) {
+    g_close (fd, NULL);
+    if (!g_file_set_contents (path, text, -1, NULL)) {
+      g_free (path);
+      path = NULL;
+    }
+  }
+  g_free (text);
+
+  return path;
+}
+
+static gchar *
+bench_caps (const BenchCase * bc)
+{
+  return g_strdup_printf ("audio/x-raw,format=%s,rate=%d,channels=%d,"
+      "layout=interleaved", gst_audio_format_to_string (bc->format),
+      bc->rate, bc->channels);
+}
+
+/* a sine on every channel, for the orchestras to work on */
+static GstBuffer *
+bench_input (const BenchCase * bc)
+{
+  const GstAudioFormatInfo *finfo = gst_audio_format_get_info (bc->format);
+  gint samples = bc->frames * bc->channels, i;
+  GstBuffer *buffer;
+  GstMapInfo map;
+
+  buffer = gst_buffer_new_allocate (NULL,
+      samples * GST_AUDIO_FORMAT_INFO_WIDTH (finfo) / 8, NULL);
+  gst_buffer_map (buffer, &map, GST_MAP_WRITE);
+  memset (map.data, 0, map.size);
+  /* host endian, the byte order does not matter to the load */
+  for (i = 0; i < samples; i++) {
+    gdouble value = 0.5 * sin (2.0 * G_PI * 440.0 * (i / bc->channels)
+        / bc->rate);
+
+    switch (GST_AUDIO_FORMAT_INFO_WIDTH (finfo)) {
+      case 64:
+        ((gdouble *) map.data)[i] = value;
+        break;
+      case 32:
+        if (GST_AUDIO_FORMAT_INFO_IS_FLOAT (finfo))
+          ((gfloat *) map.data)[i] = value;
+        else
+          ((gint32 *) map.data)[i] = value * G_MAXINT32;
+        break;
+      case 16:
+        ((gint16 *) map.data)[i] = value * G_MAXINT16;
+        break;
+      default:
+        break;
+    }
+  }
+  gst_buffer_unmap (buffer, &map);
+
+  return buffer;
+}
+
+static void
+bench_start (BenchResult * res)
+{
+  res->start = gst_util_get_timestamp ();
+  g_atomic_int_set (&allocs, 0);
+  g_atomic_int_set (&counting, 1);
+}
+
+static void
+bench_stop (BenchResult * res)
+{
+  g_atomic_int_set (&counting, 0);
+  res->allocs = g_atomic_int_get (&allocs);
+  res->wall = gst_util_get_timestamp () - res->start;
+}
+
+/* counts the buffers reaching a pad once the warm up is over, the run
+ * ends with the eos message, after the sink drained its ring buffer */
+static GstPadProbeReturn
+bench_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  BenchResult *res = user_data;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+
+  if (res->seen++ == WARMUP_BUFFERS) {
+    bench_start (res);
+  } else if (res->seen > WARMUP_BUFFERS) {
+    res->buffers++;
+    res->frames += gst_buffer_get_size (buffer) / res->bpf;
+    /* whatever size the source picked for its buffers */
+    if (res->source && res->frames >= res->target) {
+      gst_element_send_event (res->source, gst_event_new_eos ());
+      res->source = NULL;
+    }
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static gboolean
+bench_filter (const BenchCase * bc, const gchar * csd, BenchResult * res)
+{
+  GstHarness *h;
+  GstBuffer *input, *output;
+  gchar *desc, *caps;
+  guint64 n_buffers, i;
+
+  desc = g_strdup_printf ("csoundfilter location=\"%s\"", csd);
+  h = gst_harness_new_parse (desc);
+  g_free (desc);
+  caps = bench_caps (bc);
+  gst_harness_set_caps_str (h, caps, caps);
+  g_free (caps);
+
+  input = bench_input (bc);
+  n_buffers = opt_seconds * bc->rate / bc->frames;
+  for (i = 0; i < WARMUP_BUFFERS + n_buffers; i++) {
+    if (i == WARMUP_BUFFERS)
+      bench_start (res);
+    if (gst_harness_push (h, gst_buffer_ref (input)) != GST_FLOW_OK)
+      break;
+    while ((output = gst_harness_try_pull (h))) {
+      if (i >= WARMUP_BUFFERS) {
+        res->buffers++;
+        res->frames += gst_buffer_get_size (output) / res->bpf;
+      }
+      gst_buffer_unref (output);
+    }
+  }
+  gst_harness_push_event (h, gst_event_new_eos ());
+  while ((output = gst_harness_try_pull (h))) {
+    res->buffers++;
+    res->frames += gst_buffer_get_size (output) / res->bpf;
+    gst_buffer_unref (output);
+  }
+  bench_stop (res);
+
+  g_object_get (h->element, "stats", &res->stats, NULL);
+  gst_buffer_unref (input);
+  gst_harness_teardown (h);
+
+  return i == WARMUP_BUFFERS + n_buffers;
+}
+
+static gboolean
+bench_run_pipeline (GstElement * pipeline, BenchResult * res,
+    GstElement * appsrc, const BenchCase * bc)
+{
+  GstBus *bus = gst_element_get_bus (pipeline);
+  GstMessage *msg;
+  gboolean ok;
+
+  if (gst_element_set_state (pipeline,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+    gst_object_unref (bus);
+    return FALSE;
+  }
+
+  if (appsrc) {
+    GstBuffer *input = bench_input (bc);
+    guint64 n_buffers = opt_seconds * bc->rate / bc->frames, i;
+    GstFlowReturn ret = GST_FLOW_OK;
+
+    for (i = 0; i < WARMUP_BUFFERS + n_buffers && ret == GST_FLOW_OK; i++)
+      g_signal_emit_by_name (appsrc, "push-buffer", input, &ret);
+    g_signal_emit_by_name (appsrc, "end-of-stream", &ret);
+    gst_buffer_unref (input);
+  }
+
+  msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  ok = GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS;
+  if (!ok) {
+    GError *err;
+
+    gst_message_parse_error (msg, &err, NULL);
+    g_printerr ("%s: %s\n", bc->csd, err->message);
+    g_error_free (err);
+  }
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+
+  if (res->seen > WARMUP_BUFFERS)
+    bench_stop (res);
+
+  return ok;
+}
+
+static gboolean
+bench_pipeline (const BenchCase * bc, const gchar * csd, BenchResult * res)
+{
+  GstElement *pipeline, *element, *probed, *appsrc = NULL;
+  GError *err = NULL;
+  GstPad *pad;
+  gchar *desc, *caps;
+  gboolean ok;
+
+  caps = bench_caps (bc);
+  if (g_str_equal (bc->element, "csoundsrc"))
+    desc = g_strdup_printf ("csoundsrc name=bench location=\"%s\" "
+        "is-live=false ! %s ! fakesink name=probed sync=false", csd, caps);
+  else
+    desc = g_strdup_printf ("appsrc name=source caps=\"%s\" format=time "
+        "block=true max-bytes=%d ! csoundsink name=bench location=\"%s\" "
+        "sync=false", caps, bc->frames * res->bpf * 4, csd);
+  g_free (caps);
+
+  pipeline = gst_parse_launch (desc, &err);
+  g_free (desc);
+  if (pipeline == NULL) {
+    g_printerr ("%s\n", err->message);
+    g_error_free (err);
+    return FALSE;
+  }
+
+  element = gst_bin_get_by_name (GST_BIN (pipeline), "bench");
+  probed = gst_bin_get_by_name (GST_BIN (pipeline), "probed");
+  if (probed == NULL) {
+    probed = gst_object_ref (element);
+    appsrc = gst_bin_get_by_name (GST_BIN (pipeline), "source");
+  }
+
+  if (probed != element) {
+    res->source = element;
+    res->target = opt_seconds * bc->rate;
+  }
+
+  pad = gst_element_get_static_pad (probed, "sink");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, bench_probe, res, NULL);
+  gst_object_unref (pad);
+
+  ok = bench_run_pipeline (pipeline, res, appsrc, bc);
+  g_object_get (element, "stats", &res->stats, NULL);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+
+  if (appsrc)
+    gst_object_unref (appsrc);
+  gst_object_unref (probed);
+  gst_object_unref (element);
+  gst_object_unref (pipeline);
+
+  return ok;
+}
+
+static void
+bench_print (const BenchCase * bc, const BenchResult * res)
+{
+  gdouble seconds = (gdouble) res->wall / GST_SECOND;
+  gdouble audio = (gdouble) res->frames / bc->rate;
+  guint64 blocks = res->frames / bc->ksmps;
+  guint64 avg = 0, p99 = 0;
+  gchar allocs_text[32];
+
+  if (res->stats) {
+    gst_structure_get_uint64 (res->stats, "avg", &avg);
+    gst_structure_get_uint64 (res->stats, "p99", &p99);
+  }
+  if (ALLOCS_COUNTED && res->buffers > 0)
+    g_ascii_formatd (allocs_text, sizeof (allocs_text), "%.3f",
+        (gdouble) res->allocs / res->buffers);
+  else
+    g_strlcpy (allocs_text, "null", sizeof (allocs_text));
+
+  /* samples are frames, per channel */
+  g_print ("{\"element\":\"%s\",\"csd\":\"%s\",\"format\":\"%s\","
+      "\"myflt\":%u,\"rate\":%d,\"ksmps\":%d,\"channels\":%d,"
+      "\"buffer_frames\":%" G_GUINT64_FORMAT ",\"buffers\":%"
+      G_GUINT64_FORMAT ",\"samples_per_second\":%.0f,"
+      "\"ns_per_block\":%.1f,\"perform_ns_avg\":%" G_GUINT64_FORMAT
+      ",\"perform_ns_p99\":%" G_GUINT64_FORMAT ",\"allocs_per_buffer\":%s,"
+      "\"realtime_factor\":%.3f}\n", bc->element, bc->csd,
+      gst_audio_format_to_string (bc->format), (guint) sizeof (MYFLT),
+      bc->rate, bc->ksmps, bc->channels,
+      res->buffers ? res->frames / res->buffers : 0, res->buffers,
+      seconds > 0 ? res->frames / seconds : 0.0,
+      blocks ? (gdouble) res->wall / blocks : 0.0, avg, p99, allocs_text,
+      seconds > 0 ? audio / seconds : 0.0);
+}
+
+static void
+bench_case (const BenchCase * bc)
+{
+  BenchResult res = { 0, };
+  gchar *csd;
+  gboolean ok;
+
+  csd = bench_write_csd (bc);
+  if (csd == NULL) {
+    g_printerr ("%s: could not prepare the csd\n", bc->csd);
+    return;
+  }
+
+  res.bpf = bc->channels
+      * GST_AUDIO_FORMAT_INFO_WIDTH (gst_audio_format_get_info (bc->format))
+      / 8;
+  if (g_str_equal (bc->element, "csoundfilter"))
+    ok = bench_filter (bc, csd, &res);
+  else
+    ok = bench_pipeline (bc, csd, &res);
+
+  if (ok && res.buffers > 0)
+    bench_print (bc, &res);
+  else
+    g_printerr ("%s: run failed (ksmps %d, %d channels, %s)\n", bc->csd,
+        bc->ksmps, bc->channels, gst_audio_format_to_string (bc->format));
+
+  if (res.stats)
+    gst_structure_free (res.stats);
+  g_unlink (csd);
+  g_free (csd);
+}
+
+static void
+bench_csd (BenchCase * bc, GArray * ksmps, GArray * channels, GArray * frames,
+    GArray * formats)
+{
+  guint k, c, f, s;
+  /* csoundsrc decides its own buffer size */
+  guint n_frames = g_str_equal (bc->element, "csoundsrc") ? 1 : frames->len;
+
+  for (k = 0; k < ksmps->len; k++)
+    for (c = 0; c < channels->len; c++)
+      for (f = 0; f < n_frames; f++)
+        for (s = 0; s < formats->len; s++) {
+          bc->ksmps = g_array_index (ksmps, gint, k);
+          bc->channels = g_array_index (channels, gint, c);
+          bc->frames = g_array_index (frames, gint, f);
+          bc->format = g_array_index (formats, GstAudioFormat, s);
+          bench_case (bc);
+        }
+}
+
+static gint
+bench_compare_names (gconstpointer a, gconstpointer b)
+{
+  return g_strcmp0 (*(const gchar **) a, *(const gchar **) b);
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *ctx;
+  GError *err = NULL;
+  GArray *ksmps, *channels, *frames, *formats;
+  GPtrArray *names;
+  const gchar *name;
+  GDir *dir;
+  guint i;
+
+  ctx = g_option_context_new ("- csound elements throughput");
+  g_option_context_add_main_entries (ctx, entries, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (ctx, &argc, &argv, &err)) {
+    g_printerr ("%s\n", err->message);
+    g_error_free (err);
+    g_option_context_free (ctx);
+    return 1;
+  }
+  g_option_context_free (ctx);
+
+  if (opt_csd_dir == NULL)
+    opt_csd_dir = g_strdup (BENCH_CSD_DIR);
+  ksmps = bench_parse_ints (opt_ksmps ? opt_ksmps : "16,64,256");
+  channels = bench_parse_ints (opt_channels ? opt_channels : "1,2,8");
+  frames = bench_parse_ints (opt_frames ? opt_frames : "256,1024,4096");
+  formats = bench_parse_formats (opt_formats ? opt_formats :
+      GST_AUDIO_NE (F32) "," GST_AUDIO_NE (F64) "," GST_AUDIO_NE (S16));
+  if (!ksmps->len || !channels->len || !frames->len || !formats->len
+      || opt_rate <= 0 || opt_seconds <= 0) {
+    g_printerr ("nothing to run\n");
+    return 1;
+  }
+
+  dir = g_dir_open (opt_csd_dir, 0, &err);
+  if (dir == NULL) {
+    g_printerr ("%s\n", err->message);
+    g_error_free (err);
+    return 1;
+  }
+  names = g_ptr_array_new_with_free_func (g_free);
+  while ((name = g_dir_read_name (dir)))
+    if (g_str_has_suffix (name, ".csd")
+        && (opt_match == NULL || strstr (name, opt_match)))
+      g_ptr_array_add (names, g_strdup (name));
+  g_dir_close (dir);
+  g_ptr_array_sort (names, bench_compare_names);
+
+  for (i = 0; i < names->len; i++) {
+    const gchar *file = g_ptr_array_index (names, i);
+    gchar *csd_name = g_strndup (file, strlen (file) - 4);
+    gchar *path = g_build_filename (opt_csd_dir, file, NULL);
+    BenchCase bc = { NULL, };
+
+    if (g_str_has_prefix (file, "filter-"))
+      bc.element = "csoundfilter";
+    else if (g_str_has_prefix (file, "src-"))
+      bc.element = "csoundsrc";
+    else if (g_str_has_prefix (file, "sink-"))
+      bc.element = "csoundsink";
+
+    if (bc.element) {
+      bc.csd = csd_name;
+      bc.csd_path = path;
+      bc.rate = opt_rate;
+      bench_csd (&bc, ksmps, channels, frames, formats);
+    } else {
+      g_printerr ("%s: no filter-, src- or sink- prefix, skipped\n", file);
+    }
+    g_free (path);
+    g_free (csd_name);
+  }
+
+  g_ptr_array_free (names, TRUE);
+  g_array_free (ksmps, TRUE);
+  g_array_free (channels, TRUE);
+  g_array_free (frames, TRUE);
+  g_array_free (formats, TRUE);
+  g_free (opt_csd_dir);
+
+  return 0;
+}
@@ -0,0 +1,166 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/* Allocation helpers shared by csoundfilter and csoundsrc. Output buffers
+ * come from a pool of aligned buffers holding whole ksmps blocks, so the
+ * streaming thread stops calling malloc/free once the pool is warm. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstcsoundbufferpool.h"
+
+static gboolean
+gst_csound_buffer_pool_configure (GstBufferPool * pool, GstCaps * caps,
+    guint size, guint min, guint max, GstAllocator * allocator,
+    GstAllocationParams * params)
+{
+  GstStructure *config;
+
+  config = gst_buffer_pool_get_config (pool);
+  gst_buffer_pool_config_set_params (config, caps, size, min, max);
+  gst_buffer_pool_config_set_allocator (config, allocator, params);
+  return gst_buffer_pool_set_config (pool, config);
+}
+
+/**
+ * gst_csound_buffer_pool_decide:
+ * @query: the ALLOCATION query answered by downstream
+ * @block_size: bytes of one ksmps block
+ * @min_size: the smallest buffer the element needs
+ *
+ * Configure a pool of aligned buffers, rounded up to whole ksmps blocks,
+ * and store it with the allocation params in @query. The downstream pool
+ * is reused when it accepts the configuration.
+ *
+ * Returns: the size of the pool buffers, 0 if no pool could be set up
+ */
+guint
+gst_csound_buffer_pool_decide (GstQuery * query, guint block_size,
+    guint min_size)
+{
+  GstCaps *caps;
+  GstBufferPool *pool = NULL;
+  GstAllocator *allocator = NULL;
+  GstAllocationParams params;
+  guint size = 0, min = 0, max = 0;
+  gboolean update_pool, update_params;
+
+  g_return_val_if_fail (block_size > 0, 0);
+
+  gst_query_parse_allocation (query, &caps, NULL);
+
+  update_params = gst_query_get_n_allocation_params (query) > 0;
+  if (update_params)
+    gst_query_parse_nth_allocation_param (query, 0, &allocator, &params);
+  else
+    gst_allocation_params_init (&params);
+  params.align = MAX (params.align, GST_CSOUND_BUFFER_ALIGN);
+
+  update_pool = gst_query_get_n_allocation_pools (query) > 0;
+  if (update_pool)
+    gst_query_parse_nth_allocation_pool (query, 0, &pool, &size, &min, &max);
+
+  size = MAX (size, min_size);
+  size = MAX (1, (size + block_size - 1) / block_size) * block_size;
+
+  if (pool && !gst_csound_buffer_pool_configure (pool, caps, size, min, max,
+          allocator, &params)) {
+    GST_DEBUG_OBJECT (pool, "downstream pool refused our config");
+    gst_object_unref (pool);
+    pool = NULL;
+  }
+
+  if (pool == NULL) {
+    pool = gst_buffer_pool_new ();
+    if (!gst_csound_buffer_pool_configure (pool, caps, size, min, max,
+            allocator, &params)) {
+      gst_object_unref (pool);
+      if (allocator)
+        gst_object_unref (allocator);
+      return 0;
+    }
+  }
+
+  if (update_params)
+    gst_query_set_nth_allocation_param (query, 0, allocator, &params);
+  else
+    gst_query_add_allocation_param (query, allocator, &params);
+
+  if (update_pool)
+    gst_query_set_nth_allocation_pool (query, 0, pool, size, min, max);
+  else
+    gst_query_add_allocation_pool (query, pool, size, min, max);
+
+  gst_object_unref (pool);
+  if (allocator)
+    gst_object_unref (allocator);
+
+  return size;
+}
+
+/**
+ * gst_csound_buffer_pool_propose:
+ * @query: the ALLOCATION query from upstream
+ * @size: the buffer size we would like to receive, in whole ksmps blocks
+ *
+ * Ask upstream for aligned buffers and, when it needs one, offer it a
+ * pool of @size buffers.
+ */
+void
+gst_csound_buffer_pool_propose (GstQuery * query, guint size)
+{
+  GstCaps *caps;
+  gboolean need_pool;
+  GstAllocationParams params;
+
+  gst_query_parse_allocation (query, &caps, &need_pool);
+
+  gst_allocation_params_init (&params);
+  params.align = GST_CSOUND_BUFFER_ALIGN;
+  gst_query_add_allocation_param (query, NULL, &params);
+
+  if (need_pool && caps && size > 0) {
+    GstBufferPool *pool = gst_buffer_pool_new ();
+
+    if (gst_csound_buffer_pool_configure (pool, caps, size, 0, 0, NULL,
+            &params))
+      gst_query_add_allocation_pool (query, pool, size, 0, 0);
+    gst_object_unref (pool);
+  }
+}
+
+/**
+ * gst_csound_buffer_new_allocate:
+ * @size: the buffer size
+ *
+ * Fallback for buffers that do not fit the pool, with the same alignment.
+ *
+ * Returns: a new aligned buffer of @size bytes
+ */
+GstBuffer *
+gst_csound_buffer_new_allocate (gsize size)
+{
+  GstAllocationParams params;
+
+  gst_allocation_params_init (&params);
+  params.align = GST_CSOUND_BUFFER_ALIGN;
+  return gst_buffer_new_allocate (NULL, size, &params);
+}
@@ -0,0 +1,40 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_CSOUND_BUFFER_POOL_H_
+#define _GST_CSOUND_BUFFER_POOL_H_
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* alignment mask of the buffers handed to the conversion kernels,
+ * a cache line and wide enough for AVX loads */
+#define GST_CSOUND_BUFFER_ALIGN 63
+
+guint gst_csound_buffer_pool_decide (GstQuery * query, guint block_size,
+    guint min_size);
+
+void gst_csound_buffer_pool_propose (GstQuery * query, guint size);
+
+GstBuffer *gst_csound_buffer_new_allocate (gsize size);
+
+G_END_DECLS
+
+#endif
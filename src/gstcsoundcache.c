@@ -0,0 +1,314 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/* Rendered spout blocks of a score, kept on disk across runs.
+ *
+ * The file is named after a checksum of the csd contents and the options,
+ * and holds the blocks of a straight render from the start of the score:
+ * a header, then spout as csound wrote it, ksmps * nchnls MYFLT per block.
+ * It is mapped in memory, reading a block is a pointer into the mapping
+ * and the element converts it to the negotiated format like it does
+ * spout. The block count in the header is only raised once a block is
+ * written, so a file left by a crash is still good up to it.
+ *
+ * One element at a time writes a file, others rendering the same csd
+ * meanwhile go without a cache. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <glib/gstdio.h>
+#include "gstcsoundcache.h"
+
+#ifdef G_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+GST_DEBUG_CATEGORY_STATIC (gst_csound_cache_debug);
+#define GST_CAT_DEFAULT gst_csound_cache_debug
+
+#define CACHE_MAGIC 0x43534347  /* "GCSC" */
+#define CACHE_VERSION 1
+#define CACHE_HEADER_SIZE 64
+#define CACHE_MIN_BLOCKS 1024
+
+typedef struct
+{
+  guint32 magic;
+  guint32 version;
+  guint32 myflt_size;
+  guint32 channels;
+  guint32 ksmps;
+  guint32 rate;
+  guint64 blocks;               /* written, from the start of the score */
+  guint32 complete;             /* the score ended after the last block */
+} GstCsoundCacheHeader;
+
+G_STATIC_ASSERT (sizeof (GstCsoundCacheHeader) <= CACHE_HEADER_SIZE);
+
+struct _GstCsoundCache
+{
+  gint fd;
+  guint8 *map;
+  gsize map_size;
+  guint64 capacity;             /* blocks the file has room for */
+  gsize block_size;
+  GstCsoundCacheHeader *header;
+};
+
+#ifdef G_OS_UNIX
+
+static gchar *
+gst_csound_cache_path (const gchar * csd_name, const gchar * options)
+{
+  gchar *contents, *checksum, *dir, *name, *path;
+  GChecksum *sum;
+  gsize length;
+
+  if (!g_file_get_contents (csd_name, &contents, &length, NULL))
+    return NULL;
+
+  sum = g_checksum_new (G_CHECKSUM_SHA256);
+  g_checksum_update (sum, (const guchar *) contents, length);
+  if (options)
+    g_checksum_update (sum, (const guchar *) options, -1);
+  checksum = g_strdup (g_checksum_get_string (sum));
+  g_checksum_free (sum);
+  g_free (contents);
+
+  dir = g_build_filename (g_get_user_cache_dir (), "gstcsound", NULL);
+  g_mkdir_with_parents (dir, 0755);
+  name = g_strconcat (checksum, ".render", NULL);
+  path = g_build_filename (dir, name, NULL);
+  g_free (name);
+  g_free (dir);
+  g_free (checksum);
+
+  return path;
+}
+
+static gboolean
+gst_csound_cache_map (GstCsoundCache * cache, guint64 capacity)
+{
+  gsize size = CACHE_HEADER_SIZE + capacity * cache->block_size;
+  guint8 *map;
+
+  if (ftruncate (cache->fd, size) < 0)
+    return FALSE;
+
+  map = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, cache->fd, 0);
+  if (map == MAP_FAILED)
+    return FALSE;
+
+  if (cache->map)
+    munmap (cache->map, cache->map_size);
+  cache->map = map;
+  cache->map_size = size;
+  cache->capacity = capacity;
+  cache->header = (GstCsoundCacheHeader *) map;
+
+  return TRUE;
+}
+
+/**
+ * gst_csound_cache_open:
+ * @csd_name: the csd file
+ * @options: csound options it is compiled with, or %NULL
+ *
+ * Open the cache of @csd_name, created empty when it does not exist yet
+ * or was rendered with other settings.
+ *
+ * Returns: the cache, or %NULL when it can not be used, another element
+ *     may be writing it
+ */
+GstCsoundCache *
+gst_csound_cache_open (const gchar * csd_name, const gchar * options,
+    guint channels, guint ksmps, guint rate)
+{
+  GstCsoundCache *cache;
+  GstCsoundCacheHeader *header;
+  gchar *path;
+  struct stat st;
+  gint fd;
+
+  if (g_once_init_enter (&gst_csound_cache_debug)) {
+    GstDebugCategory *cat = NULL;
+
+    GST_DEBUG_CATEGORY_INIT (cat, "csoundcache", 0, "csound render cache");
+    g_once_init_leave (&gst_csound_cache_debug, cat);
+  }
+
+  path = gst_csound_cache_path (csd_name, options);
+  if (path == NULL)
+    return NULL;
+
+  fd = g_open (path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    GST_WARNING ("can not open %s", path);
+    g_free (path);
+    return NULL;
+  }
+  if (flock (fd, LOCK_EX | LOCK_NB) < 0 || fstat (fd, &st) < 0) {
+    GST_INFO ("%s is in use", path);
+    close (fd);
+    g_free (path);
+    return NULL;
+  }
+
+  cache = g_new0 (GstCsoundCache, 1);
+  cache->fd = fd;
+  cache->block_size = (gsize) ksmps * channels * sizeof (MYFLT);
+
+  if (st.st_size >= CACHE_HEADER_SIZE) {
+    guint64 capacity = (st.st_size - CACHE_HEADER_SIZE) / cache->block_size;
+
+    if (!gst_csound_cache_map (cache, MAX (capacity, 1)))
+      goto failed;
+    header = cache->header;
+    if (header->magic == CACHE_MAGIC && header->version == CACHE_VERSION
+        && header->myflt_size == sizeof (MYFLT)
+        && header->channels == channels && header->ksmps == ksmps
+        && header->rate == rate && header->blocks <= cache->capacity) {
+      GST_DEBUG ("%s holds %" G_GUINT64_FORMAT " blocks%s", path,
+          header->blocks, header->complete ? ", the whole score" : "");
+      g_free (path);
+      return cache;
+    }
+    GST_DEBUG ("%s was rendered with other settings, starting over", path);
+  }
+
+  if (!gst_csound_cache_map (cache, CACHE_MIN_BLOCKS))
+    goto failed;
+  header = cache->header;
+  memset (header, 0, CACHE_HEADER_SIZE);
+  header->magic = CACHE_MAGIC;
+  header->version = CACHE_VERSION;
+  header->myflt_size = sizeof (MYFLT);
+  header->channels = channels;
+  header->ksmps = ksmps;
+  header->rate = rate;
+  g_free (path);
+
+  return cache;
+
+failed:
+  GST_WARNING ("can not map %s", path);
+  gst_csound_cache_close (cache);
+  g_free (path);
+  return NULL;
+}
+
+void
+gst_csound_cache_close (GstCsoundCache * cache)
+{
+  if (cache == NULL)
+    return;
+
+  if (cache->map) {
+    /* leave no room past the blocks written */
+    gsize used = CACHE_HEADER_SIZE + cache->header->blocks * cache->block_size;
+
+    munmap (cache->map, cache->map_size);
+    if (ftruncate (cache->fd, used) < 0)
+      GST_DEBUG ("could not trim the cache file");
+  }
+  close (cache->fd);
+  g_free (cache);
+}
+
+/**
+ * gst_csound_cache_append:
+ * @spout: the block following the last one written
+ *
+ * Returns: %FALSE when the file can not grow
+ */
+gboolean
+gst_csound_cache_append (GstCsoundCache * cache, const MYFLT * spout)
+{
+  guint64 block = cache->header->blocks;
+
+  if (block == cache->capacity && !gst_csound_cache_map (cache,
+          MAX (cache->capacity * 2, CACHE_MIN_BLOCKS))) {
+    GST_WARNING ("can not grow the cache past %" G_GUINT64_FORMAT " blocks",
+        block);
+    return FALSE;
+  }
+
+  memcpy (cache->map + CACHE_HEADER_SIZE + block * cache->block_size, spout,
+      cache->block_size);
+  cache->header->blocks = block + 1;
+
+  return TRUE;
+}
+
+#else /* G_OS_UNIX */
+
+GstCsoundCache *
+gst_csound_cache_open (const gchar * csd_name, const gchar * options,
+    guint channels, guint ksmps, guint rate)
+{
+  return NULL;
+}
+
+void
+gst_csound_cache_close (GstCsoundCache * cache)
+{
+}
+
+gboolean
+gst_csound_cache_append (GstCsoundCache * cache, const MYFLT * spout)
+{
+  return FALSE;
+}
+
+#endif /* G_OS_UNIX */
+
+guint64
+gst_csound_cache_get_blocks (GstCsoundCache * cache)
+{
+  return cache->header->blocks;
+}
+
+gboolean
+gst_csound_cache_is_complete (GstCsoundCache * cache)
+{
+  return cache->header->complete;
+}
+
+/* valid until the next append */
+const MYFLT *
+gst_csound_cache_get_block (GstCsoundCache * cache, guint64 block)
+{
+  g_return_val_if_fail (block < cache->header->blocks, NULL);
+
+  return (const MYFLT *) (cache->map + CACHE_HEADER_SIZE +
+      block * cache->block_size);
+}
+
+void
+gst_csound_cache_set_complete (GstCsoundCache * cache)
+{
+  cache->header->complete = TRUE;
+}
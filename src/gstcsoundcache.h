@@ -0,0 +1,45 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_CSOUND_CACHE_H_
+#define _GST_CSOUND_CACHE_H_
+
+#include <gst/gst.h>
+#include <csound/csound.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstCsoundCache GstCsoundCache;
+
+GstCsoundCache *gst_csound_cache_open (const gchar * csd_name,
+    const gchar * options, guint channels, guint ksmps, guint rate);
+void gst_csound_cache_close (GstCsoundCache * cache);
+
+guint64 gst_csound_cache_get_blocks (GstCsoundCache * cache);
+gboolean gst_csound_cache_is_complete (GstCsoundCache * cache);
+const MYFLT *gst_csound_cache_get_block (GstCsoundCache * cache,
+    guint64 block);
+
+gboolean gst_csound_cache_append (GstCsoundCache * cache,
+    const MYFLT * spout);
+void gst_csound_cache_set_complete (GstCsoundCache * cache);
+
+G_END_DECLS
+
+#endif
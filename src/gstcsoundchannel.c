@@ -0,0 +1,395 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/* Control channels of the orchestra as controllable child objects.
+ *
+ * Every chn_k channel the csd declares as input becomes a GstCsoundChannel
+ * named after it, reachable through GstChildProxy, e.g.
+ * csoundfilter::cutoff::value. Once per buffer the elements evaluate the
+ * control bindings of every channel for each ksmps block with
+ * gst_object_get_value_array(), and before each csoundPerformKsmps() the
+ * values are stored through channel pointers looked up once at start. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstcsoundchannel.h"
+
+enum
+{
+  PROP_0,
+  PROP_VALUE,
+  PROP_MINIMUM,
+  PROP_MAXIMUM,
+  PROP_DEFAULT
+};
+
+G_DEFINE_TYPE (GstCsoundChannel, gst_csound_channel, GST_TYPE_OBJECT);
+
+static void
+gst_csound_channel_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstCsoundChannel *channel = GST_CSOUND_CHANNEL (object);
+
+  switch (property_id) {
+    case PROP_VALUE:
+      GST_OBJECT_LOCK (channel);
+      channel->value = g_value_get_double (value);
+      if (channel->bounded)
+        channel->value = CLAMP (channel->value, channel->minimum,
+            channel->maximum);
+      GST_OBJECT_UNLOCK (channel);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_csound_channel_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstCsoundChannel *channel = GST_CSOUND_CHANNEL (object);
+
+  switch (property_id) {
+    case PROP_VALUE:
+      GST_OBJECT_LOCK (channel);
+      g_value_set_double (value, channel->value);
+      GST_OBJECT_UNLOCK (channel);
+      break;
+    case PROP_MINIMUM:
+      g_value_set_double (value, channel->minimum);
+      break;
+    case PROP_MAXIMUM:
+      g_value_set_double (value, channel->maximum);
+      break;
+    case PROP_DEFAULT:
+      g_value_set_double (value, channel->dflt);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_csound_channel_finalize (GObject * object)
+{
+  GstCsoundChannel *channel = GST_CSOUND_CHANNEL (object);
+
+  g_free (channel->block_values);
+  G_OBJECT_CLASS (gst_csound_channel_parent_class)->finalize (object);
+}
+
+static void
+gst_csound_channel_class_init (GstCsoundChannelClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->set_property = gst_csound_channel_set_property;
+  gobject_class->get_property = gst_csound_channel_get_property;
+  gobject_class->finalize = gst_csound_channel_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_VALUE,
+      g_param_spec_double ("value", "Value",
+          "Value written to the csound channel, clamped to the range the "
+          "orchestra declares", -G_MAXDOUBLE, G_MAXDOUBLE, 0.0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_CONTROLLABLE));
+  g_object_class_install_property (gobject_class, PROP_MINIMUM,
+      g_param_spec_double ("minimum", "Minimum",
+          "Lower bound declared by chn_k", -G_MAXDOUBLE, G_MAXDOUBLE,
+          -G_MAXDOUBLE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_MAXIMUM,
+      g_param_spec_double ("maximum", "Maximum",
+          "Upper bound declared by chn_k", -G_MAXDOUBLE, G_MAXDOUBLE,
+          G_MAXDOUBLE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_DEFAULT,
+      g_param_spec_double ("default", "Default",
+          "Default value declared by chn_k", -G_MAXDOUBLE, G_MAXDOUBLE, 0.0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+}
+
+static void
+gst_csound_channel_init (GstCsoundChannel * channel)
+{
+  channel->minimum = -G_MAXDOUBLE;
+  channel->maximum = G_MAXDOUBLE;
+}
+
+/* take the channel called @name out of @channels, with the array's
+ * reference */
+static GstCsoundChannel *
+gst_csound_channels_steal (GPtrArray * channels, const gchar * name)
+{
+  guint i;
+
+  if (channels == NULL)
+    return NULL;
+
+  for (i = 0; i < channels->len; i++) {
+    GstCsoundChannel *channel = g_ptr_array_index (channels, i);
+
+    if (channel && g_strcmp0 (GST_OBJECT_NAME (channel), name) == 0) {
+      g_ptr_array_index (channels, i) = NULL;
+      return channel;
+    }
+  }
+
+  return NULL;
+}
+
+static GstCsoundChannel *
+gst_csound_channels_find (GPtrArray * channels, const gchar * name)
+{
+  guint i;
+
+  if (channels == NULL)
+    return NULL;
+
+  for (i = 0; i < channels->len; i++) {
+    GstCsoundChannel *channel = g_ptr_array_index (channels, i);
+
+    if (channel && g_strcmp0 (GST_OBJECT_NAME (channel), name) == 0)
+      return channel;
+  }
+
+  return NULL;
+}
+
+/* the free func of the arrays, unparents the channel if it is a child */
+static void
+gst_csound_channel_drop (gpointer data)
+{
+  GstObject *channel = data;
+  GstObject *parent;
+
+  if (channel == NULL)
+    return;
+
+  parent = gst_object_get_parent (channel);
+  if (parent) {
+    gst_object_unparent (channel);
+    if (GST_IS_CHILD_PROXY (parent))
+      gst_child_proxy_child_removed (GST_CHILD_PROXY (parent),
+          G_OBJECT (channel), GST_OBJECT_NAME (channel));
+    gst_object_unref (parent);
+  }
+  gst_object_unref (channel);
+}
+
+/**
+ * gst_csound_channels_update:
+ * @old: the channels from the previous start, or %NULL
+ * @csound: a compiled instance
+ * @parent: the element the channels are children of
+ *
+ * List the control input channels of @csound. Channels already in @old
+ * are kept, with their value and control bindings, the others are new
+ * and not children of @parent yet. @old is left as it is, this takes no
+ * lock and emits no signal, so it may run while @old is in use.
+ *
+ * Returns: the new channel array, for gst_csound_channels_commit() or
+ *     gst_csound_channels_discard()
+ */
+GPtrArray *
+gst_csound_channels_update (GPtrArray * old, CSOUND * csound,
+    GstObject * parent)
+{
+  GPtrArray *channels = g_ptr_array_new_with_free_func (
+      gst_csound_channel_drop);
+  controlChannelInfo_t *list = NULL;
+  gint n, i;
+
+  n = csoundListChannels (csound, &list);
+  for (i = 0; i < n; i++) {
+    GstCsoundChannel *channel;
+    gint type = list[i].type;
+
+    if ((type & CSOUND_CHANNEL_TYPE_MASK) != CSOUND_CONTROL_CHANNEL
+        || !(type & CSOUND_INPUT_CHANNEL))
+      continue;
+
+    channel = gst_csound_channels_find (old, list[i].name);
+    if (channel == NULL) {
+      channel = g_object_new (GST_TYPE_CSOUND_CHANNEL, "name", list[i].name,
+          NULL);
+      gst_object_ref_sink (channel);
+      channel->value = list[i].hints.dflt;
+    } else {
+      gst_object_ref (channel);
+    }
+
+    channel->bounded = list[i].hints.behav != CSOUND_CONTROL_CHANNEL_NO_HINTS;
+    if (channel->bounded) {
+      channel->minimum = list[i].hints.min;
+      channel->maximum = list[i].hints.max;
+    } else {
+      channel->minimum = -G_MAXDOUBLE;
+      channel->maximum = G_MAXDOUBLE;
+    }
+    channel->dflt = list[i].hints.dflt;
+    g_ptr_array_add (channels, channel);
+    GST_DEBUG_OBJECT (parent, "control channel %s [%g, %g]",
+        list[i].name, channel->minimum, channel->maximum);
+  }
+  if (list)
+    csoundDeleteChannelList (csound, list);
+
+  return channels;
+}
+
+/**
+ * gst_csound_channels_commit:
+ * @old: the channels @channels replaced, or %NULL
+ * @channels: from gst_csound_channels_update(), already in place of @old
+ * @parent: the element the channels are children of
+ *
+ * Parent the new channels and unparent the ones the orchestra no longer
+ * declares, emitting the child proxy signals, then free @old. Call it
+ * without the object lock of @parent.
+ */
+void
+gst_csound_channels_commit (GPtrArray * old, GPtrArray * channels,
+    GstObject * parent)
+{
+  guint i;
+
+  for (i = 0; i < channels->len; i++) {
+    GstObject *channel = g_ptr_array_index (channels, i);
+    GstCsoundChannel *kept = gst_csound_channels_steal (old,
+        GST_OBJECT_NAME (channel));
+
+    if (kept) {
+      gst_object_unref (kept);
+    } else {
+      gst_object_set_parent (channel, parent);
+      if (GST_IS_CHILD_PROXY (parent))
+        gst_child_proxy_child_added (GST_CHILD_PROXY (parent),
+            G_OBJECT (channel), GST_OBJECT_NAME (channel));
+    }
+  }
+
+  if (old)
+    g_ptr_array_unref (old);
+}
+
+/**
+ * gst_csound_channels_discard:
+ * @channels: from gst_csound_channels_update(), never committed
+ *
+ * Free @channels, the channels it shares with the array it was updated
+ * from stay children.
+ */
+void
+gst_csound_channels_discard (GPtrArray * channels)
+{
+  guint i;
+
+  for (i = 0; i < channels->len; i++) {
+    GstObject *channel = g_ptr_array_index (channels, i);
+
+    if (GST_OBJECT_PARENT (channel)) {
+      g_ptr_array_index (channels, i) = NULL;
+      gst_object_unref (channel);
+    }
+  }
+  g_ptr_array_unref (channels);
+}
+
+/**
+ * gst_csound_channels_bind:
+ * @channels: from gst_csound_channels_update()
+ * @csound: an instance of the same orchestra
+ * @ptrs: one pointer per channel, filled with the channel data of @csound
+ *
+ * Returns: %FALSE if @csound lacks one of the channels
+ */
+gboolean
+gst_csound_channels_bind (GPtrArray * channels, CSOUND * csound,
+    MYFLT ** ptrs)
+{
+  guint i;
+
+  for (i = 0; i < channels->len; i++) {
+    GstCsoundChannel *channel = g_ptr_array_index (channels, i);
+
+    if (csoundGetChannelPtr (csound, &ptrs[i], GST_OBJECT_NAME (channel),
+            CSOUND_CONTROL_CHANNEL | CSOUND_INPUT_CHANNEL) != 0)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/**
+ * gst_csound_channels_prepare:
+ * @channels: from gst_csound_channels_update()
+ * @timestamp: stream time of the first block
+ * @interval: duration of one ksmps block
+ * @blocks: number of blocks
+ * @values: @blocks rows of one value per channel
+ *
+ * Evaluate the channels for every block. Channels without a control
+ * binding repeat their current value.
+ */
+void
+gst_csound_channels_prepare (GPtrArray * channels, GstClockTime timestamp,
+    GstClockTime interval, guint blocks, MYFLT * values)
+{
+  guint n = channels->len;
+  guint i, b;
+
+  for (i = 0; i < n; i++) {
+    GstCsoundChannel *channel = g_ptr_array_index (channels, i);
+    gboolean controlled = FALSE;
+
+    if (GST_CLOCK_TIME_IS_VALID (timestamp)
+        && gst_object_has_active_control_bindings (GST_OBJECT (channel))) {
+      if (channel->n_block_values < blocks) {
+        channel->block_values = g_renew (gdouble, channel->block_values,
+            blocks);
+        channel->n_block_values = blocks;
+      }
+      controlled = gst_object_get_value_array (GST_OBJECT (channel), "value",
+          timestamp, interval, blocks, channel->block_values);
+    }
+
+    if (controlled) {
+      for (b = 0; b < blocks; b++) {
+        gdouble v = channel->block_values[b];
+
+        if (channel->bounded)
+          v = CLAMP (v, channel->minimum, channel->maximum);
+        values[b * n + i] = (MYFLT) v;
+      }
+    } else {
+      MYFLT v;
+
+      GST_OBJECT_LOCK (channel);
+      v = (MYFLT) channel->value;
+      GST_OBJECT_UNLOCK (channel);
+      for (b = 0; b < blocks; b++)
+        values[b * n + i] = v;
+    }
+  }
+}
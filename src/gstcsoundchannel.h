@@ -0,0 +1,82 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_CSOUND_CHANNEL_H_
+#define _GST_CSOUND_CHANNEL_H_
+
+#include <gst/gst.h>
+#include <csound/csound.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_CSOUND_CHANNEL   (gst_csound_channel_get_type())
+#define GST_CSOUND_CHANNEL(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_CSOUND_CHANNEL,GstCsoundChannel))
+#define GST_IS_CSOUND_CHANNEL(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_CSOUND_CHANNEL))
+
+typedef struct _GstCsoundChannel GstCsoundChannel;
+typedef struct _GstCsoundChannelClass GstCsoundChannelClass;
+
+/* one chn_k input channel of the orchestra, a child of the element with a
+ * controllable value property */
+struct _GstCsoundChannel
+{
+  GstObject parent;
+
+  gdouble value;
+  gdouble minimum;
+  gdouble maximum;
+  gdouble dflt;
+  gboolean bounded;
+  gdouble *block_values;        /* scratch for gst_object_get_value_array */
+  guint n_block_values;
+};
+
+struct _GstCsoundChannelClass
+{
+  GstObjectClass parent_class;
+};
+
+GType gst_csound_channel_get_type (void);
+
+GPtrArray *gst_csound_channels_update (GPtrArray * old, CSOUND * csound,
+    GstObject * parent);
+void gst_csound_channels_commit (GPtrArray * old, GPtrArray * channels,
+    GstObject * parent);
+void gst_csound_channels_discard (GPtrArray * channels);
+
+gboolean gst_csound_channels_bind (GPtrArray * channels, CSOUND * csound,
+    MYFLT ** ptrs);
+
+void gst_csound_channels_prepare (GPtrArray * channels,
+    GstClockTime timestamp, GstClockTime interval, guint blocks,
+    MYFLT * values);
+
+/* write one block of prepared values to the channels of an instance */
+static inline void
+gst_csound_channels_apply (MYFLT ** ptrs, const MYFLT * values, guint n)
+{
+  guint i;
+
+  for (i = 0; i < n; i++)
+    *ptrs[i] = values[i];
+}
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,206 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Sample conversion kernels. This file has no include guard on purpose:
+ * gstcsoundconvert.c includes it once per instruction set, with KERNEL()
+ * naming the functions and KERNEL_ATTR selecting the target. The loops
+ * work on GST_CSOUND_VEC_LEN samples at a time and finish with a scalar
+ * tail. The planar kernels at the end wrap them, see
+ * GST_CSOUND_PLANAR_KERNELS. */
+
+static void KERNEL_ATTR
+KERNEL (s16_to_myflt) (gpointer dst, gconstpointer src, guint samples,
+    MYFLT scale)
+{
+  MYFLT *d = dst;
+  const gint16 *s = src;
+  guint i = 0;
+
+  for (; i + GST_CSOUND_VEC_LEN <= samples; i += GST_CSOUND_VEC_LEN) {
+    GstCsoundVecS16 vs;
+    GstCsoundVecMyflt vd;
+
+    memcpy (&vs, s + i, sizeof (vs));
+    vd = __builtin_convertvector (vs, GstCsoundVecMyflt) * scale;
+    memcpy (d + i, &vd, sizeof (vd));
+  }
+  for (; i < samples; i++)
+    d[i] = s[i] * scale;
+}
+
+static void KERNEL_ATTR
+KERNEL (myflt_to_s16) (gpointer dst, gconstpointer src, guint samples,
+    MYFLT scale)
+{
+  gint16 *d = dst;
+  const MYFLT *s = src;
+  const GstCsoundVecMyflt lo = GST_CSOUND_VEC_SPLAT (S16_MIN);
+  const GstCsoundVecMyflt hi = GST_CSOUND_VEC_SPLAT (S16_MAX);
+  guint i = 0;
+
+  for (; i + GST_CSOUND_VEC_LEN <= samples; i += GST_CSOUND_VEC_LEN) {
+    GstCsoundVecMyflt vs;
+    GstCsoundVecS16 vd;
+
+    memcpy (&vs, s + i, sizeof (vs));
+    vs *= scale;
+    GST_CSOUND_VEC_CLAMP (vs, lo, hi);
+    vd = __builtin_convertvector (vs, GstCsoundVecS16);
+    memcpy (d + i, &vd, sizeof (vd));
+  }
+  for (; i < samples; i++)
+    d[i] = (gint16) CLAMP (s[i] * scale, S16_MIN, S16_MAX);
+}
+
+static void KERNEL_ATTR
+KERNEL (s32_to_myflt) (gpointer dst, gconstpointer src, guint samples,
+    MYFLT scale)
+{
+  MYFLT *d = dst;
+  const gint32 *s = src;
+  guint i = 0;
+
+  for (; i + GST_CSOUND_VEC_LEN <= samples; i += GST_CSOUND_VEC_LEN) {
+    GstCsoundVecS32 vs;
+    GstCsoundVecMyflt vd;
+
+    memcpy (&vs, s + i, sizeof (vs));
+    vd = __builtin_convertvector (vs, GstCsoundVecMyflt) * scale;
+    memcpy (d + i, &vd, sizeof (vd));
+  }
+  for (; i < samples; i++)
+    d[i] = s[i] * scale;
+}
+
+static void KERNEL_ATTR
+KERNEL (myflt_to_s32) (gpointer dst, gconstpointer src, guint samples,
+    MYFLT scale)
+{
+  gint32 *d = dst;
+  const MYFLT *s = src;
+  const GstCsoundVecMyflt lo = GST_CSOUND_VEC_SPLAT (S32_MIN);
+  const GstCsoundVecMyflt hi = GST_CSOUND_VEC_SPLAT (S32_MAX);
+  guint i = 0;
+
+  for (; i + GST_CSOUND_VEC_LEN <= samples; i += GST_CSOUND_VEC_LEN) {
+    GstCsoundVecMyflt vs;
+    GstCsoundVecS32 vd;
+
+    memcpy (&vs, s + i, sizeof (vs));
+    vs *= scale;
+    GST_CSOUND_VEC_CLAMP (vs, lo, hi);
+    vd = __builtin_convertvector (vs, GstCsoundVecS32);
+    memcpy (d + i, &vd, sizeof (vd));
+  }
+  for (; i < samples; i++)
+    d[i] = (gint32) CLAMP (s[i] * scale, S32_MIN, S32_MAX);
+}
+
+static void KERNEL_ATTR
+KERNEL (f32_to_myflt) (gpointer dst, gconstpointer src, guint samples,
+    MYFLT scale)
+{
+  MYFLT *d = dst;
+  const gfloat *s = src;
+  guint i = 0;
+
+  for (; i + GST_CSOUND_VEC_LEN <= samples; i += GST_CSOUND_VEC_LEN) {
+    GstCsoundVecF32 vs;
+    GstCsoundVecMyflt vd;
+
+    memcpy (&vs, s + i, sizeof (vs));
+    vd = __builtin_convertvector (vs, GstCsoundVecMyflt) * scale;
+    memcpy (d + i, &vd, sizeof (vd));
+  }
+  for (; i < samples; i++)
+    d[i] = s[i] * scale;
+}
+
+static void KERNEL_ATTR
+KERNEL (myflt_to_f32) (gpointer dst, gconstpointer src, guint samples,
+    MYFLT scale)
+{
+  gfloat *d = dst;
+  const MYFLT *s = src;
+  guint i = 0;
+
+  for (; i + GST_CSOUND_VEC_LEN <= samples; i += GST_CSOUND_VEC_LEN) {
+    GstCsoundVecMyflt vs;
+    GstCsoundVecF32 vd;
+
+    memcpy (&vs, s + i, sizeof (vs));
+    vd = __builtin_convertvector (vs * scale, GstCsoundVecF32);
+    memcpy (d + i, &vd, sizeof (vd));
+  }
+  for (; i < samples; i++)
+    d[i] = (gfloat) (s[i] * scale);
+}
+
+static void KERNEL_ATTR
+KERNEL (f64_to_myflt) (gpointer dst, gconstpointer src, guint samples,
+    MYFLT scale)
+{
+  MYFLT *d = dst;
+  const gdouble *s = src;
+  guint i = 0;
+
+  for (; i + GST_CSOUND_VEC_LEN <= samples; i += GST_CSOUND_VEC_LEN) {
+    GstCsoundVecF64 vs;
+    GstCsoundVecMyflt vd;
+
+    memcpy (&vs, s + i, sizeof (vs));
+    vd = __builtin_convertvector (vs * scale, GstCsoundVecMyflt);
+    memcpy (d + i, &vd, sizeof (vd));
+  }
+  for (; i < samples; i++)
+    d[i] = (MYFLT) (s[i] * scale);
+}
+
+static void KERNEL_ATTR
+KERNEL (myflt_to_f64) (gpointer dst, gconstpointer src, guint samples,
+    MYFLT scale)
+{
+  gdouble *d = dst;
+  const MYFLT *s = src;
+  guint i = 0;
+
+  for (; i + GST_CSOUND_VEC_LEN <= samples; i += GST_CSOUND_VEC_LEN) {
+    GstCsoundVecMyflt vs;
+    GstCsoundVecF64 vd;
+
+    memcpy (&vs, s + i, sizeof (vs));
+    vd = __builtin_convertvector (vs, GstCsoundVecF64) * scale;
+    memcpy (d + i, &vd, sizeof (vd));
+  }
+  for (; i < samples; i++)
+    d[i] = s[i] * scale;
+}
+
+GST_CSOUND_PLANAR_KERNELS (KERNEL_ATTR, KERNEL (s16_planar_to_myflt),
+    KERNEL (myflt_to_s16_planar), KERNEL (s16_to_myflt), KERNEL (myflt_to_s16),
+    sizeof (gint16))
+GST_CSOUND_PLANAR_KERNELS (KERNEL_ATTR, KERNEL (s32_planar_to_myflt),
+    KERNEL (myflt_to_s32_planar), KERNEL (s32_to_myflt), KERNEL (myflt_to_s32),
+    sizeof (gint32))
+GST_CSOUND_PLANAR_KERNELS (KERNEL_ATTR, KERNEL (f32_planar_to_myflt),
+    KERNEL (myflt_to_f32_planar), KERNEL (f32_to_myflt), KERNEL (myflt_to_f32),
+    sizeof (gfloat))
+GST_CSOUND_PLANAR_KERNELS (KERNEL_ATTR, KERNEL (f64_planar_to_myflt),
+    KERNEL (myflt_to_f64_planar), KERNEL (f64_to_myflt), KERNEL (myflt_to_f64),
+    sizeof (gdouble))
@@ -0,0 +1,366 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/* Sample format conversion shared by csoundfilter, csoundsrc and
+ * csoundsink. Samples are moved between the negotiated GStreamer format
+ * and the csound MYFLT spin/spout buffers, scaled against the orchestra
+ * 0dBFS, so no audioconvert is needed around the elements.
+ *
+ * The kernels are written with GCC vector extensions, the baseline build
+ * compiles them to SSE2 on x86-64 and NEON on aarch64, and an AVX2 copy
+ * is selected at runtime when the CPU supports it.
+ *
+ * Non-interleaved buffers are converted straight between their planes and
+ * the interleaved spin/spout, so planar pipelines take no extra
+ * interleave pass. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include "gstcsoundconvert.h"
+
+#define FLOAT_SAMPLES 4
+#define DOUBLE_SAMPLES 8
+
+#define S16_SCALE 32768.0
+#define S24_SCALE 8388608.0
+#define S32_SCALE 2147483648.0
+
+#define S16_MIN ((MYFLT) -32768.0)
+#define S16_MAX ((MYFLT) 32767.0)
+/* the largest value below 2^31 that MYFLT can hold */
+#define S32_MIN ((MYFLT) -2147483648.0)
+#define S32_MAX ((MYFLT) (sizeof (MYFLT) == DOUBLE_SAMPLES ? \
+    2147483647.0 : 2147483520.0))
+#define S24_MIN ((MYFLT) -8388608.0)
+#define S24_MAX ((MYFLT) 8388607.0)
+
+#define GST_CSOUND_VEC_LEN 8
+
+typedef MYFLT GstCsoundVecMyflt
+    __attribute__ ((vector_size (GST_CSOUND_VEC_LEN * sizeof (MYFLT))));
+typedef gint16 GstCsoundVecS16
+    __attribute__ ((vector_size (GST_CSOUND_VEC_LEN * sizeof (gint16))));
+typedef gint32 GstCsoundVecS32
+    __attribute__ ((vector_size (GST_CSOUND_VEC_LEN * sizeof (gint32))));
+typedef gfloat GstCsoundVecF32
+    __attribute__ ((vector_size (GST_CSOUND_VEC_LEN * sizeof (gfloat))));
+typedef gdouble GstCsoundVecF64
+    __attribute__ ((vector_size (GST_CSOUND_VEC_LEN * sizeof (gdouble))));
+/* result type of a comparison between two MYFLT vectors */
+typedef __typeof__ ((GstCsoundVecMyflt) { 0 } > (GstCsoundVecMyflt) { 0 })
+    GstCsoundVecMask;
+
+#define GST_CSOUND_VEC_SPLAT(x) ((GstCsoundVecMyflt) { 0 } + (x))
+
+/* there is no vector ?: in C, select lanes with the comparison masks */
+#define GST_CSOUND_VEC_CLAMP(v,lo,hi) G_STMT_START {                    \
+  GstCsoundVecMask _m;                                                  \
+  _m = (v) < (lo);                                                      \
+  (v) = (GstCsoundVecMyflt) (((GstCsoundVecMask) (v) & ~_m)             \
+      | ((GstCsoundVecMask) (lo) & _m));                                \
+  _m = (v) > (hi);                                                      \
+  (v) = (GstCsoundVecMyflt) (((GstCsoundVecMask) (v) & ~_m)             \
+      | ((GstCsoundVecMask) (hi) & _m));                                \
+} G_STMT_END
+
+/* the planar kernels run a plane at a time through a vector of MYFLT:
+ * @to and @from convert up to GST_CSOUND_VEC_LEN samples of the plane,
+ * inlined in the loop, and the lanes are scattered to or gathered from
+ * the frames of spin/spout, which stay in cache for a ksmps block */
+#define GST_CSOUND_PLANAR_KERNELS(attr,in_name,out_name,to,from,size)   \
+static void attr                                                        \
+in_name (MYFLT * dst, gpointer * planes, gsize offset, guint channels,  \
+    guint frames, MYFLT scale)                                          \
+{                                                                       \
+  MYFLT v[GST_CSOUND_VEC_LEN];                                          \
+  guint c, i, j, n;                                                     \
+                                                                        \
+  if (channels == 1) {                                                  \
+    to (dst, (const guint8 *) planes[0] + offset * (size), frames,      \
+        scale);                                                         \
+    return;                                                             \
+  }                                                                     \
+  for (c = 0; c < channels; c++) {                                      \
+    const guint8 *s = (const guint8 *) planes[c] + offset * (size);     \
+    MYFLT *d = dst + c;                                                 \
+                                                                        \
+    for (i = 0; i < frames; i += n) {                                   \
+      n = MIN (GST_CSOUND_VEC_LEN, frames - i);                         \
+      to (v, s + i * (size), n, scale);                                 \
+      for (j = 0; j < n; j++, d += channels)                            \
+        *d = v[j];                                                      \
+    }                                                                   \
+  }                                                                     \
+}                                                                       \
+                                                                        \
+static void attr                                                        \
+out_name (gpointer * planes, gsize offset, const MYFLT * src,           \
+    guint channels, guint frames, MYFLT scale)                          \
+{                                                                       \
+  MYFLT v[GST_CSOUND_VEC_LEN];                                          \
+  guint c, i, j, n;                                                     \
+                                                                        \
+  if (channels == 1) {                                                  \
+    from ((guint8 *) planes[0] + offset * (size), src, frames, scale);  \
+    return;                                                             \
+  }                                                                     \
+  for (c = 0; c < channels; c++) {                                      \
+    guint8 *d = (guint8 *) planes[c] + offset * (size);                 \
+    const MYFLT *s = src + c;                                           \
+                                                                        \
+    for (i = 0; i < frames; i += n) {                                   \
+      n = MIN (GST_CSOUND_VEC_LEN, frames - i);                         \
+      for (j = 0; j < n; j++, s += channels)                            \
+        v[j] = *s;                                                      \
+      from (d + i * (size), v, n, scale);                               \
+    }                                                                   \
+  }                                                                     \
+}
+
+/* baseline kernels */
+#define KERNEL(name) name##_generic
+#define KERNEL_ATTR
+#include "gstcsoundconvert-kernels.h"
+#undef KERNEL
+#undef KERNEL_ATTR
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_CSOUND_CONVERT_AVX2 1
+#define KERNEL(name) name##_avx2
+#define KERNEL_ATTR __attribute__ ((target ("avx2")))
+#include "gstcsoundconvert-kernels.h"
+#undef KERNEL
+#undef KERNEL_ATTR
+#endif
+
+typedef struct
+{
+  GstCsoundConvertFunc s16_to_myflt;
+  GstCsoundConvertFunc myflt_to_s16;
+  GstCsoundConvertFunc s32_to_myflt;
+  GstCsoundConvertFunc myflt_to_s32;
+  GstCsoundConvertFunc f32_to_myflt;
+  GstCsoundConvertFunc myflt_to_f32;
+  GstCsoundConvertFunc f64_to_myflt;
+  GstCsoundConvertFunc myflt_to_f64;
+  GstCsoundConvertPlanarInFunc s16_planar_to_myflt;
+  GstCsoundConvertPlanarOutFunc myflt_to_s16_planar;
+  GstCsoundConvertPlanarInFunc s32_planar_to_myflt;
+  GstCsoundConvertPlanarOutFunc myflt_to_s32_planar;
+  GstCsoundConvertPlanarInFunc f32_planar_to_myflt;
+  GstCsoundConvertPlanarOutFunc myflt_to_f32_planar;
+  GstCsoundConvertPlanarInFunc f64_planar_to_myflt;
+  GstCsoundConvertPlanarOutFunc myflt_to_f64_planar;
+} GstCsoundConvertKernels;
+
+static GstCsoundConvertKernels kernels = {
+  s16_to_myflt_generic, myflt_to_s16_generic,
+  s32_to_myflt_generic, myflt_to_s32_generic,
+  f32_to_myflt_generic, myflt_to_f32_generic,
+  f64_to_myflt_generic, myflt_to_f64_generic,
+  s16_planar_to_myflt_generic, myflt_to_s16_planar_generic,
+  s32_planar_to_myflt_generic, myflt_to_s32_planar_generic,
+  f32_planar_to_myflt_generic, myflt_to_f32_planar_generic,
+  f64_planar_to_myflt_generic, myflt_to_f64_planar_generic
+};
+
+/* packed 24 bit samples have no vector friendly layout, keep them scalar */
+static void
+s24_to_myflt (gpointer dst, gconstpointer src, guint samples, MYFLT scale)
+{
+  MYFLT *d = dst;
+  const guint8 *s = src;
+  guint i;
+
+  for (i = 0; i < samples; i++, s += 3) {
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+    gint32 v = (gint32) ((guint32) s[0] << 8 | (guint32) s[1] << 16 |
+        (guint32) s[2] << 24);
+#else
+    gint32 v = (gint32) ((guint32) s[2] << 8 | (guint32) s[1] << 16 |
+        (guint32) s[0] << 24);
+#endif
+    d[i] = (v >> 8) * scale;
+  }
+}
+
+static void
+myflt_to_s24 (gpointer dst, gconstpointer src, guint samples, MYFLT scale)
+{
+  guint8 *d = dst;
+  const MYFLT *s = src;
+  guint i;
+
+  for (i = 0; i < samples; i++, d += 3) {
+    gint32 v = (gint32) CLAMP (s[i] * scale, S24_MIN, S24_MAX);
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+    d[0] = v & 0xff;
+    d[1] = (v >> 8) & 0xff;
+    d[2] = (v >> 16) & 0xff;
+#else
+    d[2] = v & 0xff;
+    d[1] = (v >> 8) & 0xff;
+    d[0] = (v >> 16) & 0xff;
+#endif
+  }
+}
+
+static void
+myflt_copy (gpointer dst, gconstpointer src, guint samples, MYFLT scale)
+{
+  memcpy (dst, src, samples * sizeof (MYFLT));
+}
+
+GST_CSOUND_PLANAR_KERNELS (, s24_planar_to_myflt, myflt_to_s24_planar,
+    s24_to_myflt, myflt_to_s24, 3)
+GST_CSOUND_PLANAR_KERNELS (, myflt_planar_copy_in, myflt_planar_copy_out,
+    myflt_copy, myflt_copy, sizeof (MYFLT))
+
+static gpointer
+gst_csound_convert_init_once (gpointer data)
+{
+#ifdef HAVE_CSOUND_CONVERT_AVX2
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2")) {
+    GstCsoundConvertKernels avx2 = {
+      s16_to_myflt_avx2, myflt_to_s16_avx2,
+      s32_to_myflt_avx2, myflt_to_s32_avx2,
+      f32_to_myflt_avx2, myflt_to_f32_avx2,
+      f64_to_myflt_avx2, myflt_to_f64_avx2,
+      s16_planar_to_myflt_avx2, myflt_to_s16_planar_avx2,
+      s32_planar_to_myflt_avx2, myflt_to_s32_planar_avx2,
+      f32_planar_to_myflt_avx2, myflt_to_f32_planar_avx2,
+      f64_planar_to_myflt_avx2, myflt_to_f64_planar_avx2
+    };
+    kernels = avx2;
+    GST_INFO ("csound sample conversion using AVX2 kernels");
+  }
+#endif
+  return NULL;
+}
+
+/**
+ * gst_csound_convert_init:
+ *
+ * Select the conversion kernels for the running CPU. Called once from
+ * plugin_init, later calls do nothing.
+ */
+void
+gst_csound_convert_init (void)
+{
+  static GOnce once = G_ONCE_INIT;
+
+  g_once (&once, gst_csound_convert_init_once, NULL);
+}
+
+/**
+ * gst_csound_convert_native_format:
+ *
+ * Returns: the GStreamer format matching MYFLT, which needs no conversion
+ */
+GstAudioFormat
+gst_csound_convert_native_format (void)
+{
+  if (csoundGetSizeOfMYFLT () == DOUBLE_SAMPLES)
+    return GST_AUDIO_FORMAT_F64;
+  return GST_AUDIO_FORMAT_F32;
+}
+
+/**
+ * gst_csound_convert_setup:
+ * @convert: the #GstCsoundConvert to configure
+ * @format: the negotiated sample format
+ * @dbfs: the orchestra 0dBFS, from csoundGet0dBFS()
+ *
+ * Pick the kernels and scale factors to move @format samples in and out
+ * of spin/spout. Full scale of @format maps to @dbfs in the orchestra.
+ *
+ * Returns: %FALSE if @format is not supported
+ */
+gboolean
+gst_csound_convert_setup (GstCsoundConvert * convert, GstAudioFormat format,
+    MYFLT dbfs)
+{
+  gdouble full_scale;
+
+  gst_csound_convert_init ();
+
+  convert->format = format;
+
+  switch (format) {
+    case GST_AUDIO_FORMAT_S16:
+      convert->sample_size = 2;
+      convert->to_myflt = kernels.s16_to_myflt;
+      convert->from_myflt = kernels.myflt_to_s16;
+      convert->planar_to_myflt = kernels.s16_planar_to_myflt;
+      convert->planar_from_myflt = kernels.myflt_to_s16_planar;
+      full_scale = S16_SCALE;
+      break;
+    case GST_AUDIO_FORMAT_S24:
+      convert->sample_size = 3;
+      convert->to_myflt = s24_to_myflt;
+      convert->from_myflt = myflt_to_s24;
+      convert->planar_to_myflt = s24_planar_to_myflt;
+      convert->planar_from_myflt = myflt_to_s24_planar;
+      full_scale = S24_SCALE;
+      break;
+    case GST_AUDIO_FORMAT_S32:
+      convert->sample_size = 4;
+      convert->to_myflt = kernels.s32_to_myflt;
+      convert->from_myflt = kernels.myflt_to_s32;
+      convert->planar_to_myflt = kernels.s32_planar_to_myflt;
+      convert->planar_from_myflt = kernels.myflt_to_s32_planar;
+      full_scale = S32_SCALE;
+      break;
+    case GST_AUDIO_FORMAT_F32:
+      convert->sample_size = 4;
+      convert->to_myflt = kernels.f32_to_myflt;
+      convert->from_myflt = kernels.myflt_to_f32;
+      convert->planar_to_myflt = kernels.f32_planar_to_myflt;
+      convert->planar_from_myflt = kernels.myflt_to_f32_planar;
+      full_scale = 1.0;
+      break;
+    case GST_AUDIO_FORMAT_F64:
+      convert->sample_size = 8;
+      convert->to_myflt = kernels.f64_to_myflt;
+      convert->from_myflt = kernels.myflt_to_f64;
+      convert->planar_to_myflt = kernels.f64_planar_to_myflt;
+      convert->planar_from_myflt = kernels.myflt_to_f64_planar;
+      full_scale = 1.0;
+      break;
+    default:
+      return FALSE;
+  }
+
+  convert->in_scale = (MYFLT) (dbfs / full_scale);
+  convert->out_scale = (MYFLT) (full_scale / dbfs);
+
+  /* the orchestra works at 0dBFS = 1 on the native format, plain copy */
+  if (format == gst_csound_convert_native_format () && dbfs == 1.0) {
+    convert->to_myflt = myflt_copy;
+    convert->from_myflt = myflt_copy;
+    convert->planar_to_myflt = myflt_planar_copy_in;
+    convert->planar_from_myflt = myflt_planar_copy_out;
+  }
+
+  return TRUE;
+}
@@ -0,0 +1,91 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_CSOUND_CONVERT_H_
+#define _GST_CSOUND_CONVERT_H_
+
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
+#include <csound/csound.h>
+
+G_BEGIN_DECLS
+
+/* sample formats every csound element can read from and write to */
+#define GST_CSOUND_AUDIO_FORMATS \
+    "{ "GST_AUDIO_NE(F64)", "GST_AUDIO_NE(F32)", "GST_AUDIO_NE(S32)", " \
+    GST_AUDIO_NE(S24)", "GST_AUDIO_NE(S16)" }"
+
+typedef void (*GstCsoundConvertFunc) (gpointer dst, gconstpointer src,
+    guint samples, MYFLT scale);
+
+/* non-interleaved layout, one plane per channel, starting at frame
+ * @offset of every plane */
+typedef void (*GstCsoundConvertPlanarInFunc) (MYFLT * dst, gpointer * planes,
+    gsize offset, guint channels, guint frames, MYFLT scale);
+typedef void (*GstCsoundConvertPlanarOutFunc) (gpointer * planes,
+    gsize offset, const MYFLT * src, guint channels, guint frames,
+    MYFLT scale);
+
+typedef struct _GstCsoundConvert GstCsoundConvert;
+
+/* conversion between one GStreamer sample format and the csound
+ * spin/spout buffers, scaled against the orchestra 0dBFS */
+struct _GstCsoundConvert
+{
+  GstAudioFormat format;
+  guint sample_size;
+
+  GstCsoundConvertFunc to_myflt;        /* format -> spin */
+  GstCsoundConvertFunc from_myflt;      /* spout -> format */
+  GstCsoundConvertPlanarInFunc planar_to_myflt;
+  GstCsoundConvertPlanarOutFunc planar_from_myflt;
+  MYFLT in_scale;
+  MYFLT out_scale;
+};
+
+void gst_csound_convert_init (void);
+
+gboolean gst_csound_convert_setup (GstCsoundConvert * convert,
+    GstAudioFormat format, MYFLT dbfs);
+
+GstAudioFormat gst_csound_convert_native_format (void);
+
+/* convert @samples interleaved samples into spin */
+#define gst_csound_convert_in(convert,spin,src,samples) \
+    (convert)->to_myflt ((spin), (src), (samples), (convert)->in_scale)
+
+/* convert @samples interleaved samples out of spout */
+#define gst_csound_convert_out(convert,dst,spout,samples) \
+    (convert)->from_myflt ((dst), (spout), (samples), (convert)->out_scale)
+
+/* convert @frames frames of @channels planes, from frame @offset, into
+ * interleaved spin */
+#define gst_csound_convert_in_planar(convert,spin,planes,offset,channels,frames) \
+    (convert)->planar_to_myflt ((spin), (planes), (offset), (channels), \
+        (frames), (convert)->in_scale)
+
+/* deinterleave @frames frames of spout into @channels planes, from frame
+ * @offset */
+#define gst_csound_convert_out_planar(convert,planes,offset,spout,channels,frames) \
+    (convert)->planar_from_myflt ((planes), (offset), (spout), (channels), \
+        (frames), (convert)->out_scale)
+
+G_END_DECLS
+
+#endif
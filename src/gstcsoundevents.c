@@ -0,0 +1,272 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/* Score events sent from application threads to a running engine.
+ *
+ * Producers link a whole batch and publish it with a single compare and
+ * swap on the queue head, the consumer detaches everything pushed so far
+ * with another one. Nobody ever blocks and, since the consumer never
+ * removes single nodes from the shared list, there is no ABA problem.
+ *
+ * The consumer keeps the detached events sorted by running time, takes
+ * the ones due before the end of the blocks it is about to perform and
+ * plays each of them right before the ksmps block it falls in. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstcsoundevents.h"
+
+void
+gst_csound_event_queue_init (GstCsoundEventQueue * queue)
+{
+  queue->incoming = NULL;
+  queue->pending = NULL;
+}
+
+/**
+ * gst_csound_event_queue_clear:
+ *
+ * Drop every queued event. Only the consumer may call this.
+ */
+void
+gst_csound_event_queue_clear (GstCsoundEventQueue * queue)
+{
+  gst_csound_events_free (gst_csound_event_queue_take (queue,
+          GST_CLOCK_TIME_NONE));
+}
+
+static inline gboolean
+gst_csound_event_before (const GstCsoundEvent * a, GstClockTime t)
+{
+  /* events without a time sort first */
+  if (!GST_CLOCK_TIME_IS_VALID (a->running_time))
+    return TRUE;
+  if (!GST_CLOCK_TIME_IS_VALID (t))
+    return FALSE;
+  return a->running_time < t;
+}
+
+/**
+ * gst_csound_event_queue_push:
+ * @queue: the queue
+ * @type: the score statement, 'i', 'f', 'e', ...
+ * @running_times: one running time per event, or %NULL to play them all
+ *     at the next block
+ * @pfields: @n_events rows of @n_pfields p-fields
+ * @n_pfields: p-fields per event
+ * @n_events: number of events
+ *
+ * Queue a batch of events, from any thread, without taking locks.
+ *
+ * Returns: %FALSE if there was nothing to queue
+ */
+gboolean
+gst_csound_event_queue_push (GstCsoundEventQueue * queue, gchar type,
+    const GstClockTime * running_times, const MYFLT * pfields,
+    guint n_pfields, guint n_events)
+{
+  GstCsoundEvent *first = NULL, *last = NULL;
+  gpointer head;
+  guint i;
+
+  if (n_events == 0 || pfields == NULL)
+    return FALSE;
+
+  /* link the batch newest first, like the rest of the incoming list */
+  for (i = 0; i < n_events; i++) {
+    GstCsoundEvent *event = g_malloc (G_STRUCT_OFFSET (GstCsoundEvent,
+            pfields) + MAX (n_pfields, 1) * sizeof (MYFLT));
+
+    event->running_time = running_times ? running_times[i] :
+        GST_CLOCK_TIME_NONE;
+    event->type = type;
+    event->n_pfields = n_pfields;
+    memcpy (event->pfields, pfields + (gsize) i * n_pfields,
+        n_pfields * sizeof (MYFLT));
+    event->next = first;
+    first = event;
+    if (last == NULL)
+      last = event;
+  }
+
+  do {
+    head = g_atomic_pointer_get (&queue->incoming);
+    last->next = head;
+  } while (!g_atomic_pointer_compare_and_exchange (&queue->incoming, head,
+          first));
+
+  return TRUE;
+}
+
+/**
+ * gst_csound_event_queue_push_bytes:
+ * @pfields: the p-fields, as an array of MYFLT
+ * @running_times: a guint64 array of running times, or %NULL
+ *
+ * gst_csound_event_queue_push() for the action signals.
+ */
+gboolean
+gst_csound_event_queue_push_bytes (GstCsoundEventQueue * queue, gchar type,
+    guint n_pfields, GBytes * pfields, GBytes * running_times)
+{
+  const MYFLT *p;
+  const GstClockTime *t = NULL;
+  gsize size, n_events;
+
+  if (pfields == NULL || n_pfields == 0)
+    return FALSE;
+
+  p = g_bytes_get_data (pfields, &size);
+  n_events = size / (n_pfields * sizeof (MYFLT));
+  if (running_times) {
+    gsize t_size;
+
+    t = g_bytes_get_data (running_times, &t_size);
+    if (t_size / sizeof (GstClockTime) < n_events)
+      return FALSE;
+  }
+
+  return gst_csound_event_queue_push (queue, type, t, p, n_pfields,
+      n_events);
+}
+
+static GstCsoundEvent *
+gst_csound_events_merge (GstCsoundEvent * a, GstCsoundEvent * b)
+{
+  GstCsoundEvent head, *tail = &head;
+
+  /* on equal times a comes first, which keeps the sort stable */
+  while (a && b) {
+    if (gst_csound_event_before (b, a->running_time)
+        && !(gst_csound_event_before (a, b->running_time))) {
+      tail->next = b;
+      b = b->next;
+    } else {
+      tail->next = a;
+      a = a->next;
+    }
+    tail = tail->next;
+  }
+  tail->next = a ? a : b;
+
+  return head.next;
+}
+
+static GstCsoundEvent *
+gst_csound_events_sort (GstCsoundEvent * list)
+{
+  GstCsoundEvent *slow, *fast, *half;
+
+  if (list == NULL || list->next == NULL)
+    return list;
+
+  slow = list;
+  fast = list->next;
+  while (fast && fast->next) {
+    slow = slow->next;
+    fast = fast->next->next;
+  }
+  half = slow->next;
+  slow->next = NULL;
+
+  return gst_csound_events_merge (gst_csound_events_sort (list),
+      gst_csound_events_sort (half));
+}
+
+/**
+ * gst_csound_event_queue_take:
+ * @until: running time of the end of the blocks about to be performed,
+ *     or GST_CLOCK_TIME_NONE for every queued event
+ *
+ * Consumer side: collect what was pushed and return the events due before
+ * @until, sorted by running time, in a list owned by the caller.
+ */
+GstCsoundEvent *
+gst_csound_event_queue_take (GstCsoundEventQueue * queue, GstClockTime until)
+{
+  GstCsoundEvent *incoming, *reversed = NULL, *due, *last = NULL;
+  gpointer head;
+
+  do {
+    head = g_atomic_pointer_get (&queue->incoming);
+  } while (head && !g_atomic_pointer_compare_and_exchange (&queue->incoming,
+          head, NULL));
+
+  /* back to push order, so equal times play in the order they came */
+  incoming = head;
+  while (incoming) {
+    GstCsoundEvent *next = incoming->next;
+
+    incoming->next = reversed;
+    reversed = incoming;
+    incoming = next;
+  }
+  if (reversed)
+    queue->pending = gst_csound_events_merge (queue->pending,
+        gst_csound_events_sort (reversed));
+
+  due = queue->pending;
+  while (queue->pending && (!GST_CLOCK_TIME_IS_VALID (until)
+          || gst_csound_event_before (queue->pending, until))) {
+    last = queue->pending;
+    queue->pending = queue->pending->next;
+  }
+  if (last == NULL)
+    return NULL;
+  last->next = NULL;
+
+  return due;
+}
+
+/**
+ * gst_csound_events_play:
+ * @events: a sorted list from gst_csound_event_queue_take()
+ * @until: running time of the end of the next block
+ *
+ * Send csound the events of @events due before @until. The list is left
+ * untouched, so every instance can play the same one.
+ *
+ * Returns: the first event not played yet
+ */
+GstCsoundEvent *
+gst_csound_events_play (GstCsoundEvent * events, CSOUND * csound,
+    GstClockTime until)
+{
+  while (events && (!GST_CLOCK_TIME_IS_VALID (until)
+          || gst_csound_event_before (events, until))) {
+    csoundScoreEvent (csound, events->type, events->pfields,
+        events->n_pfields);
+    events = events->next;
+  }
+
+  return events;
+}
+
+void
+gst_csound_events_free (GstCsoundEvent * events)
+{
+  while (events) {
+    GstCsoundEvent *next = events->next;
+
+    g_free (events);
+    events = next;
+  }
+}
@@ -0,0 +1,68 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_CSOUND_EVENTS_H_
+#define _GST_CSOUND_EVENTS_H_
+
+#include <gst/gst.h>
+#include <csound/csound.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstCsoundEvent GstCsoundEvent;
+typedef struct _GstCsoundEventQueue GstCsoundEventQueue;
+
+/* one score event, p-fields as csoundScoreEvent() takes them */
+struct _GstCsoundEvent
+{
+  GstCsoundEvent *next;
+  GstClockTime running_time;    /* GST_CLOCK_TIME_NONE plays it at once */
+  gchar type;
+  guint n_pfields;
+  MYFLT pfields[1];
+};
+
+/* any thread pushes, a single consumer takes the events that are due */
+struct _GstCsoundEventQueue
+{
+  gpointer incoming;            /* pushed events, newest first */
+  GstCsoundEvent *pending;      /* consumer only, sorted by running time */
+};
+
+void gst_csound_event_queue_init (GstCsoundEventQueue * queue);
+void gst_csound_event_queue_clear (GstCsoundEventQueue * queue);
+
+gboolean gst_csound_event_queue_push (GstCsoundEventQueue * queue,
+    gchar type, const GstClockTime * running_times, const MYFLT * pfields,
+    guint n_pfields, guint n_events);
+
+gboolean gst_csound_event_queue_push_bytes (GstCsoundEventQueue * queue,
+    gchar type, guint n_pfields, GBytes * pfields, GBytes * running_times);
+
+GstCsoundEvent *gst_csound_event_queue_take (GstCsoundEventQueue * queue,
+    GstClockTime until);
+
+GstCsoundEvent *gst_csound_events_play (GstCsoundEvent * events,
+    CSOUND * csound, GstClockTime until);
+
+void gst_csound_events_free (GstCsoundEvent * events);
+
+G_END_DECLS
+
+#endif
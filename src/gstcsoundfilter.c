@@ -24,6 +24,44 @@
  * The procedures are in the csound csd file. We recomended to set a ksmps low in your
  * csd file.
  *
+ * Every control channel the csd declares with chn_k as input is a child
+ * object of the element, with a controllable value property, e.g.
+ * csoundfilter::cutoff::value. Control bindings on it are evaluated once
+ * per buffer and written to the channel before every ksmps block.
+ *
+ * Request out_%u pads push a range of the output channels each, set with
+ * their first-channel and channels properties, for orchestras whose
+ * outputs are separate buses.
+ *
+ * Non-interleaved caps, the same layout on both pads, are converted
+ * between the planes and spin/spout block by block, without an
+ * interleave pass. They need the default single instance, synchronous
+ * mode.
+ *
+ * A request side_%s pad feeds a mono stream into the chn_a input
+ * channel of that name, e.g. side_key into "key", ksmps frames before
+ * every block, lined up with the main input by running time. Each
+ * branch needs its own queue. Side pads need the default single
+ * instance, synchronous mode.
+ *
+ * The chn_k output channels listed in analysis-channels are read at
+ * every ksmps block and attached to the output buffer as a
+ * #GstCsoundAnalysisMeta, each row with the frame offset of the audio
+ * it goes with. Not in async mode.
+ *
+ * With follow-caps the element takes the rate and channels of its input
+ * and compiles the orchestra for them, ksmps scaled to keep the control
+ * period, so no audioresample goes in front of it. The channels follow
+ * when the orchestra has as many inputs as outputs. It compiles again
+ * only when the caps change.
+ *
+ * The orchestra can also be given as text, a whole csd in csd-text or
+ * an orc with an optional sco, instead of a location. Setting any of
+ * them while the element runs compiles the new orchestra in the
+ * background and crossfades it in over crossfade nanoseconds, without a
+ * gap. It must run at the same sr, ksmps, nchnls and 0dbfs, and the
+ * swap needs the default single instance, synchronous mode.
+ *
  * <refsect2>
  * <title>Example launch line</title>
  * |[
@@ -40,14 +78,25 @@
 #include <gst/gst.h>
 #include <gst/base/gstbasetransform.h>
 #include "gstcsoundfilter.h"
+#include "gstcsoundconvert.h"
+#include "gstcsoundbufferpool.h"
+#include "gstcsoundinstance.h"
+#include "gstcsoundlog.h"
+#include "gstcsoundstats.h"
+#include "gstcsoundchannel.h"
+#include "gstcsoundoutpad.h"
+#include "gstcsoundsidepad.h"
+#include "gstcsoundswap.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_csoundfilter_debug_category);
 #define GST_CAT_DEFAULT gst_csoundfilter_debug_category
 
-#define FLOAT_SAMPLES 4
-#define DOUBLE_SAMPLES 8
-
 #define DEFAULT_LOOP                 FALSE
+#define DEFAULT_INSTANCES            1
+#define DEFAULT_ASYNC_DEPTH          0
+#define DEFAULT_INSTANCE_POOL        FALSE
+#define DEFAULT_FOLLOW_CAPS          FALSE
+#define DEFAULT_CROSSFADE            (20 * GST_MSECOND)
 
 /* prototypes */
 static void gst_csoundfilter_set_property (GObject * object,
@@ -66,6 +115,11 @@ static gboolean gst_csoundfilter_accept_caps (GstBaseTransform * trans,
 static gboolean gst_csoundfilter_set_caps (GstBaseTransform * trans,
     GstCaps * incaps, GstCaps * outcaps);
 
+static gboolean gst_csoundfilter_decide_allocation (GstBaseTransform * trans,
+    GstQuery * query);
+static gboolean gst_csoundfilter_propose_allocation (GstBaseTransform * trans,
+    GstQuery * decide_query, GstQuery * query);
+
 static gboolean gst_csoundfilter_start (GstBaseTransform * trans);
 static gboolean gst_csoundfilter_stop (GstBaseTransform * trans);
 
@@ -75,27 +129,90 @@ static GstFlowReturn gst_csoundfilter_transform (GstBaseTransform * trans,
 static GstFlowReturn gst_csoundfilter_prepare_output_buffer (GstBaseTransform * base,
     GstBuffer * inbuf, GstBuffer ** outbuf);
 
-static void gst_csoundfilter_messages (CSOUND * csound, int attr, const char *format,
-    va_list valist);
+static GstFlowReturn gst_csoundfilter_generate_output (GstBaseTransform * trans,
+    GstBuffer ** outbuf);
+
+static gboolean gst_csoundfilter_query (GstBaseTransform * trans,
+    GstPadDirection direction, GstQuery * query);
+
+static GstPad *gst_csoundfilter_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps);
+static void gst_csoundfilter_release_pad (GstElement * element,
+    GstPad * pad);
+static GstStateChangeReturn gst_csoundfilter_change_state (GstElement *
+    element, GstStateChange transition);
+static gboolean gst_csoundfilter_sink_event (GstBaseTransform * trans,
+    GstEvent * event);
+
 
 static void
 gst_csoundfilter_trans (GstCsoundfilter * csoundfilter,
-    MYFLT * odata, guint in_bytes, guint out_bytes);
+    gconstpointer idata, gpointer odata, guint blocks,
+    const GstCsoundfilterBlocks * info);
+static void
+gst_csoundfilter_trans_parallel (GstCsoundfilter * csoundfilter,
+    gconstpointer idata, gpointer odata, guint blocks,
+    const GstCsoundfilterBlocks * info);
+static CSOUND *gst_csoundfilter_new_instance (GstCsoundfilter * csoundfilter);
+static gpointer gst_csoundfilter_worker_loop (gpointer data);
+static void gst_csoundfilter_group_out (GstCsoundfilter * csoundfilter,
+    const MYFLT * spout, guint group, guint8 * out, guint frames);
+static void gst_csoundfilter_stop_workers (GstCsoundfilter * csoundfilter);
+static void gst_csoundfilter_close (GstCsoundfilter * csoundfilter);
+static void gst_csoundfilter_clear_pending (GstCsoundfilter * csoundfilter);
+static void gst_csoundfilter_rewind_instances (GstCsoundfilter *
+    csoundfilter);
+static void gst_csoundfilter_request_swap (GstCsoundfilter * csoundfilter);
+static void
+gst_csoundfilter_trans_async (GstCsoundfilter * csoundfilter,
+    gconstpointer idata, gpointer odata, guint blocks,
+    const GstCsoundfilterBlocks * info);
+static void gst_csoundfilter_child_proxy_init (gpointer g_iface,
+    gpointer iface_data);
+static void gst_csoundfilter_start_engine (GstCsoundfilter * csoundfilter);
+static void gst_csoundfilter_stop_engine (GstCsoundfilter * csoundfilter);
+static void gst_csoundfilter_start_log (GstCsoundfilter * csoundfilter);
+static void gst_csoundfilter_reset_stats (GstCsoundfilter * csoundfilter);
+static void gst_csoundfilter_stop_log (GstCsoundfilter * csoundfilter);
+static gboolean gst_csoundfilter_score_events_bytes (GstCsoundfilter *
+    csoundfilter, gchar type, guint n_pfields, GBytes * pfields,
+    GBytes * running_times);
+
 
+enum
+{
+  SIGNAL_SCORE_EVENTS,
+  LAST_SIGNAL
+};
+
+static guint gst_csoundfilter_signals[LAST_SIGNAL] = { 0 };
 
 enum
 {
   PROP_0,
   PROP_LOCATION,
-  PROP_LOOP
+  PROP_LOOP,
+  PROP_INSTANCES,
+  PROP_ASYNC_DEPTH,
+  PROP_INSTANCE_POOL,
+  PROP_MESSAGE_LEVEL,
+  PROP_MESSAGE_RATE,
+  PROP_STATS,
+  PROP_STATS_INTERVAL,
+  PROP_ANALYSIS_CHANNELS,
+  PROP_FOLLOW_CAPS,
+  PROP_CSD_TEXT,
+  PROP_ORC,
+  PROP_SCO,
+  PROP_CROSSFADE
 };
 
 #define ALLOWED_CAPS \
     "audio/x-raw,"                                                 \
-    " format=(string){"GST_AUDIO_NE(F32)","GST_AUDIO_NE(F64)"}," \
+    " format=(string)"GST_CSOUND_AUDIO_FORMATS","                  \
     " rate=(int)[1,MAX],"                                          \
     " channels=(int)[1,MAX],"                                      \
-    " layout=(string) interleaved"
+    " layout=(string) { interleaved, non-interleaved }"
 
 /* pad templates */
 static GstStaticPadTemplate gst_csoundfilter_src_template =
@@ -105,6 +222,20 @@ GST_STATIC_PAD_TEMPLATE ("src",
     GST_STATIC_CAPS (ALLOWED_CAPS)
     );
 
+static GstStaticPadTemplate gst_csoundfilter_out_template =
+GST_STATIC_PAD_TEMPLATE ("out_%u",
+    GST_PAD_SRC,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS (GST_CSOUND_OUT_PAD_TEMPLATE_CAPS)
+    );
+
+static GstStaticPadTemplate gst_csoundfilter_side_template =
+GST_STATIC_PAD_TEMPLATE ("side_%s",
+    GST_PAD_SINK,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS (GST_CSOUND_SIDE_PAD_TEMPLATE_CAPS)
+    );
+
 static GstStaticPadTemplate gst_csoundfilter_sink_template =
 GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
@@ -117,7 +248,9 @@ GST_STATIC_PAD_TEMPLATE ("sink",
 
 G_DEFINE_TYPE_WITH_CODE (GstCsoundfilter, gst_csoundfilter, GST_TYPE_BASE_TRANSFORM,
   GST_DEBUG_CATEGORY_INIT (gst_csoundfilter_debug_category, "csoundfilter", 0,
-  "debug category for csoundfilter element"));
+  "debug category for csoundfilter element");
+  G_IMPLEMENT_INTERFACE (GST_TYPE_CHILD_PROXY,
+      gst_csoundfilter_child_proxy_init));
 
 static void
 gst_csoundfilter_class_init (GstCsoundfilterClass * klass)
@@ -131,6 +264,10 @@ gst_csoundfilter_class_init (GstCsoundfilterClass * klass)
       &gst_csoundfilter_src_template);
   gst_element_class_add_static_pad_template (GST_ELEMENT_CLASS (klass),
       &gst_csoundfilter_sink_template);
+  gst_element_class_add_static_pad_template_with_gtype (GST_ELEMENT_CLASS
+      (klass), &gst_csoundfilter_out_template, GST_TYPE_CSOUND_OUT_PAD);
+  gst_element_class_add_static_pad_template_with_gtype (GST_ELEMENT_CLASS
+      (klass), &gst_csoundfilter_side_template, GST_TYPE_CSOUND_SIDE_PAD);
 
   gobject_class->set_property = gst_csoundfilter_set_property;
   gobject_class->get_property = gst_csoundfilter_get_property;
@@ -140,11 +277,123 @@ gst_csoundfilter_class_init (GstCsoundfilterClass * klass)
           "Location of the csd file used by csound", NULL,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_CSD_TEXT,
+      g_param_spec_string ("csd-text", "CSD text",
+          "A whole csd compiled from memory, before orc and location", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ORC,
+      g_param_spec_string ("orc", "Orchestra",
+          "An orchestra compiled from memory, with -n -d and the header of "
+          "the orchestra, before location", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SCO,
+      g_param_spec_string ("sco", "Score",
+          "The score read after orc is compiled", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CROSSFADE,
+      g_param_spec_uint64 ("crossfade", "Crossfade",
+          "Crossfade from the running orchestra to one set while running, "
+          "in nanoseconds, rounded up to whole ksmps blocks (0 = cut over)",
+          0, G_MAXUINT64, DEFAULT_CROSSFADE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
    g_object_class_install_property (gobject_class, PROP_LOOP,
       g_param_spec_boolean ("loop", "Loop",
            "do a loop on the score", DEFAULT_LOOP,
             G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_INSTANCES,
+      g_param_spec_uint ("instances", "Instances",
+          "Number of csound instances running the orchestra, each one on "
+          "its own thread and with its own group of the stream channels",
+          1, G_MAXUINT16, DEFAULT_INSTANCES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_ASYNC_DEPTH,
+      g_param_spec_uint ("async-depth", "Async depth",
+          "Number of ksmps blocks queued between the streaming thread and a "
+          "dedicated csound thread, adding as many blocks of latency "
+          "(0 = perform on the streaming thread)",
+          0, 1024, DEFAULT_ASYNC_DEPTH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_INSTANCE_POOL,
+      g_param_spec_boolean ("instance-pool", "Instance pool",
+          "Take compiled csound instances from a process wide pool and give "
+          "them back rewound on stop, instead of compiling the csd on every "
+          "start", DEFAULT_INSTANCE_POOL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  /**
+   * GstCsoundfilter::score-events:
+   * @csoundfilter: the element
+   * @type: the score statement, 'i', 'f', 'e', ...
+   * @n_pfields: p-fields per event
+   * @pfields: the events, one row of @n_pfields MYFLT each
+   * @running_times: one #GstClockTime per event, or %NULL to play them
+   *     at the next ksmps block
+   *
+   * Queue a batch of score events, each one played right before the ksmps
+   * block holding its running time. Can be emitted from any thread and
+   * never blocks.
+   */
+  gst_csoundfilter_signals[SIGNAL_SCORE_EVENTS] =
+      g_signal_new ("score-events", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      G_STRUCT_OFFSET (GstCsoundfilterClass, score_events), NULL, NULL, NULL,
+      G_TYPE_BOOLEAN, 4, G_TYPE_CHAR, G_TYPE_UINT, G_TYPE_BYTES, G_TYPE_BYTES);
+  klass->score_events = gst_csoundfilter_score_events_bytes;
+
+  g_object_class_install_property (gobject_class, PROP_MESSAGE_LEVEL,
+      g_param_spec_enum ("message-level", "Message level",
+          "Most verbose csound messages forwarded to the debug log and, as "
+          "\"csound-message\" element messages, to the bus",
+          GST_TYPE_CSOUND_MESSAGE_LEVEL, GST_CSOUND_LOG_DEFAULT_LEVEL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MESSAGE_RATE,
+      g_param_spec_uint ("message-rate", "Message rate",
+          "Csound messages forwarded per second and level, the others are "
+          "only counted (0 = unlimited)", 0, G_MAXUINT,
+          GST_CSOUND_LOG_DEFAULT_RATE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Time spent in csoundPerformKsmps() per block (min, avg, max, p99), "
+          "load, real-time factor, blocks and buffers processed slower than "
+          "real time and drift of the score against the running time",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS_INTERVAL,
+      g_param_spec_uint64 ("stats-interval", "Statistics interval",
+          "Post the statistics as a \"csound-stats\" element message this "
+          "often, in nanoseconds (0 = never)", 0, G_MAXUINT64, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ANALYSIS_CHANNELS,
+      g_param_spec_string ("analysis-channels", "Analysis channels",
+          "Comma separated chn_k output channels read after every ksmps "
+          "block and attached to the output buffers as a "
+          "GstCsoundAnalysisMeta", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_FOLLOW_CAPS,
+      g_param_spec_boolean ("follow-caps", "Follow caps",
+          "Take the rate and channels upstream offers and compile the "
+          "orchestra for them, overriding the sr, ksmps and nchnls of the "
+          "csd, instead of asking for the ones of the csd",
+          DEFAULT_FOLLOW_CAPS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
   gst_element_class_set_static_metadata (GST_ELEMENT_CLASS (klass),
       "using csound for audio processing", "Filter/Effect/Audio",
       "Inplement a audio filter/effects using csound",
@@ -152,6 +401,12 @@ gst_csoundfilter_class_init (GstCsoundfilterClass * klass)
 
   gobject_class->dispose = gst_csoundfilter_dispose;
   gobject_class->finalize = gst_csoundfilter_finalize;
+  GST_ELEMENT_CLASS (klass)->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_csoundfilter_request_new_pad);
+  GST_ELEMENT_CLASS (klass)->release_pad =
+      GST_DEBUG_FUNCPTR (gst_csoundfilter_release_pad);
+  GST_ELEMENT_CLASS (klass)->change_state =
+      GST_DEBUG_FUNCPTR (gst_csoundfilter_change_state);
   base_transform_class->transform_caps = GST_DEBUG_FUNCPTR (gst_csoundfilter_transform_caps);
   base_transform_class->fixate_caps = GST_DEBUG_FUNCPTR (gst_csoundfilter_fixate_caps);
   base_transform_class->accept_caps = GST_DEBUG_FUNCPTR (gst_csoundfilter_accept_caps);
@@ -160,6 +415,11 @@ gst_csoundfilter_class_init (GstCsoundfilterClass * klass)
   base_transform_class->transform = GST_DEBUG_FUNCPTR (gst_csoundfilter_transform);
   base_transform_class->stop = GST_DEBUG_FUNCPTR (gst_csoundfilter_stop);
   base_transform_class->prepare_output_buffer = GST_DEBUG_FUNCPTR (gst_csoundfilter_prepare_output_buffer);
+  base_transform_class->decide_allocation = GST_DEBUG_FUNCPTR (gst_csoundfilter_decide_allocation);
+  base_transform_class->propose_allocation = GST_DEBUG_FUNCPTR (gst_csoundfilter_propose_allocation);
+  base_transform_class->generate_output = GST_DEBUG_FUNCPTR (gst_csoundfilter_generate_output);
+  base_transform_class->query = GST_DEBUG_FUNCPTR (gst_csoundfilter_query);
+  base_transform_class->sink_event = GST_DEBUG_FUNCPTR (gst_csoundfilter_sink_event);
   base_transform_class->transform_ip_on_passthrough = FALSE;
 
 }
@@ -168,6 +428,17 @@ static void
 gst_csoundfilter_init (GstCsoundfilter *csoundfilter)
 {
   gst_base_transform_set_in_place (GST_BASE_TRANSFORM (csoundfilter), FALSE);
+  csoundfilter->instances = DEFAULT_INSTANCES;
+  csoundfilter->async_depth = DEFAULT_ASYNC_DEPTH;
+  csoundfilter->message_level = GST_CSOUND_LOG_DEFAULT_LEVEL;
+  csoundfilter->message_rate = GST_CSOUND_LOG_DEFAULT_RATE;
+  csoundfilter->crossfade = DEFAULT_CROSSFADE;
+  csoundfilter->swap = gst_csound_swap_new (GST_ELEMENT (csoundfilter));
+  g_mutex_init (&csoundfilter->worker_lock);
+  g_cond_init (&csoundfilter->worker_cond);
+  g_cond_init (&csoundfilter->done_cond);
+  gst_csound_event_queue_init (&csoundfilter->events);
+  gst_csound_stats_board_init (&csoundfilter->stats_board);
 }
 
 void
@@ -178,11 +449,76 @@ gst_csoundfilter_set_property (GObject * object, guint property_id,
 
   switch (property_id) {
     case PROP_LOCATION:
+      GST_OBJECT_LOCK (csoundfilter);
+      g_free (csoundfilter->csd_name);
       csoundfilter->csd_name = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (csoundfilter);
+      gst_csoundfilter_request_swap (csoundfilter);
+      break;
+    case PROP_CSD_TEXT:
+      GST_OBJECT_LOCK (csoundfilter);
+      g_free (csoundfilter->csd_text);
+      csoundfilter->csd_text = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (csoundfilter);
+      gst_csoundfilter_request_swap (csoundfilter);
+      break;
+    case PROP_ORC:
+      GST_OBJECT_LOCK (csoundfilter);
+      g_free (csoundfilter->orc);
+      csoundfilter->orc = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (csoundfilter);
+      gst_csoundfilter_request_swap (csoundfilter);
+      break;
+    case PROP_SCO:
+      GST_OBJECT_LOCK (csoundfilter);
+      g_free (csoundfilter->sco);
+      csoundfilter->sco = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (csoundfilter);
+      gst_csoundfilter_request_swap (csoundfilter);
+      break;
+    case PROP_CROSSFADE:
+      csoundfilter->crossfade = g_value_get_uint64 (value);
       break;
     case PROP_LOOP:
       csoundfilter->loop = g_value_get_boolean (value);
     break;
+    case PROP_INSTANCES:
+      csoundfilter->instances = g_value_get_uint (value);
+      break;
+    case PROP_ASYNC_DEPTH:
+      csoundfilter->async_depth = g_value_get_uint (value);
+      break;
+    case PROP_INSTANCE_POOL:
+      csoundfilter->instance_pool = g_value_get_boolean (value);
+      break;
+    case PROP_MESSAGE_LEVEL:
+      GST_OBJECT_LOCK (csoundfilter);
+      csoundfilter->message_level = g_value_get_enum (value);
+      if (csoundfilter->log)
+        gst_csound_log_set_level (csoundfilter->log, csoundfilter->message_level);
+      GST_OBJECT_UNLOCK (csoundfilter);
+      break;
+    case PROP_MESSAGE_RATE:
+      GST_OBJECT_LOCK (csoundfilter);
+      csoundfilter->message_rate = g_value_get_uint (value);
+      if (csoundfilter->log)
+        gst_csound_log_set_rate (csoundfilter->log, csoundfilter->message_rate);
+      GST_OBJECT_UNLOCK (csoundfilter);
+      break;
+    case PROP_STATS_INTERVAL:
+      g_mutex_lock (&csoundfilter->stats_board.lock);
+      csoundfilter->stats_board.interval = g_value_get_uint64 (value);
+      g_mutex_unlock (&csoundfilter->stats_board.lock);
+      break;
+    case PROP_ANALYSIS_CHANNELS:
+      GST_OBJECT_LOCK (csoundfilter);
+      g_free (csoundfilter->analysis_channels);
+      csoundfilter->analysis_channels = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (csoundfilter);
+      break;
+    case PROP_FOLLOW_CAPS:
+      csoundfilter->follow_caps = g_value_get_boolean (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (csoundfilter, property_id, pspec);
       break;
@@ -197,11 +533,63 @@ gst_csoundfilter_get_property (GObject * object, guint property_id,
 
   switch (property_id) {
     case PROP_LOCATION:
+      GST_OBJECT_LOCK (csoundfilter);
       g_value_set_string (value, csoundfilter->csd_name);
+      GST_OBJECT_UNLOCK (csoundfilter);
+      break;
+    case PROP_CSD_TEXT:
+      GST_OBJECT_LOCK (csoundfilter);
+      g_value_set_string (value, csoundfilter->csd_text);
+      GST_OBJECT_UNLOCK (csoundfilter);
+      break;
+    case PROP_ORC:
+      GST_OBJECT_LOCK (csoundfilter);
+      g_value_set_string (value, csoundfilter->orc);
+      GST_OBJECT_UNLOCK (csoundfilter);
+      break;
+    case PROP_SCO:
+      GST_OBJECT_LOCK (csoundfilter);
+      g_value_set_string (value, csoundfilter->sco);
+      GST_OBJECT_UNLOCK (csoundfilter);
+      break;
+    case PROP_CROSSFADE:
+      g_value_set_uint64 (value, csoundfilter->crossfade);
       break;
     case PROP_LOOP:
       g_value_set_boolean (value, csoundfilter->loop);
     break;
+    case PROP_INSTANCES:
+      g_value_set_uint (value, csoundfilter->instances);
+      break;
+    case PROP_ASYNC_DEPTH:
+      g_value_set_uint (value, csoundfilter->async_depth);
+      break;
+    case PROP_INSTANCE_POOL:
+      g_value_set_boolean (value, csoundfilter->instance_pool);
+      break;
+    case PROP_MESSAGE_LEVEL:
+      g_value_set_enum (value, csoundfilter->message_level);
+      break;
+    case PROP_STATS:
+      g_value_take_boxed (value,
+          gst_csound_stats_board_get (&csoundfilter->stats_board));
+      break;
+    case PROP_STATS_INTERVAL:
+      g_mutex_lock (&csoundfilter->stats_board.lock);
+      g_value_set_uint64 (value, csoundfilter->stats_board.interval);
+      g_mutex_unlock (&csoundfilter->stats_board.lock);
+      break;
+    case PROP_MESSAGE_RATE:
+      g_value_set_uint (value, csoundfilter->message_rate);
+      break;
+    case PROP_ANALYSIS_CHANNELS:
+      GST_OBJECT_LOCK (csoundfilter);
+      g_value_set_string (value, csoundfilter->analysis_channels);
+      GST_OBJECT_UNLOCK (csoundfilter);
+      break;
+    case PROP_FOLLOW_CAPS:
+      g_value_set_boolean (value, csoundfilter->follow_caps);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (csoundfilter, property_id, pspec);
       break;
@@ -224,13 +612,31 @@ gst_csoundfilter_finalize (GObject * object)
   csoundfilter->spout = NULL;
   csoundfilter->spin = NULL;
   
-  if(csoundfilter->csound){
-     csoundCleanup (csoundfilter->csound);
-     csoundDestroy (csoundfilter->csound);
-  }
+  gst_csound_swap_free (csoundfilter->swap);
+  gst_csound_instance_release (csoundfilter->csound);
+  csoundfilter->csound = NULL;
   
   g_object_unref(csoundfilter->in_adapter);
   csoundfilter->in_adapter = NULL;
+  g_free (csoundfilter->block_scratch);
+  if (csoundfilter->channels)
+    g_ptr_array_unref (csoundfilter->channels);
+  g_free (csoundfilter->ctl_ptrs);
+  g_free (csoundfilter->ctl_values);
+  gst_csound_event_queue_clear (&csoundfilter->events);
+  g_free (csoundfilter->analysis_channels);
+  gst_csound_analysis_clear (&csoundfilter->analysis);
+  g_free (csoundfilter->options);
+  g_free (csoundfilter->csd_name);
+  g_free (csoundfilter->csd_text);
+  g_free (csoundfilter->orc);
+  g_free (csoundfilter->sco);
+  g_list_free_full (csoundfilter->out_pads, gst_object_unref);
+  g_list_free_full (csoundfilter->side_pads, gst_object_unref);
+  gst_csound_stats_board_clear (&csoundfilter->stats_board);
+  g_mutex_clear (&csoundfilter->worker_lock);
+  g_cond_clear (&csoundfilter->worker_cond);
+  g_cond_clear (&csoundfilter->done_cond);
   G_OBJECT_CLASS (gst_csoundfilter_parent_class)->finalize (object);
 }
 
@@ -238,36 +644,37 @@ static GstCaps *
 gst_csoundfilter_transform_caps (GstBaseTransform * base, GstPadDirection direction,
     GstCaps * caps, GstCaps * filter)
 {
-
-  GstCaps *res;
+  GstCsoundfilter *csoundfilter = GST_CSOUNDFILTER (base);
+  GstCaps *res, *templ;
   GstStructure *structure;
   gint i;
-  GST_DEBUG_OBJECT(GST_CSOUNDFILTER(base), "transform caps");
-  /*check if audio format is supported by csound
-   if not, fixing the caps and its audio format */
+  GST_DEBUG_OBJECT (csoundfilter, "transform caps");
+  /* samples are converted to MYFLT on the way in and out of csound,
+   so the other pad can use any of the supported formats */
   res = gst_caps_copy (caps);
 
-  if(csoundGetSizeOfMYFLT() == DOUBLE_SAMPLES){
   for (i = 0; i < gst_caps_get_size (res); i++) {
     structure = gst_caps_get_structure (res, i);
-    if (direction == GST_PAD_SRC) {
-      gst_structure_set (structure, "format", G_TYPE_STRING, GST_AUDIO_NE (F64), NULL);
-    } else {
-      gst_structure_set (structure, "format", G_TYPE_STRING, GST_AUDIO_NE (F64), NULL);
-     }
-    }
-   }
+    gst_structure_remove_field (structure, "format");
+  }
 
-  else  if(csoundGetSizeOfMYFLT() == FLOAT_SAMPLES){
-  for (i = 0; i < gst_caps_get_size (res); i++) {
-    structure = gst_caps_get_structure (res, i);
-    if (direction == GST_PAD_SRC) {
-      gst_structure_set (structure, "format", G_TYPE_STRING, GST_AUDIO_NE (F32), NULL);
-    } else {
-      gst_structure_set (structure, "format", G_TYPE_STRING, GST_AUDIO_NE (F32), NULL);
-     }
-   }
- }
+  if (direction == GST_PAD_SRC)
+    templ = gst_pad_get_pad_template_caps (GST_BASE_TRANSFORM_SINK_PAD (base));
+  else
+    templ = gst_pad_get_pad_template_caps (GST_BASE_TRANSFORM_SRC_PAD (base));
+
+  caps = gst_caps_intersect_full (res, templ, GST_CAPS_INTERSECT_FIRST);
+  gst_caps_unref (templ);
+  gst_caps_unref (res);
+  res = caps;
+
+  /* the channel groups and the async slots are interleaved blocks */
+  if (csoundfilter->instances > 1 || csoundfilter->async_depth > 0) {
+    res = gst_caps_make_writable (res);
+    for (i = 0; i < gst_caps_get_size (res); i++)
+      gst_structure_set (gst_caps_get_structure (res, i), "layout",
+          G_TYPE_STRING, "interleaved", NULL);
+  }
 
   if (filter) {
     GstCaps *intersection;
@@ -288,30 +695,45 @@ gst_csoundfilter_fixate_caps (GstBaseTransform * trans, GstPadDirection directio
   GstCsoundfilter *csoundfilter = GST_CSOUNDFILTER (trans);
 
   GstStructure *structure;
+  const gchar *format;
   gint rate;
-  gint caps_channels;
-  caps = gst_caps_make_writable (caps);
-  structure = gst_caps_get_structure (caps, 0);
+  gint caps_channels = 0;
+
+  othercaps = gst_caps_truncate (othercaps);
+  othercaps = gst_caps_make_writable (othercaps);
+  structure = gst_caps_get_structure (othercaps, 0);
   rate = csoundGetSr (csoundfilter->csound);
   gst_structure_fixate_field_nearest_int (structure, "rate", rate);
   GST_DEBUG_OBJECT (csoundfilter, "fixating samplerate to %d", rate);
-  /* fixate to channels setting in csound side */
-  gst_structure_get_int (structure, "channels", &caps_channels);
 
-  if (direction == GST_PAD_SRC) {
-    gst_structure_set (structure, "channels", G_TYPE_INT, csoundfilter->cs_ichannels, NULL);
+  /* keep the sample format of the other side when possible */
+  format = gst_structure_get_string (gst_caps_get_structure (caps, 0), "format");
+  if (format)
+    gst_structure_fixate_field_string (structure, "format", format);
+
+  /* fixate to channels setting in csound side. Following the caps, an
+   * orchestra with as many inputs as outputs takes any count */
+  if (csoundfilter->follow_caps
+      && csoundfilter->csd_ichannels == csoundfilter->csd_ochannels) {
+    gst_structure_fixate_field_nearest_int (structure, "channels",
+        csoundfilter->csd_ochannels * csoundfilter->instances);
+  } else if (direction == GST_PAD_SRC) {
+    gst_structure_set (structure, "channels", G_TYPE_INT,
+        csoundfilter->cs_ichannels * csoundfilter->instances, NULL);
   } else if (direction == GST_PAD_SINK) {
-      gst_structure_set (structure, "channels", G_TYPE_INT, csoundfilter->cs_ochannels, NULL);
+      gst_structure_set (structure, "channels", G_TYPE_INT,
+          csoundfilter->cs_ochannels * csoundfilter->instances, NULL);
   }
+  gst_structure_get_int (structure, "channels", &caps_channels);
 
-  if (caps_channels && caps_channels > 2) {
+  if (caps_channels > 2) {
     if (!gst_structure_has_field_typed (structure, "channel-mask",
             GST_TYPE_BITMASK))
       gst_structure_set (structure, "channel-mask", GST_TYPE_BITMASK, 0ULL,
           NULL);
   }
 
-  return caps;
+  return gst_caps_fixate (othercaps);
 }
 
 static gboolean
@@ -322,81 +744,864 @@ gst_csoundfilter_accept_caps (GstBaseTransform * trans, GstPadDirection directio
   return TRUE;
 }
 
+/* compile the orchestra again when the rate or the channels of the caps
+ * differ from the ones it runs at. ksmps is scaled along with the rate,
+ * the control period of the csd stays */
+static gboolean
+gst_csoundfilter_follow_caps (GstCsoundfilter * csoundfilter,
+    const GstAudioInfo * in_info, const GstAudioInfo * out_info)
+{
+  gint rate = GST_AUDIO_INFO_RATE (in_info);
+  guint instances = csoundfilter->instances;
+  guint ichannels = GST_AUDIO_INFO_CHANNELS (in_info) / instances;
+  guint ochannels = GST_AUDIO_INFO_CHANNELS (out_info) / instances;
+  gchar *options;
+  guint ksmps;
+
+  if (GST_AUDIO_INFO_CHANNELS (in_info) % instances != 0
+      || GST_AUDIO_INFO_CHANNELS (out_info) % instances != 0) {
+    GST_ERROR_OBJECT (csoundfilter, "the channels do not split into %u "
+        "instances", instances);
+    return FALSE;
+  }
+  if (rate == (gint) csoundGetSr (csoundfilter->csound)
+      && ichannels == csoundfilter->cs_ichannels
+      && ochannels == csoundfilter->cs_ochannels)
+    return TRUE;
+
+  options = NULL;
+  if (rate != csoundfilter->csd_rate
+      || ichannels != csoundfilter->csd_ichannels
+      || ochannels != csoundfilter->csd_ochannels) {
+    ksmps = MAX (1, gst_util_uint64_scale_int_round (csoundfilter->csd_ksmps,
+            rate, csoundfilter->csd_rate));
+    options = gst_csound_instance_options (rate, ksmps, ichannels,
+        ochannels);
+  }
+  GST_OBJECT_LOCK (csoundfilter);
+  g_free (csoundfilter->options);
+  csoundfilter->options = options;
+  GST_OBJECT_UNLOCK (csoundfilter);
+  GST_INFO_OBJECT (csoundfilter, "compiling the orchestra again with \"%s\"",
+      GST_STR_NULL (csoundfilter->options));
+
+  gst_csoundfilter_close (csoundfilter);
+  gst_csoundfilter_clear_pending (csoundfilter);
+  if (!gst_csoundfilter_open (csoundfilter))
+    return FALSE;
+  g_atomic_int_set (&csoundfilter->end_score, 0);
+
+  /* ksmps, and the latency with it, may have changed */
+  gst_element_post_message (GST_ELEMENT (csoundfilter),
+      gst_message_new_latency (GST_OBJECT (csoundfilter)));
+
+  return TRUE;
+}
+
 static gboolean
 gst_csoundfilter_set_caps (GstBaseTransform * trans, GstCaps * incaps,
     GstCaps * outcaps)
 {
   GstCsoundfilter *csoundfilter = GST_CSOUNDFILTER (trans);
+  GstAudioInfo in_info, out_info;
+  MYFLT dbfs;
+  gboolean async;
+
   GST_DEBUG_OBJECT (csoundfilter, "csoundfilter input caps configured  to: %" GST_PTR_FORMAT, incaps);
   GST_DEBUG_OBJECT (csoundfilter, "csoundfilter ouput caps configured  to: %" GST_PTR_FORMAT, outcaps);
+
+  if (!gst_audio_info_from_caps (&in_info, incaps)
+      || !gst_audio_info_from_caps (&out_info, outcaps)) {
+    GST_ERROR_OBJECT (csoundfilter, "received invalid caps");
+    return FALSE;
+  }
+
+  if (csoundfilter->follow_caps
+      && !gst_csoundfilter_follow_caps (csoundfilter, &in_info, &out_info))
+    return FALSE;
+
+  dbfs = csoundGet0dBFS (csoundfilter->csound);
+  if (!gst_csound_convert_setup (&csoundfilter->in_convert,
+          GST_AUDIO_INFO_FORMAT (&in_info), dbfs)
+      || !gst_csound_convert_setup (&csoundfilter->out_convert,
+          GST_AUDIO_INFO_FORMAT (&out_info), dbfs)) {
+    GST_ERROR_OBJECT (csoundfilter, "unsupported sample format");
+    return FALSE;
+  }
+
+  csoundfilter->planar =
+      GST_AUDIO_INFO_LAYOUT (&in_info) == GST_AUDIO_LAYOUT_NON_INTERLEAVED;
+  if (csoundfilter->planar
+      && csoundfilter->process != gst_csoundfilter_trans) {
+    GST_ERROR_OBJECT (csoundfilter, "non-interleaved audio needs a single "
+        "instance in synchronous mode");
+    return FALSE;
+  }
+  csoundfilter->spin_frames = 0;
+
+  csoundfilter->in_block_size = csoundfilter->ksmps * csoundfilter->cs_ichannels
+      * csoundfilter->instances * csoundfilter->in_convert.sample_size;
+  csoundfilter->out_block_size = csoundfilter->ksmps * csoundfilter->cs_ochannels
+      * csoundfilter->instances * csoundfilter->out_convert.sample_size;
+  g_free (csoundfilter->block_scratch);
+  csoundfilter->block_scratch = g_malloc (csoundfilter->in_block_size);
+  csoundfilter->rate = GST_AUDIO_INFO_RATE (&in_info);
+  csoundfilter->in_info = in_info;
+  csoundfilter->out_info = out_info;
+  GST_DEBUG_OBJECT (csoundfilter, "0dBFS %f, %u bytes per ksmps in, %u out",
+      (gdouble) dbfs, csoundfilter->in_block_size, csoundfilter->out_block_size);
+
+  /* the ring slots follow the block sizes */
+  async = csoundfilter->process == gst_csoundfilter_trans_async;
+  if (async)
+    gst_csoundfilter_stop_engine (csoundfilter);
+  gst_csoundfilter_reset_stats (csoundfilter);
+  if (async)
+    gst_csoundfilter_start_engine (csoundfilter);
+
   return TRUE;
 }
 
-/* states */
 static gboolean
-gst_csoundfilter_start (GstBaseTransform * trans)
+gst_csoundfilter_decide_allocation (GstBaseTransform * trans, GstQuery * query)
 {
+  GstCsoundfilter *csoundfilter = GST_CSOUNDFILTER (trans);
+  guint size;
 
+  size = gst_csound_buffer_pool_decide (query, csoundfilter->out_block_size,
+      csoundfilter->out_pool_size);
+  if (size == 0) {
+    GST_ERROR_OBJECT (csoundfilter, "failed to configure the output buffer pool");
+    return FALSE;
+  }
+
+  GST_DEBUG_OBJECT (csoundfilter, "output pool of %u bytes buffers", size);
+  csoundfilter->out_pool_size = size;
+  return TRUE;
+}
+
+static gboolean
+gst_csoundfilter_propose_allocation (GstBaseTransform * trans,
+    GstQuery * decide_query, GstQuery * query)
+{
   GstCsoundfilter *csoundfilter = GST_CSOUNDFILTER (trans);
+  guint blocks;
+
+  /* the same number of ksmps blocks the output pool holds */
+  if (csoundfilter->out_block_size == 0)
+    return TRUE;
+  blocks = MAX (1, csoundfilter->out_pool_size / csoundfilter->out_block_size);
+  gst_csound_buffer_pool_propose (query, blocks * csoundfilter->in_block_size);
+  return TRUE;
+}
+
+/* states */
+
+/* the orchestra properties, the caller holds the object lock */
+static void
+gst_csoundfilter_get_source (GstCsoundfilter * csoundfilter,
+    GstCsoundSource * source)
+{
+  source->location = g_strdup (csoundfilter->csd_name);
+  source->csd_text = g_strdup (csoundfilter->csd_text);
+  source->orc = g_strdup (csoundfilter->orc);
+  source->sco = g_strdup (csoundfilter->sco);
+}
+
+/* put the channels from gst_csound_channels_update() in place, the
+ * child proxy signals go out after the object lock */
+static void
+gst_csoundfilter_set_channels (GstCsoundfilter * csoundfilter,
+    GPtrArray * channels)
+{
+  GPtrArray *old;
+
+  GST_OBJECT_LOCK (csoundfilter);
+  old = csoundfilter->channels;
+  csoundfilter->channels = channels;
+  GST_OBJECT_UNLOCK (csoundfilter);
+
+  gst_csound_channels_commit (old, channels, GST_OBJECT (csoundfilter));
+}
 
+/* an instance of the orchestra the properties hold, compiled with the
+ * options of the element */
+static CSOUND *
+gst_csoundfilter_acquire (GstCsoundfilter * csoundfilter)
+{
+  GstCsoundSource source;
+  CSOUND *csound = NULL;
+
+  GST_OBJECT_LOCK (csoundfilter);
+  gst_csoundfilter_get_source (csoundfilter, &source);
+  GST_OBJECT_UNLOCK (csoundfilter);
+
+  if (gst_csound_source_get_name (&source) == NULL) {
+    GST_ELEMENT_ERROR (csoundfilter, RESOURCE, NOT_FOUND, (NULL),
+        ("no location, csd-text or orc set"));
+  } else {
+    csound = gst_csound_instance_acquire_source (&source,
+        csoundfilter->options, csoundfilter->instance_pool,
+        gst_csound_log_message, csoundfilter->log);
+    if (csound == NULL)
+      GST_ELEMENT_ERROR (csoundfilter, RESOURCE, OPEN_READ,
+          ("%s", gst_csound_source_get_name (&source)), (NULL));
+  }
+  gst_csound_source_clear (&source);
+
+  return csound;
+}
+
+/* a new orchestra set while running compiles next to the running one,
+ * the streaming thread swaps it in */
+static void
+gst_csoundfilter_request_swap (GstCsoundfilter * csoundfilter)
+{
+  GstCsoundSource source;
+  gchar *options;
+
+  GST_OBJECT_LOCK (csoundfilter);
+  gst_csoundfilter_get_source (csoundfilter, &source);
+  options = g_strdup (csoundfilter->options);
+  GST_OBJECT_UNLOCK (csoundfilter);
+
+  if (gst_csound_source_get_name (&source))
+    gst_csound_swap_request (csoundfilter->swap, &source, options);
+  gst_csound_source_clear (&source);
+  g_free (options);
+}
+
+/* compile the orchestra with the options of the element, on every
+ * instance, and bind everything that points into them */
+static gboolean
+gst_csoundfilter_open (GstCsoundfilter * csoundfilter)
+{
+  gchar *channels;
   gboolean ret = TRUE;
-  csoundfilter->csound = csoundCreate (NULL);
-  csoundfilter->in_adapter = gst_adapter_new();
-  csoundSetMessageCallback (csoundfilter->csound,
-      (csoundMessageCallback) gst_csoundfilter_messages);
-  int result = csoundCompileCsd (csoundfilter->csound, csoundfilter->csd_name);
-  csoundStart(csoundfilter->csound);
+
+  csoundfilter->csound = gst_csoundfilter_acquire (csoundfilter);
+  if (csoundfilter->csound == NULL)
+    return FALSE;
   csoundfilter->spin = csoundGetSpin (csoundfilter->csound);
   csoundfilter->spout = csoundGetSpout (csoundfilter->csound);
 
-  if (result) {
-    GST_ELEMENT_ERROR (csoundfilter, RESOURCE, OPEN_READ,
-        ("%s", csoundfilter->csd_name), (NULL));
-    ret = FALSE;
-  }
-
   csoundfilter->ksmps = csoundGetKsmps (csoundfilter->csound);
   csoundfilter->cs_ochannels = csoundGetNchnls (csoundfilter->csound);
   csoundfilter->cs_ichannels = csoundGetNchnlsInput (csoundfilter->csound);
   csoundfilter->process = gst_csoundfilter_trans;
+
+  gst_csoundfilter_set_channels (csoundfilter,
+      gst_csound_channels_update (csoundfilter->channels,
+          csoundfilter->csound, GST_OBJECT (csoundfilter)));
+  g_free (csoundfilter->ctl_ptrs);
+  csoundfilter->ctl_ptrs = g_new0 (MYFLT *, csoundfilter->channels->len);
+  if (!gst_csound_channels_bind (csoundfilter->channels, csoundfilter->csound,
+          csoundfilter->ctl_ptrs)) {
+    GST_ELEMENT_ERROR (csoundfilter, CORE, FAILED, (NULL),
+        ("the control channels of the orchestra do not bind"));
+    gst_csoundfilter_close (csoundfilter);
+    return FALSE;
+  }
+  gst_csound_side_pads_bind (GST_ELEMENT (csoundfilter),
+      &csoundfilter->side_pads, csoundfilter->csound);
+  GST_OBJECT_LOCK (csoundfilter);
+  channels = g_strdup (csoundfilter->analysis_channels);
+  GST_OBJECT_UNLOCK (csoundfilter);
+  gst_csound_analysis_setup (&csoundfilter->analysis, channels,
+      csoundfilter->csound, GST_ELEMENT (csoundfilter));
+  g_free (channels);
+
+  if (ret && csoundfilter->instances > 1) {
+    guint i;
+
+    GST_DEBUG_OBJECT (csoundfilter, "running %u instances of %u channels",
+        csoundfilter->instances, csoundfilter->cs_ichannels);
+    csoundfilter->n_workers = csoundfilter->instances - 1;
+    csoundfilter->workers = g_new0 (GstCsoundfilterWorker,
+        csoundfilter->n_workers);
+    csoundfilter->workers_quit = FALSE;
+    csoundfilter->job_seq = 0;
+
+    for (i = 0; i < csoundfilter->n_workers; i++) {
+      GstCsoundfilterWorker *worker = &csoundfilter->workers[i];
+
+      worker->filter = csoundfilter;
+      worker->group = i + 1;
+      worker->csound = gst_csoundfilter_new_instance (csoundfilter);
+      if (worker->csound == NULL) {
+        ret = FALSE;
+        break;
+      }
+      worker->spin = csoundGetSpin (worker->csound);
+      worker->spout = csoundGetSpout (worker->csound);
+      worker->ctl_ptrs = g_new0 (MYFLT *, csoundfilter->channels->len);
+      if (!gst_csound_channels_bind (csoundfilter->channels, worker->csound,
+              worker->ctl_ptrs)) {
+        GST_ELEMENT_ERROR (csoundfilter, CORE, FAILED, (NULL),
+            ("the control channels do not bind on instance %u", i + 1));
+        ret = FALSE;
+        break;
+      }
+      worker->thread = g_thread_new ("csoundfilter-worker",
+          gst_csoundfilter_worker_loop, worker);
+    }
+
+    if (!ret) {
+      gst_csoundfilter_close (csoundfilter);
+      return FALSE;
+    } else {
+      csoundfilter->process = gst_csoundfilter_trans_parallel;
+    }
+  }
+
+  /* the engine thread itself starts once the caps give the block sizes */
+  if (ret && csoundfilter->async_depth > 0) {
+    GST_DEBUG_OBJECT (csoundfilter, "async mode, %u blocks deep",
+        csoundfilter->async_depth);
+    csoundfilter->engine_process = csoundfilter->process;
+    csoundfilter->process = gst_csoundfilter_trans_async;
+  }
+
+  GST_OBJECT_LOCK (csoundfilter);
+  if (csoundfilter->side_pads
+      && csoundfilter->process != gst_csoundfilter_trans)
+    GST_ELEMENT_WARNING (csoundfilter, CORE, NEGOTIATION, (NULL),
+        ("side pads need a single synchronous instance, not filled"));
+  GST_OBJECT_UNLOCK (csoundfilter);
+  if (csoundfilter->analysis.n_channels > 0
+      && csoundfilter->process == gst_csoundfilter_trans_async)
+    GST_ELEMENT_WARNING (csoundfilter, CORE, NEGOTIATION, (NULL),
+        ("analysis channels are not read in async mode"));
+
+  gst_csound_swap_activate (csoundfilter->swap, csoundfilter->instance_pool,
+      gst_csound_log_message, csoundfilter->log);
+
   return ret;
 }
 
+static void
+gst_csoundfilter_close (GstCsoundfilter * csoundfilter)
+{
+  gst_csound_swap_reset (csoundfilter->swap);
+  gst_csoundfilter_stop_engine (csoundfilter);
+  gst_csoundfilter_stop_workers (csoundfilter);
+  gst_csound_side_pads_bind (GST_ELEMENT (csoundfilter),
+      &csoundfilter->side_pads, NULL);
+  gst_csound_analysis_clear (&csoundfilter->analysis);
+  gst_csound_instance_release (csoundfilter->csound);
+  csoundfilter->csound = NULL;
+  csoundfilter->spin = NULL;
+  csoundfilter->spout = NULL;
+}
+
+static gboolean
+gst_csoundfilter_start (GstBaseTransform * trans)
+{
+  GstCsoundfilter *csoundfilter = GST_CSOUNDFILTER (trans);
+
+  if (csoundfilter->in_adapter == NULL)
+    csoundfilter->in_adapter = gst_adapter_new();
+  gst_csoundfilter_start_log (csoundfilter);
+
+  /* the csd as it is, follow-caps compiles it again once the caps are
+   * known */
+  GST_OBJECT_LOCK (csoundfilter);
+  g_free (csoundfilter->options);
+  csoundfilter->options = NULL;
+  GST_OBJECT_UNLOCK (csoundfilter);
+  if (!gst_csoundfilter_open (csoundfilter)) {
+    gst_csoundfilter_stop_log (csoundfilter);
+    return FALSE;
+  }
+  csoundfilter->csd_rate = (gint) csoundGetSr (csoundfilter->csound);
+  csoundfilter->csd_ksmps = csoundfilter->ksmps;
+  csoundfilter->csd_ichannels = csoundfilter->cs_ichannels;
+  csoundfilter->csd_ochannels = csoundfilter->cs_ochannels;
+
+  g_atomic_int_set (&csoundfilter->end_score, 0);
+  csoundfilter->ts_base = GST_CLOCK_TIME_NONE;
+  csoundfilter->samples_out = 0;
+  csoundfilter->out_offset = 0;
+  csoundfilter->discont = TRUE;
+  csoundfilter->unaligned_input = FALSE;
+  return TRUE;
+}
+
 static gboolean
 gst_csoundfilter_stop (GstBaseTransform * trans)
 {
   GstCsoundfilter *csoundfilter = GST_CSOUNDFILTER (trans);
-  csoundStop (csoundfilter->csound);
+  gst_csoundfilter_close (csoundfilter);
+  gst_csoundfilter_stop_log (csoundfilter);
+  gst_adapter_clear (csoundfilter->in_adapter);
+  csoundfilter->spin_frames = 0;
+  gst_csound_event_queue_clear (&csoundfilter->events);
+  gst_csound_out_pads_reset (GST_ELEMENT (csoundfilter),
+      &csoundfilter->out_pads);
   return TRUE;
 }
 
+/* bytes of input waiting for a block to complete: in the adapter, or
+ * already converted into spin when the input is planar */
+static gsize
+gst_csoundfilter_pending (GstCsoundfilter * csoundfilter)
+{
+  if (csoundfilter->planar)
+    return (gsize) csoundfilter->spin_frames *
+        (csoundfilter->in_block_size / csoundfilter->ksmps);
+  return gst_adapter_available (csoundfilter->in_adapter);
+}
+
+static void
+gst_csoundfilter_clear_pending (GstCsoundfilter * csoundfilter)
+{
+  gst_adapter_clear (csoundfilter->in_adapter);
+  csoundfilter->spin_frames = 0;
+}
+
+/* bytes of the frames of @inbuf, the planes may be apart */
+static gsize
+gst_csoundfilter_input_size (GstCsoundfilter * csoundfilter,
+    GstBuffer * inbuf)
+{
+  GstAudioMeta *meta;
+
+  if (csoundfilter->planar && (meta = gst_buffer_get_audio_meta (inbuf)))
+    return meta->samples * GST_AUDIO_INFO_BPF (&csoundfilter->in_info);
+  return gst_buffer_get_size (inbuf);
+}
+
+/* planar output buffers carry their planes in a GstAudioMeta, packed */
+static void
+gst_csoundfilter_add_audio_meta (GstCsoundfilter * csoundfilter,
+    GstBuffer * outbuf)
+{
+  if (!csoundfilter->planar)
+    return;
+  gst_buffer_add_audio_meta (outbuf, &csoundfilter->out_info,
+      gst_buffer_get_size (outbuf) /
+      GST_AUDIO_INFO_BPF (&csoundfilter->out_info), NULL);
+}
+
 static GstFlowReturn
 gst_csoundfilter_prepare_output_buffer (GstBaseTransform * base,
     GstBuffer * inbuf, GstBuffer ** outbuf)
 {
   GstCsoundfilter *csoundfilter = GST_CSOUNDFILTER (base);
+  GstBufferPool *pool;
   gsize new_size;
-
-  if (csoundfilter->cs_ichannels != csoundfilter->cs_ochannels){
-    guint input_bpf = csoundfilter->cs_ichannels * sizeof(MYFLT);
-    guint num_samples = gst_buffer_get_size (inbuf)/input_bpf;
-    new_size = num_samples * sizeof(MYFLT) * csoundfilter->cs_ochannels ;
-  }else{
-    new_size = gst_buffer_get_size (inbuf);
+  gsize in_size = gst_csoundfilter_input_size (csoundfilter, inbuf);
+  gsize pending = gst_csoundfilter_pending (csoundfilter);
+  guint in_bytes = csoundfilter->in_block_size;
+
+  /* whole ksmps blocks and nothing pending in the adapter: csound can work
+   * directly on the input buffer, so reuse it as the output buffer */
+  if (in_bytes == csoundfilter->out_block_size
+      && in_size % in_bytes == 0
+      && pending == 0
+      && gst_buffer_is_writable (inbuf)) {
+    GST_LOG_OBJECT (csoundfilter, "processing %" G_GSIZE_FORMAT " bytes in place", in_size);
+    *outbuf = inbuf;
+    return GST_FLOW_OK;
   }
+
+  /* exactly the ksmps blocks this buffer completes */
+  new_size = ((pending + in_size) / in_bytes) * csoundfilter->out_block_size;
   
-  *outbuf = gst_buffer_new_allocate (NULL, new_size, NULL);
+  pool = gst_base_transform_get_buffer_pool (base);
+  if (pool && new_size <= csoundfilter->out_pool_size) {
+    GstFlowReturn ret;
+
+    if (!gst_buffer_pool_is_active (pool)
+        && !gst_buffer_pool_set_active (pool, TRUE)) {
+      gst_object_unref (pool);
+      GST_ELEMENT_ERROR (csoundfilter, RESOURCE, SETTINGS,
+          ("failed to activate the output buffer pool"), (NULL));
+      return GST_FLOW_ERROR;
+    }
+    ret = gst_buffer_pool_acquire_buffer (pool, outbuf, NULL);
+    gst_object_unref (pool);
+    if (ret != GST_FLOW_OK)
+      return ret;
+    gst_buffer_set_size (*outbuf, new_size);
+    gst_csoundfilter_add_audio_meta (csoundfilter, *outbuf);
+    return GST_FLOW_OK;
+  }
+
+  if (pool)
+    gst_object_unref (pool);
+
+  /* bigger than the pool buffers, grow the pool on the next buffer */
+  if (new_size > csoundfilter->out_pool_size) {
+    GST_DEBUG_OBJECT (csoundfilter, "%" G_GSIZE_FORMAT " bytes do not fit the pool", new_size);
+    csoundfilter->out_pool_size = new_size;
+    gst_base_transform_reconfigure_src (base);
+  }
+
+  *outbuf = gst_csound_buffer_new_allocate (new_size);
   
   if(*outbuf == NULL){
       GST_ELEMENT_ERROR (csoundfilter, RESOURCE, FAILED,
         ("%s", "Cant to allocate output buffers"), NULL);
       return GST_FLOW_ERROR;
   }
+  gst_csoundfilter_add_audio_meta (csoundfilter, *outbuf);
     
-  *outbuf = gst_buffer_make_writable (*outbuf);
   return GST_FLOW_OK;
 }
 
+/* @time less the @pending bytes waiting in the adapter, that is the time
+ * of the first block this buffer completes */
+static GstClockTime
+gst_csoundfilter_block_start (GstCsoundfilter * csoundfilter,
+    GstClockTime time, gsize pending)
+{
+  guint in_bpf = csoundfilter->in_block_size / csoundfilter->ksmps;
+  GstClockTime pending_time;
+
+  if (!GST_CLOCK_TIME_IS_VALID (time))
+    return GST_CLOCK_TIME_NONE;
+
+  pending_time = gst_util_uint64_scale_int (pending / in_bpf, GST_SECOND,
+      csoundfilter->rate);
+  return time > pending_time ? time - pending_time : 0;
+}
+
+/* running time of the end of block @block of @info, events due before it
+ * are played ahead of that block */
+static inline GstClockTime
+gst_csoundfilter_block_end (const GstCsoundfilterBlocks * info, guint block)
+{
+  if (!GST_CLOCK_TIME_IS_VALID (info->start))
+    return GST_CLOCK_TIME_NONE;
+
+  return info->start + (block + 1) * info->interval;
+}
+
+static GstClockTime
+gst_csoundfilter_block_at (const GstCsoundfilterBlocks * info, guint block)
+{
+  if (!GST_CLOCK_TIME_IS_VALID (info->start))
+    return GST_CLOCK_TIME_NONE;
+
+  return info->start + block * info->interval;
+}
+
+/* evaluate the channels at the start of every block this buffer completes */
+static const MYFLT *
+gst_csoundfilter_prepare_controls (GstCsoundfilter * csoundfilter,
+    GstClockTime start, GstClockTime interval, guint blocks)
+{
+  gsize n_values = (gsize) blocks * csoundfilter->channels->len;
+
+  /* in values, the channels may change with the orchestra */
+  if (n_values > csoundfilter->ctl_capacity) {
+    csoundfilter->ctl_values = g_renew (MYFLT, csoundfilter->ctl_values,
+        n_values);
+    csoundfilter->ctl_capacity = n_values;
+  }
+
+  gst_csound_channels_prepare (csoundfilter->channels, start, interval,
+      blocks, csoundfilter->ctl_values);
+  return csoundfilter->ctl_values;
+}
+
+/* the block duration changes with the caps, the workers are idle */
+static void
+gst_csoundfilter_reset_stats (GstCsoundfilter * csoundfilter)
+{
+  GstClockTime interval = 0;
+  guint i;
+
+  if (csoundfilter->rate > 0)
+    interval = gst_util_uint64_scale_int (csoundfilter->ksmps, GST_SECOND,
+        csoundfilter->rate);
+
+  gst_csound_stats_reset (&csoundfilter->stats, interval);
+  for (i = 0; i < csoundfilter->n_workers; i++)
+    gst_csound_stats_reset (&csoundfilter->workers[i].stats, interval);
+  g_atomic_int_set (&csoundfilter->late_buffers, 0);
+}
+
+/* time the whole buffer against the audio it holds and the score against
+ * the running time. In async mode the engine thread owns the stats and
+ * publishes them itself */
+static void
+gst_csoundfilter_buffer_stats (GstCsoundfilter * csoundfilter,
+    GstClockTime began, GstClockTime first, guint blocks,
+    GstClockTime interval)
+{
+  GstClockTime elapsed = gst_util_get_timestamp () - began;
+  GstClockTime duration = blocks * interval;
+
+  if (blocks == 0)
+    return;
+
+  if (csoundfilter->process == gst_csoundfilter_trans_async) {
+    if (elapsed > duration)
+      g_atomic_int_inc (&csoundfilter->late_buffers);
+    return;
+  }
+
+  gst_csound_stats_add_buffer (&csoundfilter->stats, elapsed, duration);
+  if (GST_CLOCK_TIME_IS_VALID (first))
+    gst_csound_stats_sync (&csoundfilter->stats, first + duration,
+        csoundGetCurrentTimeSamples (csoundfilter->csound),
+        csoundfilter->rate);
+  gst_csound_stats_publish (&csoundfilter->stats_board, &csoundfilter->stats,
+      GST_ELEMENT (csoundfilter));
+}
+
+/* interleaved input: the whole blocks are read straight from the mapped
+ * input, only the leftover frames go through the adapter.
+ * Returns: the blocks processed */
+static guint
+gst_csoundfilter_process_interleaved (GstCsoundfilter * csoundfilter,
+    GstBuffer * inbuf, GstBuffer * outbuf, GstCsoundfilterBlocks * info,
+    gboolean take_events)
+{
+  GstMapInfo imap, omap;
+  const guint8 *idata;
+  guint8 *odata;
+  gsize isize, offset = 0, pending;
+  guint blocks, max_blocks;
+  guint in_bytes = csoundfilter->in_block_size;
+  guint out_bytes = csoundfilter->out_block_size;
+  guint done = 0;
+
+  if (inbuf == outbuf) {
+    gst_buffer_map (outbuf, &omap, GST_MAP_READWRITE);
+    imap = omap;
+  } else {
+    gst_buffer_map (inbuf, &imap, GST_MAP_READ);
+    gst_buffer_map (outbuf, &omap, GST_MAP_WRITE);
+  }
+
+  idata = imap.data;
+  isize = imap.size;
+  odata = omap.data;
+  max_blocks = omap.size / out_bytes;
+  pending = gst_adapter_available (csoundfilter->in_adapter);
+
+  /* complete the block left over from the previous buffer first */
+  if (pending > 0 && max_blocks > 0 && pending + isize >= in_bytes) {
+    gst_adapter_copy (csoundfilter->in_adapter, csoundfilter->block_scratch,
+        0, pending);
+    memcpy (csoundfilter->block_scratch + pending, idata, in_bytes - pending);
+    gst_adapter_clear (csoundfilter->in_adapter);
+    if (take_events)
+      info->events = gst_csound_event_queue_take (&csoundfilter->events,
+          gst_csoundfilter_block_end (info, 0));
+    csoundfilter->process (csoundfilter, csoundfilter->block_scratch, odata, 1,
+        info);
+    gst_csound_events_free (info->events);
+    info->events = NULL;
+    if (info->controls)
+      info->controls += csoundfilter->channels->len;
+    if (GST_CLOCK_TIME_IS_VALID (info->start))
+      info->start += info->interval;
+    odata += out_bytes;
+    offset = in_bytes - pending;
+    max_blocks--;
+    done++;
+    pending = 0;
+  }
+
+  /* read the remaining whole blocks straight from the mapped input */
+  if (pending == 0) {
+    blocks = MIN ((isize - offset) / in_bytes, max_blocks);
+    if (take_events && blocks > 0)
+      info->events = gst_csound_event_queue_take (&csoundfilter->events,
+          gst_csoundfilter_block_end (info, blocks - 1));
+    csoundfilter->process (csoundfilter, idata + offset, odata, blocks,
+        info);
+    gst_csound_events_free (info->events);
+    info->events = NULL;
+    offset += (gsize) blocks * in_bytes;
+    done += blocks;
+  }
+
+  gst_buffer_unmap (outbuf, &omap);
+  if (inbuf != outbuf)
+    gst_buffer_unmap (inbuf, &imap);
+
+  /* only the leftover frames go through the adapter */
+  if (offset < isize)
+    gst_adapter_push (csoundfilter->in_adapter,
+        gst_buffer_copy_region (inbuf, GST_BUFFER_COPY_MEMORY, offset,
+            isize - offset));
+
+  return done;
+}
+
+/* planar input: the frames go from the input planes into spin and from
+ * spout into the output planes in the ksmps loop, the frames short of a
+ * block wait in spin for the next buffer. Only runs with the single
+ * synchronous instance.
+ * Returns: the blocks processed */
+static guint
+gst_csoundfilter_process_planar (GstCsoundfilter * csoundfilter,
+    GstBuffer * inbuf, GstBuffer * outbuf, GstCsoundfilterBlocks * info,
+    gboolean take_events)
+{
+  GstAudioBuffer in, out;
+  gpointer *in_planes;
+  guint ksmps = csoundfilter->ksmps;
+  guint ich = csoundfilter->cs_ichannels;
+  guint och = csoundfilter->cs_ochannels;
+  guint n_controls = csoundfilter->channels->len;
+  GstCsoundEvent *events;
+  GstClockTime began;
+  gsize frames, offset = 0;
+  guint blocks, max_blocks, done = 0;
+
+  if (!gst_audio_buffer_map (&out, &csoundfilter->out_info, outbuf,
+          inbuf == outbuf ? GST_MAP_READWRITE : GST_MAP_WRITE))
+    return 0;
+  if (inbuf == outbuf) {
+    in_planes = out.planes;
+    frames = GST_AUDIO_BUFFER_N_SAMPLES (&out);
+  } else {
+    if (!gst_audio_buffer_map (&in, &csoundfilter->in_info, inbuf,
+            GST_MAP_READ)) {
+      gst_audio_buffer_unmap (&out);
+      return 0;
+    }
+    in_planes = in.planes;
+    frames = GST_AUDIO_BUFFER_N_SAMPLES (&in);
+  }
+
+  max_blocks = GST_AUDIO_BUFFER_N_SAMPLES (&out) / ksmps;
+  blocks = MIN ((csoundfilter->spin_frames + frames) / ksmps, max_blocks);
+  if (take_events && blocks > 0)
+    info->events = gst_csound_event_queue_take (&csoundfilter->events,
+        gst_csoundfilter_block_end (info, blocks - 1));
+  events = info->events;
+
+  /* in place the input of a block is in spin before its output lands */
+  while (offset < frames) {
+    guint fill = csoundfilter->spin_frames;
+    guint n = MIN (frames - offset, ksmps - fill);
+
+    if (fill + n == ksmps && done == max_blocks)
+      break;
+    gst_csound_convert_in_planar (&csoundfilter->in_convert,
+        csoundfilter->spin + fill * ich, in_planes, offset, ich, n);
+    offset += n;
+    csoundfilter->spin_frames = fill + n;
+    if (csoundfilter->spin_frames < ksmps)
+      break;
+
+    gst_csound_convert_out_planar (&csoundfilter->out_convert, out.planes,
+        (gsize) done * ksmps, csoundfilter->spout, och, ksmps);
+    if (info->analysis)
+      gst_csound_analysis_sample (info->analysis, done * ksmps);
+    if (info->controls)
+      gst_csound_channels_apply (csoundfilter->ctl_ptrs,
+          info->controls + done * n_controls, n_controls);
+    if (events)
+      events = gst_csound_events_play (events, csoundfilter->csound,
+          gst_csoundfilter_block_end (info, done));
+    if (info->side_pads)
+      gst_csound_side_pads_fill (info->side_pads,
+          gst_csoundfilter_block_at (info, done));
+    began = gst_util_get_timestamp ();
+    gst_csound_swap_feed (csoundfilter->swap, csoundfilter->spin);
+    g_atomic_int_set (&csoundfilter->end_score,
+        csoundPerformKsmps (csoundfilter->csound));
+    gst_csound_swap_mix (csoundfilter->swap, csoundfilter->spout);
+    gst_csound_stats_add_block (&csoundfilter->stats,
+        gst_util_get_timestamp () - began);
+    csoundfilter->spin_frames = 0;
+    done++;
+  }
+  gst_csound_events_free (info->events);
+  info->events = NULL;
+
+  gst_audio_buffer_unmap (&out);
+  if (inbuf != outbuf)
+    gst_audio_buffer_unmap (&in);
+
+  return done;
+}
+
+/* planar input short of a block only goes into spin */
+static void
+gst_csoundfilter_stash_planar (GstCsoundfilter * csoundfilter,
+    GstBuffer * inbuf)
+{
+  GstAudioBuffer in;
+
+  if (!gst_audio_buffer_map (&in, &csoundfilter->in_info, inbuf,
+          GST_MAP_READ))
+    return;
+  gst_csound_convert_in_planar (&csoundfilter->in_convert,
+      csoundfilter->spin + csoundfilter->spin_frames *
+      csoundfilter->cs_ichannels, in.planes, 0, csoundfilter->cs_ichannels,
+      GST_AUDIO_BUFFER_N_SAMPLES (&in));
+  csoundfilter->spin_frames += GST_AUDIO_BUFFER_N_SAMPLES (&in);
+  gst_audio_buffer_unmap (&in);
+}
+
+/* put @csound in place of the running instance, between two buffers,
+ * and bind everything that points into it */
+static void
+gst_csoundfilter_swap_in (GstCsoundfilter * csoundfilter, CSOUND * csound)
+{
+  GPtrArray *new_channels;
+  MYFLT **ctl_ptrs;
+  gchar *channels;
+  guint64 blocks;
+
+  if (csoundfilter->process != gst_csoundfilter_trans) {
+    GST_ELEMENT_WARNING (csoundfilter, CORE, NEGOTIATION, (NULL),
+        ("the orchestra is only swapped with a single synchronous "
+            "instance, the new one runs from the next start"));
+    gst_csound_instance_release (csound);
+    return;
+  }
+
+  new_channels = gst_csound_channels_update (csoundfilter->channels, csound,
+      GST_OBJECT (csoundfilter));
+  ctl_ptrs = g_new0 (MYFLT *, new_channels->len);
+  if (!gst_csound_channels_bind (new_channels, csound, ctl_ptrs)) {
+    GST_ELEMENT_WARNING (csoundfilter, CORE, FAILED, (NULL),
+        ("the control channels of the new orchestra do not bind, the "
+            "running one stays"));
+    gst_csound_channels_discard (new_channels);
+    g_free (ctl_ptrs);
+    gst_csound_instance_release (csound);
+    return;
+  }
+
+  blocks = gst_util_uint64_scale_int_ceil (csoundfilter->crossfade,
+      csoundfilter->rate, GST_SECOND);
+  blocks = (blocks + csoundfilter->ksmps - 1) / csoundfilter->ksmps;
+  if (!gst_csound_swap_begin (csoundfilter->swap, csoundfilter->csound,
+          csound, (guint) MIN (blocks, G_MAXUINT))) {
+    gst_csound_channels_discard (new_channels);
+    g_free (ctl_ptrs);
+    return;
+  }
+
+  csoundfilter->csound = csound;
+  csoundfilter->spin = csoundGetSpin (csound);
+  csoundfilter->spout = csoundGetSpout (csound);
+  g_atomic_int_set (&csoundfilter->end_score, 0);
+
+  gst_csoundfilter_set_channels (csoundfilter, new_channels);
+  g_free (csoundfilter->ctl_ptrs);
+  csoundfilter->ctl_ptrs = ctl_ptrs;
+  gst_csound_side_pads_bind (GST_ELEMENT (csoundfilter),
+      &csoundfilter->side_pads, csound);
+  GST_OBJECT_LOCK (csoundfilter);
+  channels = g_strdup (csoundfilter->analysis_channels);
+  GST_OBJECT_UNLOCK (csoundfilter);
+  gst_csound_analysis_setup (&csoundfilter->analysis, channels, csound,
+      GST_ELEMENT (csoundfilter));
+  g_free (channels);
+}
+
 /* transform */
 static GstFlowReturn
 gst_csoundfilter_transform (GstBaseTransform * trans, GstBuffer * inbuf,
@@ -404,84 +1609,990 @@ gst_csoundfilter_transform (GstBaseTransform * trans, GstBuffer * inbuf,
 {
   GstCsoundfilter *csoundfilter = GST_CSOUNDFILTER (trans);
 
-  GstClockTime timestamp, stream_time;
-  GstMapInfo omap;
-  gst_buffer_map(outbuf, &omap, GST_MAP_WRITE);
-  gst_adapter_push (csoundfilter->in_adapter, inbuf);
-  guint in_bytes = csoundfilter->ksmps * csoundfilter->cs_ichannels * sizeof(MYFLT);
-  guint out_bytes = csoundfilter->ksmps * csoundfilter->cs_ochannels * sizeof(MYFLT);
-  gst_buffer_ref(inbuf);
+  GstClockTime timestamp, stream_time, running_time;
+  gsize pending;
+  guint max_blocks;
+  GstCsoundfilterBlocks info =
+      { NULL, NULL, GST_CLOCK_TIME_NONE, 0, NULL, NULL };
+  /* in async mode the events are taken block by block as they are queued */
+  gboolean take_events = csoundfilter->process != gst_csoundfilter_trans_async;
+  GstClockTime began = gst_util_get_timestamp (), first;
+  guint done;
+
   timestamp = GST_BUFFER_TIMESTAMP (inbuf);
 
+  if (!gst_csound_swap_fading (csoundfilter->swap)) {
+    CSOUND *csound = gst_csound_swap_take (csoundfilter->swap);
+
+    if (csound)
+      gst_csoundfilter_swap_in (csoundfilter, csound);
+  }
+
   GST_DEBUG_OBJECT (csoundfilter, "sync to %" GST_TIME_FORMAT,
       GST_TIME_ARGS (timestamp));
 
   stream_time = gst_segment_to_stream_time (&trans->segment, GST_FORMAT_TIME, timestamp);
+  running_time = gst_segment_to_running_time (&trans->segment, GST_FORMAT_TIME,
+      timestamp);
   
   if (GST_CLOCK_TIME_IS_VALID (stream_time))
     gst_object_sync_values (GST_OBJECT (csoundfilter), stream_time);
 
-  csoundfilter->process (csoundfilter, omap.data, in_bytes, out_bytes);
-  gst_buffer_unmap(outbuf, &omap);
-
-  if (csoundfilter->end_score){
-    GST_DEBUG_OBJECT (csoundfilter, "reached the end of the csound score - looking for loop property %d", csoundfilter->end_score);
+  max_blocks = gst_buffer_get_size (outbuf) / csoundfilter->out_block_size;
+  pending = gst_csoundfilter_pending (csoundfilter);
+
+  info.interval = gst_util_uint64_scale_int (csoundfilter->ksmps, GST_SECOND,
+      csoundfilter->rate);
+  info.start = gst_csoundfilter_block_start (csoundfilter, running_time,
+      pending);
+  if (csoundfilter->channels->len > 0)
+    info.controls = gst_csoundfilter_prepare_controls (csoundfilter,
+        gst_csoundfilter_block_start (csoundfilter, stream_time, pending),
+        info.interval, max_blocks);
+  first = info.start;
+  if (csoundfilter->process == gst_csoundfilter_trans)
+    info.side_pads = gst_csound_side_pads_ref (GST_ELEMENT (csoundfilter),
+        &csoundfilter->side_pads);
+  if (csoundfilter->analysis.n_channels > 0
+      && csoundfilter->process != gst_csoundfilter_trans_async)
+    info.analysis = &csoundfilter->analysis;
+
+  if (csoundfilter->planar)
+    done = gst_csoundfilter_process_planar (csoundfilter, inbuf, outbuf,
+        &info, take_events);
+  else
+    done = gst_csoundfilter_process_interleaved (csoundfilter, inbuf, outbuf,
+        &info, take_events);
+  g_list_free_full (info.side_pads, gst_object_unref);
+  if (info.analysis)
+    gst_csound_analysis_attach (info.analysis, outbuf);
+
+  gst_csoundfilter_buffer_stats (csoundfilter, began, first, done,
+      info.interval);
+
+  /* without loop, this buffer is still pushed and generate_output()
+   * returns EOS on the next call. The engine thread rewinds by itself */
+  if (g_atomic_int_get (&csoundfilter->end_score)
+      && csoundfilter->engine_thread == NULL){
+    GST_DEBUG_OBJECT (csoundfilter, "reached the end of the csound score - looking for loop property %d", csoundfilter->loop);
     if(csoundfilter->loop){
-      csoundSetScoreOffsetSeconds(csoundfilter->csound, 0.0);
-      csoundRewindScore(csoundfilter->csound);
-    }else{
-      GST_DEBUG_OBJECT (csoundfilter, "End of the csound score - sending a eos");
-      return GST_FLOW_EOS;
+      gst_csoundfilter_rewind_instances (csoundfilter);
     }
   }
 
   return GST_FLOW_OK;
 }
 
+/* timestamps follow the input timeline, counted in output samples */
 static void
-gst_csoundfilter_trans (GstCsoundfilter * csoundfilter,
-    MYFLT * odata, guint in_bytes, guint out_bytes)
+gst_csoundfilter_stamp_buffer (GstCsoundfilter * csoundfilter,
+    GstBuffer * buffer, guint64 frames)
 {
-  gsize offset = 0;
-  while( gst_adapter_available_fast(csoundfilter->in_adapter) >= (in_bytes + offset ) ) {
-    gst_adapter_copy(csoundfilter->in_adapter, csoundfilter->spin, offset, in_bytes);
-    memmove (odata, csoundfilter->spout, out_bytes);
-    offset += in_bytes;
-    csoundfilter->end_score = csoundPerformKsmps (csoundfilter->csound);
-    odata += csoundfilter->ksmps * csoundfilter->cs_ochannels;
+  if (GST_CLOCK_TIME_IS_VALID (csoundfilter->ts_base)) {
+    GstClockTime start, end;
+
+    start = csoundfilter->ts_base + gst_util_uint64_scale_int (
+        csoundfilter->samples_out, GST_SECOND, csoundfilter->rate);
+    end = csoundfilter->ts_base + gst_util_uint64_scale_int (
+        csoundfilter->samples_out + frames, GST_SECOND, csoundfilter->rate);
+    GST_BUFFER_PTS (buffer) = start;
+    GST_BUFFER_DURATION (buffer) = end - start;
+  } else {
+    GST_BUFFER_PTS (buffer) = GST_CLOCK_TIME_NONE;
+    GST_BUFFER_DURATION (buffer) = GST_CLOCK_TIME_NONE;
   }
-  gst_adapter_flush (csoundfilter->in_adapter, offset);
-  
+  GST_BUFFER_DTS (buffer) = GST_CLOCK_TIME_NONE;
+  GST_BUFFER_OFFSET (buffer) = csoundfilter->out_offset;
+  GST_BUFFER_OFFSET_END (buffer) = csoundfilter->out_offset + frames;
+
+  if (csoundfilter->discont) {
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
+    csoundfilter->discont = FALSE;
+  } else {
+    GST_BUFFER_FLAG_UNSET (buffer, GST_BUFFER_FLAG_DISCONT);
+  }
+
+  csoundfilter->samples_out += frames;
+  csoundfilter->out_offset += frames;
+}
+
+static GstFlowReturn
+gst_csoundfilter_generate_output (GstBaseTransform * trans, GstBuffer ** outbuf)
+{
+  GstCsoundfilter *csoundfilter = GST_CSOUNDFILTER (trans);
+  GstBaseTransformClass *klass = GST_BASE_TRANSFORM_GET_CLASS (trans);
+  GstBuffer *inbuf = trans->queued_buf;
+  GstAudioMeta *meta;
+  GstFlowReturn ret;
+  gsize pending, in_size;
+  guint in_bpf, out_bpf;
+
+  *outbuf = NULL;
+  trans->queued_buf = NULL;
+
+  if (g_atomic_int_get (&csoundfilter->end_score) && !csoundfilter->loop) {
+    GST_DEBUG_OBJECT (csoundfilter, "End of the csound score - sending a eos");
+    if (inbuf)
+      gst_buffer_unref (inbuf);
+    return GST_FLOW_EOS;
+  }
+
+  if (inbuf == NULL)
+    return GST_FLOW_OK;
+
+  in_bpf = csoundfilter->in_block_size / csoundfilter->ksmps;
+  out_bpf = csoundfilter->out_block_size / csoundfilter->ksmps;
+  pending = gst_csoundfilter_pending (csoundfilter);
+  in_size = gst_csoundfilter_input_size (csoundfilter, inbuf);
+
+  /* frames waiting from before a gap would be glued to the audio after
+   * it in one block, drop them */
+  if (GST_BUFFER_IS_DISCONT (inbuf) && pending > 0) {
+    GST_DEBUG_OBJECT (csoundfilter, "discont, dropping %" G_GSIZE_FORMAT
+        " pending bytes", pending);
+    gst_csoundfilter_clear_pending (csoundfilter);
+    pending = 0;
+  }
+
+  /* anchor the sample counter on the first sample still waiting */
+  if (GST_BUFFER_PTS_IS_VALID (inbuf) && (GST_BUFFER_IS_DISCONT (inbuf)
+          || !GST_CLOCK_TIME_IS_VALID (csoundfilter->ts_base))) {
+    GstClockTime pending_time = gst_util_uint64_scale_int (pending / in_bpf,
+        GST_SECOND, csoundfilter->rate);
+
+    if (GST_BUFFER_PTS (inbuf) > pending_time)
+      csoundfilter->ts_base = GST_BUFFER_PTS (inbuf) - pending_time;
+    else
+      csoundfilter->ts_base = 0;
+    csoundfilter->samples_out = 0;
+    csoundfilter->discont = TRUE;
+  }
+
+  if (in_size % csoundfilter->in_block_size != 0
+      && !csoundfilter->unaligned_input) {
+    GST_DEBUG_OBJECT (csoundfilter, "input is not ksmps aligned, "
+        "frames wait in the adapter");
+    csoundfilter->unaligned_input = TRUE;
+    gst_element_post_message (GST_ELEMENT (csoundfilter),
+        gst_message_new_latency (GST_OBJECT (csoundfilter)));
+  }
+
+  if (pending + in_size < csoundfilter->in_block_size) {
+    if (csoundfilter->planar) {
+      gst_csoundfilter_stash_planar (csoundfilter, inbuf);
+      gst_buffer_unref (inbuf);
+    } else {
+      gst_adapter_push (csoundfilter->in_adapter, inbuf);
+    }
+    return GST_FLOW_OK;
+  }
+
+  ret = klass->prepare_output_buffer (trans, inbuf, outbuf);
+  if (ret != GST_FLOW_OK) {
+    gst_buffer_unref (inbuf);
+    return ret;
+  }
+
+  ret = klass->transform (trans, inbuf, *outbuf);
+  if (*outbuf != inbuf)
+    gst_buffer_unref (inbuf);
+  if (ret != GST_FLOW_OK) {
+    gst_buffer_unref (*outbuf);
+    *outbuf = NULL;
+    return ret;
+  }
+
+  /* planes in place may be apart, the meta has the frames */
+  meta = gst_buffer_get_audio_meta (*outbuf);
+  gst_csoundfilter_stamp_buffer (csoundfilter, *outbuf,
+      meta ? meta->samples : gst_buffer_get_size (*outbuf) / out_bpf);
+
+  ret = gst_csound_out_pads_push (GST_ELEMENT (csoundfilter),
+      &csoundfilter->out_pads, *outbuf, &csoundfilter->out_info,
+      &trans->segment);
+  if (ret != GST_FLOW_OK)
+    gst_buffer_replace (outbuf, NULL);
+
+  return ret;
 }
 
+/* at EOS the frames waiting for a block to complete are padded with
+ * silence and performed like any other block. Output lags by a block,
+ * as many frames as were waiting go out from the block that follows the
+ * last buffer pushed. In async mode the blocks still queued for the
+ * engine thread follow, the whole out ring */
+static GstFlowReturn
+gst_csoundfilter_drain (GstCsoundfilter * csoundfilter)
+{
+  GstBuffer *outbuf;
+  GstMapInfo map;
+  GstFlowReturn ret;
+  gboolean async = csoundfilter->engine_thread != NULL;
+  guint8 *out;
+  gsize pending;
+  guint frames, blocks;
+
+  pending = gst_csoundfilter_pending (csoundfilter);
+  if ((pending == 0 && !async)
+      || g_atomic_int_get (&csoundfilter->end_score)) {
+    gst_csoundfilter_clear_pending (csoundfilter);
+    return GST_FLOW_OK;
+  }
+
+  frames = pending / (csoundfilter->in_block_size / csoundfilter->ksmps);
+  blocks = pending > 0 ? 1 : 0;
+  if (async) {
+    frames += csoundfilter->async_depth * csoundfilter->ksmps;
+    blocks += csoundfilter->async_depth;
+  }
+  outbuf = gst_csound_buffer_new_allocate ((gsize) blocks *
+      csoundfilter->out_block_size);
+  gst_buffer_map (outbuf, &map, GST_MAP_WRITE);
+  out = map.data;
+  if (pending == 0) {
+    /* only the out ring to drain */
+  } else if (csoundfilter->planar) {
+    gpointer *planes = g_newa (gpointer, csoundfilter->cs_ochannels);
+    gsize plane = frames * csoundfilter->out_convert.sample_size;
+    guint fill = csoundfilter->spin_frames;
+    guint c;
+
+    /* packed planes of the frames pushed */
+    for (c = 0; c < csoundfilter->cs_ochannels; c++)
+      planes[c] = map.data + c * plane;
+    gst_csound_convert_out_planar (&csoundfilter->out_convert, planes, 0,
+        csoundfilter->spout, csoundfilter->cs_ochannels, frames);
+    memset (csoundfilter->spin + fill * csoundfilter->cs_ichannels, 0,
+        sizeof (MYFLT) * (csoundfilter->ksmps - fill) *
+        csoundfilter->cs_ichannels);
+    gst_csound_swap_feed (csoundfilter->swap, csoundfilter->spin);
+    g_atomic_int_set (&csoundfilter->end_score,
+        csoundPerformKsmps (csoundfilter->csound));
+    gst_csound_swap_mix (csoundfilter->swap, csoundfilter->spout);
+  } else {
+    GstCsoundfilterBlocks info =
+        { NULL, NULL, GST_CLOCK_TIME_NONE, 0, NULL, NULL };
+
+    gst_adapter_copy (csoundfilter->in_adapter, csoundfilter->block_scratch,
+        0, pending);
+    gst_audio_format_fill_silence (csoundfilter->in_info.finfo,
+        csoundfilter->block_scratch + pending,
+        csoundfilter->in_block_size - pending);
+    csoundfilter->process (csoundfilter, csoundfilter->block_scratch, out, 1,
+        &info);
+    out += csoundfilter->out_block_size;
+  }
+
+  /* every block the engine thread still owes, the last one cut to the
+   * frames that were waiting */
+  for (; async && out < map.data + map.size;
+      out += csoundfilter->out_block_size) {
+    gconstpointer slot;
+
+    while (!(slot = gst_csound_ring_read_slot (csoundfilter->out_ring)))
+      if (!gst_csound_ring_wait_readable (csoundfilter->out_ring))
+        break;
+    if (slot == NULL) {
+      memset (out, 0, map.data + map.size - out);
+      break;
+    }
+    memcpy (out, slot, csoundfilter->out_block_size);
+    gst_csound_ring_read_commit (csoundfilter->out_ring);
+  }
+  gst_buffer_unmap (outbuf, &map);
+  gst_csoundfilter_clear_pending (csoundfilter);
+
+  gst_buffer_set_size (outbuf,
+      frames * (csoundfilter->out_block_size / csoundfilter->ksmps));
+  gst_csoundfilter_add_audio_meta (csoundfilter, outbuf);
+  gst_csoundfilter_stamp_buffer (csoundfilter, outbuf, frames);
+  GST_DEBUG_OBJECT (csoundfilter, "draining %u frames", frames);
+
+  /* the out pads only read the buffer, the src pad takes it */
+  ret = gst_csound_out_pads_push (GST_ELEMENT (csoundfilter),
+      &csoundfilter->out_pads, outbuf, &csoundfilter->out_info,
+      &GST_BASE_TRANSFORM (csoundfilter)->segment);
+  if (ret != GST_FLOW_OK) {
+    gst_buffer_unref (outbuf);
+    return ret;
+  }
+
+  return gst_pad_push (GST_BASE_TRANSFORM_SRC_PAD (csoundfilter), outbuf);
+}
+
+/* every instance back to the start of its score, they all run the same
+ * one in step */
 static void
-gst_csoundfilter_messages (CSOUND * csound, int attr, const char *format, va_list valist)
+gst_csoundfilter_rewind_instances (GstCsoundfilter * csoundfilter)
+{
+  guint i;
+
+  gst_csound_instance_rewind (csoundfilter->csound);
+  for (i = 0; i < csoundfilter->n_workers; i++) {
+    gst_csound_instance_rewind (csoundfilter->workers[i].csound);
+    csoundfilter->workers[i].end_score = 0;
+  }
+  g_atomic_int_set (&csoundfilter->end_score, 0);
+}
+
+/* back to the start of the score with silent buffers and nothing
+ * pending, the compiled orchestra is kept. Runs on the streaming thread
+ * with the workers idle */
+static void
+gst_csoundfilter_reset (GstCsoundfilter * csoundfilter)
+{
+  gboolean async = csoundfilter->engine_thread != NULL;
+
+  if (async)
+    gst_csoundfilter_stop_engine (csoundfilter);
+
+  gst_csoundfilter_clear_pending (csoundfilter);
+  gst_csound_event_queue_clear (&csoundfilter->events);
+  gst_csoundfilter_rewind_instances (csoundfilter);
+  csoundfilter->ts_base = GST_CLOCK_TIME_NONE;
+  csoundfilter->samples_out = 0;
+  csoundfilter->discont = TRUE;
+  /* the counters go on, the drift is measured from the new start */
+  csoundfilter->stats.drift_base = GST_CLOCK_TIME_NONE;
+
+  if (async)
+    gst_csoundfilter_start_engine (csoundfilter);
+}
+
+static gboolean
+gst_csoundfilter_sink_event (GstBaseTransform * trans, GstEvent * event)
 {
-  char **result = NULL;
-  vasprintf (&result, format, valist);
-  switch (attr) {
-    case CSOUNDMSG_ERROR:
-      GST_WARNING (result);
+  GstCsoundfilter *csoundfilter = GST_CSOUNDFILTER (trans);
+  GstFlowReturn ret;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_EOS:
+      ret = gst_csoundfilter_drain (csoundfilter);
+      /* the eos still goes downstream, after the error */
+      if (ret == GST_FLOW_NOT_LINKED || ret < GST_FLOW_EOS)
+        GST_ELEMENT_FLOW_ERROR (csoundfilter, ret);
+      break;
+    case GST_EVENT_FLUSH_START:
+      /* a block waiting on a side pad gives up */
+      gst_csound_side_pads_interrupt (GST_ELEMENT (csoundfilter),
+          &csoundfilter->side_pads, TRUE);
       break;
-    case CSOUNDMSG_WARNING:
-      GST_WARNING (result);
+    case GST_EVENT_FLUSH_STOP:
+      gst_csound_side_pads_interrupt (GST_ELEMENT (csoundfilter),
+          &csoundfilter->side_pads, FALSE);
+      /* fall through */
+    case GST_EVENT_STREAM_START:
+      GST_DEBUG_OBJECT (csoundfilter, "%s, rewinding the score",
+          GST_EVENT_TYPE_NAME (event));
+      gst_csoundfilter_reset (csoundfilter);
       break;
-    case CSOUNDMSG_ORCH:
-      GST_INFO (result);
+    default:
       break;
-    case CSOUNDMSG_REALTIME:
-      GST_LOG (result);
+  }
+
+  /* the out pads follow the src pad, with their own stream and caps */
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_EOS:
+    case GST_EVENT_FLUSH_START:
+    case GST_EVENT_FLUSH_STOP:
+      gst_csound_out_pads_push_event (GST_ELEMENT (csoundfilter),
+          &csoundfilter->out_pads, gst_event_ref (event));
       break;
-    case CSOUNDMSG_DEFAULT:
-      GST_LOG (result);
+    case GST_EVENT_SEGMENT:
+      gst_csound_out_pads_new_segment (GST_ELEMENT (csoundfilter),
+          &csoundfilter->out_pads);
       break;
     default:
-      GST_LOG (result);
       break;
   }
-  g_free (result);
+
+  return GST_BASE_TRANSFORM_CLASS (gst_csoundfilter_parent_class)->sink_event
+      (trans, event);
+}
+
+static GstPad *
+gst_csoundfilter_request_new_pad (GstElement * element, GstPadTemplate * templ,
+    const gchar * name, const GstCaps * caps)
+{
+  GstCsoundfilter *csoundfilter = GST_CSOUNDFILTER (element);
+
+  if (GST_PAD_TEMPLATE_DIRECTION (templ) == GST_PAD_SRC)
+    return gst_csound_out_pad_request (element, &csoundfilter->out_pads,
+        templ, name);
+
+  if (csoundfilter->instances > 1 || csoundfilter->async_depth > 0) {
+    GST_WARNING_OBJECT (csoundfilter, "side pads need a single synchronous "
+        "instance");
+    return NULL;
+  }
+  return gst_csound_side_pad_request (element, &csoundfilter->side_pads,
+      templ, name, csoundfilter->csound);
+}
+
+static void
+gst_csoundfilter_release_pad (GstElement * element, GstPad * pad)
+{
+  GstCsoundfilter *csoundfilter = GST_CSOUNDFILTER (element);
+
+  if (GST_PAD_DIRECTION (pad) == GST_PAD_SRC)
+    gst_csound_out_pad_release (element, &csoundfilter->out_pads, pad);
+  else
+    gst_csound_side_pad_release (element, &csoundfilter->side_pads, pad);
+}
+
+static GstStateChangeReturn
+gst_csoundfilter_change_state (GstElement * element, GstStateChange transition)
+{
+  GstCsoundfilter *csoundfilter = GST_CSOUNDFILTER (element);
+
+  /* the streaming thread may wait on a side pad, let it go before the
+   * sink pad deactivates and takes the stream lock */
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      gst_csound_side_pads_interrupt (element, &csoundfilter->side_pads,
+          FALSE);
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_csound_side_pads_interrupt (element, &csoundfilter->side_pads,
+          TRUE);
+      break;
+    default:
+      break;
+  }
+
+  return GST_ELEMENT_CLASS (gst_csoundfilter_parent_class)->change_state
+      (element, transition);
+}
+
+/* one ksmps block of delay from spout, plus the frames that may wait in
+ * the adapter or spin for a block to complete when the input is not
+ * aligned, plus the blocks queued for the engine thread in async mode */
+static GstClockTime
+gst_csoundfilter_get_latency (GstCsoundfilter * csoundfilter)
+{
+  guint frames;
+
+  if (csoundfilter->rate <= 0)
+    return 0;
+
+  frames = csoundfilter->ksmps;
+  if (csoundfilter->unaligned_input)
+    frames += csoundfilter->ksmps - 1;
+  if (csoundfilter->process == gst_csoundfilter_trans_async)
+    frames += csoundfilter->async_depth * csoundfilter->ksmps;
+
+  return gst_util_uint64_scale_int (frames, GST_SECOND, csoundfilter->rate);
+}
+
+static gboolean
+gst_csoundfilter_query (GstBaseTransform * trans, GstPadDirection direction,
+    GstQuery * query)
+{
+  GstCsoundfilter *csoundfilter = GST_CSOUNDFILTER (trans);
+  gboolean res;
+
+  res = GST_BASE_TRANSFORM_CLASS (gst_csoundfilter_parent_class)->query (trans,
+      direction, query);
+
+  if (res && direction == GST_PAD_SRC
+      && GST_QUERY_TYPE (query) == GST_QUERY_LATENCY) {
+    gboolean live;
+    GstClockTime min, max, latency;
+
+    gst_query_parse_latency (query, &live, &min, &max);
+    latency = gst_csoundfilter_get_latency (csoundfilter);
+    GST_DEBUG_OBJECT (csoundfilter, "our latency: %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (latency));
+    min += latency;
+    if (GST_CLOCK_TIME_IS_VALID (max))
+      max += latency;
+    gst_query_set_latency (query, live, min, max);
+  }
+
+  return res;
+}
+
+static void
+gst_csoundfilter_trans (GstCsoundfilter * csoundfilter,
+    gconstpointer idata, gpointer odata, guint blocks,
+    const GstCsoundfilterBlocks * info)
+{
+  const guint8 *in = idata;
+  guint8 *out = odata;
+  guint in_samples = csoundfilter->ksmps * csoundfilter->cs_ichannels;
+  guint out_samples = csoundfilter->ksmps * csoundfilter->cs_ochannels;
+  guint n_controls = csoundfilter->channels->len;
+  GstCsoundEvent *events = info->events;
+  GstClockTime began;
+  guint i;
+
+  /* idata and odata may alias when running in place, spin is filled
+   * before spout is written back over the same block */
+  for (i = 0; i < blocks; i++) {
+    gst_csound_convert_in (&csoundfilter->in_convert, csoundfilter->spin,
+        in, in_samples);
+    gst_csound_convert_out (&csoundfilter->out_convert, out,
+        csoundfilter->spout, out_samples);
+    /* spout and the channels are both from the block before */
+    if (info->analysis)
+      gst_csound_analysis_sample (info->analysis,
+          info->analysis->n_blocks * csoundfilter->ksmps);
+    if (info->controls)
+      gst_csound_channels_apply (csoundfilter->ctl_ptrs,
+          info->controls + i * n_controls, n_controls);
+    if (events)
+      events = gst_csound_events_play (events, csoundfilter->csound,
+          gst_csoundfilter_block_end (info, i));
+    if (info->side_pads)
+      gst_csound_side_pads_fill (info->side_pads,
+          gst_csoundfilter_block_at (info, i));
+    began = gst_util_get_timestamp ();
+    gst_csound_swap_feed (csoundfilter->swap, csoundfilter->spin);
+    g_atomic_int_set (&csoundfilter->end_score,
+        csoundPerformKsmps (csoundfilter->csound));
+    gst_csound_swap_mix (csoundfilter->swap, csoundfilter->spout);
+    gst_csound_stats_add_block (&csoundfilter->stats,
+        gst_util_get_timestamp () - began);
+    in += csoundfilter->in_block_size;
+    out += csoundfilter->out_block_size;
+  }
+}
+
+/* interleave @frames frames of @spout into the channels of @group */
+static void
+gst_csoundfilter_group_out (GstCsoundfilter * csoundfilter, const MYFLT * spout,
+    guint group, guint8 * out, guint frames)
+{
+  guint och = csoundfilter->cs_ochannels;
+  guint stride = csoundfilter->out_block_size / csoundfilter->ksmps;
+  guint f;
+
+  out += group * och * csoundfilter->out_convert.sample_size;
+  for (f = 0; f < frames; f++) {
+    gst_csound_convert_out (&csoundfilter->out_convert, out, spout, och);
+    spout += och;
+    out += stride;
+  }
+}
+
+/* run one instance over its own channels of @blocks ksmps blocks, called
+ * concurrently for every group, each one only touches its channels */
+static gint
+gst_csoundfilter_process_group (GstCsoundfilter * csoundfilter,
+    CSOUND * csound, MYFLT * spin, const MYFLT * spout, MYFLT ** ctl_ptrs,
+    GstCsoundStats * stats, guint group, const guint8 * in, guint8 * out,
+    guint blocks, const GstCsoundfilterBlocks * info)
+{
+  GstClockTime began;
+  guint n_controls = csoundfilter->channels->len;
+  GstCsoundEvent *events = info->events;
+  guint ich = csoundfilter->cs_ichannels;
+  guint ksmps = csoundfilter->ksmps;
+  guint in_stride = csoundfilter->in_block_size / ksmps;
+  gint end_score = 0;
+  guint b, f;
+
+  in += group * ich * csoundfilter->in_convert.sample_size;
+  for (b = 0; b < blocks; b++) {
+    for (f = 0; f < ksmps; f++) {
+      gst_csound_convert_in (&csoundfilter->in_convert, spin + f * ich, in, ich);
+      in += in_stride;
+    }
+    gst_csoundfilter_group_out (csoundfilter, spout, group, out, ksmps);
+    if (group == 0 && info->analysis)
+      gst_csound_analysis_sample (info->analysis,
+          info->analysis->n_blocks * ksmps);
+    if (info->controls)
+      gst_csound_channels_apply (ctl_ptrs, info->controls + b * n_controls,
+          n_controls);
+    if (events)
+      events = gst_csound_events_play (events, csound,
+          gst_csoundfilter_block_end (info, b));
+    began = gst_util_get_timestamp ();
+    end_score = csoundPerformKsmps (csound);
+    gst_csound_stats_add_block (stats, gst_util_get_timestamp () - began);
+    out += csoundfilter->out_block_size;
+  }
+
+  return end_score;
+}
+
+static gpointer
+gst_csoundfilter_worker_loop (gpointer data)
+{
+  GstCsoundfilterWorker *worker = data;
+  GstCsoundfilter *csoundfilter = worker->filter;
+  guint64 seen = 0;
+
+  g_mutex_lock (&csoundfilter->worker_lock);
+  for (;;) {
+    while (csoundfilter->job_seq == seen && !csoundfilter->workers_quit)
+      g_cond_wait (&csoundfilter->worker_cond, &csoundfilter->worker_lock);
+    if (csoundfilter->workers_quit)
+      break;
+    seen = csoundfilter->job_seq;
+    g_mutex_unlock (&csoundfilter->worker_lock);
+
+    worker->end_score = gst_csoundfilter_process_group (csoundfilter,
+        worker->csound, worker->spin, worker->spout, worker->ctl_ptrs,
+        &worker->stats, worker->group,
+        csoundfilter->job_in,
+        csoundfilter->job_out, csoundfilter->job_blocks,
+        csoundfilter->job_info);
+
+    g_mutex_lock (&csoundfilter->worker_lock);
+    if (++csoundfilter->jobs_done == csoundfilter->n_workers)
+      g_cond_signal (&csoundfilter->done_cond);
+  }
+  g_mutex_unlock (&csoundfilter->worker_lock);
+
+  return NULL;
+}
+
+/* hand the buffer to every worker, process group 0 here and wait for the
+ * others: one barrier per buffer, not per ksmps block */
+static void
+gst_csoundfilter_trans_parallel (GstCsoundfilter * csoundfilter,
+    gconstpointer idata, gpointer odata, guint blocks,
+    const GstCsoundfilterBlocks * info)
+{
+  gint end_score;
+  guint i;
+
+  if (blocks == 0)
+    return;
+
+  g_mutex_lock (&csoundfilter->worker_lock);
+  csoundfilter->job_in = idata;
+  csoundfilter->job_out = odata;
+  csoundfilter->job_blocks = blocks;
+  csoundfilter->job_info = info;
+  csoundfilter->jobs_done = 0;
+  csoundfilter->job_seq++;
+  g_cond_broadcast (&csoundfilter->worker_cond);
+  g_mutex_unlock (&csoundfilter->worker_lock);
+
+  end_score = gst_csoundfilter_process_group (csoundfilter,
+      csoundfilter->csound, csoundfilter->spin, csoundfilter->spout,
+      csoundfilter->ctl_ptrs, &csoundfilter->stats, 0, idata, odata, blocks,
+      info);
+
+  g_mutex_lock (&csoundfilter->worker_lock);
+  while (csoundfilter->jobs_done < csoundfilter->n_workers)
+    g_cond_wait (&csoundfilter->done_cond, &csoundfilter->worker_lock);
+  g_mutex_unlock (&csoundfilter->worker_lock);
+
+  /* the score ends when any group gets to its end */
+  for (i = 0; i < csoundfilter->n_workers; i++)
+    end_score |= csoundfilter->workers[i].end_score;
+  g_atomic_int_set (&csoundfilter->end_score, end_score);
+
+  /* the workers wait for the next job, their blocks can be collected */
+  for (i = 0; i < csoundfilter->n_workers; i++)
+    gst_csound_stats_merge (&csoundfilter->stats,
+        &csoundfilter->workers[i].stats);
+}
+
+static MYFLT *
+gst_csoundfilter_slot_controls (GstCsoundfilter * csoundfilter, gpointer slot)
+{
+  gsize offset = GST_ROUND_UP_8 (csoundfilter->in_block_size);
+
+  return (MYFLT *) ((guint8 *) slot + offset);
+}
+
+static GstCsoundEvent **
+gst_csoundfilter_slot_events (GstCsoundfilter * csoundfilter, gpointer slot)
+{
+  gsize offset = GST_ROUND_UP_8 (csoundfilter->in_block_size) +
+      GST_ROUND_UP_8 (csoundfilter->channels->len * sizeof (MYFLT));
+
+  return (GstCsoundEvent **) ((guint8 *) slot + offset);
+}
+
+/* the streaming thread side of async mode: every block pushed to the
+ * engine takes one out of the out ring, which starts async_depth blocks
+ * ahead, so the streaming thread only waits when the engine falls that
+ * far behind. idata and odata may alias, the input block is copied out
+ * before the output lands. The control values and the score events
+ * due in a block travel in its slot, after the samples */
+static void
+gst_csoundfilter_trans_async (GstCsoundfilter * csoundfilter,
+    gconstpointer idata, gpointer odata, guint blocks,
+    const GstCsoundfilterBlocks * info)
+{
+  const guint8 *in = idata;
+  guint8 *out = odata;
+  guint n_controls = csoundfilter->channels->len;
+  guint i;
+
+  for (i = 0; i < blocks; i++) {
+    gpointer slot;
+
+    while (!(slot = gst_csound_ring_write_slot (csoundfilter->in_ring)))
+      if (!gst_csound_ring_wait_writable (csoundfilter->in_ring))
+        return;
+    memcpy (slot, in, csoundfilter->in_block_size);
+    if (info->controls)
+      memcpy (gst_csoundfilter_slot_controls (csoundfilter, slot),
+          info->controls + i * n_controls, n_controls * sizeof (MYFLT));
+    *gst_csoundfilter_slot_events (csoundfilter, slot) =
+        gst_csound_event_queue_take (&csoundfilter->events,
+        gst_csoundfilter_block_end (info, i));
+    gst_csound_ring_write_commit (csoundfilter->in_ring);
+
+    while (!(slot = gst_csound_ring_read_slot (csoundfilter->out_ring))) {
+      GST_LOG_OBJECT (csoundfilter, "waiting for the engine thread");
+      if (!gst_csound_ring_wait_readable (csoundfilter->out_ring))
+        return;
+    }
+    memcpy (out, slot, csoundfilter->out_block_size);
+    gst_csound_ring_read_commit (csoundfilter->out_ring);
+
+    in += csoundfilter->in_block_size;
+    out += csoundfilter->out_block_size;
+  }
+}
+
+static gpointer
+gst_csoundfilter_engine_loop (gpointer data)
+{
+  GstCsoundfilter *csoundfilter = data;
+  GstCsoundRing *in_ring = csoundfilter->in_ring;
+  GstCsoundRing *out_ring = csoundfilter->out_ring;
+
+  for (;;) {
+    GstCsoundfilterBlocks info =
+      { NULL, NULL, GST_CLOCK_TIME_NONE, 0, NULL, NULL };
+    gpointer in, out;
+
+    while (!(in = gst_csound_ring_read_slot (in_ring)))
+      if (!gst_csound_ring_wait_readable (in_ring))
+        return NULL;
+    while (!(out = gst_csound_ring_write_slot (out_ring)))
+      if (!gst_csound_ring_wait_writable (out_ring))
+        return NULL;
+
+    /* the events of the slot are all due in this block */
+    if (csoundfilter->channels->len > 0)
+      info.controls = gst_csoundfilter_slot_controls (csoundfilter, in);
+    info.events = *gst_csoundfilter_slot_events (csoundfilter, in);
+    csoundfilter->engine_process (csoundfilter, in, out, 1, &info);
+    gst_csound_events_free (info.events);
+    gst_csound_ring_read_commit (in_ring);
+    gst_csound_ring_write_commit (out_ring);
+
+    if (g_atomic_int_get (&csoundfilter->end_score) && csoundfilter->loop)
+      gst_csoundfilter_rewind_instances (csoundfilter);
+
+    /* caught up with the streaming thread */
+    if (gst_csound_ring_fill (in_ring) == 0) {
+      csoundfilter->stats.late_buffers =
+          g_atomic_int_get (&csoundfilter->late_buffers);
+      gst_csound_stats_publish (&csoundfilter->stats_board,
+          &csoundfilter->stats, GST_ELEMENT (csoundfilter));
+    }
+  }
+
+  return NULL;
+}
+
+/* one slot more than the depth so neither side waits in steady state */
+static void
+gst_csoundfilter_start_engine (GstCsoundfilter * csoundfilter)
+{
+  guint i;
+
+  csoundfilter->in_ring = gst_csound_ring_new (csoundfilter->async_depth + 1,
+      GST_ROUND_UP_8 (csoundfilter->in_block_size) +
+      GST_ROUND_UP_8 (csoundfilter->channels->len * sizeof (MYFLT)) +
+      sizeof (GstCsoundEvent *));
+  csoundfilter->out_ring = gst_csound_ring_new (csoundfilter->async_depth + 1,
+      csoundfilter->out_block_size);
+
+  /* zeroed slots are silence in every supported format */
+  for (i = 0; i < csoundfilter->async_depth; i++) {
+    memset (gst_csound_ring_write_slot (csoundfilter->out_ring), 0,
+        csoundfilter->out_block_size);
+    gst_csound_ring_write_commit (csoundfilter->out_ring);
+  }
+
+  csoundfilter->engine_thread = g_thread_new ("csoundfilter-engine",
+      gst_csoundfilter_engine_loop, csoundfilter);
+}
+
+static void
+gst_csoundfilter_stop_engine (GstCsoundfilter * csoundfilter)
+{
+  if (csoundfilter->engine_thread == NULL)
+    return;
+
+  gst_csound_ring_set_flushing (csoundfilter->in_ring, TRUE);
+  gst_csound_ring_set_flushing (csoundfilter->out_ring, TRUE);
+  g_thread_join (csoundfilter->engine_thread);
+  csoundfilter->engine_thread = NULL;
+
+  /* events of the blocks the engine never got to */
+  for (;;) {
+    gpointer slot = gst_csound_ring_read_slot (csoundfilter->in_ring);
+
+    if (slot == NULL)
+      break;
+    gst_csound_events_free (*gst_csoundfilter_slot_events (csoundfilter,
+            slot));
+    gst_csound_ring_read_commit (csoundfilter->in_ring);
+  }
+
+  gst_csound_ring_free (csoundfilter->in_ring);
+  gst_csound_ring_free (csoundfilter->out_ring);
+  csoundfilter->in_ring = NULL;
+  csoundfilter->out_ring = NULL;
+}
+
+static CSOUND *
+gst_csoundfilter_new_instance (GstCsoundfilter * csoundfilter)
+{
+  CSOUND *csound;
+
+  csound = gst_csoundfilter_acquire (csoundfilter);
+  if (csound == NULL)
+    return NULL;
+
+  if (csoundGetKsmps (csound) != csoundfilter->ksmps) {
+    GST_ELEMENT_ERROR (csoundfilter, RESOURCE, SETTINGS, (NULL),
+        ("instances disagree on ksmps"));
+    gst_csound_instance_release (csound);
+    return NULL;
+  }
+
+  return csound;
+}
+
+static void
+gst_csoundfilter_stop_workers (GstCsoundfilter * csoundfilter)
+{
+  guint i;
+
+  if (csoundfilter->workers == NULL)
+    return;
+
+  g_mutex_lock (&csoundfilter->worker_lock);
+  csoundfilter->workers_quit = TRUE;
+  g_cond_broadcast (&csoundfilter->worker_cond);
+  g_mutex_unlock (&csoundfilter->worker_lock);
+
+  for (i = 0; i < csoundfilter->n_workers; i++) {
+    GstCsoundfilterWorker *worker = &csoundfilter->workers[i];
+
+    if (worker->thread)
+      g_thread_join (worker->thread);
+    gst_csound_instance_release (worker->csound);
+    g_free (worker->ctl_ptrs);
+  }
+
+  g_free (csoundfilter->workers);
+  csoundfilter->workers = NULL;
+  csoundfilter->n_workers = 0;
+}
+
+/* GstChildProxy, the children are the control channels */
+static GObject *
+gst_csoundfilter_child_proxy_get_child_by_index (GstChildProxy * child_proxy,
+    guint index)
+{
+  GstCsoundfilter *csoundfilter = GST_CSOUNDFILTER (child_proxy);
+  GObject *res = NULL;
+
+  GST_OBJECT_LOCK (csoundfilter);
+  if (csoundfilter->channels && index < csoundfilter->channels->len)
+    res = gst_object_ref (g_ptr_array_index (csoundfilter->channels, index));
+  GST_OBJECT_UNLOCK (csoundfilter);
+
+  return res;
+}
+
+static guint
+gst_csoundfilter_child_proxy_get_children_count (GstChildProxy * child_proxy)
+{
+  GstCsoundfilter *csoundfilter = GST_CSOUNDFILTER (child_proxy);
+  guint res;
+
+  GST_OBJECT_LOCK (csoundfilter);
+  res = csoundfilter->channels ? csoundfilter->channels->len : 0;
+  GST_OBJECT_UNLOCK (csoundfilter);
+
+  return res;
+}
+
+static void
+gst_csoundfilter_child_proxy_init (gpointer g_iface, gpointer iface_data)
+{
+  GstChildProxyInterface *iface = g_iface;
+
+  iface->get_child_by_index = gst_csoundfilter_child_proxy_get_child_by_index;
+  iface->get_children_count = gst_csoundfilter_child_proxy_get_children_count;
 }
 
 CSOUND *gst_csoundfilter_get_instance(GstCsoundfilter *csoundfilter){
     return csoundfilter->csound;
 }
+
+/**
+ * gst_csoundfilter_send_score_events:
+ * @csoundfilter: the element
+ * @type: the score statement, 'i', 'f', 'e', ...
+ * @running_times: one running time per event, or %NULL to play them all
+ *     at the next ksmps block
+ * @pfields: @n_events rows of @n_pfields p-fields
+ * @n_pfields: p-fields per event
+ * @n_events: number of events
+ *
+ * Queue a batch of score events from any thread, without blocking. Each
+ * event is sent to csound right before the ksmps block holding its
+ * running time, events already late play at the next block.
+ *
+ * Returns: %FALSE if there was nothing to queue
+ */
+gboolean
+gst_csoundfilter_send_score_events (GstCsoundfilter * csoundfilter,
+    gchar type, const GstClockTime * running_times, const MYFLT * pfields,
+    guint n_pfields, guint n_events)
+{
+  g_return_val_if_fail (GST_IS_CSOUNDFILTER (csoundfilter), FALSE);
+
+  return gst_csound_event_queue_push (&csoundfilter->events, type,
+      running_times, pfields, n_pfields, n_events);
+}
+
+static gboolean
+gst_csoundfilter_score_events_bytes (GstCsoundfilter * csoundfilter,
+    gchar type, guint n_pfields, GBytes * pfields, GBytes * running_times)
+{
+  return gst_csound_event_queue_push_bytes (&csoundfilter->events, type,
+      n_pfields, pfields, running_times);
+}
+
+/* set up before acquiring the instances, they print through it */
+static void
+gst_csoundfilter_start_log (GstCsoundfilter * csoundfilter)
+{
+  GstCsoundLog *log = gst_csound_log_new (GST_ELEMENT (csoundfilter),
+      GST_CAT_DEFAULT, csoundfilter->message_level, csoundfilter->message_rate);
+
+  GST_OBJECT_LOCK (csoundfilter);
+  csoundfilter->log = log;
+  GST_OBJECT_UNLOCK (csoundfilter);
+}
+
+/* only once every instance is released */
+static void
+gst_csoundfilter_stop_log (GstCsoundfilter * csoundfilter)
+{
+  GstCsoundLog *log;
+
+  GST_OBJECT_LOCK (csoundfilter);
+  log = csoundfilter->log;
+  csoundfilter->log = NULL;
+  GST_OBJECT_UNLOCK (csoundfilter);
+  gst_csound_log_free (log);
+}
@@ -23,6 +23,12 @@
 #include <gst/base/gstbasetransform.h>
 #include <gst/audio/audio.h>
 #include <csound/csound.h>
+#include "gstcsoundconvert.h"
+#include "gstcsoundlog.h"
+#include "gstcsoundstats.h"
+#include "gstcsoundring.h"
+#include "gstcsoundevents.h"
+#include "gstcsoundmeta.h"
 
 G_BEGIN_DECLS
 
@@ -34,13 +40,39 @@ G_BEGIN_DECLS
 
 typedef struct _GstCsoundfilter GstCsoundfilter;
 typedef struct _GstCsoundfilterClass GstCsoundfilterClass;
+typedef struct _GstCsoundfilterWorker GstCsoundfilterWorker;
+typedef struct _GstCsoundfilterBlocks GstCsoundfilterBlocks;
 
-typedef void (*GstCsoundFilterProcessFunc) (GstCsoundfilter *, MYFLT * ,
-    guint , guint );
+typedef void (*GstCsoundFilterProcessFunc) (GstCsoundfilter *, gconstpointer,
+    gpointer, guint, const GstCsoundfilterBlocks *);
 
 typedef void (*csoundMessageCallback) (CSOUND *, int attr, const char *format,
     va_list valist);
 
+/* what a run of ksmps blocks needs besides its samples */
+struct _GstCsoundfilterBlocks
+{
+  const MYFLT *controls;        /* one row of channel values per block, or NULL */
+  GstCsoundEvent *events;       /* score events due in the run, or NULL */
+  GstClockTime start;           /* running time of the first block */
+  GstClockTime interval;        /* duration of one block */
+  GList *side_pads;             /* side pads to fill before every block */
+  GstCsoundAnalysis *analysis;  /* output channels to sample, or NULL */
+};
+
+/* an extra csound instance processing one channel group on its thread */
+struct _GstCsoundfilterWorker
+{
+  GstCsoundfilter *filter;
+  GThread *thread;
+  CSOUND *csound;
+  MYFLT *spin;
+  MYFLT *spout;
+  MYFLT **ctl_ptrs;
+  guint group;
+  gint end_score;               /* of the last job */
+  GstCsoundStats stats;
+};
 
 struct _GstCsoundfilter
 {
@@ -48,6 +80,10 @@ struct _GstCsoundfilter
 
   CSOUND *csound;
   gchar *csd_name;
+  /* the orchestra as text instead, all four under the object lock */
+  gchar *csd_text;
+  gchar *orc;
+  gchar *sco;
 
   /* <private> */
 
@@ -59,14 +95,96 @@ struct _GstCsoundfilter
   guint ksmps,
         cs_ochannels,
         cs_ichannels;
-  gint16 end_score;
+  GstCsoundConvert in_convert;
+  GstCsoundConvert out_convert;
+  GstAudioInfo in_info;
+  GstAudioInfo out_info;
+  gboolean planar;              /* non-interleaved on both pads */
+  guint spin_frames;            /* planar input waiting in spin */
+  guint in_block_size;          /* bytes of one ksmps block in and out */
+  guint out_block_size;
+  guint out_pool_size;
+  gint rate;
+
+  GstClockTime ts_base;         /* time of the first sample counted */
+  guint64 samples_out;          /* samples pushed since ts_base */
+  guint64 out_offset;
+  gboolean discont;
+  gboolean unaligned_input;
+  gint end_score;               /* atomic, the engine thread sets it */
   gboolean loop;
+  gboolean instance_pool;
+  gboolean follow_caps;
+  gchar *options;               /* the instances are compiled with */
+  gint csd_rate;                /* of the csd itself, for follow-caps */
+  guint csd_ksmps;
+  guint csd_ichannels;
+  guint csd_ochannels;
+  GstCsoundLog *log;
+  GstCsoundMessageLevel message_level;
+  guint message_rate;
+  guint8 *block_scratch;        /* one input block completed from the adapter */
+
+  /* a new orchestra set while running, swapped in at a buffer start */
+  struct _GstCsoundSwap *swap;
+  GstClockTime crossfade;
+
+  /* instance 0 is csound above, the others run on workers */
+  guint instances;
+  GstCsoundfilterWorker *workers;
+  guint n_workers;
+  GMutex worker_lock;
+  GCond worker_cond;
+  GCond done_cond;
+  guint64 job_seq;
+  guint jobs_done;
+  gboolean workers_quit;
+  const guint8 *job_in;
+  guint8 *job_out;
+  guint job_blocks;
+  const GstCsoundfilterBlocks *job_info;
+
+  /* async mode: blocks travel through the rings to the engine thread,
+   * which runs engine_process on them */
+  guint async_depth;
+  GstCsoundFilterProcessFunc engine_process;
+  GstCsoundRing *in_ring;
+  GstCsoundRing *out_ring;
+  GThread *engine_thread;
+
+  /* chn_k input channels, children of the element */
+  GPtrArray *channels;
+  MYFLT **ctl_ptrs;             /* channel data of instance 0 */
+  MYFLT *ctl_values;            /* one row per block of the current buffer */
+  gsize ctl_capacity;           /* values, not blocks */
+
+  GstCsoundEventQueue events;
+
+  /* chn_k output channels read after every block, the property under
+   * the object lock */
+  gchar *analysis_channels;
+  GstCsoundAnalysis analysis;
+
+  /* request out_%u pads, under the object lock */
+  GList *out_pads;
+  /* request side_%s pads, under the object lock */
+  GList *side_pads;
+
+  /* owned by the thread performing, instance 0 adds the workers' after
+   * each buffer */
+  GstCsoundStats stats;
+  GstCsoundStatsBoard stats_board;
+  gint late_buffers;            /* counted by the streaming thread in async mode */
 
 };
 
 struct _GstCsoundfilterClass
 {
   GstBaseTransformClass base_csoundfilter_class;
+
+  /* actions */
+  gboolean (*score_events) (GstCsoundfilter * csoundfilter, gchar type,
+      guint n_pfields, GBytes * pfields, GBytes * running_times);
 };
 
 GType gst_csoundfilter_get_type (void);
@@ -74,6 +192,11 @@ GType gst_csoundfilter_get_type (void);
 GST_EXPORT
 CSOUND *gst_csoundfilter_get_instance(GstCsoundfilter *csoundfilter);
 
+GST_EXPORT
+gboolean gst_csoundfilter_send_score_events (GstCsoundfilter * csoundfilter,
+    gchar type, const GstClockTime * running_times, const MYFLT * pfields,
+    guint n_pfields, guint n_events);
+
 G_END_DECLS
 
 #endif
@@ -0,0 +1,350 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/* Process wide pool of compiled and started csound instances.
+ *
+ * Compiling a csd with big orchestras and GEN tables is slow, so elements
+ * asking for reuse return their instance here when they stop and the next
+ * element running the same csd takes it back, rewound, instead of
+ * compiling again. Instances are keyed by the csd path, a checksum of its
+ * contents and the options it was compiled with, so an edited file never
+ * hands out a stale orchestra. Orchestras given as text are keyed by a
+ * checksum of the text.
+ *
+ * Rewinding restarts the score but keeps orchestra state such as global
+ * variables and tables written at performance time, which is why reuse is
+ * something elements opt into. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include "gstcsoundinstance.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_csound_instance_debug);
+#define GST_CAT_DEFAULT gst_csound_instance_debug
+
+G_LOCK_DEFINE_STATIC (pool);
+static GHashTable *idle;        /* key -> GQueue of idle instances */
+static GHashTable *busy;        /* checked out instance -> key */
+
+void
+gst_csound_instance_init (void)
+{
+  GST_DEBUG_CATEGORY_INIT (gst_csound_instance_debug, "csoundinstance", 0,
+      "csound instance pool");
+
+  G_LOCK (pool);
+  if (idle == NULL) {
+    idle = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    busy = g_hash_table_new (g_direct_hash, g_direct_equal);
+  }
+  G_UNLOCK (pool);
+}
+
+/**
+ * gst_csound_source_copy:
+ *
+ * Fill @dest with copies of the strings of @source.
+ */
+void
+gst_csound_source_copy (GstCsoundSource * dest, const GstCsoundSource * source)
+{
+  dest->location = g_strdup (source->location);
+  dest->csd_text = g_strdup (source->csd_text);
+  dest->orc = g_strdup (source->orc);
+  dest->sco = g_strdup (source->sco);
+}
+
+void
+gst_csound_source_clear (GstCsoundSource * source)
+{
+  g_free (source->location);
+  g_free (source->csd_text);
+  g_free (source->orc);
+  g_free (source->sco);
+  memset (source, 0, sizeof (GstCsoundSource));
+}
+
+/**
+ * gst_csound_source_get_name:
+ *
+ * Returns: the location, or what the orchestra text is, for messages
+ */
+const gchar *
+gst_csound_source_get_name (const GstCsoundSource * source)
+{
+  if (source->csd_text)
+    return "csd-text";
+  if (source->orc)
+    return "orc";
+  return source->location;
+}
+
+static gchar *
+gst_csound_instance_key (const GstCsoundSource * source,
+    const gchar * options)
+{
+  gchar *contents, *checksum, *key;
+  gsize length;
+
+  if (source->csd_text) {
+    contents = g_strdup (source->csd_text);
+  } else if (source->orc) {
+    contents = g_strconcat (source->orc, "\n", source->sco, NULL);
+  } else if (!g_file_get_contents (source->location, &contents, &length,
+          NULL)) {
+    return NULL;
+  }
+  length = strlen (contents);
+
+  checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA256,
+      (const guchar *) contents, length);
+  key = g_strdup_printf ("%s\n%s\n%s", gst_csound_source_get_name (source),
+      checksum, options ? options : "");
+  g_free (checksum);
+  g_free (contents);
+
+  return key;
+}
+
+static void
+gst_csound_instance_destroy (CSOUND * csound)
+{
+  csoundStop (csound);
+  csoundCleanup (csound);
+  csoundDestroy (csound);
+}
+
+static CSOUND *
+gst_csound_instance_new (const GstCsoundSource * source,
+    const gchar * options, GstCsoundMessageFunc message_func,
+    gpointer host_data)
+{
+  CSOUND *csound = csoundCreate (host_data);
+  gint failed;
+
+  if (message_func)
+    csoundSetMessageCallback (csound, message_func);
+
+  /* an orc has no CsOptions, the element moves the audio itself */
+  if (source->csd_text == NULL && source->orc) {
+    csoundSetOption (csound, "-n");
+    csoundSetOption (csound, "-d");
+  }
+
+  if (options) {
+    gchar **opts = g_strsplit_set (options, " \t", -1);
+    gchar **opt;
+
+    for (opt = opts; *opt; opt++)
+      if (**opt)
+        csoundSetOption (csound, *opt);
+    g_strfreev (opts);
+  }
+
+  if (source->csd_text)
+    failed = csoundCompileCsdText (csound, source->csd_text);
+  else if (source->orc)
+    failed = csoundCompileOrc (csound, source->orc);
+  else
+    failed = csoundCompileCsd (csound, source->location);
+  if (failed) {
+    csoundDestroy (csound);
+    return NULL;
+  }
+  csoundStart (csound);
+  if (source->csd_text == NULL && source->orc && source->sco)
+    csoundReadScore (csound, source->sco);
+
+  return csound;
+}
+
+/**
+ * gst_csound_instance_rewind:
+ * @csound: a started instance
+ *
+ * Restart the score from the beginning and silence spin and spout,
+ * without compiling the orchestra again.
+ */
+void
+gst_csound_instance_rewind (CSOUND * csound)
+{
+  MYFLT *spin = csoundGetSpin (csound);
+  MYFLT *spout = csoundGetSpout (csound);
+  guint ksmps = csoundGetKsmps (csound);
+
+  csoundSetScoreOffsetSeconds (csound, 0.0);
+  csoundRewindScore (csound);
+  if (spin)
+    memset (spin, 0, sizeof (MYFLT) * ksmps * csoundGetNchnlsInput (csound));
+  if (spout)
+    memset (spout, 0, sizeof (MYFLT) * ksmps * csoundGetNchnls (csound));
+}
+
+/**
+ * gst_csound_instance_options:
+ * @ichannels: nchnls_i, or 0 to keep the one of the csd
+ *
+ * Returns: the options compiling a csd at @rate with @ksmps and these
+ *     channels instead of the header of its orchestra
+ */
+gchar *
+gst_csound_instance_options (gint rate, guint ksmps, guint ichannels,
+    guint ochannels)
+{
+  GString *options = g_string_new (NULL);
+
+  g_string_append_printf (options, "--sample-rate=%d --ksmps=%u", rate,
+      ksmps);
+  if (ichannels > 0)
+    g_string_append_printf (options, " --nchnls_i=%u", ichannels);
+  g_string_append_printf (options, " --nchnls=%u", ochannels);
+
+  return g_string_free (options, FALSE);
+}
+
+/**
+ * gst_csound_instance_acquire:
+ * @csd_name: the csd file
+ * @options: csound command line options, separated by spaces, or %NULL
+ * @reuse: take an idle instance from the pool and give it back to the
+ *     pool on release
+ * @message_func: the message callback of the caller
+ * @host_data: host data for @message_func, cleared on release
+ *
+ * Returns: a started instance, or %NULL if the csd does not compile
+ */
+CSOUND *
+gst_csound_instance_acquire (const gchar * csd_name, const gchar * options,
+    gboolean reuse, GstCsoundMessageFunc message_func, gpointer host_data)
+{
+  GstCsoundSource source = { (gchar *) csd_name, NULL, NULL, NULL };
+
+  g_return_val_if_fail (csd_name != NULL, NULL);
+
+  return gst_csound_instance_acquire_source (&source, options, reuse,
+      message_func, host_data);
+}
+
+/**
+ * gst_csound_instance_acquire_source:
+ * @source: the csd file or the orchestra text
+ *
+ * gst_csound_instance_acquire() for any #GstCsoundSource.
+ *
+ * Returns: a started instance, or %NULL if the orchestra does not compile
+ */
+CSOUND *
+gst_csound_instance_acquire_source (const GstCsoundSource * source,
+    const gchar * options, gboolean reuse, GstCsoundMessageFunc message_func,
+    gpointer host_data)
+{
+  CSOUND *csound = NULL;
+  const gchar *name = gst_csound_source_get_name (source);
+  gchar *key;
+  GQueue *queue;
+
+  g_return_val_if_fail (name != NULL, NULL);
+
+  if (!reuse)
+    return gst_csound_instance_new (source, options, message_func,
+        host_data);
+
+  key = gst_csound_instance_key (source, options);
+  if (key == NULL)
+    return gst_csound_instance_new (source, options, message_func,
+        host_data);
+
+  G_LOCK (pool);
+  queue = g_hash_table_lookup (idle, key);
+  if (queue)
+    csound = g_queue_pop_head (queue);
+  G_UNLOCK (pool);
+
+  if (csound) {
+    GST_DEBUG ("reusing instance %p for %s", csound, name);
+    csoundSetHostData (csound, host_data);
+    if (message_func)
+      csoundSetMessageCallback (csound, message_func);
+    gst_csound_instance_rewind (csound);
+  } else {
+    GST_DEBUG ("no idle instance for %s, compiling", name);
+    csound = gst_csound_instance_new (source, options, message_func,
+        host_data);
+    if (csound == NULL) {
+      g_free (key);
+      return NULL;
+    }
+  }
+
+  G_LOCK (pool);
+  g_hash_table_insert (busy, csound, key);
+  G_UNLOCK (pool);
+
+  return csound;
+}
+
+/**
+ * gst_csound_instance_release:
+ * @csound: an instance from gst_csound_instance_acquire()
+ *
+ * Hand the instance back. Instances acquired for reuse stay compiled and
+ * started in the pool, up to GST_CSOUND_INSTANCE_MAX_IDLE per csd, the
+ * others are destroyed.
+ */
+void
+gst_csound_instance_release (CSOUND * csound)
+{
+  gchar *key;
+  GQueue *queue;
+
+  if (csound == NULL)
+    return;
+
+  /* the host data belongs to the element giving the instance back */
+  csoundSetHostData (csound, NULL);
+
+  G_LOCK (pool);
+  key = g_hash_table_lookup (busy, csound);
+  if (key == NULL) {
+    G_UNLOCK (pool);
+    gst_csound_instance_destroy (csound);
+    return;
+  }
+  g_hash_table_remove (busy, csound);
+
+  queue = g_hash_table_lookup (idle, key);
+  if (queue == NULL) {
+    queue = g_queue_new ();
+    g_hash_table_insert (idle, key, queue);
+  } else {
+    g_free (key);
+  }
+
+  if (g_queue_get_length (queue) < GST_CSOUND_INSTANCE_MAX_IDLE) {
+    g_queue_push_tail (queue, csound);
+    csound = NULL;
+  }
+  G_UNLOCK (pool);
+
+  if (csound)
+    gst_csound_instance_destroy (csound);
+}
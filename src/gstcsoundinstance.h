@@ -0,0 +1,69 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_CSOUND_INSTANCE_H_
+#define _GST_CSOUND_INSTANCE_H_
+
+#include <gst/gst.h>
+#include <csound/csound.h>
+
+G_BEGIN_DECLS
+
+/* idle instances kept for each csd */
+#define GST_CSOUND_INSTANCE_MAX_IDLE 4
+
+typedef void (*GstCsoundMessageFunc) (CSOUND *, int attr, const char *format,
+    va_list valist);
+
+typedef struct _GstCsoundSource GstCsoundSource;
+
+/* where the orchestra comes from: csd_text, else orc and sco, else the
+ * csd file at location */
+struct _GstCsoundSource
+{
+  gchar *location;
+  gchar *csd_text;
+  gchar *orc;
+  gchar *sco;
+};
+
+void gst_csound_source_copy (GstCsoundSource * dest,
+    const GstCsoundSource * source);
+void gst_csound_source_clear (GstCsoundSource * source);
+const gchar *gst_csound_source_get_name (const GstCsoundSource * source);
+
+void gst_csound_instance_init (void);
+
+CSOUND *gst_csound_instance_acquire (const gchar * csd_name,
+    const gchar * options, gboolean reuse, GstCsoundMessageFunc message_func,
+    gpointer host_data);
+CSOUND *gst_csound_instance_acquire_source (const GstCsoundSource * source,
+    const gchar * options, gboolean reuse, GstCsoundMessageFunc message_func,
+    gpointer host_data);
+
+void gst_csound_instance_release (CSOUND * csound);
+
+void gst_csound_instance_rewind (CSOUND * csound);
+
+gchar *gst_csound_instance_options (gint rate, guint ksmps, guint ichannels,
+    guint ochannels);
+
+G_END_DECLS
+
+#endif
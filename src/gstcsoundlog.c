@@ -0,0 +1,323 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/* Csound messages, printed from inside csoundPerformKsmps().
+ *
+ * The message callback formats the text straight into a slot of a
+ * preallocated ring and returns: no allocation, no lock and no logging
+ * I/O on the audio thread. Every instance of an element may print at
+ * once, so slots are claimed with a compare and swap on the head and
+ * carry a sequence number telling the reader when they are complete.
+ * When the ring is full the message is only counted.
+ *
+ * A thread per element drains the ring a few times per second, without
+ * ever being woken by the audio threads, and turns the messages into
+ * debug output and "csound-message" element messages, at most a given
+ * number per second and level. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include "gstcsoundlog.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_csound_log_debug);
+#define GST_CAT_DEFAULT gst_csound_log_debug
+
+#define LOG_SLOTS 256
+#define LOG_TEXT 248
+#define LOG_PERIOD (50 * G_TIME_SPAN_MILLISECOND)
+#define N_LEVELS (GST_CSOUND_MESSAGE_ALL + 1)
+
+typedef struct
+{
+  gint seq;                     /* position + 1 once the text is written */
+  gint level;
+  gchar text[LOG_TEXT];
+} GstCsoundLogSlot;
+
+struct _GstCsoundLog
+{
+  GstElement *element;
+  GstDebugCategory *category;
+  GstCsoundLogSlot *slots;
+
+  gint head;                    /* next position claimed by a producer */
+  gint level;
+  gint rate;
+  gint dropped;
+
+  /* drain thread only */
+  guint tail;
+  gint64 window;
+  guint count[N_LEVELS];
+  guint suppressed[N_LEVELS];
+
+  GThread *thread;
+  GMutex lock;
+  GCond cond;
+  gboolean quit;
+};
+
+static const GstDebugLevel debug_levels[N_LEVELS] = {
+  GST_LEVEL_NONE, GST_LEVEL_ERROR, GST_LEVEL_WARNING, GST_LEVEL_INFO,
+  GST_LEVEL_LOG
+};
+
+GType
+gst_csound_message_level_get_type (void)
+{
+  static gsize type = 0;
+  static const GEnumValue values[] = {
+    {GST_CSOUND_MESSAGE_NONE, "No messages", "none"},
+    {GST_CSOUND_MESSAGE_ERROR, "Errors", "error"},
+    {GST_CSOUND_MESSAGE_WARNING, "Errors and warnings", "warning"},
+    {GST_CSOUND_MESSAGE_ORCHESTRA, "Errors, warnings and orchestra output",
+        "orchestra"},
+    {GST_CSOUND_MESSAGE_ALL, "All messages", "all"},
+    {0, NULL, NULL}
+  };
+
+  if (g_once_init_enter (&type)) {
+    GType t = g_enum_register_static ("GstCsoundMessageLevel", values);
+
+    GST_DEBUG_CATEGORY_INIT (gst_csound_log_debug, "csoundlog", 0,
+        "csound messages");
+    g_once_init_leave (&type, t);
+  }
+
+  return type;
+}
+
+static GstCsoundMessageLevel
+gst_csound_log_level_of (int attr)
+{
+  switch (attr & CSOUNDMSG_TYPE_MASK) {
+    case CSOUNDMSG_ERROR:
+      return GST_CSOUND_MESSAGE_ERROR;
+    case CSOUNDMSG_WARNING:
+      return GST_CSOUND_MESSAGE_WARNING;
+    case CSOUNDMSG_ORCH:
+      return GST_CSOUND_MESSAGE_ORCHESTRA;
+    default:
+      return GST_CSOUND_MESSAGE_ALL;
+  }
+}
+
+/**
+ * gst_csound_log_message:
+ *
+ * The csound message callback. The log is the host data of the instance,
+ * instances without one, idle in the pool, print straight to the debug
+ * log.
+ */
+void
+gst_csound_log_message (CSOUND * csound, int attr, const char *format,
+    va_list valist)
+{
+  GstCsoundLog *log = csoundGetHostData (csound);
+  GstCsoundMessageLevel level = gst_csound_log_level_of (attr);
+  GstCsoundLogSlot *slot;
+  guint pos;
+
+  if (log == NULL) {
+    gchar text[LOG_TEXT];
+
+    g_vsnprintf (text, sizeof (text), format, valist);
+    GST_LOG ("%s", text);
+    return;
+  }
+
+  if (level > (GstCsoundMessageLevel) g_atomic_int_get (&log->level))
+    return;
+
+  pos = (guint) g_atomic_int_get (&log->head);
+  for (;;) {
+    gint diff;
+
+    slot = &log->slots[pos & (LOG_SLOTS - 1)];
+    diff = (gint) ((guint) g_atomic_int_get (&slot->seq) - pos);
+    if (diff == 0) {
+      if (g_atomic_int_compare_and_exchange (&log->head, (gint) pos,
+              (gint) (pos + 1)))
+        break;
+    } else if (diff < 0) {
+      /* the reader has not freed this slot yet, the ring is full */
+      g_atomic_int_inc (&log->dropped);
+      return;
+    }
+    pos = (guint) g_atomic_int_get (&log->head);
+  }
+
+  slot->level = level;
+  g_vsnprintf (slot->text, LOG_TEXT, format, valist);
+  g_atomic_int_set (&slot->seq, (gint) (pos + 1));
+}
+
+static void
+gst_csound_log_forward (GstCsoundLog * log, GstCsoundMessageLevel level,
+    gchar * text)
+{
+  gsize length = strlen (text);
+
+  /* csound ends most lines with a newline of its own */
+  while (length > 0 && g_ascii_isspace (text[length - 1]))
+    text[--length] = '\0';
+  if (length == 0)
+    return;
+
+  GST_CAT_LEVEL_LOG (log->category, debug_levels[level], log->element,
+      "%s", text);
+  gst_element_post_message (log->element,
+      gst_message_new_element (GST_OBJECT (log->element),
+          gst_structure_new ("csound-message",
+              "level", GST_TYPE_CSOUND_MESSAGE_LEVEL, level,
+              "text", G_TYPE_STRING, text, NULL)));
+}
+
+static void
+gst_csound_log_drain (GstCsoundLog * log)
+{
+  guint rate = (guint) g_atomic_int_get (&log->rate);
+  gint64 now = g_get_monotonic_time ();
+  gint dropped;
+
+  if (now - log->window >= G_USEC_PER_SEC) {
+    gint level;
+
+    for (level = 0; level < N_LEVELS; level++) {
+      if (log->suppressed[level] > 0)
+        GST_CAT_LEVEL_LOG (log->category, debug_levels[level], log->element,
+            "%u more csound messages suppressed", log->suppressed[level]);
+      log->count[level] = 0;
+      log->suppressed[level] = 0;
+    }
+    log->window = now;
+  }
+
+  dropped = g_atomic_int_get (&log->dropped);
+  if (dropped > 0) {
+    g_atomic_int_add (&log->dropped, -dropped);
+    GST_CAT_WARNING_OBJECT (log->category, log->element,
+        "%d csound messages lost, the message ring was full", dropped);
+  }
+
+  for (;;) {
+    GstCsoundLogSlot *slot = &log->slots[log->tail & (LOG_SLOTS - 1)];
+
+    if ((guint) g_atomic_int_get (&slot->seq) != log->tail + 1)
+      break;
+
+    if (rate == 0 || log->count[slot->level]++ < rate)
+      gst_csound_log_forward (log, slot->level, slot->text);
+    else
+      log->suppressed[slot->level]++;
+
+    g_atomic_int_set (&slot->seq, (gint) (log->tail + LOG_SLOTS));
+    log->tail++;
+  }
+}
+
+static gpointer
+gst_csound_log_loop (gpointer data)
+{
+  GstCsoundLog *log = data;
+
+  g_mutex_lock (&log->lock);
+  while (!log->quit) {
+    g_cond_wait_until (&log->cond, &log->lock,
+        g_get_monotonic_time () + LOG_PERIOD);
+    g_mutex_unlock (&log->lock);
+    gst_csound_log_drain (log);
+    g_mutex_lock (&log->lock);
+  }
+  g_mutex_unlock (&log->lock);
+
+  return NULL;
+}
+
+/**
+ * gst_csound_log_new:
+ * @element: the element posting the messages
+ * @category: debug category of @element
+ * @level: the most verbose messages forwarded
+ * @rate: messages forwarded per second and level, 0 for no limit
+ *
+ * Returns: a log for the instances of @element, to be set as their host
+ *     data, with its drain thread running
+ */
+GstCsoundLog *
+gst_csound_log_new (GstElement * element, GstDebugCategory * category,
+    GstCsoundMessageLevel level, guint rate)
+{
+  GstCsoundLog *log = g_new0 (GstCsoundLog, 1);
+  guint i;
+
+  log->element = element;
+  log->category = category;
+  log->slots = g_new0 (GstCsoundLogSlot, LOG_SLOTS);
+  for (i = 0; i < LOG_SLOTS; i++)
+    log->slots[i].seq = i;
+  log->level = level;
+  log->rate = rate;
+  log->window = g_get_monotonic_time ();
+  g_mutex_init (&log->lock);
+  g_cond_init (&log->cond);
+  log->thread = g_thread_new ("csound-log", gst_csound_log_loop, log);
+
+  return log;
+}
+
+/**
+ * gst_csound_log_free:
+ *
+ * Stop the drain thread after forwarding what is left. No instance may
+ * use the log any more.
+ */
+void
+gst_csound_log_free (GstCsoundLog * log)
+{
+  if (log == NULL)
+    return;
+
+  g_mutex_lock (&log->lock);
+  log->quit = TRUE;
+  g_cond_signal (&log->cond);
+  g_mutex_unlock (&log->lock);
+  g_thread_join (log->thread);
+  gst_csound_log_drain (log);
+
+  g_mutex_clear (&log->lock);
+  g_cond_clear (&log->cond);
+  g_free (log->slots);
+  g_free (log);
+}
+
+void
+gst_csound_log_set_level (GstCsoundLog * log, GstCsoundMessageLevel level)
+{
+  g_atomic_int_set (&log->level, level);
+}
+
+void
+gst_csound_log_set_rate (GstCsoundLog * log, guint rate)
+{
+  g_atomic_int_set (&log->rate, (gint) rate);
+}
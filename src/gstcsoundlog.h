@@ -0,0 +1,61 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_CSOUND_LOG_H_
+#define _GST_CSOUND_LOG_H_
+
+#include <gst/gst.h>
+#include <csound/csound.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_CSOUND_MESSAGE_LEVEL (gst_csound_message_level_get_type ())
+
+/* the most verbose csound messages forwarded, each level includes the
+ * ones before it */
+typedef enum
+{
+  GST_CSOUND_MESSAGE_NONE,
+  GST_CSOUND_MESSAGE_ERROR,
+  GST_CSOUND_MESSAGE_WARNING,
+  GST_CSOUND_MESSAGE_ORCHESTRA,
+  GST_CSOUND_MESSAGE_ALL
+} GstCsoundMessageLevel;
+
+#define GST_CSOUND_LOG_DEFAULT_LEVEL GST_CSOUND_MESSAGE_ORCHESTRA
+#define GST_CSOUND_LOG_DEFAULT_RATE 50
+
+typedef struct _GstCsoundLog GstCsoundLog;
+
+GType gst_csound_message_level_get_type (void);
+
+GstCsoundLog *gst_csound_log_new (GstElement * element,
+    GstDebugCategory * category, GstCsoundMessageLevel level, guint rate);
+void gst_csound_log_free (GstCsoundLog * log);
+
+void gst_csound_log_set_level (GstCsoundLog * log,
+    GstCsoundMessageLevel level);
+void gst_csound_log_set_rate (GstCsoundLog * log, guint rate);
+
+void gst_csound_log_message (CSOUND * csound, int attr, const char *format,
+    va_list valist);
+
+G_END_DECLS
+
+#endif
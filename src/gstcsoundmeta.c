@@ -0,0 +1,264 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Analysis results on the buffers.
+ *
+ * Orchestras tracking pitch, levels or onsets write them to chn_k output
+ * channels. The element reads the channels it is told about right after
+ * each csoundPerformKsmps(), on the thread performing, and attaches the
+ * rows of one buffer to it as a GstCsoundAnalysisMeta: the values arrive
+ * with the audio they describe, no application thread polls csound. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include "gstcsoundmeta.h"
+
+GType
+gst_csound_analysis_meta_api_get_type (void)
+{
+  static volatile GType type = 0;
+  static const gchar *tags[] = { GST_META_TAG_AUDIO_STR, NULL };
+
+  if (g_once_init_enter (&type)) {
+    GType _type =
+        gst_meta_api_type_register ("GstCsoundAnalysisMetaAPI", tags);
+    g_once_init_leave (&type, _type);
+  }
+  return type;
+}
+
+static gboolean
+gst_csound_analysis_meta_init (GstMeta * meta, gpointer params,
+    GstBuffer * buffer)
+{
+  GstCsoundAnalysisMeta *ameta = (GstCsoundAnalysisMeta *) meta;
+
+  ameta->n_channels = 0;
+  ameta->channels = NULL;
+  ameta->n_blocks = 0;
+  ameta->offsets = NULL;
+  ameta->values = NULL;
+
+  return TRUE;
+}
+
+/* the channels and offsets follow the values in one allocation */
+static void
+gst_csound_analysis_meta_free (GstMeta * meta, GstBuffer * buffer)
+{
+  GstCsoundAnalysisMeta *ameta = (GstCsoundAnalysisMeta *) meta;
+
+  g_free (ameta->values);
+}
+
+static gboolean
+gst_csound_analysis_meta_transform (GstBuffer * dest, GstMeta * meta,
+    GstBuffer * buffer, GQuark type, gpointer data)
+{
+  GstCsoundAnalysisMeta *ameta = (GstCsoundAnalysisMeta *) meta;
+
+  /* the offsets are frames of the whole buffer, a region of it would
+   * need its bytes per frame */
+  if (GST_META_TRANSFORM_IS_COPY (type)) {
+    GstMetaTransformCopy *copy = data;
+
+    if (copy->region)
+      return TRUE;
+  } else {
+    return FALSE;
+  }
+
+  return gst_buffer_add_csound_analysis_meta (dest, ameta->n_channels,
+      ameta->channels, ameta->n_blocks, ameta->offsets,
+      ameta->values) != NULL;
+}
+
+const GstMetaInfo *
+gst_csound_analysis_meta_get_info (void)
+{
+  static const GstMetaInfo *meta_info = NULL;
+
+  if (g_once_init_enter ((GstMetaInfo **) & meta_info)) {
+    const GstMetaInfo *mi =
+        gst_meta_register (GST_CSOUND_ANALYSIS_META_API_TYPE,
+        "GstCsoundAnalysisMeta", sizeof (GstCsoundAnalysisMeta),
+        gst_csound_analysis_meta_init, gst_csound_analysis_meta_free,
+        gst_csound_analysis_meta_transform);
+    g_once_init_leave ((GstMetaInfo **) & meta_info, (GstMetaInfo *) mi);
+  }
+  return meta_info;
+}
+
+/**
+ * gst_buffer_add_csound_analysis_meta:
+ * @channels: (array length=n_channels): the channel names
+ * @offsets: (array length=n_blocks): first frame of each block
+ * @values: @n_blocks rows of @n_channels values
+ *
+ * Returns: (transfer none): the meta, holding copies of the arrays
+ */
+GstCsoundAnalysisMeta *
+gst_buffer_add_csound_analysis_meta (GstBuffer * buffer, guint n_channels,
+    const GQuark * channels, guint n_blocks, const guint * offsets,
+    const gdouble * values)
+{
+  GstCsoundAnalysisMeta *meta;
+  gsize values_size = (gsize) n_blocks * n_channels * sizeof (gdouble);
+  gsize channels_size = n_channels * sizeof (GQuark);
+  gsize offsets_size = n_blocks * sizeof (guint);
+  guint8 *mem;
+
+  g_return_val_if_fail (GST_IS_BUFFER (buffer), NULL);
+
+  meta = (GstCsoundAnalysisMeta *) gst_buffer_add_meta (buffer,
+      GST_CSOUND_ANALYSIS_META_INFO, NULL);
+
+  /* the doubles first, for their alignment */
+  mem = g_malloc (values_size + channels_size + offsets_size);
+  meta->values = (gdouble *) mem;
+  meta->channels = (GQuark *) (mem + values_size);
+  meta->offsets = (guint *) (mem + values_size + channels_size);
+  memcpy (meta->values, values, values_size);
+  memcpy (meta->channels, channels, channels_size);
+  memcpy (meta->offsets, offsets, offsets_size);
+  meta->n_channels = n_channels;
+  meta->n_blocks = n_blocks;
+
+  return meta;
+}
+
+/**
+ * gst_csound_analysis_setup:
+ * @channels: comma separated chn_k output channel names, or %NULL
+ * @element: posts a warning for the channels @csound lacks
+ *
+ * Bind @analysis to the channels of @csound, the ones missing are left
+ * out.
+ */
+void
+gst_csound_analysis_setup (GstCsoundAnalysis * analysis,
+    const gchar * channels, CSOUND * csound, GstElement * element)
+{
+  controlChannelInfo_t *list = NULL;
+  gchar **names;
+  gint n, i, j;
+
+  gst_csound_analysis_clear (analysis);
+  if (channels == NULL || *channels == '\0')
+    return;
+
+  names = g_strsplit (channels, ",", -1);
+  n = csoundListChannels (csound, &list);
+  analysis->channels = g_new0 (GQuark, g_strv_length (names));
+  analysis->ptrs = g_new0 (MYFLT *, g_strv_length (names));
+  for (i = 0; names[i]; i++) {
+    const gchar *name = g_strstrip (names[i]);
+    gint type = 0;
+    MYFLT *ptr = NULL;
+
+    if (*name == '\0')
+      continue;
+    for (j = 0; j < n; j++)
+      if (strcmp (list[j].name, name) == 0)
+        type = list[j].type;
+
+    if ((type & CSOUND_CHANNEL_TYPE_MASK) != CSOUND_CONTROL_CHANNEL
+        || !(type & CSOUND_OUTPUT_CHANNEL)
+        || csoundGetChannelPtr (csound, &ptr, name,
+            CSOUND_CONTROL_CHANNEL | CSOUND_OUTPUT_CHANNEL) != 0) {
+      GST_ELEMENT_WARNING (element, RESOURCE, SETTINGS, (NULL),
+          ("the orchestra has no chn_k output channel \"%s\"", name));
+      continue;
+    }
+    analysis->channels[analysis->n_channels] = g_quark_from_string (name);
+    analysis->ptrs[analysis->n_channels] = ptr;
+    analysis->n_channels++;
+  }
+  if (list)
+    csoundDeleteChannelList (csound, list);
+  g_strfreev (names);
+
+  GST_DEBUG_OBJECT (element, "sampling %u analysis channels",
+      analysis->n_channels);
+}
+
+void
+gst_csound_analysis_clear (GstCsoundAnalysis * analysis)
+{
+  g_free (analysis->channels);
+  g_free (analysis->ptrs);
+  g_free (analysis->offsets);
+  g_free (analysis->values);
+  memset (analysis, 0, sizeof (GstCsoundAnalysis));
+}
+
+/**
+ * gst_csound_analysis_sample:
+ * @offset: first frame in the output buffer of the block just performed
+ *
+ * Read the channels after a csoundPerformKsmps().
+ */
+void
+gst_csound_analysis_sample (GstCsoundAnalysis * analysis, guint offset)
+{
+  gdouble *row;
+  guint i;
+
+  if (analysis->n_channels == 0)
+    return;
+
+  if (analysis->n_blocks == analysis->capacity) {
+    analysis->capacity = MAX (16, analysis->capacity * 2);
+    analysis->offsets = g_renew (guint, analysis->offsets,
+        analysis->capacity);
+    analysis->values = g_renew (gdouble, analysis->values,
+        (gsize) analysis->capacity * analysis->n_channels);
+  }
+
+  row = analysis->values + (gsize) analysis->n_blocks * analysis->n_channels;
+  for (i = 0; i < analysis->n_channels; i++)
+    row[i] = *analysis->ptrs[i];
+  analysis->offsets[analysis->n_blocks++] = offset;
+}
+
+/**
+ * gst_csound_analysis_attach:
+ *
+ * Hand the rows sampled since the last call to @buffer, none are
+ * attached when no block was performed.
+ */
+void
+gst_csound_analysis_attach (GstCsoundAnalysis * analysis, GstBuffer * buffer)
+{
+  GstCsoundAnalysisMeta *meta;
+
+  if (analysis->n_blocks == 0)
+    return;
+
+  /* a pooled buffer may still carry the meta of its last round */
+  while ((meta = gst_buffer_get_csound_analysis_meta (buffer)))
+    gst_buffer_remove_meta (buffer, (GstMeta *) meta);
+  gst_buffer_add_csound_analysis_meta (buffer, analysis->n_channels,
+      analysis->channels, analysis->n_blocks, analysis->offsets,
+      analysis->values);
+  analysis->n_blocks = 0;
+}
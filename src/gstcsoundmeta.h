@@ -0,0 +1,93 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_CSOUND_META_H_
+#define _GST_CSOUND_META_H_
+
+#include <gst/gst.h>
+#include <csound/csound.h>
+
+G_BEGIN_DECLS
+
+#define GST_CSOUND_ANALYSIS_META_API_TYPE \
+    (gst_csound_analysis_meta_api_get_type())
+#define GST_CSOUND_ANALYSIS_META_INFO \
+    (gst_csound_analysis_meta_get_info())
+
+typedef struct _GstCsoundAnalysisMeta GstCsoundAnalysisMeta;
+typedef struct _GstCsoundAnalysis GstCsoundAnalysis;
+
+/**
+ * GstCsoundAnalysisMeta:
+ * @meta: parent #GstMeta
+ * @n_channels: the chn_k output channels sampled
+ * @channels: their names
+ * @n_blocks: the ksmps blocks of the buffer csound performed
+ * @offsets: the first frame of each block in the buffer
+ * @values: the channels after each block, @n_blocks rows of @n_channels
+ *
+ * The k-rate output channels of the orchestra, read after every ksmps
+ * block that produced the buffer.
+ */
+struct _GstCsoundAnalysisMeta
+{
+  GstMeta meta;
+
+  guint n_channels;
+  GQuark *channels;
+  guint n_blocks;
+  guint *offsets;
+  gdouble *values;
+};
+
+GType gst_csound_analysis_meta_api_get_type (void);
+const GstMetaInfo *gst_csound_analysis_meta_get_info (void);
+
+#define gst_buffer_get_csound_analysis_meta(b) \
+    ((GstCsoundAnalysisMeta *) gst_buffer_get_meta ((b), \
+        GST_CSOUND_ANALYSIS_META_API_TYPE))
+
+GstCsoundAnalysisMeta *gst_buffer_add_csound_analysis_meta (GstBuffer *
+    buffer, guint n_channels, const GQuark * channels, guint n_blocks,
+    const guint * offsets, const gdouble * values);
+
+/* the channels of the analysis-channels property of an element, read by
+ * the thread performing and handed to the buffer it produces */
+struct _GstCsoundAnalysis
+{
+  guint n_channels;
+  GQuark *channels;
+  MYFLT **ptrs;                 /* channel data of the instance */
+
+  guint n_blocks;               /* rows since the last buffer */
+  guint capacity;
+  guint *offsets;
+  gdouble *values;
+};
+
+void gst_csound_analysis_setup (GstCsoundAnalysis * analysis,
+    const gchar * channels, CSOUND * csound, GstElement * element);
+void gst_csound_analysis_clear (GstCsoundAnalysis * analysis);
+void gst_csound_analysis_sample (GstCsoundAnalysis * analysis, guint offset);
+void gst_csound_analysis_attach (GstCsoundAnalysis * analysis,
+    GstBuffer * buffer);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,903 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+/**
+ * SECTION:element-csoundmixer
+ * @see_also: #csoundfilter, #csoundsink
+ * @short_description: run several audio streams through one Csound
+ *
+ * Every request sink pad feeds a range of the orchestra inputs (nchnls_i),
+ * as many channels as its caps have. By default a pad follows the one
+ * requested before it, the first-channel pad property places it anywhere
+ * else. The samples are converted straight into spin, block by block,
+ * and the orchestra output comes out of the src pad.
+ *
+ * Buffers are placed by their running time. A pad starting later, or
+ * with a gap, is silent meanwhile; a pad that ended is silent from then
+ * on.
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 csoundmixer name=mix location=conference.csd ! autoaudiosink \
+ *     filesrc location=a.wav ! decodebin ! audioconvert ! mix. \
+ *     filesrc location=b.wav ! decodebin ! audioconvert ! mix.
+ * ]| will mix two files through a 2 input channel orchestra, if both
+ * are mono.
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <gst/gst.h>
+#include "gstcsoundmixer.h"
+#include "gstcsoundbufferpool.h"
+#include "gstcsoundconvert.h"
+#include "gstcsoundinstance.h"
+#include "gstcsoundlog.h"
+#include "gstcsoundstats.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_csoundmixer_debug_category);
+#define GST_CAT_DEFAULT gst_csoundmixer_debug_category
+
+#define DEFAULT_INSTANCE_POOL        FALSE
+#define DEFAULT_SAMPLES_PER_BUFFER   0
+#define DEFAULT_FIRST_CHANNEL        -1
+
+/* prototypes */
+
+
+static void gst_csoundmixer_set_property (GObject * object,
+    guint property_id, const GValue * value, GParamSpec * pspec);
+static void gst_csoundmixer_get_property (GObject * object,
+    guint property_id, GValue * value, GParamSpec * pspec);
+static void gst_csoundmixer_finalize (GObject * object);
+
+static gboolean gst_csoundmixer_start (GstAggregator * agg);
+static gboolean gst_csoundmixer_stop (GstAggregator * agg);
+static GstFlowReturn gst_csoundmixer_flush (GstAggregator * agg);
+static gboolean gst_csoundmixer_sink_query (GstAggregator * agg,
+    GstAggregatorPad * aggpad, GstQuery * query);
+static gboolean gst_csoundmixer_sink_event (GstAggregator * agg,
+    GstAggregatorPad * aggpad, GstEvent * event);
+static GstFlowReturn gst_csoundmixer_update_src_caps (GstAggregator * agg,
+    GstCaps * caps, GstCaps ** ret);
+static gboolean gst_csoundmixer_negotiated_src_caps (GstAggregator * agg,
+    GstCaps * caps);
+static GstFlowReturn gst_csoundmixer_aggregate (GstAggregator * agg,
+    gboolean timeout);
+static void gst_csoundmixer_start_log (GstCsoundmixer * csoundmixer);
+static void gst_csoundmixer_stop_log (GstCsoundmixer * csoundmixer);
+
+enum
+{
+  PROP_0,
+  PROP_LOCATION,
+  PROP_INSTANCE_POOL,
+  PROP_SAMPLES_PER_BUFFER,
+  PROP_MESSAGE_LEVEL,
+  PROP_MESSAGE_RATE,
+  PROP_STATS,
+  PROP_STATS_INTERVAL
+};
+
+enum
+{
+  PROP_PAD_0,
+  PROP_PAD_FIRST_CHANNEL
+};
+
+/* pad templates */
+
+static GstStaticPadTemplate gst_csoundmixer_src_template =
+GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("audio/x-raw,format=" GST_CSOUND_AUDIO_FORMATS
+        ",rate=[1,max],channels=[1,max],layout=interleaved")
+    );
+
+static GstStaticPadTemplate gst_csoundmixer_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink_%u",
+    GST_PAD_SINK,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS ("audio/x-raw,format=" GST_CSOUND_AUDIO_FORMATS
+        ",rate=[1,max],channels=[1,max],layout=interleaved")
+    );
+
+/* sink pads */
+
+G_DEFINE_TYPE (GstCsoundmixerPad, gst_csoundmixer_pad, GST_TYPE_AGGREGATOR_PAD);
+
+static void
+gst_csoundmixer_pad_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstCsoundmixerPad *pad = GST_CSOUNDMIXER_PAD (object);
+
+  switch (property_id) {
+    case PROP_PAD_FIRST_CHANNEL:
+      GST_OBJECT_LOCK (pad);
+      pad->first_channel = g_value_get_int (value);
+      GST_OBJECT_UNLOCK (pad);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_csoundmixer_pad_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstCsoundmixerPad *pad = GST_CSOUNDMIXER_PAD (object);
+
+  switch (property_id) {
+    case PROP_PAD_FIRST_CHANNEL:
+      GST_OBJECT_LOCK (pad);
+      g_value_set_int (value, pad->first_channel);
+      GST_OBJECT_UNLOCK (pad);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_csoundmixer_pad_finalize (GObject * object)
+{
+  GstCsoundmixerPad *pad = GST_CSOUNDMIXER_PAD (object);
+
+  g_object_unref (pad->adapter);
+
+  G_OBJECT_CLASS (gst_csoundmixer_pad_parent_class)->finalize (object);
+}
+
+static GstFlowReturn
+gst_csoundmixer_pad_flush (GstAggregatorPad * aggpad, GstAggregator * agg)
+{
+  GstCsoundmixerPad *pad = GST_CSOUNDMIXER_PAD (aggpad);
+
+  gst_adapter_clear (pad->adapter);
+  pad->next_sample = -1;
+
+  return GST_FLOW_OK;
+}
+
+static void
+gst_csoundmixer_pad_class_init (GstCsoundmixerPadClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstAggregatorPadClass *aggpad_class = GST_AGGREGATOR_PAD_CLASS (klass);
+
+  gobject_class->set_property = gst_csoundmixer_pad_set_property;
+  gobject_class->get_property = gst_csoundmixer_pad_get_property;
+  gobject_class->finalize = gst_csoundmixer_pad_finalize;
+  aggpad_class->flush = GST_DEBUG_FUNCPTR (gst_csoundmixer_pad_flush);
+
+  g_object_class_install_property (gobject_class, PROP_PAD_FIRST_CHANNEL,
+      g_param_spec_int ("first-channel", "First channel",
+          "Orchestra input channel taking the first channel of the pad "
+          "(-1 = the one after the channels of the pad requested before)",
+          -1, G_MAXINT, DEFAULT_FIRST_CHANNEL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+}
+
+static void
+gst_csoundmixer_pad_init (GstCsoundmixerPad * pad)
+{
+  pad->first_channel = DEFAULT_FIRST_CHANNEL;
+  pad->adapter = gst_adapter_new ();
+  pad->next_sample = -1;
+  gst_audio_info_init (&pad->info);
+}
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (GstCsoundmixer, gst_csoundmixer, GST_TYPE_AGGREGATOR,
+    GST_DEBUG_CATEGORY_INIT (gst_csoundmixer_debug_category, "csoundmixer", 0,
+        "debug category for csoundmixer element"));
+
+static void
+gst_csoundmixer_class_init (GstCsoundmixerClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstAggregatorClass *aggregator_class = GST_AGGREGATOR_CLASS (klass);
+
+  gst_element_class_add_static_pad_template (GST_ELEMENT_CLASS (klass),
+      &gst_csoundmixer_src_template);
+  gst_element_class_add_static_pad_template_with_gtype (GST_ELEMENT_CLASS
+      (klass), &gst_csoundmixer_sink_template, GST_TYPE_CSOUNDMIXER_PAD);
+
+  gobject_class->set_property = gst_csoundmixer_set_property;
+  gobject_class->get_property = gst_csoundmixer_get_property;
+  gobject_class->finalize = gst_csoundmixer_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_LOCATION,
+      g_param_spec_string ("location", "Location",
+          "Location of the csd file used for csound", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_INSTANCE_POOL,
+      g_param_spec_boolean ("instance-pool", "Instance pool",
+          "Take compiled csound instances from a process wide pool and give "
+          "them back rewound on stop, instead of compiling the csd on every "
+          "start", DEFAULT_INSTANCE_POOL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_SAMPLES_PER_BUFFER,
+      g_param_spec_uint ("samples-per-buffer", "Samples per buffer",
+          "Most frames in an output buffer, rounded up to whole ksmps blocks "
+          "(0 = 10 ms)", 0, G_MAXINT, DEFAULT_SAMPLES_PER_BUFFER,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_MESSAGE_LEVEL,
+      g_param_spec_enum ("message-level", "Message level",
+          "Most verbose csound messages forwarded to the debug log and, as "
+          "\"csound-message\" element messages, to the bus",
+          GST_TYPE_CSOUND_MESSAGE_LEVEL, GST_CSOUND_LOG_DEFAULT_LEVEL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MESSAGE_RATE,
+      g_param_spec_uint ("message-rate", "Message rate",
+          "Csound messages forwarded per second and level, the others are "
+          "only counted (0 = unlimited)", 0, G_MAXUINT,
+          GST_CSOUND_LOG_DEFAULT_RATE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Time spent in csoundPerformKsmps() per block (min, avg, max, p99), "
+          "load, real-time factor, blocks and buffers processed slower than "
+          "real time",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS_INTERVAL,
+      g_param_spec_uint64 ("stats-interval", "Statistics interval",
+          "Post the statistics as a \"csound-stats\" element message this "
+          "often, in nanoseconds (0 = never)", 0, G_MAXUINT64, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_set_static_metadata (GST_ELEMENT_CLASS (klass),
+      "Csound audio mixer", "Filter/Effect/Audio",
+      "Run several audio streams through one csound orchestra",
+      "Natanael Mojica <neithanmo@gmail.com>");
+
+  aggregator_class->start = GST_DEBUG_FUNCPTR (gst_csoundmixer_start);
+  aggregator_class->stop = GST_DEBUG_FUNCPTR (gst_csoundmixer_stop);
+  aggregator_class->flush = GST_DEBUG_FUNCPTR (gst_csoundmixer_flush);
+  aggregator_class->sink_query = GST_DEBUG_FUNCPTR (gst_csoundmixer_sink_query);
+  aggregator_class->sink_event = GST_DEBUG_FUNCPTR (gst_csoundmixer_sink_event);
+  aggregator_class->update_src_caps =
+      GST_DEBUG_FUNCPTR (gst_csoundmixer_update_src_caps);
+  aggregator_class->negotiated_src_caps =
+      GST_DEBUG_FUNCPTR (gst_csoundmixer_negotiated_src_caps);
+  aggregator_class->aggregate = GST_DEBUG_FUNCPTR (gst_csoundmixer_aggregate);
+}
+
+static void
+gst_csoundmixer_init (GstCsoundmixer * csoundmixer)
+{
+  csoundmixer->samples_per_buffer = DEFAULT_SAMPLES_PER_BUFFER;
+  csoundmixer->message_level = GST_CSOUND_LOG_DEFAULT_LEVEL;
+  csoundmixer->message_rate = GST_CSOUND_LOG_DEFAULT_RATE;
+  gst_csound_stats_board_init (&csoundmixer->stats_board);
+  gst_audio_info_init (&csoundmixer->info);
+}
+
+void
+gst_csoundmixer_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstCsoundmixer *csoundmixer = GST_CSOUNDMIXER (object);
+
+  GST_DEBUG_OBJECT (csoundmixer, "set_property");
+
+  switch (property_id) {
+    case PROP_LOCATION:
+      g_free (csoundmixer->csd_name);
+      csoundmixer->csd_name = g_value_dup_string (value);
+      break;
+    case PROP_INSTANCE_POOL:
+      csoundmixer->instance_pool = g_value_get_boolean (value);
+      break;
+    case PROP_SAMPLES_PER_BUFFER:
+      csoundmixer->samples_per_buffer = g_value_get_uint (value);
+      break;
+    case PROP_MESSAGE_LEVEL:
+      GST_OBJECT_LOCK (csoundmixer);
+      csoundmixer->message_level = g_value_get_enum (value);
+      if (csoundmixer->log)
+        gst_csound_log_set_level (csoundmixer->log,
+            csoundmixer->message_level);
+      GST_OBJECT_UNLOCK (csoundmixer);
+      break;
+    case PROP_MESSAGE_RATE:
+      GST_OBJECT_LOCK (csoundmixer);
+      csoundmixer->message_rate = g_value_get_uint (value);
+      if (csoundmixer->log)
+        gst_csound_log_set_rate (csoundmixer->log, csoundmixer->message_rate);
+      GST_OBJECT_UNLOCK (csoundmixer);
+      break;
+    case PROP_STATS_INTERVAL:
+      g_mutex_lock (&csoundmixer->stats_board.lock);
+      csoundmixer->stats_board.interval = g_value_get_uint64 (value);
+      g_mutex_unlock (&csoundmixer->stats_board.lock);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+void
+gst_csoundmixer_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstCsoundmixer *csoundmixer = GST_CSOUNDMIXER (object);
+
+  GST_DEBUG_OBJECT (csoundmixer, "get_property");
+
+  switch (property_id) {
+    case PROP_LOCATION:
+      g_value_set_string (value, csoundmixer->csd_name);
+      break;
+    case PROP_INSTANCE_POOL:
+      g_value_set_boolean (value, csoundmixer->instance_pool);
+      break;
+    case PROP_SAMPLES_PER_BUFFER:
+      g_value_set_uint (value, csoundmixer->samples_per_buffer);
+      break;
+    case PROP_MESSAGE_LEVEL:
+      g_value_set_enum (value, csoundmixer->message_level);
+      break;
+    case PROP_MESSAGE_RATE:
+      g_value_set_uint (value, csoundmixer->message_rate);
+      break;
+    case PROP_STATS:
+      g_value_take_boxed (value,
+          gst_csound_stats_board_get (&csoundmixer->stats_board));
+      break;
+    case PROP_STATS_INTERVAL:
+      g_mutex_lock (&csoundmixer->stats_board.lock);
+      g_value_set_uint64 (value, csoundmixer->stats_board.interval);
+      g_mutex_unlock (&csoundmixer->stats_board.lock);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+void
+gst_csoundmixer_finalize (GObject * object)
+{
+  GstCsoundmixer *csoundmixer = GST_CSOUNDMIXER (object);
+
+  GST_DEBUG_OBJECT (csoundmixer, "finalize");
+  gst_csound_stats_board_clear (&csoundmixer->stats_board);
+  g_free (csoundmixer->csd_name);
+
+  G_OBJECT_CLASS (gst_csoundmixer_parent_class)->finalize (object);
+}
+
+static gboolean
+gst_csoundmixer_start (GstAggregator * agg)
+{
+  GstCsoundmixer *csoundmixer = GST_CSOUNDMIXER (agg);
+  GstClockTime duration;
+  guint frames;
+
+  gst_csoundmixer_start_log (csoundmixer);
+  /* the instance comes back compiled and started */
+  csoundmixer->csound = gst_csound_instance_acquire (csoundmixer->csd_name,
+      NULL, csoundmixer->instance_pool, gst_csound_log_message,
+      csoundmixer->log);
+  if (csoundmixer->csound == NULL) {
+    GST_ELEMENT_ERROR (csoundmixer, RESOURCE, OPEN_READ,
+        ("%s", csoundmixer->csd_name), NULL);
+    gst_csoundmixer_stop_log (csoundmixer);
+    return FALSE;
+  }
+
+  csoundmixer->ksmps = csoundGetKsmps (csoundmixer->csound);
+  csoundmixer->ichannels = csoundGetNchnlsInput (csoundmixer->csound);
+  csoundmixer->ochannels = csoundGetNchnls (csoundmixer->csound);
+  csoundmixer->rate = csoundGetSr (csoundmixer->csound);
+  csoundmixer->spin = csoundGetSpin (csoundmixer->csound);
+  csoundmixer->spout = csoundGetSpout (csoundmixer->csound);
+  csoundmixer->out_sample = 0;
+  csoundmixer->end_of_score = 0;
+  gst_audio_info_init (&csoundmixer->info);
+
+  frames = csoundmixer->samples_per_buffer;
+  if (frames == 0)
+    frames = csoundmixer->rate / 100;
+  csoundmixer->buffer_blocks =
+      MAX (1, (frames + csoundmixer->ksmps - 1) / csoundmixer->ksmps);
+  duration = gst_util_uint64_scale_int (csoundmixer->buffer_blocks *
+      csoundmixer->ksmps, GST_SECOND, csoundmixer->rate);
+  gst_aggregator_set_latency (agg, duration, duration);
+  gst_csound_stats_reset (&csoundmixer->stats,
+      gst_util_uint64_scale_int (csoundmixer->ksmps, GST_SECOND,
+          csoundmixer->rate));
+  GST_DEBUG_OBJECT (csoundmixer, "%u inputs, %u outputs, %u blocks per buffer",
+      csoundmixer->ichannels, csoundmixer->ochannels,
+      csoundmixer->buffer_blocks);
+
+  return TRUE;
+}
+
+static gboolean
+gst_csoundmixer_stop (GstAggregator * agg)
+{
+  GstCsoundmixer *csoundmixer = GST_CSOUNDMIXER (agg);
+
+  GST_DEBUG_OBJECT (csoundmixer, "stop");
+  gst_csound_instance_release (csoundmixer->csound);
+  csoundmixer->csound = NULL;
+  csoundmixer->spin = NULL;
+  csoundmixer->spout = NULL;
+  gst_csoundmixer_stop_log (csoundmixer);
+
+  return TRUE;
+}
+
+/* start the score over without recompiling it, the pads clear their
+ * adapters themselves */
+static GstFlowReturn
+gst_csoundmixer_flush (GstAggregator * agg)
+{
+  GstCsoundmixer *csoundmixer = GST_CSOUNDMIXER (agg);
+
+  if (csoundmixer->csound)
+    gst_csound_instance_rewind (csoundmixer->csound);
+  csoundmixer->out_sample = 0;
+  csoundmixer->end_of_score = 0;
+
+  return GST_FLOW_OK;
+}
+
+/* any format, the orchestra rate, no more channels than it takes */
+static gboolean
+gst_csoundmixer_sink_query (GstAggregator * agg, GstAggregatorPad * aggpad,
+    GstQuery * query)
+{
+  GstCsoundmixer *csoundmixer = GST_CSOUNDMIXER (agg);
+
+  if (GST_QUERY_TYPE (query) == GST_QUERY_CAPS && csoundmixer->csound) {
+    GstCaps *filter, *caps, *res;
+
+    gst_query_parse_caps (query, &filter);
+    caps = gst_caps_make_writable (gst_pad_get_pad_template_caps (GST_PAD
+            (aggpad)));
+    gst_caps_set_simple (caps, "rate", G_TYPE_INT, csoundmixer->rate, NULL);
+    if (csoundmixer->ichannels > 1)
+      gst_caps_set_simple (caps, "channels", GST_TYPE_INT_RANGE, 1,
+          csoundmixer->ichannels, NULL);
+    else
+      gst_caps_set_simple (caps, "channels", G_TYPE_INT, 1, NULL);
+    if (filter) {
+      res = gst_caps_intersect_full (filter, caps, GST_CAPS_INTERSECT_FIRST);
+      gst_caps_unref (caps);
+    } else {
+      res = caps;
+    }
+    gst_query_set_caps_result (query, res);
+    gst_caps_unref (res);
+
+    return TRUE;
+  }
+
+  return GST_AGGREGATOR_CLASS (gst_csoundmixer_parent_class)->sink_query (agg,
+      aggpad, query);
+}
+
+/* every pad on its range of inputs, in request order: a pad without
+ * first-channel follows the pad before it, one without caps yet takes
+ * no input. Called with the object lock, the ranges are checked again
+ * whenever a pad negotiates, since they depend on the pads before.
+ * Returns the reason, to post without the lock, when they do not fit */
+static gchar *
+gst_csoundmixer_place_pads (GstCsoundmixer * csoundmixer)
+{
+  GstCsoundmixerPad **owners = g_newa (GstCsoundmixerPad *,
+      csoundmixer->ichannels);
+  guint next = 0, first, channels, c;
+  gint first_channel;
+  GList *l;
+
+  memset (owners, 0, sizeof (GstCsoundmixerPad *) * csoundmixer->ichannels);
+  for (l = GST_ELEMENT (csoundmixer)->sinkpads; l; l = l->next) {
+    GstCsoundmixerPad *pad = l->data;
+
+    GST_OBJECT_LOCK (pad);
+    first_channel = pad->first_channel;
+    GST_OBJECT_UNLOCK (pad);
+    first = first_channel >= 0 ? (guint) first_channel : next;
+    channels = GST_AUDIO_INFO_CHANNELS (&pad->info);
+
+    if (first + channels > csoundmixer->ichannels)
+      return g_strdup_printf ("%s takes inputs %u to %u, the orchestra has %u",
+          GST_PAD_NAME (pad), first + 1, first + channels,
+          csoundmixer->ichannels);
+    for (c = first; c < first + channels; c++) {
+      if (owners[c])
+        return g_strdup_printf ("%s and %s both take input %u",
+            GST_PAD_NAME (owners[c]), GST_PAD_NAME (pad), c + 1);
+      owners[c] = pad;
+    }
+
+    if (channels > 0 && pad->first != first)
+      GST_DEBUG_OBJECT (pad, "inputs %u to %u", first + 1, first + channels);
+    pad->first = first;
+    next = first + channels;
+  }
+
+  return NULL;
+}
+
+static gboolean
+gst_csoundmixer_pad_set_caps (GstCsoundmixer * csoundmixer,
+    GstCsoundmixerPad * pad, GstCaps * caps)
+{
+  GstAudioInfo info, old_info;
+  GstCsoundConvert convert;
+  gchar *error;
+
+  if (!gst_audio_info_from_caps (&info, caps)
+      || GST_AUDIO_INFO_RATE (&info) != csoundmixer->rate
+      || !gst_csound_convert_setup (&convert,
+          GST_AUDIO_INFO_FORMAT (&info), csoundGet0dBFS (csoundmixer->csound))) {
+    GST_ERROR_OBJECT (pad, "invalid caps %" GST_PTR_FORMAT, caps);
+    return FALSE;
+  }
+
+  /* the streaming thread of the src pad reads the placement under it */
+  GST_OBJECT_LOCK (csoundmixer);
+  old_info = pad->info;
+  pad->info = info;
+  error = gst_csoundmixer_place_pads (csoundmixer);
+  if (error) {
+    /* back to the ranges that fitted */
+    pad->info = old_info;
+    g_free (gst_csoundmixer_place_pads (csoundmixer));
+  } else {
+    pad->in_convert = convert;
+    if (!gst_audio_info_is_equal (&info, &old_info))
+      gst_adapter_clear (pad->adapter);
+  }
+  GST_OBJECT_UNLOCK (csoundmixer);
+
+  if (error) {
+    GST_ELEMENT_ERROR (csoundmixer, CORE, NEGOTIATION, (NULL), ("%s",
+            error));
+    g_free (error);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_csoundmixer_sink_event (GstAggregator * agg, GstAggregatorPad * aggpad,
+    GstEvent * event)
+{
+  GstCsoundmixer *csoundmixer = GST_CSOUNDMIXER (agg);
+
+  if (GST_EVENT_TYPE (event) == GST_EVENT_CAPS) {
+    GstCaps *caps;
+
+    gst_event_parse_caps (event, &caps);
+    if (!gst_csoundmixer_pad_set_caps (csoundmixer,
+            GST_CSOUNDMIXER_PAD (aggpad), caps)) {
+      gst_event_unref (event);
+      return FALSE;
+    }
+  }
+
+  return GST_AGGREGATOR_CLASS (gst_csoundmixer_parent_class)->sink_event (agg,
+      aggpad, event);
+}
+
+/* what downstream takes at the orchestra rate and outputs */
+static GstFlowReturn
+gst_csoundmixer_update_src_caps (GstAggregator * agg, GstCaps * caps,
+    GstCaps ** ret)
+{
+  GstCsoundmixer *csoundmixer = GST_CSOUNDMIXER (agg);
+  GstCaps *orchestra;
+
+  orchestra = gst_caps_new_simple ("audio/x-raw",
+      "rate", G_TYPE_INT, csoundmixer->rate,
+      "channels", G_TYPE_INT, csoundmixer->ochannels,
+      "layout", G_TYPE_STRING, "interleaved", NULL);
+  *ret = gst_caps_intersect (caps, orchestra);
+  gst_caps_unref (orchestra);
+  if (gst_caps_is_empty (*ret)) {
+    gst_caps_replace (ret, NULL);
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  return GST_FLOW_OK;
+}
+
+static gboolean
+gst_csoundmixer_negotiated_src_caps (GstAggregator * agg, GstCaps * caps)
+{
+  GstCsoundmixer *csoundmixer = GST_CSOUNDMIXER (agg);
+  GstAudioInfo info;
+
+  if (!gst_audio_info_from_caps (&info, caps)
+      || !gst_csound_convert_setup (&csoundmixer->out_convert,
+          GST_AUDIO_INFO_FORMAT (&info), csoundGet0dBFS (csoundmixer->csound)))
+    return FALSE;
+
+  GST_DEBUG_OBJECT (csoundmixer, "negotiated to caps %" GST_PTR_FORMAT, caps);
+  csoundmixer->info = info;
+
+  return TRUE;
+}
+
+/* @buffer at its place in the output: silence before it when it starts
+ * later than the pad data so far, its head dropped when it overlaps */
+static void
+gst_csoundmixer_pad_queue (GstCsoundmixer * csoundmixer,
+    GstCsoundmixerPad * pad, GstBuffer * buffer)
+{
+  GstAggregatorPad *aggpad = GST_AGGREGATOR_PAD (pad);
+  gint bpf = GST_AUDIO_INFO_BPF (&pad->info);
+  GstClockTime running_time;
+  gint64 frames;
+
+  if (bpf == 0) {
+    gst_buffer_unref (buffer);
+    return;
+  }
+  frames = gst_buffer_get_size (buffer) / bpf;
+  if (pad->next_sample < 0)
+    pad->next_sample = csoundmixer->out_sample;
+
+  running_time = gst_segment_to_running_time (&aggpad->segment,
+      GST_FORMAT_TIME, GST_BUFFER_PTS (buffer));
+  if (GST_CLOCK_TIME_IS_VALID (running_time)) {
+    gint64 gap = (gint64) gst_util_uint64_scale_int_round (running_time,
+        csoundmixer->rate, GST_SECOND) - pad->next_sample;
+
+    /* less than a block apart is jitter */
+    if (gap > (gint64) csoundmixer->ksmps) {
+      GstBuffer *silence = gst_buffer_new_allocate (NULL, gap * bpf, NULL);
+      GstMapInfo map;
+
+      GST_DEBUG_OBJECT (pad, "%" G_GINT64_FORMAT " frames of silence", gap);
+      gst_buffer_map (silence, &map, GST_MAP_WRITE);
+      gst_audio_format_fill_silence (pad->info.finfo, map.data, map.size);
+      gst_buffer_unmap (silence, &map);
+      gst_adapter_push (pad->adapter, silence);
+      pad->next_sample += gap;
+    } else if (gap < -(gint64) csoundmixer->ksmps) {
+      GST_DEBUG_OBJECT (pad, "%" G_GINT64_FORMAT " frames late", -gap);
+      if (-gap >= frames) {
+        gst_buffer_unref (buffer);
+        return;
+      }
+      buffer = gst_buffer_make_writable (buffer);
+      gst_buffer_resize (buffer, -gap * bpf, -1);
+      frames += gap;
+    }
+  }
+
+  pad->next_sample += frames;
+  gst_adapter_push (pad->adapter, buffer);
+}
+
+/* the pad samples of the next block into its channels of spin, straight
+ * from its buffers. A pad short of a block is silent for the rest of it,
+ * its data after that goes later in the output */
+static void
+gst_csoundmixer_pad_fill (GstCsoundmixer * csoundmixer,
+    GstCsoundmixerPad * pad)
+{
+  guint channels = GST_AUDIO_INFO_CHANNELS (&pad->info);
+  gint bpf = GST_AUDIO_INFO_BPF (&pad->info);
+  const guint8 *in;
+  guint frames, i;
+
+  if (bpf == 0)
+    return;
+  frames = MIN (gst_adapter_available (pad->adapter) / bpf,
+      csoundmixer->ksmps);
+  if (pad->next_sample >= 0)
+    pad->next_sample += csoundmixer->ksmps - frames;
+  if (frames == 0)
+    return;
+
+  in = gst_adapter_map (pad->adapter, frames * bpf);
+  if (channels == csoundmixer->ichannels) {
+    gst_csound_convert_in (&pad->in_convert, csoundmixer->spin, in,
+        frames * channels);
+  } else {
+    for (i = 0; i < frames; i++)
+      gst_csound_convert_in (&pad->in_convert,
+          csoundmixer->spin + i * csoundmixer->ichannels + pad->first,
+          in + i * bpf, channels);
+  }
+  gst_adapter_unmap (pad->adapter);
+  gst_adapter_flush (pad->adapter, frames * bpf);
+}
+
+/* as many blocks as every running pad has data for, the pads that ended
+ * are silent. Nothing is output while a pad is short of a block, the
+ * base class calls again once it has another buffer, or with @timeout
+ * in live mode, when the pads short of a block are silent instead.
+ * Buffers stay queued on their pad until an output buffer needs them,
+ * so upstream is held back by the aggregator queues */
+static GstFlowReturn
+gst_csoundmixer_aggregate (GstAggregator * agg, gboolean timeout)
+{
+  GstCsoundmixer *csoundmixer = GST_CSOUNDMIXER (agg);
+  GstAggregatorPad *srcpad = GST_AGGREGATOR_PAD (agg->srcpad);
+  guint ksmps = csoundmixer->ksmps;
+  guint wanted = csoundmixer->buffer_blocks * ksmps;
+  guint blocks = G_MAXUINT, tail = 0, done;
+  gboolean running = FALSE;
+  gint bpf = GST_AUDIO_INFO_BPF (&csoundmixer->info);
+  GstClockTime began, elapsed, total = 0, pts;
+  GstBuffer *outbuf;
+  GstMapInfo map;
+  gint ret = 0;
+  GList *l;
+
+  if (bpf == 0)
+    return GST_FLOW_NOT_NEGOTIATED;
+  if (csoundmixer->end_of_score)
+    return GST_FLOW_EOS;
+
+  GST_OBJECT_LOCK (csoundmixer);
+  for (l = GST_ELEMENT (csoundmixer)->sinkpads; l; l = l->next) {
+    GstCsoundmixerPad *pad = l->data;
+    GstAggregatorPad *aggpad = GST_AGGREGATOR_PAD (pad);
+    gint bpf = GST_AUDIO_INFO_BPF (&pad->info);
+    GstBuffer *buffer;
+    guint available;
+
+    available = bpf ? gst_adapter_available (pad->adapter) / bpf : 0;
+    while (available < wanted && gst_aggregator_pad_has_buffer (aggpad)) {
+      if (!(buffer = gst_aggregator_pad_pop_buffer (aggpad)))
+        break;
+      gst_csoundmixer_pad_queue (csoundmixer, pad, buffer);
+      available = bpf ? gst_adapter_available (pad->adapter) / bpf : 0;
+    }
+
+    if (gst_aggregator_pad_is_eos (aggpad)) {
+      tail = MAX (tail, (available + ksmps - 1) / ksmps);
+    } else {
+      running = TRUE;
+      if (!timeout || available >= ksmps)
+        blocks = MIN (blocks, available / ksmps);
+    }
+  }
+  GST_OBJECT_UNLOCK (csoundmixer);
+
+  if (blocks == G_MAXUINT) {
+    if (running)
+      /* timed out with every running pad starved, all silent */
+      blocks = csoundmixer->buffer_blocks;
+    else if (tail == 0)
+      /* every pad ended */
+      return GST_FLOW_EOS;
+    else
+      /* every pad ended, what is left of them */
+      blocks = tail;
+  }
+  blocks = MIN (blocks, csoundmixer->buffer_blocks);
+  if (blocks == 0)
+    return GST_FLOW_OK;
+
+  outbuf = gst_csound_buffer_new_allocate ((gsize) blocks * ksmps * bpf);
+  gst_buffer_map (outbuf, &map, GST_MAP_WRITE);
+  for (done = 0; done < blocks; done++) {
+    memset (csoundmixer->spin, 0,
+        sizeof (MYFLT) * ksmps * csoundmixer->ichannels);
+    GST_OBJECT_LOCK (csoundmixer);
+    for (l = GST_ELEMENT (csoundmixer)->sinkpads; l; l = l->next)
+      gst_csoundmixer_pad_fill (csoundmixer, l->data);
+    GST_OBJECT_UNLOCK (csoundmixer);
+
+    began = gst_util_get_timestamp ();
+    ret = csoundPerformKsmps (csoundmixer->csound);
+    elapsed = gst_util_get_timestamp () - began;
+    gst_csound_stats_add_block (&csoundmixer->stats, elapsed);
+    total += elapsed;
+    if (ret) {
+      GST_INFO_OBJECT (csoundmixer, "end of score");
+      csoundmixer->end_of_score = ret;
+      break;
+    }
+    gst_csound_convert_out (&csoundmixer->out_convert,
+        map.data + (gsize) done * ksmps * bpf, csoundmixer->spout,
+        ksmps * csoundmixer->ochannels);
+  }
+  gst_buffer_unmap (outbuf, &map);
+  gst_csound_stats_add_buffer (&csoundmixer->stats, total,
+      done * csoundmixer->stats.block_duration);
+  gst_csound_stats_publish (&csoundmixer->stats_board, &csoundmixer->stats,
+      GST_ELEMENT (csoundmixer));
+
+  if (done == 0) {
+    gst_buffer_unref (outbuf);
+    return GST_FLOW_EOS;
+  }
+
+  gst_buffer_set_size (outbuf, (gsize) done * ksmps * bpf);
+  pts = srcpad->segment.start +
+      gst_util_uint64_scale_int (csoundmixer->out_sample, GST_SECOND,
+      csoundmixer->rate);
+  GST_BUFFER_OFFSET (outbuf) = csoundmixer->out_sample;
+  csoundmixer->out_sample += done * ksmps;
+  GST_BUFFER_OFFSET_END (outbuf) = csoundmixer->out_sample;
+  GST_BUFFER_PTS (outbuf) = pts;
+  GST_BUFFER_DURATION (outbuf) = srcpad->segment.start +
+      gst_util_uint64_scale_int (csoundmixer->out_sample, GST_SECOND,
+      csoundmixer->rate) - pts;
+  if (GST_BUFFER_OFFSET (outbuf) == 0)
+    GST_BUFFER_FLAG_SET (outbuf, GST_BUFFER_FLAG_DISCONT);
+
+  GST_OBJECT_LOCK (agg);
+  srcpad->segment.position = pts + GST_BUFFER_DURATION (outbuf);
+  GST_OBJECT_UNLOCK (agg);
+
+  return gst_aggregator_finish_buffer (agg, outbuf);
+}
+
+CSOUND *
+gst_csoundmixer_get_instance (GstCsoundmixer * csoundmixer)
+{
+  return csoundmixer->csound;
+}
+
+/* set up before acquiring the instance, it prints through it */
+static void
+gst_csoundmixer_start_log (GstCsoundmixer * csoundmixer)
+{
+  GstCsoundLog *log = gst_csound_log_new (GST_ELEMENT (csoundmixer),
+      GST_CAT_DEFAULT, csoundmixer->message_level, csoundmixer->message_rate);
+
+  GST_OBJECT_LOCK (csoundmixer);
+  csoundmixer->log = log;
+  GST_OBJECT_UNLOCK (csoundmixer);
+}
+
+/* only once the instance is released */
+static void
+gst_csoundmixer_stop_log (GstCsoundmixer * csoundmixer)
+{
+  GstCsoundLog *log;
+
+  GST_OBJECT_LOCK (csoundmixer);
+  log = csoundmixer->log;
+  csoundmixer->log = NULL;
+  GST_OBJECT_UNLOCK (csoundmixer);
+  gst_csound_log_free (log);
+}
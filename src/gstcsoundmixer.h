@@ -0,0 +1,103 @@
+/* GStreamer
+ * Copyright (C) 2017 <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_CSOUNDMIXER_H_
+#define _GST_CSOUNDMIXER_H_
+
+#include <gst/base/gstaggregator.h>
+#include <gst/base/gstadapter.h>
+#include <gst/audio/audio.h>
+#include <csound/csound.h>
+#include "gstcsoundconvert.h"
+#include "gstcsoundlog.h"
+#include "gstcsoundstats.h"
+
+G_BEGIN_DECLS
+#define GST_TYPE_CSOUNDMIXER   (gst_csoundmixer_get_type())
+#define GST_CSOUNDMIXER(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_CSOUNDMIXER,GstCsoundmixer))
+#define GST_CSOUNDMIXER_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_CSOUNDMIXER,GstCsoundmixerClass))
+#define GST_IS_CSOUNDMIXER(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_CSOUNDMIXER))
+#define GST_IS_CSOUNDMIXER_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_CSOUNDMIXER))
+#define GST_TYPE_CSOUNDMIXER_PAD   (gst_csoundmixer_pad_get_type())
+#define GST_CSOUNDMIXER_PAD(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_CSOUNDMIXER_PAD,GstCsoundmixerPad))
+typedef struct _GstCsoundmixer GstCsoundmixer;
+typedef struct _GstCsoundmixerClass GstCsoundmixerClass;
+typedef struct _GstCsoundmixerPad GstCsoundmixerPad;
+typedef struct _GstCsoundmixerPadClass GstCsoundmixerPadClass;
+
+/* a sink pad, feeding a range of the orchestra inputs */
+struct _GstCsoundmixerPad
+{
+  GstAggregatorPad parent;
+
+  gint first_channel;           /* property, -1 to follow the pad before */
+
+  /* set on caps, read by the src pad thread, under the element lock */
+  GstAudioInfo info;
+  GstCsoundConvert in_convert;
+  guint first;                  /* spin channel of the first pad channel */
+  GstAdapter *adapter;
+  gint64 next_sample;           /* output sample at the end of the adapter */
+};
+
+struct _GstCsoundmixerPadClass
+{
+  GstAggregatorPadClass parent_class;
+};
+
+struct _GstCsoundmixer
+{
+  GstAggregator base_csoundmixer;
+  CSOUND *csound;
+  gchar *csd_name;
+  gboolean instance_pool;
+  guint samples_per_buffer;
+  GstCsoundLog *log;
+  GstCsoundMessageLevel message_level;
+  guint message_rate;
+
+  /* owned by the streaming thread */
+  GstCsoundStats stats;
+  GstCsoundStatsBoard stats_board;
+  GstAudioInfo info;
+  GstCsoundConvert out_convert;
+  MYFLT *spin;
+  MYFLT *spout;
+  guint ksmps;
+  guint ichannels;
+  guint ochannels;
+  gint rate;
+  guint buffer_blocks;
+  gint64 out_sample;            /* samples pushed since the segment start */
+  gint end_of_score;
+};
+
+struct _GstCsoundmixerClass
+{
+  GstAggregatorClass base_csoundmixer_class;
+};
+
+GType gst_csoundmixer_get_type (void);
+GType gst_csoundmixer_pad_get_type (void);
+
+GST_EXPORT
+CSOUND *gst_csoundmixer_get_instance (GstCsoundmixer * csoundmixer);
+
+G_END_DECLS
+#endif
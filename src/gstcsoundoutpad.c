@@ -0,0 +1,372 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/* Output buses on their own pads.
+ *
+ * An "out_%u" request pad takes the channels first-channel to
+ * first-channel + channels - 1 of every buffer the element pushes on its
+ * src pad, with the same format, layout, rate and timestamps, so
+ * separate buses of one orchestra go to separate branches without a
+ * deinterleave element. The channels are picked from the buffer right
+ * after it was converted from spout, while it is still in cache, by the
+ * thread that pushes it. The pads carry the flushes, segments and EOS of
+ * the src pad. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include "gstcsoundoutpad.h"
+
+enum
+{
+  PROP_0,
+  PROP_FIRST_CHANNEL,
+  PROP_CHANNELS
+};
+
+G_DEFINE_TYPE (GstCsoundOutPad, gst_csound_out_pad, GST_TYPE_PAD);
+
+static void
+gst_csound_out_pad_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstCsoundOutPad *pad = GST_CSOUND_OUT_PAD (object);
+
+  switch (property_id) {
+    case PROP_FIRST_CHANNEL:
+      GST_OBJECT_LOCK (pad);
+      pad->first_channel = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (pad);
+      break;
+    case PROP_CHANNELS:
+      GST_OBJECT_LOCK (pad);
+      pad->channels = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (pad);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_csound_out_pad_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstCsoundOutPad *pad = GST_CSOUND_OUT_PAD (object);
+
+  switch (property_id) {
+    case PROP_FIRST_CHANNEL:
+      GST_OBJECT_LOCK (pad);
+      g_value_set_uint (value, pad->first_channel);
+      GST_OBJECT_UNLOCK (pad);
+      break;
+    case PROP_CHANNELS:
+      GST_OBJECT_LOCK (pad);
+      g_value_set_uint (value, pad->channels);
+      GST_OBJECT_UNLOCK (pad);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_csound_out_pad_class_init (GstCsoundOutPadClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->set_property = gst_csound_out_pad_set_property;
+  gobject_class->get_property = gst_csound_out_pad_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_FIRST_CHANNEL,
+      g_param_spec_uint ("first-channel", "First channel",
+          "First output channel of the orchestra pushed on the pad, from 0",
+          0, G_MAXINT, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CHANNELS,
+      g_param_spec_uint ("channels", "Channels",
+          "Output channels pushed on the pad", 1, G_MAXINT, 1,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+}
+
+static void
+gst_csound_out_pad_init (GstCsoundOutPad * pad)
+{
+  pad->channels = 1;
+  gst_audio_info_init (&pad->info);
+  pad->need_stream_start = TRUE;
+  pad->need_segment = TRUE;
+  gst_pad_use_fixed_caps (GST_PAD (pad));
+}
+
+/**
+ * gst_csound_out_pad_request:
+ * @pads: the out pads of @element, changed under its object lock
+ *
+ * Returns: a new pad, added to @element
+ */
+GstPad *
+gst_csound_out_pad_request (GstElement * element, GList ** pads,
+    GstPadTemplate * templ, const gchar * name)
+{
+  GstPad *pad, *other;
+  gchar *pad_name = g_strdup (name);
+  guint index = 0;
+
+  /* the first free name */
+  while (pad_name == NULL) {
+    pad_name = g_strdup_printf ("out_%u", index++);
+    if ((other = gst_element_get_static_pad (element, pad_name))) {
+      gst_object_unref (other);
+      g_free (pad_name);
+      pad_name = NULL;
+    }
+  }
+  pad = g_object_new (GST_TYPE_CSOUND_OUT_PAD, "name", pad_name,
+      "direction", GST_PAD_SRC, "template", templ, NULL);
+  g_free (pad_name);
+
+  if (GST_STATE (element) > GST_STATE_READY)
+    gst_pad_set_active (pad, TRUE);
+  if (!gst_element_add_pad (element, pad)) {
+    gst_object_unref (pad);
+    return NULL;
+  }
+
+  GST_OBJECT_LOCK (element);
+  *pads = g_list_append (*pads, gst_object_ref (pad));
+  GST_OBJECT_UNLOCK (element);
+
+  return pad;
+}
+
+void
+gst_csound_out_pad_release (GstElement * element, GList ** pads,
+    GstPad * pad)
+{
+  GList *l;
+
+  GST_OBJECT_LOCK (element);
+  l = g_list_find (*pads, pad);
+  if (l == NULL) {
+    GST_OBJECT_UNLOCK (element);
+    return;
+  }
+  *pads = g_list_delete_link (*pads, l);
+  GST_OBJECT_UNLOCK (element);
+
+  gst_pad_set_active (pad, FALSE);
+  gst_element_remove_pad (element, pad);
+  gst_object_unref (pad);
+}
+
+static GList *
+gst_csound_out_pads_ref (GstElement * element, GList ** pads)
+{
+  GList *res;
+
+  GST_OBJECT_LOCK (element);
+  res = g_list_copy_deep (*pads, (GCopyFunc) gst_object_ref, NULL);
+  GST_OBJECT_UNLOCK (element);
+
+  return res;
+}
+
+/* the sticky events the pad still misses, in order */
+static gboolean
+gst_csound_out_pad_prepare (GstElement * element, GstCsoundOutPad * pad,
+    const GstAudioInfo * info, guint channels, const GstSegment * segment)
+{
+  GstPad *srcpad = GST_PAD (pad);
+  GstAudioInfo out;
+
+  if (pad->need_stream_start) {
+    gchar *stream_id = gst_pad_create_stream_id (srcpad, element,
+        GST_PAD_NAME (pad));
+
+    gst_pad_push_event (srcpad, gst_event_new_stream_start (stream_id));
+    g_free (stream_id);
+    pad->need_stream_start = FALSE;
+  }
+
+  gst_audio_info_set_format (&out, GST_AUDIO_INFO_FORMAT (info),
+      GST_AUDIO_INFO_RATE (info), channels, NULL);
+  GST_AUDIO_INFO_LAYOUT (&out) = GST_AUDIO_INFO_LAYOUT (info);
+  if (!gst_audio_info_is_equal (&out, &pad->info)) {
+    GstCaps *caps = gst_audio_info_to_caps (&out);
+    gboolean res = gst_pad_push_event (srcpad, gst_event_new_caps (caps));
+
+    gst_caps_unref (caps);
+    if (!res)
+      return FALSE;
+    pad->info = out;
+  }
+
+  if (pad->need_segment) {
+    gst_pad_push_event (srcpad, gst_event_new_segment (segment));
+    pad->need_segment = FALSE;
+  }
+
+  return TRUE;
+}
+
+/**
+ * gst_csound_out_pads_push:
+ * @buffer: as pushed on the src pad of @element, only read, the caller
+ *     keeps its reference
+ * @info: its format
+ * @segment: the segment of the src pad
+ *
+ * Push the channels of every out pad from @buffer.
+ *
+ * Returns: a flow @element has to return, %GST_FLOW_OK when the pads
+ *     are not linked or ended
+ */
+GstFlowReturn
+gst_csound_out_pads_push (GstElement * element, GList ** out_pads,
+    GstBuffer * buffer, const GstAudioInfo * info, const GstSegment * segment)
+{
+  GstFlowReturn res = GST_FLOW_OK;
+  GList *pads, *l;
+  GstAudioBuffer in;
+  gint bpf = GST_AUDIO_INFO_BPF (info), bps = GST_AUDIO_INFO_BPS (info);
+  gboolean planar =
+      GST_AUDIO_INFO_LAYOUT (info) == GST_AUDIO_LAYOUT_NON_INTERLEAVED;
+  guint frames, i;
+
+  if (bpf == 0)
+    return GST_FLOW_OK;
+  pads = gst_csound_out_pads_ref (element, out_pads);
+  if (pads == NULL)
+    return GST_FLOW_OK;
+
+  if (!gst_audio_buffer_map (&in, info, buffer, GST_MAP_READ)) {
+    g_list_free_full (pads, gst_object_unref);
+    return GST_FLOW_ERROR;
+  }
+  frames = GST_AUDIO_BUFFER_N_SAMPLES (&in);
+
+  for (l = pads; l; l = l->next) {
+    GstCsoundOutPad *pad = l->data;
+    guint first, channels;
+    GstBuffer *outbuf;
+    GstMapInfo out;
+    GstFlowReturn ret;
+
+    GST_OBJECT_LOCK (pad);
+    first = pad->first_channel;
+    channels = pad->channels;
+    GST_OBJECT_UNLOCK (pad);
+    if (first + channels > GST_AUDIO_INFO_CHANNELS (info)) {
+      GST_ELEMENT_ERROR (element, CORE, NEGOTIATION, (NULL),
+          ("%s wants channels %u to %u of %d", GST_PAD_NAME (pad), first,
+              first + channels - 1, GST_AUDIO_INFO_CHANNELS (info)));
+      res = GST_FLOW_NOT_NEGOTIATED;
+      break;
+    }
+    if (!gst_csound_out_pad_prepare (element, pad, info, channels, segment))
+      continue;
+
+    outbuf = gst_buffer_new_allocate (NULL, (gsize) frames * channels * bps,
+        NULL);
+    gst_buffer_map (outbuf, &out, GST_MAP_WRITE);
+    if (planar) {
+      gsize plane = (gsize) frames * bps;
+
+      /* planes of the buffer may not be packed, copy them one by one */
+      for (i = 0; i < channels; i++)
+        memcpy (out.data + i * plane, in.planes[first + i], plane);
+    } else if (channels == GST_AUDIO_INFO_CHANNELS (info)) {
+      memcpy (out.data, in.planes[0], out.size);
+    } else {
+      const guint8 *src = (const guint8 *) in.planes[0] + first * bps;
+      guint8 *dst = out.data;
+      gsize size = channels * bps;
+
+      for (i = 0; i < frames; i++, src += bpf, dst += size)
+        memcpy (dst, src, size);
+    }
+    gst_buffer_unmap (outbuf, &out);
+    if (planar)
+      gst_buffer_add_audio_meta (outbuf, &pad->info, frames, NULL);
+    gst_buffer_copy_into (outbuf, buffer, GST_BUFFER_COPY_FLAGS |
+        GST_BUFFER_COPY_TIMESTAMPS, 0, -1);
+
+    ret = gst_pad_push (GST_PAD (pad), outbuf);
+    /* one branch not linked or done does not stop the others */
+    if (ret != GST_FLOW_OK && ret != GST_FLOW_NOT_LINKED
+        && ret != GST_FLOW_EOS && res == GST_FLOW_OK)
+      res = ret;
+  }
+
+  gst_audio_buffer_unmap (&in);
+  g_list_free_full (pads, gst_object_unref);
+
+  return res;
+}
+
+/* flushes and EOS of the src pad, a flush is followed by a new segment */
+void
+gst_csound_out_pads_push_event (GstElement * element, GList ** out_pads,
+    GstEvent * event)
+{
+  GList *pads, *l;
+
+  pads = gst_csound_out_pads_ref (element, out_pads);
+  for (l = pads; l; l = l->next) {
+    if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP)
+      GST_CSOUND_OUT_PAD (l->data)->need_segment = TRUE;
+    gst_pad_push_event (l->data, gst_event_ref (event));
+  }
+  g_list_free_full (pads, gst_object_unref);
+  gst_event_unref (event);
+}
+
+/* the segment of the src pad changed, pushed with the next buffer */
+void
+gst_csound_out_pads_new_segment (GstElement * element, GList ** pads)
+{
+  GList *l;
+
+  GST_OBJECT_LOCK (element);
+  for (l = *pads; l; l = l->next)
+    GST_CSOUND_OUT_PAD (l->data)->need_segment = TRUE;
+  GST_OBJECT_UNLOCK (element);
+}
+
+/* the pads were deactivated and lost their sticky events */
+void
+gst_csound_out_pads_reset (GstElement * element, GList ** pads)
+{
+  GList *l;
+
+  GST_OBJECT_LOCK (element);
+  for (l = *pads; l; l = l->next) {
+    GstCsoundOutPad *pad = l->data;
+
+    gst_audio_info_init (&pad->info);
+    pad->need_stream_start = TRUE;
+    pad->need_segment = TRUE;
+  }
+  GST_OBJECT_UNLOCK (element);
+}
@@ -0,0 +1,77 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_CSOUND_OUT_PAD_H_
+#define _GST_CSOUND_OUT_PAD_H_
+
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
+#include "gstcsoundconvert.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_CSOUND_OUT_PAD   (gst_csound_out_pad_get_type())
+#define GST_CSOUND_OUT_PAD(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_CSOUND_OUT_PAD,GstCsoundOutPad))
+
+typedef struct _GstCsoundOutPad GstCsoundOutPad;
+typedef struct _GstCsoundOutPadClass GstCsoundOutPadClass;
+
+/* the request "out_%u" pads of csoundsrc and csoundfilter, each pushing
+ * a range of the output channels */
+struct _GstCsoundOutPad
+{
+  GstPad parent;
+
+  /* properties, under the object lock */
+  guint first_channel;
+  guint channels;
+
+  /* owned by the streaming thread */
+  GstAudioInfo info;
+  gboolean need_stream_start;
+  gboolean need_segment;
+};
+
+struct _GstCsoundOutPadClass
+{
+  GstPadClass parent_class;
+};
+
+GType gst_csound_out_pad_get_type (void);
+
+#define GST_CSOUND_OUT_PAD_TEMPLATE_CAPS \
+    "audio/x-raw,format=" GST_CSOUND_AUDIO_FORMATS \
+    ",rate=[1,max],channels=[1,max]," \
+    "layout={interleaved,non-interleaved}"
+
+GstPad *gst_csound_out_pad_request (GstElement * element, GList ** pads,
+    GstPadTemplate * templ, const gchar * name);
+void gst_csound_out_pad_release (GstElement * element, GList ** pads,
+    GstPad * pad);
+
+GstFlowReturn gst_csound_out_pads_push (GstElement * element, GList ** pads,
+    GstBuffer * buffer, const GstAudioInfo * info, const GstSegment * segment);
+void gst_csound_out_pads_push_event (GstElement * element, GList ** pads,
+    GstEvent * event);
+void gst_csound_out_pads_new_segment (GstElement * element, GList ** pads);
+void gst_csound_out_pads_reset (GstElement * element, GList ** pads);
+
+G_END_DECLS
+
+#endif
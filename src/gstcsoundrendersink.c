@@ -0,0 +1,527 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+/**
+ * SECTION:element-csoundrendersink
+ * @see_also: #csoundsink, #csoundsrc, #csoundfilter
+ * @short_description: feed raw audio samples to Csound as fast as possible
+ *
+ * Like csoundsink, but the buffers go straight into csound's input from
+ * the streaming thread, without a ring buffer and, by default, without
+ * waiting for the clock. Meant for orchestras that analyse what they get
+ * (feature extraction, loudness measurement) rather than play it.
+ * Unlike csoundsink it also takes non-interleaved buffers, their planes
+ * are interleaved into spin block by block.
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 filesrc location=stream.wav ! decodebin ! audioconvert ! csoundrendersink location=loudness.csd
+ * ]| will run a whole file through csound at the speed of the CPU.
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+#include "gstcsoundrendersink.h"
+#include "gstcsoundconvert.h"
+#include "gstcsoundinstance.h"
+#include "gstcsoundlog.h"
+#include "gstcsoundstats.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_csoundrendersink_debug_category);
+#define GST_CAT_DEFAULT gst_csoundrendersink_debug_category
+
+#define DEFAULT_INSTANCE_POOL        FALSE
+
+/* prototypes */
+
+
+static void gst_csoundrendersink_set_property (GObject * object,
+    guint property_id, const GValue * value, GParamSpec * pspec);
+static void gst_csoundrendersink_get_property (GObject * object,
+    guint property_id, GValue * value, GParamSpec * pspec);
+static void gst_csoundrendersink_finalize (GObject * object);
+
+static gboolean gst_csoundrendersink_start (GstBaseSink * sink);
+static gboolean gst_csoundrendersink_stop (GstBaseSink * sink);
+static gboolean gst_csoundrendersink_set_caps (GstBaseSink * sink,
+    GstCaps * caps);
+static GstFlowReturn gst_csoundrendersink_render (GstBaseSink * sink,
+    GstBuffer * buffer);
+static gboolean gst_csoundrendersink_event (GstBaseSink * sink,
+    GstEvent * event);
+static void gst_csoundrendersink_start_log (GstCsoundrendersink *
+    csoundrendersink);
+static void gst_csoundrendersink_stop_log (GstCsoundrendersink *
+    csoundrendersink);
+
+enum
+{
+  PROP_0,
+  PROP_LOCATION,
+  PROP_INSTANCE_POOL,
+  PROP_MESSAGE_LEVEL,
+  PROP_MESSAGE_RATE,
+  PROP_STATS,
+  PROP_STATS_INTERVAL
+};
+
+/* pad templates */
+
+static GstStaticPadTemplate gst_csoundrendersink_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("audio/x-raw,format=" GST_CSOUND_AUDIO_FORMATS
+        ",rate=[1,max],channels=[1,max],"
+        "layout={interleaved,non-interleaved}")
+    );
+
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (GstCsoundrendersink, gst_csoundrendersink,
+    GST_TYPE_BASE_SINK,
+    GST_DEBUG_CATEGORY_INIT (gst_csoundrendersink_debug_category,
+        "csoundrendersink", 0, "debug category for csoundrendersink element"));
+
+static void
+gst_csoundrendersink_class_init (GstCsoundrendersinkClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstBaseSinkClass *base_sink_class = GST_BASE_SINK_CLASS (klass);
+
+  gst_element_class_add_static_pad_template (GST_ELEMENT_CLASS (klass),
+      &gst_csoundrendersink_sink_template);
+
+  gobject_class->set_property = gst_csoundrendersink_set_property;
+  gobject_class->get_property = gst_csoundrendersink_get_property;
+  gobject_class->finalize = gst_csoundrendersink_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_LOCATION,
+      g_param_spec_string ("location", "Location",
+          "Location of the csd file used for csound", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_INSTANCE_POOL,
+      g_param_spec_boolean ("instance-pool", "Instance pool",
+          "Take compiled csound instances from a process wide pool and give "
+          "them back rewound on stop, instead of compiling the csd on every "
+          "start", DEFAULT_INSTANCE_POOL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_MESSAGE_LEVEL,
+      g_param_spec_enum ("message-level", "Message level",
+          "Most verbose csound messages forwarded to the debug log and, as "
+          "\"csound-message\" element messages, to the bus",
+          GST_TYPE_CSOUND_MESSAGE_LEVEL, GST_CSOUND_LOG_DEFAULT_LEVEL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MESSAGE_RATE,
+      g_param_spec_uint ("message-rate", "Message rate",
+          "Csound messages forwarded per second and level, the others are "
+          "only counted (0 = unlimited)", 0, G_MAXUINT,
+          GST_CSOUND_LOG_DEFAULT_RATE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Time spent in csoundPerformKsmps() per block (min, avg, max, p99), "
+          "load, real-time factor, blocks and buffers processed slower than "
+          "real time",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS_INTERVAL,
+      g_param_spec_uint64 ("stats-interval", "Statistics interval",
+          "Post the statistics as a \"csound-stats\" element message this "
+          "often, in nanoseconds (0 = never)", 0, G_MAXUINT64, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_set_static_metadata (GST_ELEMENT_CLASS (klass),
+      "Csound render sink", "Sink/Analyzer/Audio",
+      "Feed audio to csound without pacing it",
+      "Natanael Mojica <neithanmo@gmail.com>");
+
+  base_sink_class->start = GST_DEBUG_FUNCPTR (gst_csoundrendersink_start);
+  base_sink_class->stop = GST_DEBUG_FUNCPTR (gst_csoundrendersink_stop);
+  base_sink_class->set_caps = GST_DEBUG_FUNCPTR (gst_csoundrendersink_set_caps);
+  base_sink_class->render = GST_DEBUG_FUNCPTR (gst_csoundrendersink_render);
+  base_sink_class->event = GST_DEBUG_FUNCPTR (gst_csoundrendersink_event);
+}
+
+static void
+gst_csoundrendersink_init (GstCsoundrendersink * csoundrendersink)
+{
+  g_mutex_init (&csoundrendersink->lock);
+  csoundrendersink->message_level = GST_CSOUND_LOG_DEFAULT_LEVEL;
+  csoundrendersink->message_rate = GST_CSOUND_LOG_DEFAULT_RATE;
+  gst_csound_stats_board_init (&csoundrendersink->stats_board);
+  gst_base_sink_set_sync (GST_BASE_SINK (csoundrendersink), FALSE);
+}
+
+void
+gst_csoundrendersink_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstCsoundrendersink *csoundrendersink = GST_CSOUNDRENDERSINK (object);
+
+  GST_DEBUG_OBJECT (csoundrendersink, "set_property");
+
+  switch (property_id) {
+    case PROP_LOCATION:
+      g_free (csoundrendersink->csd_name);
+      csoundrendersink->csd_name = g_value_dup_string (value);
+      break;
+    case PROP_INSTANCE_POOL:
+      csoundrendersink->instance_pool = g_value_get_boolean (value);
+      break;
+    case PROP_MESSAGE_LEVEL:
+      GST_OBJECT_LOCK (csoundrendersink);
+      csoundrendersink->message_level = g_value_get_enum (value);
+      if (csoundrendersink->log)
+        gst_csound_log_set_level (csoundrendersink->log,
+            csoundrendersink->message_level);
+      GST_OBJECT_UNLOCK (csoundrendersink);
+      break;
+    case PROP_MESSAGE_RATE:
+      GST_OBJECT_LOCK (csoundrendersink);
+      csoundrendersink->message_rate = g_value_get_uint (value);
+      if (csoundrendersink->log)
+        gst_csound_log_set_rate (csoundrendersink->log,
+            csoundrendersink->message_rate);
+      GST_OBJECT_UNLOCK (csoundrendersink);
+      break;
+    case PROP_STATS_INTERVAL:
+      g_mutex_lock (&csoundrendersink->stats_board.lock);
+      csoundrendersink->stats_board.interval = g_value_get_uint64 (value);
+      g_mutex_unlock (&csoundrendersink->stats_board.lock);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+void
+gst_csoundrendersink_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstCsoundrendersink *csoundrendersink = GST_CSOUNDRENDERSINK (object);
+
+  GST_DEBUG_OBJECT (csoundrendersink, "get_property");
+
+  switch (property_id) {
+    case PROP_LOCATION:
+      g_value_set_string (value, csoundrendersink->csd_name);
+      break;
+    case PROP_INSTANCE_POOL:
+      g_value_set_boolean (value, csoundrendersink->instance_pool);
+      break;
+    case PROP_MESSAGE_LEVEL:
+      g_value_set_enum (value, csoundrendersink->message_level);
+      break;
+    case PROP_MESSAGE_RATE:
+      g_value_set_uint (value, csoundrendersink->message_rate);
+      break;
+    case PROP_STATS:
+      g_value_take_boxed (value,
+          gst_csound_stats_board_get (&csoundrendersink->stats_board));
+      break;
+    case PROP_STATS_INTERVAL:
+      g_mutex_lock (&csoundrendersink->stats_board.lock);
+      g_value_set_uint64 (value, csoundrendersink->stats_board.interval);
+      g_mutex_unlock (&csoundrendersink->stats_board.lock);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+void
+gst_csoundrendersink_finalize (GObject * object)
+{
+  GstCsoundrendersink *csoundrendersink = GST_CSOUNDRENDERSINK (object);
+
+  GST_DEBUG_OBJECT (csoundrendersink, "finalize");
+  g_mutex_clear (&csoundrendersink->lock);
+  gst_csound_stats_board_clear (&csoundrendersink->stats_board);
+  g_free (csoundrendersink->csd_name);
+
+  G_OBJECT_CLASS (gst_csoundrendersink_parent_class)->finalize (object);
+}
+
+static gboolean
+gst_csoundrendersink_start (GstBaseSink * sink)
+{
+  GstCsoundrendersink *csoundrendersink = GST_CSOUNDRENDERSINK (sink);
+
+  gst_csoundrendersink_start_log (csoundrendersink);
+  /* the instance comes back compiled and started */
+  csoundrendersink->csound =
+      gst_csound_instance_acquire (csoundrendersink->csd_name, NULL,
+      csoundrendersink->instance_pool, gst_csound_log_message,
+      csoundrendersink->log);
+  if (csoundrendersink->csound == NULL) {
+    GST_ELEMENT_ERROR (csoundrendersink, RESOURCE, OPEN_READ,
+        ("%s", csoundrendersink->csd_name), NULL);
+    gst_csoundrendersink_stop_log (csoundrendersink);
+    return FALSE;
+  }
+
+  csoundrendersink->ksmps = csoundGetKsmps (csoundrendersink->csound);
+  csoundrendersink->channels = csoundGetNchnlsInput (csoundrendersink->csound);
+  csoundrendersink->csound_input = csoundGetSpin (csoundrendersink->csound);
+  csoundrendersink->spin_frames = 0;
+  csoundrendersink->end_of_score = 0;
+  gst_audio_info_init (&csoundrendersink->info);
+  GST_DEBUG_OBJECT (csoundrendersink, "start");
+
+  return TRUE;
+}
+
+static gboolean
+gst_csoundrendersink_stop (GstBaseSink * sink)
+{
+  GstCsoundrendersink *csoundrendersink = GST_CSOUNDRENDERSINK (sink);
+  CSOUND *csound;
+
+  GST_DEBUG_OBJECT (csoundrendersink, "stop");
+  g_mutex_lock (&csoundrendersink->lock);
+  csound = csoundrendersink->csound;
+  csoundrendersink->csound = NULL;
+  csoundrendersink->csound_input = NULL;
+  g_mutex_unlock (&csoundrendersink->lock);
+  gst_csound_instance_release (csound);
+  gst_csoundrendersink_stop_log (csoundrendersink);
+
+  return TRUE;
+}
+
+static gboolean
+gst_csoundrendersink_set_caps (GstBaseSink * sink, GstCaps * caps)
+{
+  GstCsoundrendersink *csoundrendersink = GST_CSOUNDRENDERSINK (sink);
+  GstAudioInfo info;
+
+  if (!gst_audio_info_from_caps (&info, caps))
+    goto invalid_caps;
+
+  if (GST_AUDIO_INFO_CHANNELS (&info) != csoundrendersink->channels) {
+    GST_ERROR_OBJECT (csoundrendersink, "the orchestra takes %d channels",
+        csoundrendersink->channels);
+    return FALSE;
+  }
+  if (!gst_csound_convert_setup (&csoundrendersink->in_convert,
+          GST_AUDIO_INFO_FORMAT (&info),
+          csoundGet0dBFS (csoundrendersink->csound)))
+    goto invalid_caps;
+
+  if (GST_AUDIO_INFO_RATE (&info) != (gint) csoundGetSr
+      (csoundrendersink->csound))
+    GST_WARNING_OBJECT (csoundrendersink, "the orchestra runs at %g Hz",
+        (gdouble) csoundGetSr (csoundrendersink->csound));
+
+  csoundrendersink->info = info;
+  gst_csound_stats_reset (&csoundrendersink->stats,
+      gst_util_uint64_scale_int (csoundrendersink->ksmps, GST_SECOND,
+          GST_AUDIO_INFO_RATE (&info)));
+  GST_DEBUG_OBJECT (csoundrendersink, "negotiated to caps %" GST_PTR_FORMAT,
+      caps);
+
+  return TRUE;
+
+invalid_caps:
+  GST_ERROR_OBJECT (csoundrendersink, "invalid caps %" GST_PTR_FORMAT, caps);
+  return FALSE;
+}
+
+/* the frames of @buffer into spin, a block performed every ksmps of
+ * them. Planar buffers are interleaved on the way in. The lock is held */
+static gint
+gst_csoundrendersink_feed (GstCsoundrendersink * csoundrendersink,
+    GstAudioBuffer * buffer)
+{
+  gint bpf = GST_AUDIO_INFO_BPF (&csoundrendersink->info);
+  gint channels = csoundrendersink->channels;
+  gboolean planar = GST_AUDIO_INFO_LAYOUT (&csoundrendersink->info) ==
+      GST_AUDIO_LAYOUT_NON_INTERLEAVED;
+  gsize frames = GST_AUDIO_BUFFER_N_SAMPLES (buffer), offset = 0;
+  GstClockTime began, elapsed, total = 0;
+  guint blocks = 0;
+  gint ret = 0;
+
+  while (offset < frames) {
+    guint fill = csoundrendersink->spin_frames;
+    guint n = MIN (frames - offset, csoundrendersink->ksmps - fill);
+    MYFLT *spin = csoundrendersink->csound_input + fill * channels;
+
+    if (planar)
+      gst_csound_convert_in_planar (&csoundrendersink->in_convert, spin,
+          buffer->planes, offset, channels, n);
+    else
+      gst_csound_convert_in (&csoundrendersink->in_convert, spin,
+          (const guint8 *) buffer->planes[0] + offset * bpf, n * channels);
+    offset += n;
+    csoundrendersink->spin_frames = fill + n;
+    if (csoundrendersink->spin_frames < csoundrendersink->ksmps)
+      break;
+
+    began = gst_util_get_timestamp ();
+    ret = csoundPerformKsmps (csoundrendersink->csound);
+    elapsed = gst_util_get_timestamp () - began;
+    csoundrendersink->spin_frames = 0;
+    gst_csound_stats_add_block (&csoundrendersink->stats, elapsed);
+    total += elapsed;
+    blocks++;
+    if (ret) {
+      csoundrendersink->end_of_score = ret;
+      break;
+    }
+  }
+  gst_csound_stats_add_buffer (&csoundrendersink->stats, total,
+      blocks * csoundrendersink->stats.block_duration);
+
+  return ret;
+}
+
+static GstFlowReturn
+gst_csoundrendersink_render (GstBaseSink * sink, GstBuffer * buffer)
+{
+  GstCsoundrendersink *csoundrendersink = GST_CSOUNDRENDERSINK (sink);
+  GstAudioBuffer abuf;
+  gint ret;
+
+  if (!gst_audio_buffer_map (&abuf, &csoundrendersink->info, buffer,
+          GST_MAP_READ))
+    return GST_FLOW_ERROR;
+
+  g_mutex_lock (&csoundrendersink->lock);
+  if (csoundrendersink->end_of_score) {
+    g_mutex_unlock (&csoundrendersink->lock);
+    gst_audio_buffer_unmap (&abuf);
+    return GST_FLOW_EOS;
+  }
+  ret = gst_csoundrendersink_feed (csoundrendersink, &abuf);
+  g_mutex_unlock (&csoundrendersink->lock);
+  gst_audio_buffer_unmap (&abuf);
+
+  gst_csound_stats_publish (&csoundrendersink->stats_board,
+      &csoundrendersink->stats, GST_ELEMENT (csoundrendersink));
+  if (ret) {
+    GST_ELEMENT_ERROR (csoundrendersink, RESOURCE, WRITE,
+        ("Score finished in csoundPerformKsmps()"), NULL);
+    return GST_FLOW_ERROR;
+  }
+
+  return GST_FLOW_OK;
+}
+
+/* the last frames, short of a block, are performed padded with silence */
+static void
+gst_csoundrendersink_drain (GstCsoundrendersink * csoundrendersink)
+{
+  guint fill;
+
+  g_mutex_lock (&csoundrendersink->lock);
+  fill = csoundrendersink->spin_frames;
+  if (csoundrendersink->csound && fill > 0
+      && !csoundrendersink->end_of_score) {
+    GST_DEBUG_OBJECT (csoundrendersink, "padding the last %u frames", fill);
+    memset (csoundrendersink->csound_input + fill * csoundrendersink->channels,
+        0, sizeof (MYFLT) * (csoundrendersink->ksmps - fill) *
+        csoundrendersink->channels);
+    csoundrendersink->end_of_score =
+        csoundPerformKsmps (csoundrendersink->csound);
+    csoundrendersink->spin_frames = 0;
+  }
+  g_mutex_unlock (&csoundrendersink->lock);
+}
+
+/* rewind the score and silence spin, keeping the compiled orchestra, so
+ * a flush does not cost a recompile */
+static void
+gst_csoundrendersink_rewind (GstCsoundrendersink * csoundrendersink)
+{
+  g_mutex_lock (&csoundrendersink->lock);
+  if (csoundrendersink->csound)
+    gst_csound_instance_rewind (csoundrendersink->csound);
+  csoundrendersink->spin_frames = 0;
+  csoundrendersink->end_of_score = 0;
+  g_mutex_unlock (&csoundrendersink->lock);
+}
+
+static gboolean
+gst_csoundrendersink_event (GstBaseSink * sink, GstEvent * event)
+{
+  GstCsoundrendersink *csoundrendersink = GST_CSOUNDRENDERSINK (sink);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_EOS:
+      gst_csoundrendersink_drain (csoundrendersink);
+      break;
+      /* a new stream in a playlist starts the score over */
+    case GST_EVENT_STREAM_START:
+    case GST_EVENT_FLUSH_STOP:
+      gst_csoundrendersink_rewind (csoundrendersink);
+      break;
+    default:
+      break;
+  }
+
+  return GST_BASE_SINK_CLASS (gst_csoundrendersink_parent_class)->event (sink,
+      event);
+}
+
+CSOUND *
+gst_csoundrendersink_get_instance (GstCsoundrendersink * csoundrendersink)
+{
+  return csoundrendersink->csound;
+}
+
+/* set up before acquiring the instance, it prints through it */
+static void
+gst_csoundrendersink_start_log (GstCsoundrendersink * csoundrendersink)
+{
+  GstCsoundLog *log = gst_csound_log_new (GST_ELEMENT (csoundrendersink),
+      GST_CAT_DEFAULT, csoundrendersink->message_level,
+      csoundrendersink->message_rate);
+
+  GST_OBJECT_LOCK (csoundrendersink);
+  csoundrendersink->log = log;
+  GST_OBJECT_UNLOCK (csoundrendersink);
+}
+
+/* only once the instance is released */
+static void
+gst_csoundrendersink_stop_log (GstCsoundrendersink * csoundrendersink)
+{
+  GstCsoundLog *log;
+
+  GST_OBJECT_LOCK (csoundrendersink);
+  log = csoundrendersink->log;
+  csoundrendersink->log = NULL;
+  GST_OBJECT_UNLOCK (csoundrendersink);
+  gst_csound_log_free (log);
+}
@@ -0,0 +1,75 @@
+/* GStreamer
+ * Copyright (C) 2017 <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_CSOUNDRENDERSINK_H_
+#define _GST_CSOUNDRENDERSINK_H_
+
+#include <gst/base/gstbasesink.h>
+#include <gst/audio/audio.h>
+#include <csound/csound.h>
+#include "gstcsoundconvert.h"
+#include "gstcsoundlog.h"
+#include "gstcsoundstats.h"
+
+G_BEGIN_DECLS
+#define GST_TYPE_CSOUNDRENDERSINK   (gst_csoundrendersink_get_type())
+#define GST_CSOUNDRENDERSINK(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_CSOUNDRENDERSINK,GstCsoundrendersink))
+#define GST_CSOUNDRENDERSINK_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_CSOUNDRENDERSINK,GstCsoundrendersinkClass))
+#define GST_IS_CSOUNDRENDERSINK(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_CSOUNDRENDERSINK))
+#define GST_IS_CSOUNDRENDERSINK_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_CSOUNDRENDERSINK))
+typedef struct _GstCsoundrendersink GstCsoundrendersink;
+typedef struct _GstCsoundrendersinkClass GstCsoundrendersinkClass;
+
+struct _GstCsoundrendersink
+{
+  GstBaseSink base_csoundrendersink;
+  CSOUND *csound;
+  gchar *csd_name;
+  gboolean instance_pool;
+  GstCsoundLog *log;
+  GstCsoundMessageLevel message_level;
+  guint message_rate;
+
+  /* owned by the streaming thread */
+  GstCsoundStats stats;
+  GstCsoundStatsBoard stats_board;
+  GstAudioInfo info;
+  gint channels;
+  GstCsoundConvert in_convert;
+
+  MYFLT *csound_input;
+  guint ksmps;
+  guint spin_frames;            /* written to spin, not performed yet */
+  GMutex lock;
+  gint end_of_score;
+};
+
+struct _GstCsoundrendersinkClass
+{
+  GstBaseSinkClass base_csoundrendersink_class;
+};
+
+GType gst_csoundrendersink_get_type (void);
+
+GST_EXPORT
+CSOUND *gst_csoundrendersink_get_instance (GstCsoundrendersink *
+    csoundrendersink);
+
+G_END_DECLS
+#endif
@@ -0,0 +1,244 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/* Single producer, single consumer ring of fixed size slots.
+ *
+ * The producer fills the slot returned by gst_csound_ring_write_slot() and
+ * publishes it with gst_csound_ring_write_commit(), the consumer does the
+ * same with the read functions. Passing a slot only takes atomic loads and
+ * stores of the two counters. The mutex and condition are only touched
+ * when one side has to sleep on an empty or full ring, and the other side
+ * only takes them when it sees a sleeper flagged. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstcsoundring.h"
+
+#define RING_ALIGN 64
+
+struct _GstCsoundRing
+{
+  guint8 *data;
+  guint8 *mem;
+  gsize slot_size;
+  guint mask;
+
+  /* monotonic counters, the slot is counter & mask */
+  gint write_count;
+  gint read_count;
+
+  gint reader_waiting;
+  gint writer_waiting;
+  gint flushing;
+  GMutex lock;
+  GCond cond;
+};
+
+/**
+ * gst_csound_ring_new:
+ * @slots: the minimum number of slots, rounded up to a power of two
+ * @slot_size: bytes per slot
+ *
+ * Returns: a new ring with 64 byte aligned slots
+ */
+GstCsoundRing *
+gst_csound_ring_new (guint slots, gsize slot_size)
+{
+  GstCsoundRing *ring = g_new0 (GstCsoundRing, 1);
+  guint n = 1;
+
+  while (n < slots)
+    n <<= 1;
+
+  ring->slot_size = (slot_size + RING_ALIGN - 1) & ~((gsize) RING_ALIGN - 1);
+  ring->mask = n - 1;
+  ring->mem = g_malloc0 (ring->slot_size * n + RING_ALIGN);
+  ring->data = (guint8 *) (((guintptr) ring->mem + RING_ALIGN - 1)
+      & ~((guintptr) RING_ALIGN - 1));
+  g_mutex_init (&ring->lock);
+  g_cond_init (&ring->cond);
+
+  return ring;
+}
+
+void
+gst_csound_ring_free (GstCsoundRing * ring)
+{
+  if (ring == NULL)
+    return;
+
+  g_mutex_clear (&ring->lock);
+  g_cond_clear (&ring->cond);
+  g_free (ring->mem);
+  g_free (ring);
+}
+
+static inline guint
+gst_csound_ring_count (GstCsoundRing * ring)
+{
+  return (guint) g_atomic_int_get (&ring->write_count) -
+      (guint) g_atomic_int_get (&ring->read_count);
+}
+
+static void
+gst_csound_ring_wake (GstCsoundRing * ring, gint * waiting)
+{
+  if (g_atomic_int_get (waiting)) {
+    g_mutex_lock (&ring->lock);
+    g_cond_broadcast (&ring->cond);
+    g_mutex_unlock (&ring->lock);
+  }
+}
+
+/**
+ * gst_csound_ring_write_slot:
+ *
+ * Returns: the next free slot, or %NULL when the ring is full
+ */
+gpointer
+gst_csound_ring_write_slot (GstCsoundRing * ring)
+{
+  guint w = (guint) g_atomic_int_get (&ring->write_count);
+
+  if (w - (guint) g_atomic_int_get (&ring->read_count) > ring->mask)
+    return NULL;
+
+  return ring->data + (w & ring->mask) * ring->slot_size;
+}
+
+void
+gst_csound_ring_write_commit (GstCsoundRing * ring)
+{
+  g_atomic_int_inc (&ring->write_count);
+  gst_csound_ring_wake (ring, &ring->reader_waiting);
+}
+
+/**
+ * gst_csound_ring_read_slot:
+ *
+ * Returns: the oldest filled slot, or %NULL when the ring is empty
+ */
+gpointer
+gst_csound_ring_read_slot (GstCsoundRing * ring)
+{
+  guint r = (guint) g_atomic_int_get (&ring->read_count);
+
+  if ((guint) g_atomic_int_get (&ring->write_count) == r)
+    return NULL;
+
+  return ring->data + (r & ring->mask) * ring->slot_size;
+}
+
+void
+gst_csound_ring_read_commit (GstCsoundRing * ring)
+{
+  g_atomic_int_inc (&ring->read_count);
+  gst_csound_ring_wake (ring, &ring->writer_waiting);
+}
+
+/* the flag is raised before checking the ring again, so a commit either
+ * sees the sleeper or happened before the check */
+static gboolean
+gst_csound_ring_wait (GstCsoundRing * ring, gint * waiting, gboolean writer)
+{
+  g_mutex_lock (&ring->lock);
+  g_atomic_int_set (waiting, 1);
+  while (!g_atomic_int_get (&ring->flushing)) {
+    guint count = gst_csound_ring_count (ring);
+
+    if (writer ? count <= ring->mask : count > 0)
+      break;
+    g_cond_wait (&ring->cond, &ring->lock);
+  }
+  g_atomic_int_set (waiting, 0);
+  g_mutex_unlock (&ring->lock);
+
+  return !g_atomic_int_get (&ring->flushing);
+}
+
+/**
+ * gst_csound_ring_wait_writable:
+ *
+ * Sleep until a slot is free.
+ *
+ * Returns: %FALSE if the ring is flushing
+ */
+gboolean
+gst_csound_ring_wait_writable (GstCsoundRing * ring)
+{
+  return gst_csound_ring_wait (ring, &ring->writer_waiting, TRUE);
+}
+
+/**
+ * gst_csound_ring_wait_readable:
+ *
+ * Sleep until a slot is filled.
+ *
+ * Returns: %FALSE if the ring is flushing
+ */
+gboolean
+gst_csound_ring_wait_readable (GstCsoundRing * ring)
+{
+  return gst_csound_ring_wait (ring, &ring->reader_waiting, FALSE);
+}
+
+/**
+ * gst_csound_ring_set_flushing:
+ *
+ * While flushing, the wait functions return %FALSE at once and wake up
+ * whoever sleeps in them.
+ */
+void
+gst_csound_ring_set_flushing (GstCsoundRing * ring, gboolean flushing)
+{
+  g_mutex_lock (&ring->lock);
+  g_atomic_int_set (&ring->flushing, flushing);
+  g_cond_broadcast (&ring->cond);
+  g_mutex_unlock (&ring->lock);
+}
+
+/**
+ * gst_csound_ring_reset:
+ *
+ * Drop all filled slots. Neither side may be using the ring.
+ */
+void
+gst_csound_ring_reset (GstCsoundRing * ring)
+{
+  g_atomic_int_set (&ring->read_count, g_atomic_int_get (&ring->write_count));
+}
+
+/**
+ * gst_csound_ring_fill:
+ *
+ * Returns: the number of filled slots
+ */
+guint
+gst_csound_ring_fill (GstCsoundRing * ring)
+{
+  return gst_csound_ring_count (ring);
+}
+
+gsize
+gst_csound_ring_slot_size (GstCsoundRing * ring)
+{
+  return ring->slot_size;
+}
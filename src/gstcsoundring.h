@@ -0,0 +1,47 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_CSOUND_RING_H_
+#define _GST_CSOUND_RING_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstCsoundRing GstCsoundRing;
+
+GstCsoundRing *gst_csound_ring_new (guint slots, gsize slot_size);
+void gst_csound_ring_free (GstCsoundRing * ring);
+
+gpointer gst_csound_ring_write_slot (GstCsoundRing * ring);
+void gst_csound_ring_write_commit (GstCsoundRing * ring);
+gpointer gst_csound_ring_read_slot (GstCsoundRing * ring);
+void gst_csound_ring_read_commit (GstCsoundRing * ring);
+
+gboolean gst_csound_ring_wait_writable (GstCsoundRing * ring);
+gboolean gst_csound_ring_wait_readable (GstCsoundRing * ring);
+
+void gst_csound_ring_set_flushing (GstCsoundRing * ring, gboolean flushing);
+void gst_csound_ring_reset (GstCsoundRing * ring);
+guint gst_csound_ring_fill (GstCsoundRing * ring);
+gsize gst_csound_ring_slot_size (GstCsoundRing * ring);
+
+G_END_DECLS
+
+#endif
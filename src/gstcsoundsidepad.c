@@ -0,0 +1,559 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Side-chain inputs on their own pads.
+ *
+ * A "side_%s" request pad, e.g. side_key, takes a mono stream for the
+ * audio input channel the orchestra declares with chn_a, here "key".
+ * Its buffers wait in the pad, placed by running time, and the element
+ * converts ksmps of them straight into the channel before every block
+ * it performs, the block at the same running time as its main input.
+ * The element waits for a side stream that lags behind, a side stream
+ * ahead of it waits in the pad, up to a second. Each branch needs its
+ * own streaming thread, a queue after a tee. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include "gstcsoundsidepad.h"
+
+#define SIDE_PAD_PREFIX "side_"
+
+G_DEFINE_TYPE (GstCsoundSidePad, gst_csound_side_pad, GST_TYPE_PAD);
+
+static void
+gst_csound_side_pad_finalize (GObject * object)
+{
+  GstCsoundSidePad *pad = GST_CSOUND_SIDE_PAD (object);
+
+  g_free (pad->channel);
+  g_object_unref (pad->adapter);
+  g_mutex_clear (&pad->lock);
+  g_cond_clear (&pad->cond);
+
+  G_OBJECT_CLASS (gst_csound_side_pad_parent_class)->finalize (object);
+}
+
+static void
+gst_csound_side_pad_class_init (GstCsoundSidePadClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = gst_csound_side_pad_finalize;
+}
+
+/* back to an empty pad, the lock is held */
+static void
+gst_csound_side_pad_clear (GstCsoundSidePad * pad)
+{
+  gst_adapter_clear (pad->adapter);
+  gst_segment_init (&pad->segment, GST_FORMAT_TIME);
+  pad->head_sample = -1;
+  pad->eos = FALSE;
+  g_cond_broadcast (&pad->cond);
+}
+
+/* place @buffer after the frames waiting by its running time, less than
+ * a block apart is jitter. The lock is held */
+static void
+gst_csound_side_pad_queue (GstCsoundSidePad * pad, GstBuffer * buffer)
+{
+  gint bpf = GST_AUDIO_INFO_BPF (&pad->info);
+  GstClockTime running_time;
+  gint64 sample, next, gap, frames;
+
+  frames = gst_buffer_get_size (buffer) / bpf;
+  running_time = gst_segment_to_running_time (&pad->segment, GST_FORMAT_TIME,
+      GST_BUFFER_PTS (buffer));
+  if (!GST_CLOCK_TIME_IS_VALID (running_time) || pad->rate == 0) {
+    gst_adapter_push (pad->adapter, buffer);
+    return;
+  }
+
+  sample = gst_util_uint64_scale_int_round (running_time, pad->rate,
+      GST_SECOND);
+  if (pad->head_sample < 0 || gst_adapter_available (pad->adapter) == 0) {
+    pad->head_sample = sample;
+    gst_adapter_push (pad->adapter, buffer);
+    return;
+  }
+
+  next = pad->head_sample + gst_adapter_available (pad->adapter) / bpf;
+  gap = sample - next;
+  if (gap > (gint64) pad->ksmps) {
+    GstBuffer *silence = gst_buffer_new_allocate (NULL, gap * bpf, NULL);
+    GstMapInfo map;
+
+    GST_DEBUG_OBJECT (pad, "%" G_GINT64_FORMAT " frames of silence", gap);
+    gst_buffer_map (silence, &map, GST_MAP_WRITE);
+    gst_audio_format_fill_silence (pad->info.finfo, map.data, map.size);
+    gst_buffer_unmap (silence, &map);
+    gst_adapter_push (pad->adapter, silence);
+  } else if (gap < -(gint64) pad->ksmps) {
+    GST_DEBUG_OBJECT (pad, "%" G_GINT64_FORMAT " frames late", -gap);
+    if (-gap >= frames) {
+      gst_buffer_unref (buffer);
+      return;
+    }
+    buffer = gst_buffer_make_writable (buffer);
+    gst_buffer_resize (buffer, -gap * bpf, -1);
+  }
+  gst_adapter_push (pad->adapter, buffer);
+}
+
+static GstFlowReturn
+gst_csound_side_pad_chain (GstPad * sinkpad, GstObject * parent,
+    GstBuffer * buffer)
+{
+  GstCsoundSidePad *pad = GST_CSOUND_SIDE_PAD (sinkpad);
+  GstFlowReturn ret = GST_FLOW_OK;
+  gint bpf;
+
+  g_mutex_lock (&pad->lock);
+  bpf = GST_AUDIO_INFO_BPF (&pad->info);
+  if (pad->flushing) {
+    ret = GST_FLOW_FLUSHING;
+  } else if (pad->eos) {
+    ret = GST_FLOW_EOS;
+  } else if (bpf == 0) {
+    ret = GST_FLOW_NOT_NEGOTIATED;
+  } else {
+    gst_csound_side_pad_queue (pad, buffer);
+    buffer = NULL;
+    g_cond_broadcast (&pad->cond);
+
+    /* a second ahead of the element is enough */
+    while (!pad->flushing && pad->rate > 0
+        && gst_adapter_available (pad->adapter) / bpf > (gsize) pad->rate)
+      g_cond_wait (&pad->cond, &pad->lock);
+    if (pad->flushing)
+      ret = GST_FLOW_FLUSHING;
+  }
+  g_mutex_unlock (&pad->lock);
+
+  if (buffer)
+    gst_buffer_unref (buffer);
+
+  return ret;
+}
+
+static gboolean
+gst_csound_side_pad_set_caps (GstCsoundSidePad * pad, GstCaps * caps)
+{
+  GstAudioInfo info;
+  gboolean res = TRUE;
+
+  if (!gst_audio_info_from_caps (&info, caps)
+      || GST_AUDIO_INFO_CHANNELS (&info) != 1)
+    return FALSE;
+
+  g_mutex_lock (&pad->lock);
+  if (pad->rate > 0 && GST_AUDIO_INFO_RATE (&info) != pad->rate) {
+    GST_ERROR_OBJECT (pad, "the orchestra runs at %d Hz", pad->rate);
+    res = FALSE;
+  } else if (!gst_csound_convert_setup (&pad->convert,
+          GST_AUDIO_INFO_FORMAT (&info), pad->dbfs)) {
+    res = FALSE;
+  } else {
+    /* frames of the old format are dropped */
+    if (!gst_audio_info_is_equal (&info, &pad->info))
+      gst_adapter_clear (pad->adapter);
+    pad->info = info;
+  }
+  g_mutex_unlock (&pad->lock);
+
+  return res;
+}
+
+/* the events stop at the pad, only the element's main input goes on */
+static gboolean
+gst_csound_side_pad_event (GstPad * sinkpad, GstObject * parent,
+    GstEvent * event)
+{
+  GstCsoundSidePad *pad = GST_CSOUND_SIDE_PAD (sinkpad);
+  gboolean res = TRUE;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CAPS:{
+      GstCaps *caps;
+
+      gst_event_parse_caps (event, &caps);
+      res = gst_csound_side_pad_set_caps (pad, caps);
+      break;
+    }
+    case GST_EVENT_SEGMENT:
+      g_mutex_lock (&pad->lock);
+      gst_event_copy_segment (event, &pad->segment);
+      if (pad->segment.format != GST_FORMAT_TIME) {
+        GST_WARNING_OBJECT (pad, "not a time segment, not synchronized");
+        gst_segment_init (&pad->segment, GST_FORMAT_TIME);
+      }
+      g_mutex_unlock (&pad->lock);
+      break;
+    case GST_EVENT_EOS:
+      g_mutex_lock (&pad->lock);
+      pad->eos = TRUE;
+      g_cond_broadcast (&pad->cond);
+      g_mutex_unlock (&pad->lock);
+      break;
+    case GST_EVENT_FLUSH_START:
+      g_mutex_lock (&pad->lock);
+      pad->flushing = TRUE;
+      g_cond_broadcast (&pad->cond);
+      g_mutex_unlock (&pad->lock);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      g_mutex_lock (&pad->lock);
+      pad->flushing = FALSE;
+      gst_csound_side_pad_clear (pad);
+      g_mutex_unlock (&pad->lock);
+      break;
+    case GST_EVENT_STREAM_START:
+      g_mutex_lock (&pad->lock);
+      pad->eos = FALSE;
+      g_mutex_unlock (&pad->lock);
+      break;
+    default:
+      break;
+  }
+  gst_event_unref (event);
+
+  return res;
+}
+
+static gboolean
+gst_csound_side_pad_query (GstPad * sinkpad, GstObject * parent,
+    GstQuery * query)
+{
+  GstCsoundSidePad *pad = GST_CSOUND_SIDE_PAD (sinkpad);
+
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_CAPS:{
+      GstCaps *filter, *caps;
+      gint rate;
+
+      gst_query_parse_caps (query, &filter);
+      caps = gst_pad_get_pad_template_caps (sinkpad);
+      g_mutex_lock (&pad->lock);
+      rate = pad->rate;
+      g_mutex_unlock (&pad->lock);
+      if (rate > 0) {
+        caps = gst_caps_make_writable (caps);
+        gst_caps_set_simple (caps, "rate", G_TYPE_INT, rate, NULL);
+      }
+      if (filter) {
+        GstCaps *res = gst_caps_intersect_full (filter, caps,
+            GST_CAPS_INTERSECT_FIRST);
+
+        gst_caps_unref (caps);
+        caps = res;
+      }
+      gst_query_set_caps_result (query, caps);
+      gst_caps_unref (caps);
+      return TRUE;
+    }
+    case GST_QUERY_ACCEPT_CAPS:
+      return gst_pad_query_default (sinkpad, parent, query);
+    default:
+      return FALSE;
+  }
+}
+
+static gboolean
+gst_csound_side_pad_activate_mode (GstPad * sinkpad, GstObject * parent,
+    GstPadMode mode, gboolean active)
+{
+  GstCsoundSidePad *pad = GST_CSOUND_SIDE_PAD (sinkpad);
+
+  if (mode != GST_PAD_MODE_PUSH)
+    return FALSE;
+
+  g_mutex_lock (&pad->lock);
+  pad->flushing = !active;
+  gst_csound_side_pad_clear (pad);
+  g_mutex_unlock (&pad->lock);
+
+  return TRUE;
+}
+
+static void
+gst_csound_side_pad_init (GstCsoundSidePad * pad)
+{
+  g_mutex_init (&pad->lock);
+  g_cond_init (&pad->cond);
+  pad->adapter = gst_adapter_new ();
+  gst_segment_init (&pad->segment, GST_FORMAT_TIME);
+  gst_audio_info_init (&pad->info);
+  pad->head_sample = -1;
+  pad->flushing = TRUE;
+  pad->dbfs = 1.0;
+
+  gst_pad_set_chain_function (GST_PAD (pad), gst_csound_side_pad_chain);
+  gst_pad_set_event_function (GST_PAD (pad), gst_csound_side_pad_event);
+  gst_pad_set_query_function (GST_PAD (pad), gst_csound_side_pad_query);
+  gst_pad_set_activatemode_function (GST_PAD (pad),
+      gst_csound_side_pad_activate_mode);
+}
+
+/* look @pad's channel up in @csound, the element's streaming thread
+ * owns the binding */
+static void
+gst_csound_side_pad_bind (GstElement * element, GstCsoundSidePad * pad,
+    CSOUND * csound)
+{
+  controlChannelInfo_t *list = NULL;
+  gint n, i, type = 0;
+
+  pad->csound = csound;
+  pad->data = NULL;
+  if (csound == NULL) {
+    g_mutex_lock (&pad->lock);
+    pad->rate = 0;
+    g_mutex_unlock (&pad->lock);
+    return;
+  }
+
+  n = csoundListChannels (csound, &list);
+  for (i = 0; i < n; i++)
+    if (strcmp (list[i].name, pad->channel) == 0)
+      type = list[i].type;
+  if (list)
+    csoundDeleteChannelList (csound, list);
+
+  if ((type & CSOUND_CHANNEL_TYPE_MASK) != CSOUND_AUDIO_CHANNEL
+      || !(type & CSOUND_INPUT_CHANNEL)
+      || csoundGetChannelPtr (csound, &pad->data, pad->channel,
+          CSOUND_AUDIO_CHANNEL | CSOUND_INPUT_CHANNEL) != 0) {
+    GST_ELEMENT_WARNING (element, RESOURCE, SETTINGS, (NULL),
+        ("the orchestra has no chn_a input channel \"%s\" for %s",
+            pad->channel, GST_PAD_NAME (pad)));
+    pad->data = NULL;
+  }
+
+  g_mutex_lock (&pad->lock);
+  pad->rate = (gint) csoundGetSr (csound);
+  pad->ksmps = csoundGetKsmps (csound);
+  pad->dbfs = csoundGet0dBFS (csound);
+  if (GST_AUDIO_INFO_FORMAT (&pad->info) != GST_AUDIO_FORMAT_UNKNOWN)
+    gst_csound_convert_setup (&pad->convert,
+        GST_AUDIO_INFO_FORMAT (&pad->info), pad->dbfs);
+  g_mutex_unlock (&pad->lock);
+  GST_DEBUG_OBJECT (pad, "bound to channel %s", pad->channel);
+}
+
+/**
+ * gst_csound_side_pad_request:
+ * @pads: the side pads of @element, changed under its object lock
+ * @name: side_ and the name of the channel
+ * @csound: the instance of @element when it has one, or %NULL
+ *
+ * Returns: a new pad, added to @element
+ */
+GstPad *
+gst_csound_side_pad_request (GstElement * element, GList ** pads,
+    GstPadTemplate * templ, const gchar * name, CSOUND * csound)
+{
+  GstCsoundSidePad *pad;
+
+  if (name == NULL || !g_str_has_prefix (name, SIDE_PAD_PREFIX)
+      || name[strlen (SIDE_PAD_PREFIX)] == '\0') {
+    GST_WARNING_OBJECT (element, "side pads are named after their channel, "
+        "e.g. " SIDE_PAD_PREFIX "key");
+    return NULL;
+  }
+
+  pad = g_object_new (GST_TYPE_CSOUND_SIDE_PAD, "name", name,
+      "direction", GST_PAD_SINK, "template", templ, NULL);
+  pad->channel = g_strdup (name + strlen (SIDE_PAD_PREFIX));
+  gst_csound_side_pad_bind (element, pad, csound);
+
+  if (GST_STATE (element) > GST_STATE_READY)
+    gst_pad_set_active (GST_PAD (pad), TRUE);
+  if (!gst_element_add_pad (element, GST_PAD (pad))) {
+    gst_object_unref (pad);
+    return NULL;
+  }
+
+  GST_OBJECT_LOCK (element);
+  *pads = g_list_append (*pads, gst_object_ref (pad));
+  GST_OBJECT_UNLOCK (element);
+
+  return GST_PAD (pad);
+}
+
+void
+gst_csound_side_pad_release (GstElement * element, GList ** pads,
+    GstPad * pad)
+{
+  GList *l;
+
+  GST_OBJECT_LOCK (element);
+  l = g_list_find (*pads, pad);
+  if (l == NULL) {
+    GST_OBJECT_UNLOCK (element);
+    return;
+  }
+  *pads = g_list_delete_link (*pads, l);
+  GST_OBJECT_UNLOCK (element);
+
+  gst_pad_set_active (pad, FALSE);
+  gst_element_remove_pad (element, pad);
+  gst_object_unref (pad);
+}
+
+/**
+ * gst_csound_side_pads_bind:
+ * @csound: the instance of @element, or %NULL when it released it
+ *
+ * Point every side pad at its channel in @csound.
+ */
+void
+gst_csound_side_pads_bind (GstElement * element, GList ** pads,
+    CSOUND * csound)
+{
+  GList *l, *list = gst_csound_side_pads_ref (element, pads);
+
+  for (l = list; l; l = l->next)
+    gst_csound_side_pad_bind (element, l->data, csound);
+  g_list_free_full (list, gst_object_unref);
+}
+
+/**
+ * gst_csound_side_pads_ref:
+ *
+ * Returns: the side pads of @element, each with a reference, for the
+ *     blocks of one buffer
+ */
+GList *
+gst_csound_side_pads_ref (GstElement * element, GList ** pads)
+{
+  GList *res;
+
+  GST_OBJECT_LOCK (element);
+  res = g_list_copy_deep (*pads, (GCopyFunc) gst_object_ref, NULL);
+  GST_OBJECT_UNLOCK (element);
+
+  return res;
+}
+
+/* the block at sample @first into the channel, @first is -1 without
+ * timestamps and the frames are taken in order */
+static void
+gst_csound_side_pad_fill (GstCsoundSidePad * pad, gint64 first)
+{
+  guint ksmps, offset = 0, frames = 0;
+  gsize avail;
+  gint bpf;
+
+  g_mutex_lock (&pad->lock);
+  ksmps = pad->ksmps;
+  bpf = GST_AUDIO_INFO_BPF (&pad->info);
+  for (;;) {
+    avail = bpf ? gst_adapter_available (pad->adapter) / bpf : 0;
+    if (first >= 0 && pad->head_sample >= 0) {
+      /* what comes before the block is too late */
+      if (avail > 0 && pad->head_sample < first) {
+        gsize late = MIN ((gsize) (first - pad->head_sample), avail);
+
+        gst_adapter_flush (pad->adapter, late * bpf);
+        pad->head_sample += late;
+        g_cond_broadcast (&pad->cond);
+        continue;
+      }
+      if (avail > 0 && pad->head_sample + avail >= first + ksmps)
+        break;
+    } else if (avail >= ksmps) {
+      break;
+    }
+    if (pad->eos || pad->flushing || pad->interrupted
+        || !gst_pad_is_linked (GST_PAD (pad)))
+      break;
+    g_cond_wait (&pad->cond, &pad->lock);
+  }
+
+  /* the stream starts after the block starts */
+  if (first >= 0 && pad->head_sample > first)
+    offset = MIN (pad->head_sample - first, ksmps);
+  if (avail > 0)
+    frames = MIN (avail, ksmps - offset);
+
+  memset (pad->data, 0, offset * sizeof (MYFLT));
+  if (frames > 0) {
+    gst_csound_convert_in (&pad->convert, pad->data + offset,
+        gst_adapter_map (pad->adapter, frames * bpf), frames);
+    gst_adapter_unmap (pad->adapter);
+    gst_adapter_flush (pad->adapter, frames * bpf);
+    if (pad->head_sample >= 0)
+      pad->head_sample += frames;
+    g_cond_broadcast (&pad->cond);
+  }
+  memset (pad->data + offset + frames, 0,
+      (ksmps - offset - frames) * sizeof (MYFLT));
+  g_mutex_unlock (&pad->lock);
+}
+
+/**
+ * gst_csound_side_pads_fill:
+ * @pads: from gst_csound_side_pads_ref()
+ * @start: running time of the block about to be performed
+ *
+ * Write ksmps frames of every side pad into its channel, waiting for
+ * them while the pad is linked and running.
+ */
+void
+gst_csound_side_pads_fill (GList * pads, GstClockTime start)
+{
+  GList *l;
+
+  for (l = pads; l; l = l->next) {
+    GstCsoundSidePad *pad = l->data;
+
+    if (pad->data == NULL)
+      continue;
+    gst_csound_side_pad_fill (pad, GST_CLOCK_TIME_IS_VALID (start) ?
+        (gint64) gst_util_uint64_scale_int_round (start, pad->rate,
+            GST_SECOND) : -1);
+  }
+}
+
+/**
+ * gst_csound_side_pads_interrupt:
+ * @interrupt: %TRUE while the element flushes or stops
+ *
+ * Have a streaming thread waiting in gst_csound_side_pads_fill() go on.
+ */
+void
+gst_csound_side_pads_interrupt (GstElement * element, GList ** pads,
+    gboolean interrupt)
+{
+  GList *l;
+
+  GST_OBJECT_LOCK (element);
+  for (l = *pads; l; l = l->next) {
+    GstCsoundSidePad *pad = l->data;
+
+    g_mutex_lock (&pad->lock);
+    pad->interrupted = interrupt;
+    g_cond_broadcast (&pad->cond);
+    g_mutex_unlock (&pad->lock);
+  }
+  GST_OBJECT_UNLOCK (element);
+}
@@ -0,0 +1,91 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_CSOUND_SIDE_PAD_H_
+#define _GST_CSOUND_SIDE_PAD_H_
+
+#include <gst/gst.h>
+#include <gst/base/gstadapter.h>
+#include <gst/audio/audio.h>
+#include <csound/csound.h>
+#include "gstcsoundconvert.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_CSOUND_SIDE_PAD   (gst_csound_side_pad_get_type())
+#define GST_CSOUND_SIDE_PAD(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_CSOUND_SIDE_PAD,GstCsoundSidePad))
+
+typedef struct _GstCsoundSidePad GstCsoundSidePad;
+typedef struct _GstCsoundSidePadClass GstCsoundSidePadClass;
+
+/* a request "side_%s" sink pad of csoundfilter, its mono stream goes into
+ * the chn_a input channel of the same name, block by block */
+struct _GstCsoundSidePad
+{
+  GstPad parent;
+
+  gchar *channel;
+
+  /* under lock, shared by the pad streaming thread and the element's */
+  GMutex lock;
+  GCond cond;
+  GstAdapter *adapter;
+  GstSegment segment;
+  GstAudioInfo info;
+  GstCsoundConvert convert;
+  gint64 head_sample;           /* running time of the adapter head, in
+                                 * samples, -1 without timestamps */
+  gboolean eos;
+  gboolean flushing;
+  gboolean interrupted;         /* the element stopped waiting */
+  gint rate;                    /* of the orchestra, 0 until bound */
+  guint ksmps;
+  MYFLT dbfs;
+
+  /* owned by the element streaming thread */
+  CSOUND *csound;
+  MYFLT *data;                  /* ksmps samples of the channel */
+};
+
+struct _GstCsoundSidePadClass
+{
+  GstPadClass parent_class;
+};
+
+GType gst_csound_side_pad_get_type (void);
+
+#define GST_CSOUND_SIDE_PAD_TEMPLATE_CAPS \
+    "audio/x-raw,format=" GST_CSOUND_AUDIO_FORMATS \
+    ",rate=[1,max],channels=1,layout=interleaved"
+
+GstPad *gst_csound_side_pad_request (GstElement * element, GList ** pads,
+    GstPadTemplate * templ, const gchar * name, CSOUND * csound);
+void gst_csound_side_pad_release (GstElement * element, GList ** pads,
+    GstPad * pad);
+
+void gst_csound_side_pads_bind (GstElement * element, GList ** pads,
+    CSOUND * csound);
+GList *gst_csound_side_pads_ref (GstElement * element, GList ** pads);
+void gst_csound_side_pads_fill (GList * pads, GstClockTime start);
+void gst_csound_side_pads_interrupt (GstElement * element, GList ** pads,
+    gboolean interrupt);
+
+G_END_DECLS
+
+#endif
@@ -37,10 +37,18 @@
 #include <gst/gst.h>
 #include <gst/audio/gstaudiosink.h>
 #include "gstcsoundsink.h"
+#include "gstcsoundconvert.h"
+#include "gstcsoundinstance.h"
+#include "gstcsoundlog.h"
+#include "gstcsoundstats.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_csoundsink_debug_category);
 #define GST_CAT_DEFAULT gst_csoundsink_debug_category
 
+#define DEFAULT_INSTANCE_POOL        FALSE
+#define DEFAULT_SEGMENT_BLOCKS       8
+#define DEFAULT_SEGMENTS             0
+
 /* prototypes */
 
 
@@ -60,13 +68,21 @@ static gint gst_csoundsink_write (GstAudioSink * sink, gpointer data,
     guint length);
 static guint gst_csoundsink_delay (GstAudioSink * sink);
 static void gst_csoundsink_reset (GstAudioSink * sink);
-static void gst_csoundsink_messages (CSOUND * csound, int attr,
-    const char *format, va_list valist);
+static gboolean gst_csoundsink_event (GstBaseSink * sink, GstEvent * event);
+static void gst_csoundsink_start_log (GstCsoundsink * csoundsink);
+static void gst_csoundsink_stop_log (GstCsoundsink * csoundsink);
 
 enum
 {
   PROP_0,
-  PROP_LOCATION
+  PROP_LOCATION,
+  PROP_INSTANCE_POOL,
+  PROP_SEGMENT_BLOCKS,
+  PROP_SEGMENTS,
+  PROP_MESSAGE_LEVEL,
+  PROP_MESSAGE_RATE,
+  PROP_STATS,
+  PROP_STATS_INTERVAL
 };
 
 /* pad templates */
@@ -75,8 +91,8 @@ static GstStaticPadTemplate gst_csoundsink_sink_template =
 GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS ("audio/x-raw,format=F64LE,rate=[1,max],"
-        "channels=[1,max],layout=interleaved")
+    GST_STATIC_CAPS ("audio/x-raw,format=" GST_CSOUND_AUDIO_FORMATS
+        ",rate=[1,max],channels=[1,max],layout=interleaved")
     );
 
 
@@ -90,6 +106,7 @@ static void
 gst_csoundsink_class_init (GstCsoundsinkClass * klass)
 {
   GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstBaseSinkClass *base_sink_class = GST_BASE_SINK_CLASS (klass);
   GstAudioSinkClass *audio_sink_class = GST_AUDIO_SINK_CLASS (klass);
 
   /* Setting up pads and setting metadata should be moved to
@@ -105,6 +122,55 @@ gst_csoundsink_class_init (GstCsoundsinkClass * klass)
           "Location of the csd file used for csound", NULL,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_INSTANCE_POOL,
+      g_param_spec_boolean ("instance-pool", "Instance pool",
+          "Take compiled csound instances from a process wide pool and give "
+          "them back rewound on stop, instead of compiling the csd on every "
+          "start", DEFAULT_INSTANCE_POOL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_SEGMENT_BLOCKS,
+      g_param_spec_uint ("segment-blocks", "Segment blocks",
+          "Csound blocks (ksmps frames) in a ring buffer segment, all "
+          "performed on one wakeup of the ring buffer thread", 1, G_MAXUINT16,
+          DEFAULT_SEGMENT_BLOCKS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_SEGMENTS,
+      g_param_spec_uint ("segments", "Segments",
+          "Segments in the ring buffer (0 = as many as fit in buffer-time)",
+          0, G_MAXUINT16, DEFAULT_SEGMENTS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_MESSAGE_LEVEL,
+      g_param_spec_enum ("message-level", "Message level",
+          "Most verbose csound messages forwarded to the debug log and, as "
+          "\"csound-message\" element messages, to the bus",
+          GST_TYPE_CSOUND_MESSAGE_LEVEL, GST_CSOUND_LOG_DEFAULT_LEVEL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MESSAGE_RATE,
+      g_param_spec_uint ("message-rate", "Message rate",
+          "Csound messages forwarded per second and level, the others are "
+          "only counted (0 = unlimited)", 0, G_MAXUINT,
+          GST_CSOUND_LOG_DEFAULT_RATE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Time spent in csoundPerformKsmps() per block (min, avg, max, p99), "
+          "load, real-time factor, blocks and buffers processed slower than "
+          "real time",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS_INTERVAL,
+      g_param_spec_uint64 ("stats-interval", "Statistics interval",
+          "Post the statistics as a \"csound-stats\" element message this "
+          "often, in nanoseconds (0 = never)", 0, G_MAXUINT64, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gst_element_class_set_static_metadata (GST_ELEMENT_CLASS (klass),
       "Csound audio sink", "Sink/audio",
       "Output audio to csound", "Natanael Mojica <neithanmo@gmail.com>");
@@ -120,12 +186,19 @@ gst_csoundsink_class_init (GstCsoundsinkClass * klass)
   audio_sink_class->write = GST_DEBUG_FUNCPTR (gst_csoundsink_write);
   audio_sink_class->delay = GST_DEBUG_FUNCPTR (gst_csoundsink_delay);
   audio_sink_class->reset = GST_DEBUG_FUNCPTR (gst_csoundsink_reset);
+  base_sink_class->event = GST_DEBUG_FUNCPTR (gst_csoundsink_event);
 
 }
 
 static void
 gst_csoundsink_init (GstCsoundsink * csoundsink)
 {
+  g_mutex_init (&csoundsink->lock);
+  csoundsink->segment_blocks = DEFAULT_SEGMENT_BLOCKS;
+  csoundsink->segments = DEFAULT_SEGMENTS;
+  csoundsink->message_level = GST_CSOUND_LOG_DEFAULT_LEVEL;
+  csoundsink->message_rate = GST_CSOUND_LOG_DEFAULT_RATE;
+  gst_csound_stats_board_init (&csoundsink->stats_board);
 }
 
 void
@@ -140,6 +213,34 @@ gst_csoundsink_set_property (GObject * object, guint property_id,
     case PROP_LOCATION:
       csoundsink->csd_name = g_value_dup_string (value);
       break;
+    case PROP_INSTANCE_POOL:
+      csoundsink->instance_pool = g_value_get_boolean (value);
+      break;
+    case PROP_SEGMENT_BLOCKS:
+      csoundsink->segment_blocks = g_value_get_uint (value);
+      break;
+    case PROP_SEGMENTS:
+      csoundsink->segments = g_value_get_uint (value);
+      break;
+    case PROP_MESSAGE_LEVEL:
+      GST_OBJECT_LOCK (csoundsink);
+      csoundsink->message_level = g_value_get_enum (value);
+      if (csoundsink->log)
+        gst_csound_log_set_level (csoundsink->log, csoundsink->message_level);
+      GST_OBJECT_UNLOCK (csoundsink);
+      break;
+    case PROP_MESSAGE_RATE:
+      GST_OBJECT_LOCK (csoundsink);
+      csoundsink->message_rate = g_value_get_uint (value);
+      if (csoundsink->log)
+        gst_csound_log_set_rate (csoundsink->log, csoundsink->message_rate);
+      GST_OBJECT_UNLOCK (csoundsink);
+      break;
+    case PROP_STATS_INTERVAL:
+      g_mutex_lock (&csoundsink->stats_board.lock);
+      csoundsink->stats_board.interval = g_value_get_uint64 (value);
+      g_mutex_unlock (&csoundsink->stats_board.lock);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -158,6 +259,30 @@ gst_csoundsink_get_property (GObject * object, guint property_id,
     case PROP_LOCATION:
       g_value_set_string (value, csoundsink->csd_name);
       break;
+    case PROP_INSTANCE_POOL:
+      g_value_set_boolean (value, csoundsink->instance_pool);
+      break;
+    case PROP_SEGMENT_BLOCKS:
+      g_value_set_uint (value, csoundsink->segment_blocks);
+      break;
+    case PROP_SEGMENTS:
+      g_value_set_uint (value, csoundsink->segments);
+      break;
+    case PROP_MESSAGE_LEVEL:
+      g_value_set_enum (value, csoundsink->message_level);
+      break;
+    case PROP_STATS:
+      g_value_take_boxed (value,
+          gst_csound_stats_board_get (&csoundsink->stats_board));
+      break;
+    case PROP_STATS_INTERVAL:
+      g_mutex_lock (&csoundsink->stats_board.lock);
+      g_value_set_uint64 (value, csoundsink->stats_board.interval);
+      g_mutex_unlock (&csoundsink->stats_board.lock);
+      break;
+    case PROP_MESSAGE_RATE:
+      g_value_set_uint (value, csoundsink->message_rate);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -182,10 +307,10 @@ gst_csoundsink_finalize (GObject * object)
   GstCsoundsink *csoundsink = GST_CSOUNDSINK (object);
 
   GST_DEBUG_OBJECT (csoundsink, "finalize");
-  if (csoundsink->csound) {
-    csoundCleanup (csoundsink->csound);
-    csoundDestroy (csoundsink->csound);
-  }
+  g_mutex_clear (&csoundsink->lock);
+  gst_csound_stats_board_clear (&csoundsink->stats_board);
+  gst_csound_instance_release (csoundsink->csound);
+  csoundsink->csound = NULL;
 
   /* clean up object here */
 
@@ -197,10 +322,8 @@ static gboolean
 gst_csoundsink_open (GstAudioSink * sink)
 {
   GstCsoundsink *csoundsink = GST_CSOUNDSINK (sink);
-  csoundsink->csound = csoundCreate (NULL);
-  csoundSetMessageCallback (csoundsink->csound,
-      (csoundMessageCallback) gst_csoundsink_messages);
   GST_DEBUG_OBJECT (csoundsink, "open");
+  gst_csoundsink_start_log (csoundsink);
 
   return TRUE;
 }
@@ -210,8 +333,11 @@ static gboolean
 gst_csoundsink_prepare (GstAudioSink * sink, GstAudioRingBufferSpec * spec)
 {
   GstCsoundsink *csoundsink = GST_CSOUNDSINK (sink);
-  int result = csoundCompileCsd (csoundsink->csound, csoundsink->csd_name);
-  if (result) {
+  /* the instance comes back compiled and started */
+  csoundsink->csound = gst_csound_instance_acquire (csoundsink->csd_name,
+      NULL, csoundsink->instance_pool, gst_csound_log_message,
+      csoundsink->log);
+  if (csoundsink->csound == NULL) {
     GST_ELEMENT_ERROR (csoundsink, RESOURCE, OPEN_READ,
         ("%s", csoundsink->csd_name), NULL);
     return FALSE;
@@ -221,22 +347,43 @@ gst_csoundsink_prepare (GstAudioSink * sink, GstAudioRingBufferSpec * spec)
   csoundsink->channels = csoundGetNchnlsInput (csoundsink->csound);
   csoundsink->bpf = GST_AUDIO_INFO_BPF (&spec->info);
   int rate = GST_AUDIO_INFO_RATE (&spec->info);
+  if (!gst_csound_convert_setup (&csoundsink->in_convert,
+          GST_AUDIO_INFO_FORMAT (&spec->info),
+          csoundGet0dBFS (csoundsink->csound))) {
+    GST_ERROR_OBJECT (csoundsink, "unsupported sample format");
+    gst_csound_instance_release (csoundsink->csound);
+    csoundsink->csound = NULL;
+    return FALSE;
+  }
   if (csoundsink->ksmps % 2 != 0) {
     GST_WARNING_OBJECT (csoundsink, "csound ksmps is not a power-of-two");
   }
-  csoundStart (csoundsink->csound);
 
+  gst_csound_stats_reset (&csoundsink->stats,
+      gst_util_uint64_scale_int (csoundsink->ksmps, GST_SECOND, rate));
+
+  csoundsink->csound_input = csoundGetSpin (csoundsink->csound);
+  csoundsink->spin_frames = 0;
+  csoundsink->output_frames = csoundGetOutputBufferSize (csoundsink->csound) /
+      MAX (csoundGetNchnls (csoundsink->csound), 1);
+
+  /* a segment is performed in one go, a whole number of blocks */
   GST_DEBUG_OBJECT (csoundsink, "prepare");
-  spec->segsize = sizeof (MYFLT) * csoundsink->channels * csoundsink->ksmps;
+  spec->segsize = csoundsink->bpf * csoundsink->ksmps *
+      csoundsink->segment_blocks;
   spec->latency_time = gst_util_uint64_scale (spec->segsize,
       (GST_SECOND / GST_USECOND), rate * csoundsink->bpf);
-  spec->segtotal = spec->buffer_time / spec->latency_time;
+  if (csoundsink->segments > 0)
+    spec->segtotal = csoundsink->segments;
+  else
+    spec->segtotal = spec->buffer_time / spec->latency_time;
+  spec->segtotal = MAX (spec->segtotal, 2);
 
   GST_DEBUG_OBJECT (csoundsink, "buffer time: %" G_GINT64_FORMAT " usec",
       spec->buffer_time);
   GST_DEBUG_OBJECT (csoundsink, "latency time: %" G_GINT64_FORMAT " usec",
       spec->latency_time);
-  GST_DEBUG_OBJECT (csoundsink, "buffer_size %d, segsize %d, segtotal %d",
+  GST_DEBUG_OBJECT (csoundsink, "ksmps %u, segsize %d, segtotal %d",
       csoundsink->ksmps, spec->segsize, spec->segtotal);
   return TRUE;
 }
@@ -246,8 +393,15 @@ static gboolean
 gst_csoundsink_unprepare (GstAudioSink * sink)
 {
   GstCsoundsink *csoundsink = GST_CSOUNDSINK (sink);
+  CSOUND *csound;
 
   GST_DEBUG_OBJECT (csoundsink, "unprepare");
+  g_mutex_lock (&csoundsink->lock);
+  csound = csoundsink->csound;
+  csoundsink->csound = NULL;
+  csoundsink->csound_input = NULL;
+  g_mutex_unlock (&csoundsink->lock);
+  gst_csound_instance_release (csound);
 
   return TRUE;
 }
@@ -257,79 +411,150 @@ static gboolean
 gst_csoundsink_close (GstAudioSink * sink)
 {
   GstCsoundsink *csoundsink = GST_CSOUNDSINK (sink);
-  csoundStop (csoundsink->csound);
   GST_DEBUG_OBJECT (csoundsink, "close");
+  gst_csoundsink_stop_log (csoundsink);
 
   return TRUE;
 }
 
 
+/* fill spin and perform a block every ksmps frames, a frame short of a
+ * block stays in spin until the next write */
 static gint
 gst_csoundsink_write (GstAudioSink * sink, gpointer data, guint length)
 {
   GstCsoundsink *csoundsink = GST_CSOUNDSINK (sink);
-  csoundsink->csound_input = csoundGetSpin (csoundsink->csound);
-  memcpy (csoundsink->csound_input, data, length);
-  gint ret = csoundPerformKsmps (csoundsink->csound);
+  GstClockTime began, elapsed, total = 0;
+  const guint8 *in = data;
+  guint frames = length / csoundsink->bpf, blocks = 0;
+  gint ret = 0;
+
+  g_mutex_lock (&csoundsink->lock);
+  if (csoundsink->end_of_score) {
+    g_mutex_unlock (&csoundsink->lock);
+    return -1;
+  }
+
+  while (frames > 0) {
+    guint fill = csoundsink->spin_frames;
+    guint n = MIN (frames, csoundsink->ksmps - fill);
+
+    gst_csound_convert_in (&csoundsink->in_convert,
+        csoundsink->csound_input + fill * csoundsink->channels, in,
+        n * csoundsink->channels);
+    in += n * csoundsink->bpf;
+    frames -= n;
+    fill += n;
+    if (fill < csoundsink->ksmps) {
+      g_atomic_int_set (&csoundsink->spin_frames, fill);
+      break;
+    }
+
+    began = gst_util_get_timestamp ();
+    ret = csoundPerformKsmps (csoundsink->csound);
+    elapsed = gst_util_get_timestamp () - began;
+    g_atomic_int_set (&csoundsink->spin_frames, 0);
+    gst_csound_stats_add_block (&csoundsink->stats, elapsed);
+    total += elapsed;
+    blocks++;
+    if (ret) {
+      csoundsink->end_of_score = ret;
+      break;
+    }
+  }
+  gst_csound_stats_add_buffer (&csoundsink->stats, total,
+      blocks * csoundsink->stats.block_duration);
+  g_mutex_unlock (&csoundsink->lock);
+  gst_csound_stats_publish (&csoundsink->stats_board, &csoundsink->stats,
+      GST_ELEMENT (csoundsink));
   if (ret) {
     GST_ELEMENT_ERROR (csoundsink, RESOURCE, WRITE,
         ("Score finished in csoundPerformKsmps()"), NULL);
-    return 0;
+    return -1;
   }
   return length;
 }
 
 
+/* rewind the score and silence spin, keeping the compiled orchestra, so
+ * a flush does not cost a recompile */
+static void
+gst_csoundsink_rewind (GstCsoundsink * csoundsink)
+{
+  g_mutex_lock (&csoundsink->lock);
+  if (csoundsink->csound)
+    gst_csound_instance_rewind (csoundsink->csound);
+  g_atomic_int_set (&csoundsink->spin_frames, 0);
+  csoundsink->end_of_score = 0;
+  g_mutex_unlock (&csoundsink->lock);
+}
+
+/* frames written but not heard yet: those waiting in spin for a whole
+ * block, and csound's own output buffer. Called from any thread, so it
+ * does not wait for a write to finish */
 static guint
 gst_csoundsink_delay (GstAudioSink * sink)
 {
   GstCsoundsink *csoundsink = GST_CSOUNDSINK (sink);
 
-  GST_DEBUG_OBJECT (csoundsink, "delay");
-
-  return 0;
+  return g_atomic_int_get (&csoundsink->spin_frames) +
+      csoundsink->output_frames;
 }
 
 
+/* also called when the ring buffer pauses, the score goes on from
+ * there. write() performs in place and never waits, nothing to unblock */
 static void
 gst_csoundsink_reset (GstAudioSink * sink)
 {
   GstCsoundsink *csoundsink = GST_CSOUNDSINK (sink);
-  csoundReset (csoundsink->csound);
   GST_DEBUG_OBJECT (csoundsink, "reset");
-
 }
 
-static void
-gst_csoundsink_messages (CSOUND * csound, int attr, const char *format,
-    va_list valist)
+static gboolean
+gst_csoundsink_event (GstBaseSink * sink, GstEvent * event)
 {
-  char **result = NULL;
-  vasprintf (&result, format, valist);
-  switch (attr) {
-    case CSOUNDMSG_ERROR:
-      GST_WARNING (result);
-      break;
-    case CSOUNDMSG_WARNING:
-      GST_WARNING (result);
-      break;
-    case CSOUNDMSG_ORCH:
-      GST_INFO (result);
-      break;
-    case CSOUNDMSG_REALTIME:
-      GST_LOG (result);
-      break;
-    case CSOUNDMSG_DEFAULT:
-      GST_LOG (result);
+  GstCsoundsink *csoundsink = GST_CSOUNDSINK (sink);
+
+  /* a flush or a new stream in a playlist starts the score over */
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_FLUSH_STOP:
+    case GST_EVENT_STREAM_START:
+      gst_csoundsink_rewind (csoundsink);
       break;
     default:
-      GST_LOG (result);
       break;
   }
-  g_free (result);
 
+  return GST_BASE_SINK_CLASS (gst_csoundsink_parent_class)->event (sink,
+      event);
 }
 
 CSOUND *gst_csoundsink_get_instance(GstCsoundsink *csoundsink){
     return csoundsink->csound;
 }
+
+/* set up before acquiring the instances, they print through it */
+static void
+gst_csoundsink_start_log (GstCsoundsink * csoundsink)
+{
+  GstCsoundLog *log = gst_csound_log_new (GST_ELEMENT (csoundsink),
+      GST_CAT_DEFAULT, csoundsink->message_level, csoundsink->message_rate);
+
+  GST_OBJECT_LOCK (csoundsink);
+  csoundsink->log = log;
+  GST_OBJECT_UNLOCK (csoundsink);
+}
+
+/* only once every instance is released */
+static void
+gst_csoundsink_stop_log (GstCsoundsink * csoundsink)
+{
+  GstCsoundLog *log;
+
+  GST_OBJECT_LOCK (csoundsink);
+  log = csoundsink->log;
+  csoundsink->log = NULL;
+  GST_OBJECT_UNLOCK (csoundsink);
+  gst_csound_log_free (log);
+}
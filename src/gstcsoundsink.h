@@ -22,6 +22,9 @@
 
 #include <gst/audio/gstaudiosink.h>
 #include <csound/csound.h>
+#include "gstcsoundconvert.h"
+#include "gstcsoundlog.h"
+#include "gstcsoundstats.h"
 
 G_BEGIN_DECLS
 #define GST_TYPE_CSOUNDSINK   (gst_csoundsink_get_type())
@@ -39,11 +42,24 @@ struct _GstCsoundsink
   GstAudioSink base_csoundsink;
   CSOUND *csound;
   gchar *csd_name;
+  gboolean instance_pool;
+  guint segment_blocks;
+  guint segments;
+  GstCsoundLog *log;
+  GstCsoundMessageLevel message_level;
+  guint message_rate;
+
+  /* owned by the streaming thread */
+  GstCsoundStats stats;
+  GstCsoundStatsBoard stats_board;
   gint channels;
   gint bpf;
+  GstCsoundConvert in_convert;
 
   MYFLT *csound_input;
   guint ksmps;
+  gint spin_frames;             /* written to spin, not performed yet */
+  guint output_frames;          /* csound output buffer */
   GMutex lock;
   gint end_of_score;
 };
@@ -21,11 +21,40 @@
  *
  * input audio data through csound engine.
  *
+ * Request out_%u pads push a range of the output channels each, set with
+ * their first-channel and channels properties, e.g. the stems of a 4
+ * channel orchestra as two stereo streams.
+ *
+ * Non-interleaved caps get one plane per channel, deinterleaved from
+ * spout as each ksmps block is converted. loop-replay only records
+ * interleaved audio.
+ *
+ * The chn_k output channels listed in analysis-channels are read after
+ * every ksmps block csound performs and attached to the buffer as a
+ * #GstCsoundAnalysisMeta. Blocks served from the render cache or a
+ * replay have no rows.
+ *
+ * With follow-caps the rate and channels come from downstream and the
+ * orchestra is compiled for them, its ksmps scaled to keep the control
+ * period, instead of an audioresample after the element. A caps change
+ * starts the score over.
+ *
+ * The orchestra can also be given as text, a whole csd in csd-text or
+ * an orc with an optional sco, instead of a location. Setting any of
+ * them while the element runs compiles the new orchestra in the
+ * background and crossfades it in over crossfade nanoseconds. It must
+ * run at the same sr, ksmps, nchnls and 0dbfs, and is not swapped in
+ * with render-cache or loop-replay. The render cache needs a location.
+ *
  * <refsect2>
  * <title>Example launch line</title>
  * |[
  * gst-launch-1.0 -v csoundsrc location=hello.csd ! audioconvert ! autoaudiosink
  * ]|
+ * Render a score to a file as fast as the CPU allows.
+ * |[
+ * gst-launch-1.0 csoundsrc location=piece.csd is-live=false ! wavenc ! filesink location=piece.wav
+ * ]|
  *
  * </refsect2>
  */
@@ -34,25 +63,39 @@
 #include "config.h"
 #endif
 
+#include <string.h>
 #include <gst/gst.h>
 #include <gst/base/gstbasesrc.h>
 #include "gstcsoundsrc.h"
+#include "gstcsoundconvert.h"
+#include "gstcsoundbufferpool.h"
+#include "gstcsoundinstance.h"
+#include "gstcsoundlog.h"
+#include "gstcsoundstats.h"
+#include "gstcsoundchannel.h"
+#include "gstcsoundoutpad.h"
+#include "gstcsoundswap.h"
 
 
 #define ALLOWED_CAPS \
     "audio/x-raw,"                                                 \
-    " format=(string){"GST_AUDIO_NE(F32)","GST_AUDIO_NE(F64)"}," \
+    " format=(string)"GST_CSOUND_AUDIO_FORMATS","                  \
     " rate=(int)[1,MAX],"                                          \
     " channels=(int)[1,MAX],"                                      \
-    " layout=(string) interleaved"
+    " layout=(string) { interleaved, non-interleaved }"
 
-#define DEFAULT_SAMPLES_PER_BUFFER   1024
-#define DEFAULT_IS_LIVE              FALSE
+#define DEFAULT_SAMPLES_PER_BUFFER   0
+#define DEFAULT_IS_LIVE              TRUE
+#define DEFAULT_FOLLOW_CAPS          FALSE
 #define DEFAULT_LOOP                 FALSE
 #define DEFAULT_TIMESTAMP_OFFSET     G_GINT64_CONSTANT (0)
+#define DEFAULT_INSTANCE_POOL        FALSE
+#define DEFAULT_RENDER_CACHE         FALSE
+#define DEFAULT_LOOP_REPLAY          FALSE
+#define DEFAULT_CROSSFADE            (20 * GST_MSECOND)
 
-#define FLOAT_SAMPLES 4
-#define DOUBLE_SAMPLES 8
+/* the longest first pass kept for loop-replay */
+#define REPLAY_MAX_SIZE              (256 * 1024 * 1024)
 
 GST_DEBUG_CATEGORY_STATIC (gst_csoundsrc_debug_category);
 #define GST_CAT_DEFAULT gst_csoundsrc_debug_category
@@ -70,25 +113,69 @@ static void gst_csoundsrc_finalize (GObject * object);
 /*virtual functions */
 static GstCaps *gst_csoundsrc_fixate (GstBaseSrc * src, GstCaps * caps);
 static gboolean gst_csoundsrc_set_caps (GstBaseSrc * src, GstCaps * caps);
+static gboolean gst_csoundsrc_decide_allocation (GstBaseSrc * src,
+    GstQuery * query);
 static gboolean gst_csoundsrc_start (GstBaseSrc * src);
 static gboolean gst_csoundsrc_stop (GstBaseSrc * src);
+static gboolean gst_csoundsrc_open (GstCsoundsrc * csoundsrc);
+static void gst_csoundsrc_close (GstCsoundsrc * csoundsrc);
+static void gst_csoundsrc_request_swap (GstCsoundsrc * csoundsrc);
 static void gst_csoundsrc_get_times (GstBaseSrc * src, GstBuffer * buffer,
     GstClockTime * start, GstClockTime * end);
 static gboolean gst_csoundsrc_is_seekable (GstBaseSrc * src);
+static gboolean gst_csoundsrc_query (GstBaseSrc * src, GstQuery * query);
+static gboolean gst_csoundsrc_do_seek (GstBaseSrc * src, GstSegment * segment);
+static gboolean gst_csoundsrc_event (GstBaseSrc * src, GstEvent * event);
+static GstPad *gst_csoundsrc_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps);
+static void gst_csoundsrc_release_pad (GstElement * element, GstPad * pad);
+static GstFlowReturn gst_csoundsrc_create (GstBaseSrc * src, guint64 offset,
+    guint size, GstBuffer ** buf);
 static GstFlowReturn gst_csoundsrc_fill (GstBaseSrc * src, guint64 offset,
     guint size, GstBuffer * buf);
-static void gst_csoundsrc_get_csamples(GstCsoundsrc * csoundsrc,
-    MYFLT * data);
-static void gst_csoundsrc_messages (CSOUND * csound, int attr,
-    const char *format, va_list valist);
+static guint gst_csoundsrc_get_csamples (GstCsoundsrc * csoundsrc,
+    gpointer data, guint first, guint n_blocks);
+static gboolean gst_csoundsrc_score_events_bytes (GstCsoundsrc * csoundsrc,
+    gchar type, guint n_pfields, GBytes * pfields, GBytes * running_times);
+static guint gst_csoundsrc_render (GstCsoundsrc * csoundsrc, guint8 * out,
+    guint n_blocks);
+static void gst_csoundsrc_restart_score (GstCsoundsrc * csoundsrc);
+static void gst_csoundsrc_replay_reset (GstCsoundsrc * csoundsrc,
+    gboolean record);
+static void gst_csoundsrc_start_log (GstCsoundsrc * csoundsrc);
+static void gst_csoundsrc_stop_log (GstCsoundsrc * csoundsrc);
+static void gst_csoundsrc_child_proxy_init (gpointer g_iface,
+    gpointer iface_data);
+
+enum
+{
+  SIGNAL_SCORE_EVENTS,
+  LAST_SIGNAL
+};
+
+static guint gst_csoundsrc_signals[LAST_SIGNAL] = { 0 };
 
 enum
 {
   PROP_0,
   PROP_LOCATION,
   PROP_IS_LIVE,
+  PROP_SAMPLES_PER_BUFFER,
   PROP_TIMESTAMP_OFFSET,
-  PROP_LOOP
+  PROP_LOOP,
+  PROP_INSTANCE_POOL,
+  PROP_RENDER_CACHE,
+  PROP_LOOP_REPLAY,
+  PROP_MESSAGE_LEVEL,
+  PROP_MESSAGE_RATE,
+  PROP_STATS,
+  PROP_STATS_INTERVAL,
+  PROP_ANALYSIS_CHANNELS,
+  PROP_FOLLOW_CAPS,
+  PROP_CSD_TEXT,
+  PROP_ORC,
+  PROP_SCO,
+  PROP_CROSSFADE
 };
 
 static GstStaticPadTemplate gst_csoundsrc_src_template =
@@ -98,10 +185,19 @@ GST_STATIC_PAD_TEMPLATE ("src",
     GST_STATIC_CAPS (ALLOWED_CAPS)
     );
 
+static GstStaticPadTemplate gst_csoundsrc_out_template =
+GST_STATIC_PAD_TEMPLATE ("out_%u",
+    GST_PAD_SRC,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS (GST_CSOUND_OUT_PAD_TEMPLATE_CAPS)
+    );
+
 /* class initialization */
 G_DEFINE_TYPE_WITH_CODE (GstCsoundsrc, gst_csoundsrc, GST_TYPE_BASE_SRC,
     GST_DEBUG_CATEGORY_INIT (gst_csoundsrc_debug_category, "csoundsrc", 0,
-        "debug category for csoundsrc element"));
+        "debug category for csoundsrc element");
+    G_IMPLEMENT_INTERFACE (GST_TYPE_CHILD_PROXY,
+        gst_csoundsrc_child_proxy_init));
 
 static void
 gst_csoundsrc_class_init (GstCsoundsrcClass * klass)
@@ -114,6 +210,8 @@ gst_csoundsrc_class_init (GstCsoundsrcClass * klass)
 
   gst_element_class_add_static_pad_template (GST_ELEMENT_CLASS (klass),
       &gst_csoundsrc_src_template);
+  gst_element_class_add_static_pad_template_with_gtype (GST_ELEMENT_CLASS
+      (klass), &gst_csoundsrc_out_template, GST_TYPE_CSOUND_OUT_PAD);
 
   gobject_class->set_property = gst_csoundsrc_set_property;
   gobject_class->get_property = gst_csoundsrc_get_property;
@@ -123,6 +221,42 @@ gst_csoundsrc_class_init (GstCsoundsrcClass * klass)
           "Location of the csd file used for csound", NULL,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_CSD_TEXT,
+      g_param_spec_string ("csd-text", "CSD text",
+          "A whole csd compiled from memory, before orc and location", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ORC,
+      g_param_spec_string ("orc", "Orchestra",
+          "An orchestra compiled from memory, with -n -d and the header of "
+          "the orchestra, before location", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SCO,
+      g_param_spec_string ("sco", "Score",
+          "The score read after orc is compiled", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CROSSFADE,
+      g_param_spec_uint64 ("crossfade", "Crossfade",
+          "Crossfade from the running orchestra to one set while running, "
+          "in nanoseconds, rounded up to whole ksmps blocks (0 = cut over)",
+          0, G_MAXUINT64, DEFAULT_CROSSFADE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_IS_LIVE,
+      g_param_spec_boolean ("is-live", "Is Live",
+          "Render in real time against the clock, otherwise as fast as "
+          "downstream takes the buffers", DEFAULT_IS_LIVE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SAMPLES_PER_BUFFER,
+      g_param_spec_uint ("samples-per-buffer", "Samples per buffer",
+          "Frames rendered per buffer, rounded up to whole ksmps blocks "
+          "(0 = one block when live, 100 ms otherwise)", 0, G_MAXINT,
+          DEFAULT_SAMPLES_PER_BUFFER,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_property (gobject_class,
       PROP_TIMESTAMP_OFFSET, g_param_spec_int64 ("timestamp-offset",
           "Timestamp offset",
@@ -135,18 +269,117 @@ gst_csoundsrc_class_init (GstCsoundsrcClass * klass)
           "do a loop on the score", FALSE,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_INSTANCE_POOL,
+      g_param_spec_boolean ("instance-pool", "Instance pool",
+          "Take compiled csound instances from a process wide pool and give "
+          "them back rewound on stop, instead of compiling the csd on every "
+          "start", DEFAULT_INSTANCE_POOL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_RENDER_CACHE,
+      g_param_spec_boolean ("render-cache", "Render cache",
+          "Keep the rendered audio in a memory mapped file of the user cache "
+          "directory, keyed by the csd contents, and serve it again on later "
+          "runs and seeks. Makes a non live source seekable. Only for scores "
+          "rendering the same audio every time, control channels are not "
+          "part of the key", DEFAULT_RENDER_CACHE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_LOOP_REPLAY,
+      g_param_spec_boolean ("loop-replay", "Loop replay",
+          "With loop, keep the first pass of the score in memory, up to "
+          "256 MiB, and push slices of it on the later passes instead of "
+          "rendering them. Only for scores rendering the same audio on "
+          "every pass, score events sent while replaying are dropped. "
+          "Ignored with non-interleaved caps", DEFAULT_LOOP_REPLAY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  /**
+   * GstCsoundsrc::score-events:
+   * @csoundsrc: the element
+   * @type: the score statement, 'i', 'f', 'e', ...
+   * @n_pfields: p-fields per event
+   * @pfields: the events, one row of @n_pfields MYFLT each
+   * @running_times: one #GstClockTime per event, or %NULL to play them
+   *     at the next ksmps block
+   *
+   * Queue a batch of score events, see #GstCsoundfilter::score-events.
+   */
+  gst_csoundsrc_signals[SIGNAL_SCORE_EVENTS] =
+      g_signal_new ("score-events", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      G_STRUCT_OFFSET (GstCsoundsrcClass, score_events), NULL, NULL, NULL,
+      G_TYPE_BOOLEAN, 4, G_TYPE_CHAR, G_TYPE_UINT, G_TYPE_BYTES, G_TYPE_BYTES);
+  klass->score_events = gst_csoundsrc_score_events_bytes;
+
+  g_object_class_install_property (gobject_class, PROP_MESSAGE_LEVEL,
+      g_param_spec_enum ("message-level", "Message level",
+          "Most verbose csound messages forwarded to the debug log and, as "
+          "\"csound-message\" element messages, to the bus",
+          GST_TYPE_CSOUND_MESSAGE_LEVEL, GST_CSOUND_LOG_DEFAULT_LEVEL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MESSAGE_RATE,
+      g_param_spec_uint ("message-rate", "Message rate",
+          "Csound messages forwarded per second and level, the others are "
+          "only counted (0 = unlimited)", 0, G_MAXUINT,
+          GST_CSOUND_LOG_DEFAULT_RATE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Time spent in csoundPerformKsmps() per block (min, avg, max, p99), "
+          "load, real-time factor, blocks and buffers processed slower than "
+          "real time and drift of the score against the running time",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS_INTERVAL,
+      g_param_spec_uint64 ("stats-interval", "Statistics interval",
+          "Post the statistics as a \"csound-stats\" element message this "
+          "often, in nanoseconds (0 = never)", 0, G_MAXUINT64, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ANALYSIS_CHANNELS,
+      g_param_spec_string ("analysis-channels", "Analysis channels",
+          "Comma separated chn_k output channels read after every ksmps "
+          "block and attached to the buffers as a GstCsoundAnalysisMeta",
+          NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_FOLLOW_CAPS,
+      g_param_spec_boolean ("follow-caps", "Follow caps",
+          "Take the rate and channels downstream asks for and compile the "
+          "orchestra for them, overriding the sr, ksmps and nchnls of the "
+          "csd, instead of asking for the ones of the csd",
+          DEFAULT_FOLLOW_CAPS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
   gst_element_class_set_static_metadata (GST_ELEMENT_CLASS (klass),
       "Csound audio source", "Source/audio",
       "Input audio through Csound", "Natanael Mojica <neithanmo@gmail.com>");
 
   gobject_class->dispose = GST_DEBUG_FUNCPTR (gst_csoundsrc_dispose);
   gobject_class->finalize = GST_DEBUG_FUNCPTR (gst_csoundsrc_finalize);
+  GST_ELEMENT_CLASS (klass)->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_csoundsrc_request_new_pad);
+  GST_ELEMENT_CLASS (klass)->release_pad =
+      GST_DEBUG_FUNCPTR (gst_csoundsrc_release_pad);
   base_src_class->fixate = GST_DEBUG_FUNCPTR (gst_csoundsrc_fixate);
   base_src_class->set_caps = GST_DEBUG_FUNCPTR (gst_csoundsrc_set_caps);
+  base_src_class->decide_allocation =
+      GST_DEBUG_FUNCPTR (gst_csoundsrc_decide_allocation);
   base_src_class->start = GST_DEBUG_FUNCPTR (gst_csoundsrc_start);
   base_src_class->stop = GST_DEBUG_FUNCPTR (gst_csoundsrc_stop);
   base_src_class->get_times = GST_DEBUG_FUNCPTR (gst_csoundsrc_get_times);
   base_src_class->is_seekable = GST_DEBUG_FUNCPTR (gst_csoundsrc_is_seekable);
+  base_src_class->query = GST_DEBUG_FUNCPTR (gst_csoundsrc_query);
+  base_src_class->do_seek = GST_DEBUG_FUNCPTR (gst_csoundsrc_do_seek);
+  base_src_class->event = GST_DEBUG_FUNCPTR (gst_csoundsrc_event);
+  base_src_class->create = GST_DEBUG_FUNCPTR (gst_csoundsrc_create);
   base_src_class->fill = GST_DEBUG_FUNCPTR (gst_csoundsrc_fill);
 
 }
@@ -155,10 +388,18 @@ static void
 gst_csoundsrc_init (GstCsoundsrc * csoundsrc)
 {
   gst_base_src_set_format (GST_BASE_SRC (csoundsrc), GST_FORMAT_TIME);
-  gst_base_src_set_live (GST_BASE_SRC (csoundsrc), TRUE);
+  gst_base_src_set_live (GST_BASE_SRC (csoundsrc), DEFAULT_IS_LIVE);
   gst_base_src_set_blocksize (GST_BASE_SRC (csoundsrc), -1);
+  csoundsrc->samples_per_buffer = DEFAULT_SAMPLES_PER_BUFFER;
   csoundsrc->process = (csoundsrcProcessFunc) gst_csoundsrc_get_csamples;
   csoundsrc->timestamp_offset = DEFAULT_TIMESTAMP_OFFSET;
+  csoundsrc->message_level = GST_CSOUND_LOG_DEFAULT_LEVEL;
+  csoundsrc->message_rate = GST_CSOUND_LOG_DEFAULT_RATE;
+  csoundsrc->crossfade = DEFAULT_CROSSFADE;
+  csoundsrc->swap = gst_csound_swap_new (GST_ELEMENT (csoundsrc));
+  g_mutex_init (&csoundsrc->lock);
+  gst_csound_event_queue_init (&csoundsrc->events);
+  gst_csound_stats_board_init (&csoundsrc->stats_board);
 }
 
 void
@@ -170,7 +411,42 @@ gst_csoundsrc_set_property (GObject * object, guint property_id,
   GST_DEBUG_OBJECT (csoundsrc, "set_property");
   switch (property_id) {
     case PROP_LOCATION:
+      GST_OBJECT_LOCK (csoundsrc);
+      g_free (csoundsrc->csd_name);
       csoundsrc->csd_name = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (csoundsrc);
+      gst_csoundsrc_request_swap (csoundsrc);
+      break;
+    case PROP_CSD_TEXT:
+      GST_OBJECT_LOCK (csoundsrc);
+      g_free (csoundsrc->csd_text);
+      csoundsrc->csd_text = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (csoundsrc);
+      gst_csoundsrc_request_swap (csoundsrc);
+      break;
+    case PROP_ORC:
+      GST_OBJECT_LOCK (csoundsrc);
+      g_free (csoundsrc->orc);
+      csoundsrc->orc = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (csoundsrc);
+      gst_csoundsrc_request_swap (csoundsrc);
+      break;
+    case PROP_SCO:
+      GST_OBJECT_LOCK (csoundsrc);
+      g_free (csoundsrc->sco);
+      csoundsrc->sco = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (csoundsrc);
+      gst_csoundsrc_request_swap (csoundsrc);
+      break;
+    case PROP_CROSSFADE:
+      csoundsrc->crossfade = g_value_get_uint64 (value);
+      break;
+    case PROP_IS_LIVE:
+      gst_base_src_set_live (GST_BASE_SRC (csoundsrc),
+          g_value_get_boolean (value));
+      break;
+    case PROP_SAMPLES_PER_BUFFER:
+      csoundsrc->samples_per_buffer = g_value_get_uint (value);
       break;
     case PROP_TIMESTAMP_OFFSET:
       csoundsrc->timestamp_offset = g_value_get_int64 (value);
@@ -178,6 +454,43 @@ gst_csoundsrc_set_property (GObject * object, guint property_id,
     case PROP_LOOP:
         csoundsrc->loop = g_value_get_boolean (value);
         break;
+    case PROP_INSTANCE_POOL:
+      csoundsrc->instance_pool = g_value_get_boolean (value);
+      break;
+    case PROP_RENDER_CACHE:
+      csoundsrc->render_cache = g_value_get_boolean (value);
+      break;
+    case PROP_LOOP_REPLAY:
+      csoundsrc->loop_replay = g_value_get_boolean (value);
+      break;
+    case PROP_MESSAGE_LEVEL:
+      GST_OBJECT_LOCK (csoundsrc);
+      csoundsrc->message_level = g_value_get_enum (value);
+      if (csoundsrc->log)
+        gst_csound_log_set_level (csoundsrc->log, csoundsrc->message_level);
+      GST_OBJECT_UNLOCK (csoundsrc);
+      break;
+    case PROP_MESSAGE_RATE:
+      GST_OBJECT_LOCK (csoundsrc);
+      csoundsrc->message_rate = g_value_get_uint (value);
+      if (csoundsrc->log)
+        gst_csound_log_set_rate (csoundsrc->log, csoundsrc->message_rate);
+      GST_OBJECT_UNLOCK (csoundsrc);
+      break;
+    case PROP_STATS_INTERVAL:
+      g_mutex_lock (&csoundsrc->stats_board.lock);
+      csoundsrc->stats_board.interval = g_value_get_uint64 (value);
+      g_mutex_unlock (&csoundsrc->stats_board.lock);
+      break;
+    case PROP_ANALYSIS_CHANNELS:
+      GST_OBJECT_LOCK (csoundsrc);
+      g_free (csoundsrc->analysis_channels);
+      csoundsrc->analysis_channels = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (csoundsrc);
+      break;
+    case PROP_FOLLOW_CAPS:
+      csoundsrc->follow_caps = g_value_get_boolean (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -194,7 +507,34 @@ gst_csoundsrc_get_property (GObject * object, guint property_id,
 
   switch (property_id) {
     case PROP_LOCATION:
+      GST_OBJECT_LOCK (csoundsrc);
       g_value_set_string (value, csoundsrc->csd_name);
+      GST_OBJECT_UNLOCK (csoundsrc);
+      break;
+    case PROP_CSD_TEXT:
+      GST_OBJECT_LOCK (csoundsrc);
+      g_value_set_string (value, csoundsrc->csd_text);
+      GST_OBJECT_UNLOCK (csoundsrc);
+      break;
+    case PROP_ORC:
+      GST_OBJECT_LOCK (csoundsrc);
+      g_value_set_string (value, csoundsrc->orc);
+      GST_OBJECT_UNLOCK (csoundsrc);
+      break;
+    case PROP_SCO:
+      GST_OBJECT_LOCK (csoundsrc);
+      g_value_set_string (value, csoundsrc->sco);
+      GST_OBJECT_UNLOCK (csoundsrc);
+      break;
+    case PROP_CROSSFADE:
+      g_value_set_uint64 (value, csoundsrc->crossfade);
+      break;
+    case PROP_IS_LIVE:
+      g_value_set_boolean (value, gst_base_src_is_live (GST_BASE_SRC
+              (csoundsrc)));
+      break;
+    case PROP_SAMPLES_PER_BUFFER:
+      g_value_set_uint (value, csoundsrc->samples_per_buffer);
       break;
     case PROP_TIMESTAMP_OFFSET:
       g_value_set_int64 (value, csoundsrc->timestamp_offset);
@@ -202,6 +542,38 @@ gst_csoundsrc_get_property (GObject * object, guint property_id,
     case PROP_LOOP:
         g_value_set_boolean (value, csoundsrc->loop);
       break;
+    case PROP_INSTANCE_POOL:
+      g_value_set_boolean (value, csoundsrc->instance_pool);
+      break;
+    case PROP_RENDER_CACHE:
+      g_value_set_boolean (value, csoundsrc->render_cache);
+      break;
+    case PROP_LOOP_REPLAY:
+      g_value_set_boolean (value, csoundsrc->loop_replay);
+      break;
+    case PROP_MESSAGE_LEVEL:
+      g_value_set_enum (value, csoundsrc->message_level);
+      break;
+    case PROP_STATS:
+      g_value_take_boxed (value,
+          gst_csound_stats_board_get (&csoundsrc->stats_board));
+      break;
+    case PROP_STATS_INTERVAL:
+      g_mutex_lock (&csoundsrc->stats_board.lock);
+      g_value_set_uint64 (value, csoundsrc->stats_board.interval);
+      g_mutex_unlock (&csoundsrc->stats_board.lock);
+      break;
+    case PROP_MESSAGE_RATE:
+      g_value_set_uint (value, csoundsrc->message_rate);
+      break;
+    case PROP_ANALYSIS_CHANNELS:
+      GST_OBJECT_LOCK (csoundsrc);
+      g_value_set_string (value, csoundsrc->analysis_channels);
+      GST_OBJECT_UNLOCK (csoundsrc);
+      break;
+    case PROP_FOLLOW_CAPS:
+      g_value_set_boolean (value, csoundsrc->follow_caps);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -223,12 +595,27 @@ gst_csoundsrc_finalize (GObject * object)
   GstCsoundsrc *csoundsrc = GST_CSOUNDSRC (object);
 
   GST_DEBUG_OBJECT (csoundsrc, "finalize");
-  if (csoundsrc->csound) {
-    csoundStop (csoundsrc->csound);
-    csoundCleanup (csoundsrc->csound);
-    csoundDestroy (csoundsrc->csound);
-    csoundsrc->csound_output = NULL;
-  }
+  gst_csound_swap_free (csoundsrc->swap);
+  gst_csound_instance_release (csoundsrc->csound);
+  csoundsrc->csound = NULL;
+  csoundsrc->csound_output = NULL;
+  if (csoundsrc->ctl_channels)
+    g_ptr_array_unref (csoundsrc->ctl_channels);
+  g_free (csoundsrc->ctl_ptrs);
+  g_free (csoundsrc->ctl_values);
+  g_free (csoundsrc->planes);
+  g_free (csoundsrc->analysis_channels);
+  gst_csound_analysis_clear (&csoundsrc->analysis);
+  g_free (csoundsrc->options);
+  g_free (csoundsrc->csd_name);
+  g_free (csoundsrc->csd_text);
+  g_free (csoundsrc->orc);
+  g_free (csoundsrc->sco);
+  gst_csound_event_queue_clear (&csoundsrc->events);
+  gst_csoundsrc_replay_reset (csoundsrc, FALSE);
+  g_list_free_full (csoundsrc->out_pads, gst_object_unref);
+  g_mutex_clear (&csoundsrc->lock);
+  gst_csound_stats_board_clear (&csoundsrc->stats_board);
   G_OBJECT_CLASS (gst_csoundsrc_parent_class)->finalize (object);
 }
 
@@ -251,22 +638,18 @@ gst_csoundsrc_fixate (GstBaseSrc * src, GstCaps * caps)
   rate = csoundGetSr (csoundsrc->csound);
   gst_structure_fixate_field_nearest_int (structure, "rate", rate);
 
-  if (csoundGetSizeOfMYFLT () == DOUBLE_SAMPLES) {
-    GST_INFO_OBJECT (csoundsrc,
-        "csound only support F64 audio samples - fixed caps");
-    gst_structure_set (structure, "format", G_TYPE_STRING, GST_AUDIO_NE (F64),
-        NULL);
-  }
+  /* any format works, prefer the one csound renders to */
+  gst_structure_fixate_field_string (structure, "format",
+      gst_audio_format_to_string (gst_csound_convert_native_format ()));
 
-  else if (csoundGetSizeOfMYFLT () == FLOAT_SAMPLES) {
-    GST_INFO_OBJECT (src, "csound only support F32 audio samples - fixed caps");
-    gst_structure_set (structure, "format", G_TYPE_STRING, GST_AUDIO_NE (F32),
+  /* fixate to channels setting in csound side, following the caps any
+   * count downstream asks for */
+  if (csoundsrc->follow_caps)
+    gst_structure_fixate_field_nearest_int (structure, "channels",
+        csoundsrc->csd_channels);
+  else
+    gst_structure_set (structure, "channels", G_TYPE_INT, csoundsrc->channels,
         NULL);
-  }
-
-  /* fixate to channels setting in csound side */
-  gst_structure_set (structure, "channels", G_TYPE_INT, csoundsrc->channels,
-      NULL);
   if (gst_structure_get_int (structure, "channels", &caps_channels)
       && caps_channels > 2) {
     if (!gst_structure_has_field_typed (structure, "channel-mask",
@@ -280,6 +663,59 @@ gst_csoundsrc_fixate (GstBaseSrc * src, GstCaps * caps)
   return caps;
 }
 
+/* a live source renders one block at a time to keep its latency low, a
+ * non live one big buffers, to spend its time in csound */
+static guint
+gst_csoundsrc_buffer_frames (GstCsoundsrc * csoundsrc, gint rate)
+{
+  guint frames = csoundsrc->samples_per_buffer;
+
+  if (frames == 0)
+    frames = gst_base_src_is_live (GST_BASE_SRC (csoundsrc)) ?
+        csoundsrc->ksmps : rate / 10;
+
+  return MAX (1, (frames + csoundsrc->ksmps - 1) / csoundsrc->ksmps)
+      * csoundsrc->ksmps;
+}
+
+/* compile the orchestra again when the rate or the channels of the caps
+ * differ from the ones it runs at, the score starts over. ksmps is
+ * scaled along with the rate, the control period of the csd stays */
+static gboolean
+gst_csoundsrc_follow_caps (GstCsoundsrc * csoundsrc, const GstAudioInfo * info)
+{
+  gint rate = GST_AUDIO_INFO_RATE (info);
+  gint channels = GST_AUDIO_INFO_CHANNELS (info);
+  gchar *options = NULL;
+  guint ksmps;
+
+  if (rate == (gint) csoundGetSr (csoundsrc->csound)
+      && channels == csoundsrc->channels)
+    return TRUE;
+
+  if (rate != csoundsrc->csd_rate || channels != csoundsrc->csd_channels) {
+    ksmps = MAX (1, gst_util_uint64_scale_int_round (csoundsrc->csd_ksmps,
+            rate, csoundsrc->csd_rate));
+    options = gst_csound_instance_options (rate, ksmps, 0, channels);
+  }
+  GST_OBJECT_LOCK (csoundsrc);
+  g_free (csoundsrc->options);
+  csoundsrc->options = options;
+  GST_OBJECT_UNLOCK (csoundsrc);
+  GST_INFO_OBJECT (csoundsrc, "compiling the orchestra again with \"%s\"",
+      GST_STR_NULL (csoundsrc->options));
+
+  gst_csoundsrc_close (csoundsrc);
+  if (!gst_csoundsrc_open (csoundsrc))
+    return FALSE;
+
+  /* ksmps, and the latency with it, may have changed */
+  gst_element_post_message (GST_ELEMENT (csoundsrc),
+      gst_message_new_latency (GST_OBJECT (csoundsrc)));
+
+  return TRUE;
+}
+
 static gboolean
 gst_csoundsrc_set_caps (GstBaseSrc * src, GstCaps * caps)
 {
@@ -291,8 +727,29 @@ gst_csoundsrc_set_caps (GstBaseSrc * src, GstCaps * caps)
 
   GST_DEBUG_OBJECT (csoundsrc, "negotiated to caps %" GST_PTR_FORMAT, caps);
 
+  if (csoundsrc->follow_caps && !gst_csoundsrc_follow_caps (csoundsrc, &info))
+    return FALSE;
+
   csoundsrc->info = info;
-  gst_base_src_set_blocksize (src, GST_AUDIO_INFO_BPF (&info) * csoundsrc->ksmps * csoundsrc->channels);
+  csoundsrc->planes = g_renew (gpointer, csoundsrc->planes,
+      GST_AUDIO_INFO_CHANNELS (&info));
+  if (!gst_csound_convert_setup (&csoundsrc->out_convert,
+          GST_AUDIO_INFO_FORMAT (&info), csoundGet0dBFS (csoundsrc->csound)))
+    goto invalid_caps;
+
+  csoundsrc->buffer_frames = gst_csoundsrc_buffer_frames (csoundsrc,
+      GST_AUDIO_INFO_RATE (&info));
+  /* what was recorded is in the old format */
+  g_mutex_lock (&csoundsrc->lock);
+  gst_csoundsrc_replay_reset (csoundsrc, csoundsrc->next_sample == 0);
+  g_mutex_unlock (&csoundsrc->lock);
+  gst_base_src_set_blocksize (src,
+      GST_AUDIO_INFO_BPF (&info) * csoundsrc->buffer_frames);
+  GST_DEBUG_OBJECT (csoundsrc, "%u frames per buffer",
+      csoundsrc->buffer_frames);
+  gst_csound_stats_reset (&csoundsrc->stats,
+      gst_util_uint64_scale_int (csoundsrc->ksmps, GST_SECOND,
+          GST_AUDIO_INFO_RATE (&info)));
   return TRUE;
 
   /* ERROR */
@@ -306,17 +763,160 @@ invalid_caps:
 }
 
 static gboolean
-gst_csoundsrc_start (GstBaseSrc * src)
+gst_csoundsrc_decide_allocation (GstBaseSrc * src, GstQuery * query)
 {
   GstCsoundsrc *csoundsrc = GST_CSOUNDSRC (src);
+  guint size;
+
+  /* the base class only uses a pool when downstream offers one, use our
+   * own so fill() gets recycled buffers */
+  size = gst_csound_buffer_pool_decide (query,
+      GST_AUDIO_INFO_BPF (&csoundsrc->info) * csoundsrc->ksmps,
+      gst_base_src_get_blocksize (src));
+  if (size == 0) {
+    GST_ERROR_OBJECT (csoundsrc, "failed to configure the buffer pool");
+    return FALSE;
+  }
+
+  GST_DEBUG_OBJECT (csoundsrc, "buffer pool of %u bytes buffers", size);
+  return TRUE;
+}
+
+/* the orchestra properties, the caller holds the object lock */
+static void
+gst_csoundsrc_get_source (GstCsoundsrc * csoundsrc, GstCsoundSource * source)
+{
+  source->location = g_strdup (csoundsrc->csd_name);
+  source->csd_text = g_strdup (csoundsrc->csd_text);
+  source->orc = g_strdup (csoundsrc->orc);
+  source->sco = g_strdup (csoundsrc->sco);
+}
+
+/* a new orchestra set while running compiles next to the running one,
+ * fill() swaps it in */
+static void
+gst_csoundsrc_request_swap (GstCsoundsrc * csoundsrc)
+{
+  GstCsoundSource source;
+  gchar *options;
+
+  GST_OBJECT_LOCK (csoundsrc);
+  gst_csoundsrc_get_source (csoundsrc, &source);
+  options = g_strdup (csoundsrc->options);
+  GST_OBJECT_UNLOCK (csoundsrc);
+
+  if (gst_csound_source_get_name (&source))
+    gst_csound_swap_request (csoundsrc->swap, &source, options);
+  gst_csound_source_clear (&source);
+  g_free (options);
+}
+
+/* put the channels from gst_csound_channels_update() in place, the
+ * caller passes the old ones to gst_csound_channels_commit() without
+ * holding any lock, the child proxy signals may call back into us */
+static GPtrArray *
+gst_csoundsrc_replace_channels (GstCsoundsrc * csoundsrc,
+    GPtrArray * channels)
+{
+  GPtrArray *old;
+
+  GST_OBJECT_LOCK (csoundsrc);
+  old = csoundsrc->ctl_channels;
+  csoundsrc->ctl_channels = channels;
+  GST_OBJECT_UNLOCK (csoundsrc);
 
-  csoundsrc->csound = csoundCreate (NULL);
-  csoundSetMessageCallback (csoundsrc->csound,
-      (csoundMessageCallback) gst_csoundsrc_messages);
-  int result = csoundCompileCsd (csoundsrc->csound, csoundsrc->csd_name);
-  if (result) {
+  return old;
+}
+
+/* put @csound in place of the running instance, between two buffers,
+ * and bind everything that points into it. Called with the lock, the
+ * channels replaced go to @old_channels
+ *
+ * Returns: %FALSE when the running instance stays */
+static gboolean
+gst_csoundsrc_swap_in (GstCsoundsrc * csoundsrc, CSOUND * csound,
+    GPtrArray ** old_channels)
+{
+  GPtrArray *new_channels;
+  MYFLT **ctl_ptrs;
+  gchar *channels;
+  guint64 blocks;
+
+  /* both replay what the old orchestra rendered */
+  if (csoundsrc->cache || csoundsrc->loop_replay) {
+    GST_ELEMENT_WARNING (csoundsrc, CORE, NEGOTIATION, (NULL),
+        ("the orchestra is not swapped with render-cache or loop-replay, "
+            "the new one runs from the next start"));
+    gst_csound_instance_release (csound);
+    return FALSE;
+  }
+
+  new_channels = gst_csound_channels_update (csoundsrc->ctl_channels, csound,
+      GST_OBJECT (csoundsrc));
+  ctl_ptrs = g_new0 (MYFLT *, new_channels->len);
+  if (!gst_csound_channels_bind (new_channels, csound, ctl_ptrs)) {
+    GST_ELEMENT_WARNING (csoundsrc, CORE, FAILED, (NULL),
+        ("the control channels of the new orchestra do not bind, the "
+            "running one stays"));
+    gst_csound_channels_discard (new_channels);
+    g_free (ctl_ptrs);
+    gst_csound_instance_release (csound);
+    return FALSE;
+  }
+
+  blocks = gst_util_uint64_scale_int_ceil (csoundsrc->crossfade,
+      GST_AUDIO_INFO_RATE (&csoundsrc->info), GST_SECOND);
+  blocks = (blocks + csoundsrc->ksmps - 1) / csoundsrc->ksmps;
+  if (!gst_csound_swap_begin (csoundsrc->swap, csoundsrc->csound, csound,
+          (guint) MIN (blocks, G_MAXUINT))) {
+    gst_csound_channels_discard (new_channels);
+    g_free (ctl_ptrs);
+    return FALSE;
+  }
+
+  csoundsrc->csound = csound;
+  csoundsrc->csound_output = csoundGetSpout (csound);
+  csoundsrc->end_of_score = 0;
+  csoundsrc->engine_exact = FALSE;
+
+  *old_channels = gst_csoundsrc_replace_channels (csoundsrc, new_channels);
+  g_free (csoundsrc->ctl_ptrs);
+  csoundsrc->ctl_ptrs = ctl_ptrs;
+  GST_OBJECT_LOCK (csoundsrc);
+  channels = g_strdup (csoundsrc->analysis_channels);
+  GST_OBJECT_UNLOCK (csoundsrc);
+  gst_csound_analysis_setup (&csoundsrc->analysis, channels, csound,
+      GST_ELEMENT (csoundsrc));
+  g_free (channels);
+
+  return TRUE;
+}
+
+/* compile the orchestra with the options of the element and bind
+ * everything that points into it */
+static gboolean
+gst_csoundsrc_open (GstCsoundsrc * csoundsrc)
+{
+  GstCsoundSource source;
+  GPtrArray *old_channels;
+  gchar *channels;
+
+  GST_OBJECT_LOCK (csoundsrc);
+  gst_csoundsrc_get_source (csoundsrc, &source);
+  GST_OBJECT_UNLOCK (csoundsrc);
+  if (gst_csound_source_get_name (&source) == NULL) {
+    GST_ELEMENT_ERROR (csoundsrc, RESOURCE, NOT_FOUND, (NULL),
+        ("no location, csd-text or orc set"));
+    return FALSE;
+  }
+
+  csoundsrc->csound = gst_csound_instance_acquire_source (&source,
+      csoundsrc->options, csoundsrc->instance_pool, gst_csound_log_message,
+      csoundsrc->log);
+  if (csoundsrc->csound == NULL) {
     GST_ELEMENT_ERROR (csoundsrc, RESOURCE, OPEN_READ,
-        ("%s", csoundsrc->csd_name), (NULL));
+        ("%s", gst_csound_source_get_name (&source)), (NULL));
+    gst_csound_source_clear (&source);
     return FALSE;
   }
   csoundsrc->ksmps = csoundGetKsmps (csoundsrc->csound);
@@ -326,11 +926,96 @@ gst_csoundsrc_start (GstBaseSrc * src)
   csoundsrc->channels = csoundGetNchnls (csoundsrc->csound);
   GST_DEBUG_OBJECT (csoundsrc, "ksmps: %d , channels: %d", csoundsrc->ksmps,
       csoundsrc->channels);
-  csoundsrc->next_sample = 0;
-  csoundsrc->next_time = 0;
-  csoundStart (csoundsrc->csound);
+  csoundsrc->end_of_score = 0;
 
   csoundsrc->csound_output = csoundGetSpout (csoundsrc->csound);
+
+  csoundsrc->position = 0;
+  csoundsrc->engine_block = 0;
+  csoundsrc->engine_exact = TRUE;
+  if (csoundsrc->render_cache && (source.csd_text || source.orc)) {
+    GST_WARNING_OBJECT (csoundsrc, "the render cache needs a location");
+  } else if (csoundsrc->render_cache) {
+    GstCsoundCache *cache = gst_csound_cache_open (source.location,
+        csoundsrc->options, csoundsrc->channels, csoundsrc->ksmps,
+        csoundGetSr (csoundsrc->csound));
+
+    if (cache == NULL)
+      GST_WARNING_OBJECT (csoundsrc, "rendering without a cache");
+    g_mutex_lock (&csoundsrc->lock);
+    csoundsrc->cache = cache;
+    g_mutex_unlock (&csoundsrc->lock);
+  }
+
+  old_channels = gst_csoundsrc_replace_channels (csoundsrc,
+      gst_csound_channels_update (csoundsrc->ctl_channels, csoundsrc->csound,
+          GST_OBJECT (csoundsrc)));
+  gst_csound_channels_commit (old_channels, csoundsrc->ctl_channels,
+      GST_OBJECT (csoundsrc));
+  g_free (csoundsrc->ctl_ptrs);
+  csoundsrc->ctl_ptrs = g_new0 (MYFLT *, csoundsrc->ctl_channels->len);
+  if (!gst_csound_channels_bind (csoundsrc->ctl_channels, csoundsrc->csound,
+          csoundsrc->ctl_ptrs)) {
+    GST_ELEMENT_ERROR (csoundsrc, CORE, FAILED, (NULL),
+        ("the control channels of the orchestra do not bind"));
+    gst_csoundsrc_close (csoundsrc);
+    gst_csound_source_clear (&source);
+    return FALSE;
+  }
+  GST_OBJECT_LOCK (csoundsrc);
+  channels = g_strdup (csoundsrc->analysis_channels);
+  GST_OBJECT_UNLOCK (csoundsrc);
+  gst_csound_analysis_setup (&csoundsrc->analysis, channels,
+      csoundsrc->csound, GST_ELEMENT (csoundsrc));
+  g_free (channels);
+  gst_csound_source_clear (&source);
+
+  gst_csound_swap_activate (csoundsrc->swap, csoundsrc->instance_pool,
+      gst_csound_log_message, csoundsrc->log);
+
+  return TRUE;
+}
+
+static void
+gst_csoundsrc_close (GstCsoundsrc * csoundsrc)
+{
+  gst_csound_swap_reset (csoundsrc->swap);
+  g_mutex_lock (&csoundsrc->lock);
+  gst_csound_cache_close (csoundsrc->cache);
+  csoundsrc->cache = NULL;
+  g_mutex_unlock (&csoundsrc->lock);
+  gst_csound_analysis_clear (&csoundsrc->analysis);
+  gst_csound_instance_release (csoundsrc->csound);
+  csoundsrc->csound = NULL;
+  csoundsrc->csound_output = NULL;
+}
+
+static gboolean
+gst_csoundsrc_start (GstBaseSrc * src)
+{
+  GstCsoundsrc *csoundsrc = GST_CSOUNDSRC (src);
+
+  gst_csoundsrc_start_log (csoundsrc);
+
+  /* the csd as it is, follow-caps compiles it again once the caps are
+   * known */
+  GST_OBJECT_LOCK (csoundsrc);
+  g_free (csoundsrc->options);
+  csoundsrc->options = NULL;
+  GST_OBJECT_UNLOCK (csoundsrc);
+  if (!gst_csoundsrc_open (csoundsrc)) {
+    gst_csoundsrc_stop_log (csoundsrc);
+    return FALSE;
+  }
+  csoundsrc->csd_rate = (gint) csoundGetSr (csoundsrc->csound);
+  csoundsrc->csd_ksmps = csoundsrc->ksmps;
+  csoundsrc->csd_channels = csoundsrc->channels;
+
+  csoundsrc->next_sample = 0;
+  csoundsrc->next_time = 0;
+  g_mutex_lock (&csoundsrc->lock);
+  gst_csoundsrc_replay_reset (csoundsrc, TRUE);
+  g_mutex_unlock (&csoundsrc->lock);
   GST_DEBUG_OBJECT (csoundsrc, "start");
 
   return TRUE;
@@ -340,12 +1025,94 @@ static gboolean
 gst_csoundsrc_stop (GstBaseSrc * src)
 {
   GstCsoundsrc *csoundsrc = GST_CSOUNDSRC (src);
-  csoundStop (csoundsrc->csound);
+
+  g_mutex_lock (&csoundsrc->lock);
+  gst_csoundsrc_replay_reset (csoundsrc, FALSE);
+  g_mutex_unlock (&csoundsrc->lock);
+  gst_csoundsrc_close (csoundsrc);
+  gst_csoundsrc_stop_log (csoundsrc);
+  gst_csound_event_queue_clear (&csoundsrc->events);
+  gst_csound_out_pads_reset (GST_ELEMENT (csoundsrc), &csoundsrc->out_pads);
   GST_DEBUG_OBJECT (csoundsrc, "stop");
 
   return TRUE;
 }
 
+/* start the score over without recompiling it, the caller holds the
+ * lock. With a cache csound stays where it is, a seek may not need it */
+static void
+gst_csoundsrc_rewind (GstCsoundsrc * csoundsrc)
+{
+  if (csoundsrc->csound && csoundsrc->cache == NULL) {
+    gst_csound_instance_rewind (csoundsrc->csound);
+    csoundsrc->engine_block = 0;
+    csoundsrc->engine_exact = TRUE;
+  }
+  csoundsrc->end_of_score = 0;
+  gst_csound_event_queue_clear (&csoundsrc->events);
+  csoundsrc->stats.drift_base = GST_CLOCK_TIME_NONE;
+}
+
+/* the out pads are flushed along with the src pad, the flush stop
+ * before the streaming thread starts again */
+static void
+gst_csoundsrc_flush_out_pads (GstCsoundsrc * csoundsrc, gboolean start)
+{
+  if (start) {
+    csoundsrc->out_flushing = TRUE;
+    gst_csound_out_pads_push_event (GST_ELEMENT (csoundsrc),
+        &csoundsrc->out_pads, gst_event_new_flush_start ());
+  } else if (csoundsrc->out_flushing) {
+    csoundsrc->out_flushing = FALSE;
+    gst_csound_out_pads_push_event (GST_ELEMENT (csoundsrc),
+        &csoundsrc->out_pads, gst_event_new_flush_stop (TRUE));
+  }
+}
+
+/* a flush from downstream starts the score over, seeks rewind in
+ * do_seek(). The flush start goes to the out pads first, so a push
+ * blocked on them lets go of the stream lock */
+static gboolean
+gst_csoundsrc_event (GstBaseSrc * src, GstEvent * event)
+{
+  GstCsoundsrc *csoundsrc = GST_CSOUNDSRC (src);
+  gboolean res;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_SEEK:{
+      GstSeekFlags flags;
+
+      gst_event_parse_seek (event, NULL, NULL, &flags, NULL, NULL, NULL,
+          NULL);
+      if (flags & GST_SEEK_FLAG_FLUSH)
+        gst_csoundsrc_flush_out_pads (csoundsrc, TRUE);
+      res = GST_BASE_SRC_CLASS (gst_csoundsrc_parent_class)->event (src,
+          event);
+      /* do_seek() already did when the seek got that far */
+      gst_csoundsrc_flush_out_pads (csoundsrc, FALSE);
+      return res;
+    }
+    case GST_EVENT_FLUSH_START:
+      gst_csoundsrc_flush_out_pads (csoundsrc, TRUE);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      g_mutex_lock (&csoundsrc->lock);
+      gst_csoundsrc_rewind (csoundsrc);
+      csoundsrc->position = 0;
+      gst_csoundsrc_replay_reset (csoundsrc, TRUE);
+      csoundsrc->next_sample = 0;
+      csoundsrc->next_time = 0;
+      g_mutex_unlock (&csoundsrc->lock);
+      GST_DEBUG_OBJECT (csoundsrc, "flushed, score rewound");
+      gst_csoundsrc_flush_out_pads (csoundsrc, FALSE);
+      break;
+    default:
+      break;
+  }
+
+  return GST_BASE_SRC_CLASS (gst_csoundsrc_parent_class)->event (src, event);
+}
+
 /* given a buffer, return start and stop time when it should be pushed
  * out. The base class will sync on the clock using these times. */
 static void
@@ -370,12 +1137,189 @@ gst_csoundsrc_get_times (GstBaseSrc * src, GstBuffer * buffer,
   }
 }
 
-/* check if the resource is seekable */
+/* only what is rendered once can be served again, so only with a cache */
 static gboolean
 gst_csoundsrc_is_seekable (GstBaseSrc * src)
 {
-  // not seekeable !!
-  return FALSE;
+  GstCsoundsrc *csoundsrc = GST_CSOUNDSRC (src);
+  gboolean res;
+
+  g_mutex_lock (&csoundsrc->lock);
+  res = csoundsrc->cache != NULL && !gst_base_src_is_live (src);
+  g_mutex_unlock (&csoundsrc->lock);
+
+  return res;
+}
+
+/* buffers start on a block, at or before the seek position */
+static gboolean
+gst_csoundsrc_do_seek (GstBaseSrc * src, GstSegment * segment)
+{
+  GstCsoundsrc *csoundsrc = GST_CSOUNDSRC (src);
+  gint rate = GST_AUDIO_INFO_RATE (&csoundsrc->info);
+  GstClockTimeDiff time;
+  guint64 block;
+
+  if (segment->rate < 0.0)
+    return FALSE;
+
+  time = (GstClockTimeDiff) segment->start - csoundsrc->timestamp_offset;
+  block = rate > 0 && csoundsrc->ksmps > 0 ?
+      gst_util_uint64_scale_int (MAX (time, 0), rate, GST_SECOND) /
+      csoundsrc->ksmps : 0;
+
+  g_mutex_lock (&csoundsrc->lock);
+  if (block > 0 && csoundsrc->cache == NULL) {
+    g_mutex_unlock (&csoundsrc->lock);
+    return FALSE;
+  }
+  csoundsrc->position = block;
+  /* a first pass is only recorded from the start of the score */
+  gst_csoundsrc_replay_reset (csoundsrc, block == 0);
+  csoundsrc->next_sample = block * csoundsrc->ksmps;
+  csoundsrc->next_time = rate > 0 ?
+      gst_util_uint64_scale_int (csoundsrc->next_sample, GST_SECOND, rate) : 0;
+  gst_csoundsrc_rewind (csoundsrc);
+  g_mutex_unlock (&csoundsrc->lock);
+  GST_DEBUG_OBJECT (csoundsrc, "seek to block %" G_GUINT64_FORMAT, block);
+  gst_csoundsrc_flush_out_pads (csoundsrc, FALSE);
+  gst_csound_out_pads_new_segment (GST_ELEMENT (csoundsrc),
+      &csoundsrc->out_pads);
+
+  return GST_BASE_SRC_CLASS (gst_csoundsrc_parent_class)->do_seek (src,
+      segment);
+}
+
+/* a live source is one buffer late. The duration is known once the
+ * whole score is in the cache */
+static gboolean
+gst_csoundsrc_query (GstBaseSrc * src, GstQuery * query)
+{
+  GstCsoundsrc *csoundsrc = GST_CSOUNDSRC (src);
+  gint rate = GST_AUDIO_INFO_RATE (&csoundsrc->info);
+
+  if (GST_QUERY_TYPE (query) == GST_QUERY_DURATION && rate > 0) {
+    GstFormat format;
+    gint64 duration = -1;
+
+    gst_query_parse_duration (query, &format, NULL);
+    g_mutex_lock (&csoundsrc->lock);
+    if (csoundsrc->cache && gst_csound_cache_is_complete (csoundsrc->cache))
+      duration = gst_util_uint64_scale_int (gst_csound_cache_get_blocks
+          (csoundsrc->cache) * csoundsrc->ksmps, GST_SECOND, rate);
+    g_mutex_unlock (&csoundsrc->lock);
+
+    if (format == GST_FORMAT_TIME && duration >= 0) {
+      gst_query_set_duration (query, GST_FORMAT_TIME, duration);
+      return TRUE;
+    }
+  }
+
+  if (GST_QUERY_TYPE (query) == GST_QUERY_LATENCY
+      && gst_base_src_is_live (src)) {
+    GstClockTime latency;
+
+    if (rate <= 0 || csoundsrc->buffer_frames == 0)
+      return FALSE;
+
+    latency = gst_util_uint64_scale_int (csoundsrc->buffer_frames,
+        GST_SECOND, rate);
+    GST_DEBUG_OBJECT (csoundsrc, "latency: %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (latency));
+    gst_query_set_latency (query, TRUE, latency, GST_CLOCK_TIME_NONE);
+    return TRUE;
+  }
+
+  return GST_BASE_SRC_CLASS (gst_csoundsrc_parent_class)->query (src, query);
+}
+
+/* offsets and timestamps of a buffer of @samples frames, the next buffer
+ * follows it */
+static void
+gst_csoundsrc_stamp (GstCsoundsrc * csoundsrc, GstBuffer * buffer,
+    guint samples)
+{
+  gint64 next_sample = csoundsrc->next_sample + samples;
+  GstClockTime next_time = gst_util_uint64_scale_int (next_sample, GST_SECOND,
+      GST_AUDIO_INFO_RATE (&csoundsrc->info));
+
+  GST_BUFFER_OFFSET (buffer) = csoundsrc->next_sample;
+  GST_BUFFER_OFFSET_END (buffer) = next_sample;
+  GST_BUFFER_TIMESTAMP (buffer) = csoundsrc->timestamp_offset +
+      csoundsrc->next_time;
+  GST_BUFFER_DURATION (buffer) = next_time - csoundsrc->next_time;
+  if (csoundsrc->next_sample == 0)
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
+
+  csoundsrc->next_time = next_time;
+  csoundsrc->next_sample = next_sample;
+}
+
+/* while replaying, the buffers are slices of the first pass and never
+ * go through fill().
+ * Returns: %FALSE when not replaying */
+static gboolean
+gst_csoundsrc_replay_next (GstCsoundsrc * csoundsrc, GstBuffer ** buf)
+{
+  GstBuffer *buffer;
+  GstCsoundEvent *dropped;
+  gsize size;
+
+  g_mutex_lock (&csoundsrc->lock);
+  if (csoundsrc->replay == NULL) {
+    g_mutex_unlock (&csoundsrc->lock);
+    return FALSE;
+  }
+
+  dropped = gst_csound_event_queue_take (&csoundsrc->events,
+      GST_CLOCK_TIME_NONE);
+  if (dropped) {
+    GST_WARNING_OBJECT (csoundsrc, "replaying, score events dropped");
+    gst_csound_events_free (dropped);
+  }
+
+  buffer = gst_buffer_new ();
+  size = csoundsrc->buffer_frames * GST_AUDIO_INFO_BPF (&csoundsrc->info);
+  while (size > 0) {
+    gsize chunk = MIN (size, csoundsrc->replay_size - csoundsrc->replay_offset);
+
+    gst_buffer_append_memory (buffer, gst_memory_share (csoundsrc->replay,
+            csoundsrc->replay_offset, chunk));
+    csoundsrc->replay_offset = (csoundsrc->replay_offset + chunk) %
+        csoundsrc->replay_size;
+    size -= chunk;
+  }
+  gst_csoundsrc_stamp (csoundsrc, buffer, csoundsrc->buffer_frames);
+  g_mutex_unlock (&csoundsrc->lock);
+
+  *buf = buffer;
+  return TRUE;
+}
+
+/* every buffer of the src pad also feeds the out pads */
+static GstFlowReturn
+gst_csoundsrc_create (GstBaseSrc * basesrc, guint64 offset, guint length,
+    GstBuffer ** buf)
+{
+  GstCsoundsrc *csoundsrc = GST_CSOUNDSRC (basesrc);
+  gboolean allocated = *buf == NULL;
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  if (!allocated || !gst_csoundsrc_replay_next (csoundsrc, buf))
+    ret = GST_BASE_SRC_CLASS (gst_csoundsrc_parent_class)->create (basesrc,
+        offset, length, buf);
+
+  if (ret == GST_FLOW_OK) {
+    ret = gst_csound_out_pads_push (GST_ELEMENT (csoundsrc),
+        &csoundsrc->out_pads, *buf, &csoundsrc->info, &basesrc->segment);
+    if (ret != GST_FLOW_OK && allocated)
+      gst_buffer_replace (buf, NULL);
+  } else if (ret == GST_FLOW_EOS) {
+    gst_csound_out_pads_push_event (GST_ELEMENT (csoundsrc),
+        &csoundsrc->out_pads, gst_event_new_eos ());
+  }
+
+  return ret;
 }
 
 /* ask the subclass to fill the buffer with data from offset and size */
@@ -386,20 +1330,35 @@ gst_csoundsrc_fill (GstBaseSrc * basesrc, guint64 offset,
 
   GstCsoundsrc *csoundsrc = GST_CSOUNDSRC (basesrc);
 
-  GstClockTime next_time;
-  gint64 next_sample;
-  gint bytes, samples;
+  guint samples, blocks, wanted;
   GstMapInfo map;
   gint samplerate, bpf;
+  GstClockTime began;
+  gboolean planar = GST_AUDIO_INFO_LAYOUT (&csoundsrc->info) ==
+      GST_AUDIO_LAYOUT_NON_INTERLEAVED;
 
   g_mutex_lock (&csoundsrc->lock);
 
+  if (!gst_csound_swap_fading (csoundsrc->swap)) {
+    CSOUND *csound = gst_csound_swap_take (csoundsrc->swap);
+    GPtrArray *old_channels = NULL;
+
+    if (csound && gst_csoundsrc_swap_in (csoundsrc, csound, &old_channels)) {
+      /* a child-added handler may query us, which takes the lock. Only
+       * this thread replaces the channels, the new ones stay in place */
+      g_mutex_unlock (&csoundsrc->lock);
+      gst_csound_channels_commit (old_channels, csoundsrc->ctl_channels,
+          GST_OBJECT (csoundsrc));
+      g_mutex_lock (&csoundsrc->lock);
+    }
+  }
+
   if (csoundsrc->end_of_score) {
-    if(csoundsrc->loop){
-      csoundSetScoreOffsetSeconds(csoundsrc->csound, 0.0);
-      csoundRewindScore(csoundsrc->csound);
-    }else{
+    if (csoundsrc->loop) {
+      gst_csoundsrc_restart_score (csoundsrc);
+    } else {
       GST_INFO_OBJECT (csoundsrc, "eos");
+      g_mutex_unlock (&csoundsrc->lock);
       return GST_FLOW_EOS;
     }
   }
@@ -407,88 +1366,481 @@ gst_csoundsrc_fill (GstBaseSrc * basesrc, guint64 offset,
   samplerate = GST_AUDIO_INFO_RATE (&csoundsrc->info);
   bpf = GST_AUDIO_INFO_BPF (&csoundsrc->info);
 
+  /* whole blocks only, csound renders nothing smaller */
   if (length == -1)
-    samples = csoundsrc->ksmps * csoundsrc->channels;
+    samples = csoundsrc->buffer_frames;
   else
     samples = length / bpf;
-
+  blocks = wanted = MAX (1, samples / csoundsrc->ksmps);
+  samples = blocks * csoundsrc->ksmps;
   csoundsrc->samples_to_generate = samples;
 
-  next_sample = csoundsrc->next_sample + samples;
-  bytes = csoundsrc->samples_to_generate * bpf;
-  next_time = gst_util_uint64_scale_int (next_sample, GST_SECOND, samplerate);
-
-  gst_buffer_set_size (buffer, bytes);
-  GST_BUFFER_TIMESTAMP (buffer) = csoundsrc->timestamp_offset + next_time;
-  GST_BUFFER_DURATION (buffer) = csoundsrc->next_time - next_time;
-
   gst_object_sync_values (GST_OBJECT (csoundsrc),
-      GST_BUFFER_TIMESTAMP (buffer));
+      csoundsrc->timestamp_offset + csoundsrc->next_time);
 
-  csoundsrc->next_time = next_time;
-  csoundsrc->next_sample = next_sample;
+  GST_LOG_OBJECT (csoundsrc, "generating %u samples at ts %" GST_TIME_FORMAT,
+      samples, GST_TIME_ARGS (csoundsrc->timestamp_offset +
+          csoundsrc->next_time));
 
-  GST_LOG_OBJECT (csoundsrc, "generating %lu samples at ts %" GST_TIME_FORMAT,
-      csoundsrc->samples_to_generate, GST_TIME_ARGS (GST_BUFFER_TIMESTAMP (buffer)));
+  /* the channel values of every block, from the time of its first sample */
+  if (csoundsrc->ctl_channels->len > 0) {
+    gsize n_values = (gsize) blocks * csoundsrc->ctl_channels->len;
 
+    /* in values, the channels may change with the orchestra */
+    if (n_values > csoundsrc->ctl_capacity) {
+      csoundsrc->ctl_values = g_renew (MYFLT, csoundsrc->ctl_values,
+          n_values);
+      csoundsrc->ctl_capacity = n_values;
+    }
+    gst_csound_channels_prepare (csoundsrc->ctl_channels,
+        gst_util_uint64_scale_int (csoundsrc->next_sample, GST_SECOND,
+            samplerate),
+        gst_util_uint64_scale_int (csoundsrc->ksmps, GST_SECOND, samplerate),
+        blocks, csoundsrc->ctl_values);
+  }
+
+  /* the score events due before the end of the buffer */
+  csoundsrc->block_duration = gst_util_uint64_scale_int (csoundsrc->ksmps,
+      GST_SECOND, samplerate);
+  csoundsrc->due_start = gst_segment_to_running_time (&basesrc->segment,
+      GST_FORMAT_TIME, csoundsrc->timestamp_offset +
+      gst_util_uint64_scale_int (csoundsrc->next_sample, GST_SECOND,
+          samplerate));
+  csoundsrc->due_events = gst_csound_event_queue_take (&csoundsrc->events,
+      GST_CLOCK_TIME_IS_VALID (csoundsrc->due_start) ?
+      csoundsrc->due_start + blocks * csoundsrc->block_duration :
+      GST_CLOCK_TIME_NONE);
+
+  began = gst_util_get_timestamp ();
   gst_buffer_map (buffer, &map, GST_MAP_READWRITE);
-  csoundsrc->process (csoundsrc, map.data);
-  MYFLT *data = (MYFLT *) map.data;
-  /* ouput scaling */
-  gdouble scale = (1.0 / 32767.0);
+  if (planar)
+    gst_csoundsrc_map_planes (csoundsrc, map.data, samples);
+  csoundsrc->due_next = csoundsrc->due_events;
+  blocks = gst_csoundsrc_render (csoundsrc, map.data, wanted);
+  if (blocks == 0 && csoundsrc->loop) {
+    /* the score ended on the first block, once more from the start */
+    gst_csoundsrc_restart_score (csoundsrc);
+    blocks = gst_csoundsrc_render (csoundsrc, map.data, wanted);
+  }
+  /* the score ended inside the buffer, close the gaps between planes */
+  if (planar && blocks > 0 && blocks < wanted) {
+    gsize plane = (gsize) blocks * csoundsrc->ksmps *
+        csoundsrc->out_convert.sample_size;
+    gint c;
+
+    for (c = 1; c < csoundsrc->channels; c++)
+      memmove (map.data + c * plane, csoundsrc->planes[c], plane);
+  }
+  gst_buffer_unmap (buffer, &map);
+  gst_csound_events_free (csoundsrc->due_events);
+  csoundsrc->due_events = csoundsrc->due_next = NULL;
 
-  for (gint i = 0; i < csoundsrc->samples_to_generate * csoundsrc->channels; i++) {
-    *data++ *= scale;
+  if (blocks == 0) {
+    GST_INFO_OBJECT (csoundsrc, "eos");
+    g_mutex_unlock (&csoundsrc->lock);
+    return GST_FLOW_EOS;
   }
 
-  gst_buffer_unmap (buffer, &map);
+  /* the score may end inside the buffer */
+  samples = blocks * csoundsrc->ksmps;
+  gst_buffer_set_size (buffer, samples * bpf);
+  if (planar) {
+    GstAudioMeta *meta = gst_buffer_get_audio_meta (buffer);
+
+    if (meta)
+      gst_buffer_remove_meta (buffer, (GstMeta *) meta);
+    gst_buffer_add_audio_meta (buffer, &csoundsrc->info, samples, NULL);
+  }
+  gst_csoundsrc_stamp (csoundsrc, buffer, samples);
+  gst_csound_analysis_attach (&csoundsrc->analysis, buffer);
+
+  gst_csound_stats_add_buffer (&csoundsrc->stats,
+      gst_util_get_timestamp () - began,
+      gst_util_uint64_scale_int (samples, GST_SECOND, samplerate));
+  if (GST_CLOCK_TIME_IS_VALID (csoundsrc->due_start) && !csoundsrc->cache
+      && !csoundsrc->replay)
+    gst_csound_stats_sync (&csoundsrc->stats, csoundsrc->due_start +
+        gst_util_uint64_scale_int (samples, GST_SECOND, samplerate),
+        csoundGetCurrentTimeSamples (csoundsrc->csound), samplerate);
+  gst_csound_stats_publish (&csoundsrc->stats_board, &csoundsrc->stats,
+      GST_ELEMENT (csoundsrc));
   g_mutex_unlock (&csoundsrc->lock);
 
   return GST_FLOW_OK;
 }
 
+/* planar buffers of @frames frames, packed, every plane of @data */
 static void
-gst_csoundsrc_get_csamples (GstCsoundsrc * csoundsrc, MYFLT * data)
+gst_csoundsrc_map_planes (GstCsoundsrc * csoundsrc, guint8 * data,
+    guint frames)
 {
-  guint bytes_to_move = csoundsrc->ksmps * sizeof (data) * csoundsrc->channels;
-  guint loops_to_fill = csoundsrc->samples_to_generate / (csoundsrc->ksmps);
-  for (gint i = 0; i < loops_to_fill; i++) {
-    memcpy (data, csoundsrc->csound_output, bytes_to_move);
-    csoundsrc->end_of_score = csoundPerformKsmps (csoundsrc->csound);
-    data += csoundsrc->ksmps * csoundsrc->channels;
-  }
+  gsize plane = (gsize) frames * csoundsrc->out_convert.sample_size;
+  gint c;
+
+  for (c = 0; c < csoundsrc->channels; c++)
+    csoundsrc->planes[c] = data + c * plane;
 }
 
-/*callback for std-out messages*/
+/* @spout scaled from the orchestra 0dBFS to block @block of the buffer
+ * at @data, or of its planes */
 static void
-gst_csoundsrc_messages (CSOUND * csound, int attr, const char *format,
-    va_list valist)
+gst_csoundsrc_convert_block (GstCsoundsrc * csoundsrc, guint8 * data,
+    guint block, const MYFLT * spout)
 {
-  char *result = NULL;
-  vasprintf (&result, format, valist);
-  switch (attr) {
-    case CSOUNDMSG_ERROR:
-      GST_WARNING (result);
-      break;
-    case CSOUNDMSG_WARNING:
-      GST_WARNING (result);
-      break;
-    case CSOUNDMSG_ORCH:
-      GST_INFO (result);
-      break;
-    case CSOUNDMSG_REALTIME:
-      GST_LOG (result);
+  guint ksmps = csoundsrc->ksmps;
+  guint samples = ksmps * csoundsrc->channels;
+
+  if (GST_AUDIO_INFO_LAYOUT (&csoundsrc->info) ==
+      GST_AUDIO_LAYOUT_NON_INTERLEAVED)
+    gst_csound_convert_out_planar (&csoundsrc->out_convert,
+        csoundsrc->planes, (gsize) block * ksmps, spout, csoundsrc->channels,
+        ksmps);
+  else
+    gst_csound_convert_out (&csoundsrc->out_convert,
+        data + (gsize) block * samples * csoundsrc->out_convert.sample_size,
+        spout, samples);
+}
+
+/* render @n_blocks blocks of the buffer from block @first, stops early at
+ * the end of the score.
+ * Returns: the blocks rendered */
+static guint
+gst_csoundsrc_get_csamples (GstCsoundsrc * csoundsrc, gpointer data,
+    guint first, guint n_blocks)
+{
+  guint n_controls = csoundsrc->ctl_channels->len;
+  GstCsoundCache *cache = csoundsrc->cache;
+  GstClockTime began;
+  guint i;
+
+  for (i = first; i < first + n_blocks; i++) {
+    if (n_controls > 0)
+      gst_csound_channels_apply (csoundsrc->ctl_ptrs,
+          csoundsrc->ctl_values + i * n_controls, n_controls);
+    if (csoundsrc->due_next) {
+      GstCsoundEvent *next = gst_csound_events_play (csoundsrc->due_next,
+          csoundsrc->csound, GST_CLOCK_TIME_IS_VALID (csoundsrc->due_start) ?
+          csoundsrc->due_start + (i + 1) * csoundsrc->block_duration :
+          GST_CLOCK_TIME_NONE);
+
+      /* not the score any more */
+      if (next != csoundsrc->due_next)
+        csoundsrc->engine_exact = FALSE;
+      csoundsrc->due_next = next;
+    }
+    began = gst_util_get_timestamp ();
+    gst_csound_swap_feed (csoundsrc->swap, NULL);
+    csoundsrc->end_of_score = csoundPerformKsmps (csoundsrc->csound);
+    gst_csound_swap_mix (csoundsrc->swap, csoundsrc->csound_output);
+    gst_csound_stats_add_block (&csoundsrc->stats,
+        gst_util_get_timestamp () - began);
+
+    if (cache && csoundsrc->engine_exact
+        && csoundsrc->engine_block == gst_csound_cache_get_blocks (cache)) {
+      if (csoundsrc->end_of_score)
+        gst_csound_cache_set_complete (cache);
+      else
+        gst_csound_cache_append (cache, csoundsrc->csound_output);
+    }
+    if (csoundsrc->end_of_score)
       break;
-    case CSOUNDMSG_DEFAULT:
-      GST_LOG (result);
+    csoundsrc->engine_block++;
+
+    gst_csoundsrc_convert_block (csoundsrc, data, i, csoundsrc->csound_output);
+    gst_csound_analysis_sample (&csoundsrc->analysis, i * csoundsrc->ksmps);
+  }
+
+  return i - first;
+}
+
+/* bring csound to @block of a straight render of the score, rendering the
+ * blocks before it as fast as it goes, into the cache when missing */
+static gboolean
+gst_csoundsrc_seek_engine (GstCsoundsrc * csoundsrc, guint64 block)
+{
+  GstCsoundCache *cache = csoundsrc->cache;
+
+  if (csoundsrc->engine_block == block)
+    return TRUE;
+
+  if (!csoundsrc->engine_exact || csoundsrc->engine_block > block) {
+    gst_csound_instance_rewind (csoundsrc->csound);
+    csoundsrc->engine_block = 0;
+    csoundsrc->engine_exact = TRUE;
+  }
+
+  GST_DEBUG_OBJECT (csoundsrc, "fast forward from block %" G_GUINT64_FORMAT
+      " to %" G_GUINT64_FORMAT, csoundsrc->engine_block, block);
+  while (csoundsrc->engine_block < block) {
+    if (csoundPerformKsmps (csoundsrc->csound)) {
+      if (csoundsrc->engine_block == gst_csound_cache_get_blocks (cache))
+        gst_csound_cache_set_complete (cache);
+      return FALSE;
+    }
+    if (csoundsrc->engine_block == gst_csound_cache_get_blocks (cache))
+      gst_csound_cache_append (cache, csoundsrc->csound_output);
+    csoundsrc->engine_block++;
+  }
+
+  return TRUE;
+}
+
+/* serve the blocks in the cache from the mapping and have csound render
+ * the others. Csound keeps rendering once score events made it leave the
+ * score, until the next seek */
+static guint
+gst_csoundsrc_fill_cached (GstCsoundsrc * csoundsrc, guint8 * out,
+    guint n_blocks)
+{
+  GstCsoundCache *cache = csoundsrc->cache;
+  guint done = 0;
+
+  while (done < n_blocks) {
+    guint64 cached = gst_csound_cache_get_blocks (cache);
+
+    if (csoundsrc->position < cached && csoundsrc->due_next == NULL
+        && (csoundsrc->engine_exact
+            || csoundsrc->engine_block != csoundsrc->position)) {
+      gst_csoundsrc_convert_block (csoundsrc, out, done,
+          gst_csound_cache_get_block (cache, csoundsrc->position));
+      csoundsrc->position++;
+      done++;
+      continue;
+    }
+
+    if (csoundsrc->position >= cached && gst_csound_cache_is_complete (cache))
       break;
-    default:
-      GST_LOG (result);
+    if (!gst_csoundsrc_seek_engine (csoundsrc, csoundsrc->position)
+        || csoundsrc->process (csoundsrc, out, done, 1) == 0)
       break;
+    csoundsrc->position++;
+    done++;
   }
-  g_free (result);
+
+  csoundsrc->end_of_score = done < n_blocks;
+  return done;
+}
+
+static guint
+gst_csoundsrc_render (GstCsoundsrc * csoundsrc, guint8 * out, guint n_blocks)
+{
+  gsize block_size = csoundsrc->ksmps * csoundsrc->channels *
+      csoundsrc->out_convert.sample_size;
+  guint blocks;
+
+  /* the first replayed buffer, fill() was already called for it */
+  if (csoundsrc->replay) {
+    gsize size = n_blocks * block_size;
+
+    while (size > 0) {
+      gsize chunk = MIN (size,
+          csoundsrc->replay_size - csoundsrc->replay_offset);
+
+      gst_memory_extract (csoundsrc->replay, csoundsrc->replay_offset, out,
+          chunk);
+      csoundsrc->replay_offset = (csoundsrc->replay_offset + chunk) %
+          csoundsrc->replay_size;
+      out += chunk;
+      size -= chunk;
+    }
+    return n_blocks;
+  }
+
+  if (csoundsrc->cache)
+    blocks = gst_csoundsrc_fill_cached (csoundsrc, out, n_blocks);
+  else
+    blocks = csoundsrc->process (csoundsrc, out, 0, n_blocks);
+
+  if (csoundsrc->recording) {
+    if (csoundsrc->due_next != csoundsrc->due_events) {
+      GST_DEBUG_OBJECT (csoundsrc, "score events played, not recording");
+      gst_csoundsrc_replay_reset (csoundsrc, FALSE);
+    } else if (csoundsrc->recording->len + blocks * block_size >
+        REPLAY_MAX_SIZE) {
+      GST_WARNING_OBJECT (csoundsrc, "score too long to replay");
+      gst_csoundsrc_replay_reset (csoundsrc, FALSE);
+    } else {
+      g_byte_array_append (csoundsrc->recording, out, blocks * block_size);
+    }
+  }
+
+  return blocks;
+}
+
+/* drop the recording and the replay, start recording again when @record
+ * and the element is asked to */
+static void
+gst_csoundsrc_replay_reset (GstCsoundsrc * csoundsrc, gboolean record)
+{
+  if (csoundsrc->recording) {
+    g_byte_array_unref (csoundsrc->recording);
+    csoundsrc->recording = NULL;
+  }
+  if (csoundsrc->replay) {
+    gst_memory_unref (csoundsrc->replay);
+    csoundsrc->replay = NULL;
+  }
+  /* the slices of a planar recording would not be planar buffers */
+  if (record && csoundsrc->loop_replay
+      && GST_AUDIO_INFO_LAYOUT (&csoundsrc->info) ==
+      GST_AUDIO_LAYOUT_INTERLEAVED)
+    csoundsrc->recording = g_byte_array_new ();
+}
+
+/* the first pass in one aligned memory, to be shared by every buffer */
+static void
+gst_csoundsrc_replay_start (GstCsoundsrc * csoundsrc)
+{
+  GByteArray *recording = csoundsrc->recording;
+  GstAllocationParams params;
+  GstMemory *mem;
+
+  csoundsrc->recording = NULL;
+  if (recording->len == 0) {
+    g_byte_array_unref (recording);
+    return;
+  }
+
+  gst_allocation_params_init (&params);
+  params.align = GST_CSOUND_BUFFER_ALIGN;
+  mem = gst_allocator_alloc (NULL, recording->len, &params);
+  gst_memory_fill (mem, 0, recording->data, recording->len);
+  g_byte_array_unref (recording);
+
+  GST_INFO_OBJECT (csoundsrc, "replaying the %" G_GSIZE_FORMAT " bytes of "
+      "the first pass", gst_memory_get_sizes (mem, NULL, NULL));
+  csoundsrc->replay = mem;
+  csoundsrc->replay_size = gst_memory_get_sizes (mem, NULL, NULL);
+  csoundsrc->replay_offset = 0;
+}
+
+/* back to the start of the score for a loop, timestamps go on */
+static void
+gst_csoundsrc_restart_score (GstCsoundsrc * csoundsrc)
+{
+  csoundsrc->end_of_score = 0;
+  if (csoundsrc->recording) {
+    gst_csoundsrc_replay_start (csoundsrc);
+    if (csoundsrc->replay)
+      return;
+  }
+  /* the last pass could not be kept, record this one */
+  gst_csoundsrc_replay_reset (csoundsrc, TRUE);
+
+  if (csoundsrc->cache) {
+    csoundsrc->position = 0;
+  } else {
+    csoundSetScoreOffsetSeconds (csoundsrc->csound, 0.0);
+    csoundRewindScore (csoundsrc->csound);
+  }
+}
+
+static GstPad *
+gst_csoundsrc_request_new_pad (GstElement * element, GstPadTemplate * templ,
+    const gchar * name, const GstCaps * caps)
+{
+  return gst_csound_out_pad_request (element,
+      &GST_CSOUNDSRC (element)->out_pads, templ, name);
+}
+
+static void
+gst_csoundsrc_release_pad (GstElement * element, GstPad * pad)
+{
+  gst_csound_out_pad_release (element, &GST_CSOUNDSRC (element)->out_pads,
+      pad);
+}
+
+/* GstChildProxy, the children are the control channels */
+static GObject *
+gst_csoundsrc_child_proxy_get_child_by_index (GstChildProxy * child_proxy,
+    guint index)
+{
+  GstCsoundsrc *csoundsrc = GST_CSOUNDSRC (child_proxy);
+  GObject *res = NULL;
+
+  GST_OBJECT_LOCK (csoundsrc);
+  if (csoundsrc->ctl_channels && index < csoundsrc->ctl_channels->len)
+    res = gst_object_ref (g_ptr_array_index (csoundsrc->ctl_channels,
+            index));
+  GST_OBJECT_UNLOCK (csoundsrc);
+
+  return res;
+}
+
+static guint
+gst_csoundsrc_child_proxy_get_children_count (GstChildProxy * child_proxy)
+{
+  GstCsoundsrc *csoundsrc = GST_CSOUNDSRC (child_proxy);
+  guint res;
+
+  GST_OBJECT_LOCK (csoundsrc);
+  res = csoundsrc->ctl_channels ? csoundsrc->ctl_channels->len : 0;
+  GST_OBJECT_UNLOCK (csoundsrc);
+
+  return res;
+}
+
+static void
+gst_csoundsrc_child_proxy_init (gpointer g_iface, gpointer iface_data)
+{
+  GstChildProxyInterface *iface = g_iface;
+
+  iface->get_child_by_index = gst_csoundsrc_child_proxy_get_child_by_index;
+  iface->get_children_count = gst_csoundsrc_child_proxy_get_children_count;
 }
 
 CSOUND *gst_csoundsrc_get_instance(GstCsoundsrc *csoundsrc){
   return csoundsrc->csound;
 }
+
+/**
+ * gst_csoundsrc_send_score_events:
+ *
+ * Queue a batch of score events from any thread, without blocking, see
+ * gst_csoundfilter_send_score_events().
+ *
+ * Returns: %FALSE if there was nothing to queue
+ */
+gboolean
+gst_csoundsrc_send_score_events (GstCsoundsrc * csoundsrc, gchar type,
+    const GstClockTime * running_times, const MYFLT * pfields,
+    guint n_pfields, guint n_events)
+{
+  g_return_val_if_fail (GST_IS_CSOUNDSRC (csoundsrc), FALSE);
+
+  return gst_csound_event_queue_push (&csoundsrc->events, type,
+      running_times, pfields, n_pfields, n_events);
+}
+
+static gboolean
+gst_csoundsrc_score_events_bytes (GstCsoundsrc * csoundsrc, gchar type,
+    guint n_pfields, GBytes * pfields, GBytes * running_times)
+{
+  return gst_csound_event_queue_push_bytes (&csoundsrc->events, type,
+      n_pfields, pfields, running_times);
+}
+
+/* set up before acquiring the instances, they print through it */
+static void
+gst_csoundsrc_start_log (GstCsoundsrc * csoundsrc)
+{
+  GstCsoundLog *log = gst_csound_log_new (GST_ELEMENT (csoundsrc),
+      GST_CAT_DEFAULT, csoundsrc->message_level, csoundsrc->message_rate);
+
+  GST_OBJECT_LOCK (csoundsrc);
+  csoundsrc->log = log;
+  GST_OBJECT_UNLOCK (csoundsrc);
+}
+
+/* only once every instance is released */
+static void
+gst_csoundsrc_stop_log (GstCsoundsrc * csoundsrc)
+{
+  GstCsoundLog *log;
+
+  GST_OBJECT_LOCK (csoundsrc);
+  log = csoundsrc->log;
+  csoundsrc->log = NULL;
+  GST_OBJECT_UNLOCK (csoundsrc);
+  gst_csound_log_free (log);
+}
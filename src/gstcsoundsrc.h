@@ -24,6 +24,12 @@
 #include <gst/base/gstbasesrc.h>
 #include <gst/audio/audio.h>
 #include <csound/csound.h>
+#include "gstcsoundconvert.h"
+#include "gstcsoundlog.h"
+#include "gstcsoundstats.h"
+#include "gstcsoundevents.h"
+#include "gstcsoundcache.h"
+#include "gstcsoundmeta.h"
 
 G_BEGIN_DECLS
 #define GST_TYPE_CSOUNDSRC   (gst_csoundsrc_get_type())
@@ -37,26 +43,90 @@ typedef struct _GstCsoundsrcClass GstCsoundsrcClass;
 typedef void (*csoundMessageCallback) (CSOUND *, int attr, const char *format,
     va_list valist);
 
-typedef void (*csoundsrcProcessFunc) (GstCsoundsrc *, MYFLT *);
+typedef guint (*csoundsrcProcessFunc) (GstCsoundsrc *, gpointer, guint,
+    guint);
 
 struct _GstCsoundsrc
 {
   GstBaseSrc base_csoundsrc;
   CSOUND *csound;
   gchar *csd_name;
+  /* the orchestra as text instead, all four under the object lock */
+  gchar *csd_text;
+  gchar *orc;
+  gchar *sco;
   gboolean loop;
+  gboolean instance_pool;
+  gboolean follow_caps;
+  gchar *options;               /* the instance is compiled with */
+  gint csd_rate;                /* of the csd itself, for follow-caps */
+  guint csd_ksmps;
+  gint csd_channels;
+  guint samples_per_buffer;
+  gboolean render_cache;
+  gboolean loop_replay;
+  GstCsoundLog *log;
+  GstCsoundMessageLevel message_level;
+  guint message_rate;
+
+  /* owned by the streaming thread */
+  GstCsoundStats stats;
+  GstCsoundStatsBoard stats_board;
 
   /* <private> */
   csoundsrcProcessFunc process;
   //GstAudioFormatPack pack_func;
   //gint pack_size;
   GstAudioInfo info;
+  GstCsoundConvert out_convert;
   gint channels;
+  gpointer *planes;             /* of the buffer in fill(), non-interleaved */
 
   MYFLT *csound_output;
+  guint buffer_frames;          /* whole ksmps blocks */
   guint64 samples_to_generate;
+
+  /* chn_k input channels, children of the element */
+  GPtrArray *ctl_channels;
+
+  /* request out_%u pads, under the object lock */
+  GList *out_pads;
+  gboolean out_flushing;        /* flush start pushed on them, no stop yet */
+  MYFLT **ctl_ptrs;
+  MYFLT *ctl_values;            /* one row per block of the current buffer */
+  gsize ctl_capacity;           /* values, not blocks */
+
+  /* chn_k output channels read after every block, the property under
+   * the object lock */
+  gchar *analysis_channels;
+  GstCsoundAnalysis analysis;
   guint ksmps;
 
+  /* score events, the ones due in the current buffer are taken by fill() */
+  GstCsoundEventQueue events;
+  GstCsoundEvent *due_events;
+  GstCsoundEvent *due_next;     /* the first not played yet */
+  GstClockTime due_start;       /* running time of the first block */
+  GstClockTime block_duration;
+
+  /* render cache, csound is at engine_block of a straight render of the
+   * score as long as engine_exact */
+  GstCsoundCache *cache;
+  guint64 position;             /* block of the score of the next buffer */
+  guint64 engine_block;
+  gboolean engine_exact;
+
+  /* loop replay, the first pass of the score is recorded and the later
+   * ones are slices of it */
+  GByteArray *recording;
+  GstMemory *replay;
+  gsize replay_size;
+  gsize replay_offset;
+
+  /* a new orchestra set while running, swapped in at a buffer start */
+  struct _GstCsoundSwap *swap;
+  GstClockTime crossfade;
+
   GstClockTimeDiff timestamp_offset;
   GstClockTime next_time;       /* next timestamp */
   gint64 next_sample;           /* next sample to send */
@@ -69,6 +139,10 @@ struct _GstCsoundsrc
 struct _GstCsoundsrcClass
 {
   GstBaseSrcClass base_csoundsrc_class;
+
+  /* actions */
+  gboolean (*score_events) (GstCsoundsrc * csoundsrc, gchar type,
+      guint n_pfields, GBytes * pfields, GBytes * running_times);
 };
 
 GST_EXPORT
@@ -77,5 +151,10 @@ GType gst_csoundsrc_get_type (void);
 GST_EXPORT
 CSOUND *gst_csoundsrc_get_instance(GstCsoundsrc *csoundsrc);
 
+GST_EXPORT
+gboolean gst_csoundsrc_send_score_events (GstCsoundsrc * csoundsrc,
+    gchar type, const GstClockTime * running_times, const MYFLT * pfields,
+    guint n_pfields, guint n_events);
+
 G_END_DECLS
 #endif
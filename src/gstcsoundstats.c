@@ -0,0 +1,216 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/* How much of the real-time budget csound takes.
+ *
+ * The thread running csoundPerformKsmps() times every block into its own
+ * GstCsoundStats, without locking, and now and then publishes a copy to
+ * the board. It only tries the board lock, so a reader holding it costs
+ * the audio thread one skipped update, never a wait. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include "gstcsoundstats.h"
+
+void
+gst_csound_stats_reset (GstCsoundStats * stats, GstClockTime block_duration)
+{
+  memset (stats, 0, sizeof (GstCsoundStats));
+  stats->block_duration = block_duration;
+  stats->min = GST_CLOCK_TIME_NONE;
+  stats->drift_base = GST_CLOCK_TIME_NONE;
+}
+
+void
+gst_csound_stats_add_block (GstCsoundStats * stats, GstClockTime elapsed)
+{
+  guint bin = GST_CSOUND_STATS_BINS - 1;
+
+  stats->blocks++;
+  stats->total += elapsed;
+  if (elapsed < stats->min)
+    stats->min = elapsed;
+  if (elapsed > stats->max)
+    stats->max = elapsed;
+
+  if (stats->block_duration > 0) {
+    if (elapsed > stats->block_duration)
+      stats->late_blocks++;
+    if (elapsed / stats->block_duration < 2)
+      bin = MIN (elapsed * 100 / stats->block_duration, bin);
+  }
+  stats->bins[bin]++;
+}
+
+/* a buffer took @elapsed to process and holds @duration of audio */
+void
+gst_csound_stats_add_buffer (GstCsoundStats * stats, GstClockTime elapsed,
+    GstClockTime duration)
+{
+  if (GST_CLOCK_TIME_IS_VALID (duration) && elapsed > duration)
+    stats->late_buffers++;
+}
+
+/**
+ * gst_csound_stats_sync:
+ * @running_time: pipeline running time at the end of the blocks performed
+ * @samples: csoundGetCurrentTimeSamples() after them
+ * @rate: the orchestra sample rate
+ *
+ * Measure how far the score moved away from the pipeline since it last
+ * started over.
+ */
+void
+gst_csound_stats_sync (GstCsoundStats * stats, GstClockTime running_time,
+    gint64 samples, gint rate)
+{
+  GstClockTime score_time;
+
+  if (!GST_CLOCK_TIME_IS_VALID (running_time) || rate <= 0 || samples < 0)
+    return;
+
+  score_time = gst_util_uint64_scale_int (samples, GST_SECOND, rate);
+  /* the first measure, or the score was rewound */
+  if (!GST_CLOCK_TIME_IS_VALID (stats->drift_base)
+      || samples < stats->last_samples)
+    stats->drift_base = running_time - MIN (score_time, running_time);
+
+  stats->last_samples = samples;
+  stats->drift = GST_CLOCK_DIFF (score_time, running_time - stats->drift_base);
+}
+
+/* add the blocks of @from, performed by another thread, and clear it */
+void
+gst_csound_stats_merge (GstCsoundStats * stats, GstCsoundStats * from)
+{
+  guint i;
+
+  stats->blocks += from->blocks;
+  stats->total += from->total;
+  if (from->min < stats->min)
+    stats->min = from->min;
+  if (from->max > stats->max)
+    stats->max = from->max;
+  stats->late_blocks += from->late_blocks;
+  for (i = 0; i < GST_CSOUND_STATS_BINS; i++)
+    stats->bins[i] += from->bins[i];
+
+  gst_csound_stats_reset (from, from->block_duration);
+}
+
+static GstClockTime
+gst_csound_stats_percentile (const GstCsoundStats * stats, guint percent)
+{
+  guint64 wanted = (stats->blocks * percent + 99) / 100, seen = 0;
+  guint i;
+
+  for (i = 0; i < GST_CSOUND_STATS_BINS - 1; i++) {
+    seen += stats->bins[i];
+    if (seen >= wanted)
+      return MIN ((i + 1) * stats->block_duration / 100, stats->max);
+  }
+
+  return stats->max;
+}
+
+static GstStructure *
+gst_csound_stats_to_structure (const GstCsoundStats * stats)
+{
+  GstClockTime audio = stats->blocks * stats->block_duration;
+
+  return gst_structure_new ("csound-stats",
+      "blocks", G_TYPE_UINT64, stats->blocks,
+      "block-duration", G_TYPE_UINT64, stats->block_duration,
+      "min", G_TYPE_UINT64, stats->blocks ? stats->min : 0,
+      "avg", G_TYPE_UINT64, stats->blocks ? stats->total / stats->blocks : 0,
+      "max", G_TYPE_UINT64, stats->max,
+      "p99", G_TYPE_UINT64, stats->blocks ?
+      gst_csound_stats_percentile (stats, 99) : 0,
+      "load", G_TYPE_DOUBLE, audio ? (gdouble) stats->total / audio : 0.0,
+      "realtime-factor", G_TYPE_DOUBLE, stats->total ?
+      (gdouble) audio / stats->total : 0.0,
+      "late-blocks", G_TYPE_UINT64, stats->late_blocks,
+      "late-buffers", G_TYPE_UINT64, stats->late_buffers,
+      "drift", G_TYPE_INT64, stats->drift, NULL);
+}
+
+void
+gst_csound_stats_board_init (GstCsoundStatsBoard * board)
+{
+  g_mutex_init (&board->lock);
+  gst_csound_stats_reset (&board->snapshot, 0);
+  board->interval = 0;
+  board->posted = GST_CLOCK_TIME_NONE;
+}
+
+void
+gst_csound_stats_board_clear (GstCsoundStatsBoard * board)
+{
+  g_mutex_clear (&board->lock);
+}
+
+/**
+ * gst_csound_stats_publish:
+ * @element: posts a "csound-stats" element message every interval of
+ *     the board, if set
+ *
+ * Called by the thread owning @stats, skipped when a reader holds the
+ * board.
+ */
+void
+gst_csound_stats_publish (GstCsoundStatsBoard * board,
+    const GstCsoundStats * stats, GstElement * element)
+{
+  GstClockTime now;
+  gboolean post = FALSE;
+
+  if (!g_mutex_trylock (&board->lock))
+    return;
+
+  board->snapshot = *stats;
+  if (board->interval > 0) {
+    now = gst_util_get_timestamp ();
+    if (!GST_CLOCK_TIME_IS_VALID (board->posted)
+        || now - board->posted >= board->interval) {
+      board->posted = now;
+      post = TRUE;
+    }
+  }
+  g_mutex_unlock (&board->lock);
+
+  if (post)
+    gst_element_post_message (element,
+        gst_message_new_element (GST_OBJECT (element),
+            gst_csound_stats_to_structure (stats)));
+}
+
+GstStructure *
+gst_csound_stats_board_get (GstCsoundStatsBoard * board)
+{
+  GstStructure *s;
+
+  g_mutex_lock (&board->lock);
+  s = gst_csound_stats_to_structure (&board->snapshot);
+  g_mutex_unlock (&board->lock);
+
+  return s;
+}
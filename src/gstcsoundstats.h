@@ -0,0 +1,80 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_CSOUND_STATS_H_
+#define _GST_CSOUND_STATS_H_
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* perform times are binned in percents of the block duration, the last
+ * bin takes everything slower */
+#define GST_CSOUND_STATS_BINS 200
+
+typedef struct _GstCsoundStats GstCsoundStats;
+typedef struct _GstCsoundStatsBoard GstCsoundStatsBoard;
+
+/* accumulated by the thread performing, nobody else touches them */
+struct _GstCsoundStats
+{
+  GstClockTime block_duration;
+  guint64 blocks;
+  GstClockTime min;
+  GstClockTime max;
+  GstClockTime total;
+  guint64 late_blocks;          /* blocks performed slower than real time */
+  guint64 late_buffers;         /* buffers processed slower than real time */
+  guint32 bins[GST_CSOUND_STATS_BINS];
+
+  /* pipeline running time less the score time */
+  GstClockTimeDiff drift;
+  GstClockTime drift_base;
+  gint64 last_samples;
+};
+
+/* the last published copy, for the application threads */
+struct _GstCsoundStatsBoard
+{
+  GMutex lock;
+  GstCsoundStats snapshot;
+  guint64 interval;             /* between element messages, 0 for none */
+  GstClockTime posted;
+};
+
+void gst_csound_stats_reset (GstCsoundStats * stats,
+    GstClockTime block_duration);
+
+void gst_csound_stats_add_block (GstCsoundStats * stats,
+    GstClockTime elapsed);
+void gst_csound_stats_add_buffer (GstCsoundStats * stats,
+    GstClockTime elapsed, GstClockTime duration);
+void gst_csound_stats_sync (GstCsoundStats * stats, GstClockTime running_time,
+    gint64 samples, gint rate);
+void gst_csound_stats_merge (GstCsoundStats * stats, GstCsoundStats * from);
+
+void gst_csound_stats_board_init (GstCsoundStatsBoard * board);
+void gst_csound_stats_board_clear (GstCsoundStatsBoard * board);
+void gst_csound_stats_publish (GstCsoundStatsBoard * board,
+    const GstCsoundStats * stats, GstElement * element);
+GstStructure *gst_csound_stats_board_get (GstCsoundStatsBoard * board);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,328 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Hot-swap of the running orchestra.
+ *
+ * A new orchestra set while the element runs is compiled on a thread of
+ * its own, with the options of the running instance, so the streaming
+ * thread never waits for csound to compile. The thread performing takes
+ * it at the start of a buffer, a ksmps boundary, and both instances then
+ * perform the same input for the crossfade, the old one fading out
+ * linearly under the new one. Once faded, the old instance is destroyed
+ * on yet another thread. A request made while another one compiles
+ * wins over it. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include "gstcsoundswap.h"
+
+typedef struct
+{
+  GstCsoundSwap *swap;
+  GstCsoundSource source;
+  gchar *options;
+  guint serial;
+} GstCsoundSwapJob;
+
+GstCsoundSwap *
+gst_csound_swap_new (GstElement * element)
+{
+  GstCsoundSwap *swap = g_new0 (GstCsoundSwap, 1);
+
+  swap->element = element;
+  g_mutex_init (&swap->lock);
+  g_cond_init (&swap->cond);
+
+  return swap;
+}
+
+void
+gst_csound_swap_free (GstCsoundSwap * swap)
+{
+  gst_csound_swap_reset (swap);
+  g_mutex_clear (&swap->lock);
+  g_cond_clear (&swap->cond);
+  g_free (swap);
+}
+
+/**
+ * gst_csound_swap_activate:
+ * @reuse: compile through the instance pool
+ * @message_func: the message callback of the new instances
+ * @host_data: their host data, valid until gst_csound_swap_reset()
+ *
+ * Accept requests, an instance is running.
+ */
+void
+gst_csound_swap_activate (GstCsoundSwap * swap, gboolean reuse,
+    GstCsoundMessageFunc message_func, gpointer host_data)
+{
+  g_mutex_lock (&swap->lock);
+  swap->active = TRUE;
+  swap->reuse = reuse;
+  swap->message_func = message_func;
+  swap->host_data = host_data;
+  g_mutex_unlock (&swap->lock);
+}
+
+/**
+ * gst_csound_swap_reset:
+ *
+ * Refuse requests, wait for the compile threads and release every
+ * instance that is not swapped in.
+ */
+void
+gst_csound_swap_reset (GstCsoundSwap * swap)
+{
+  CSOUND *ready;
+
+  g_mutex_lock (&swap->lock);
+  swap->active = FALSE;
+  swap->serial++;
+  while (swap->compiling > 0)
+    g_cond_wait (&swap->cond, &swap->lock);
+  ready = swap->ready;
+  swap->ready = NULL;
+  g_mutex_unlock (&swap->lock);
+
+  gst_csound_instance_release (ready);
+  gst_csound_instance_release (swap->old);
+  swap->old = NULL;
+  if (swap->releasing) {
+    g_thread_join (swap->releasing);
+    swap->releasing = NULL;
+  }
+}
+
+static gpointer
+gst_csound_swap_compile (gpointer data)
+{
+  GstCsoundSwapJob *job = data;
+  GstCsoundSwap *swap = job->swap;
+  CSOUND *csound, *stale;
+
+  csound = gst_csound_instance_acquire_source (&job->source, job->options,
+      swap->reuse, swap->message_func, swap->host_data);
+  if (csound == NULL)
+    GST_ELEMENT_WARNING (swap->element, RESOURCE, OPEN_READ, (NULL),
+        ("%s does not compile, the running orchestra stays",
+            gst_csound_source_get_name (&job->source)));
+
+  g_mutex_lock (&swap->lock);
+  if (job->serial == swap->serial) {
+    stale = swap->ready;
+    swap->ready = csound;
+  } else {
+    stale = csound;
+  }
+  swap->compiling--;
+  g_cond_broadcast (&swap->cond);
+  g_mutex_unlock (&swap->lock);
+
+  gst_csound_instance_release (stale);
+  gst_csound_source_clear (&job->source);
+  g_free (job->options);
+  g_free (job);
+
+  return NULL;
+}
+
+/**
+ * gst_csound_swap_request:
+ * @options: the options of the running instance
+ *
+ * Compile @source in the background.
+ *
+ * Returns: %FALSE when no instance is running, nothing to swap
+ */
+gboolean
+gst_csound_swap_request (GstCsoundSwap * swap,
+    const GstCsoundSource * source, const gchar * options)
+{
+  GstCsoundSwapJob *job;
+
+  g_mutex_lock (&swap->lock);
+  if (!swap->active) {
+    g_mutex_unlock (&swap->lock);
+    return FALSE;
+  }
+  job = g_new0 (GstCsoundSwapJob, 1);
+  job->swap = swap;
+  gst_csound_source_copy (&job->source, source);
+  job->options = g_strdup (options);
+  job->serial = ++swap->serial;
+  swap->compiling++;
+  g_mutex_unlock (&swap->lock);
+
+  GST_INFO_OBJECT (swap->element, "compiling %s in the background",
+      gst_csound_source_get_name (source));
+  g_thread_unref (g_thread_new ("csound-compile", gst_csound_swap_compile,
+          job));
+
+  return TRUE;
+}
+
+/**
+ * gst_csound_swap_take:
+ *
+ * Returns: the instance compiled last, or %NULL, never waits
+ */
+CSOUND *
+gst_csound_swap_take (GstCsoundSwap * swap)
+{
+  CSOUND *csound;
+
+  g_mutex_lock (&swap->lock);
+  csound = swap->ready;
+  swap->ready = NULL;
+  g_mutex_unlock (&swap->lock);
+
+  return csound;
+}
+
+static gpointer
+gst_csound_swap_release (gpointer data)
+{
+  gst_csound_instance_release (data);
+
+  return NULL;
+}
+
+/* the faded instance goes, csoundCleanup() may take a while */
+static void
+gst_csound_swap_finish (GstCsoundSwap * swap)
+{
+  if (swap->releasing)
+    g_thread_join (swap->releasing);
+  /* the element may stop before the thread gets to it */
+  csoundSetHostData (swap->old, NULL);
+  swap->releasing = g_thread_new ("csound-release", gst_csound_swap_release,
+      swap->old);
+  swap->old = NULL;
+}
+
+/**
+ * gst_csound_swap_begin:
+ * @old: the running instance, between two blocks
+ * @csound: an instance from gst_csound_swap_take()
+ * @fade_blocks: ksmps blocks of crossfade, 0 to cut over
+ *
+ * Start the crossfade from @old to @csound. The buffers of @old, input
+ * waiting in spin and output not converted yet, are carried over.
+ *
+ * Returns: %FALSE, @csound released, when it runs at another rate, ksmps,
+ *     channels or 0dBFS than @old
+ */
+gboolean
+gst_csound_swap_begin (GstCsoundSwap * swap, CSOUND * old, CSOUND * csound,
+    guint fade_blocks)
+{
+  guint ksmps = csoundGetKsmps (old);
+  guint ichannels = csoundGetNchnlsInput (old);
+  guint ochannels = csoundGetNchnls (old);
+
+  g_return_val_if_fail (swap->old == NULL, FALSE);
+
+  if (csoundGetSr (csound) != csoundGetSr (old)
+      || csoundGetKsmps (csound) != ksmps
+      || csoundGetNchnlsInput (csound) != ichannels
+      || csoundGetNchnls (csound) != ochannels
+      || csoundGet0dBFS (csound) != csoundGet0dBFS (old)) {
+    GST_ELEMENT_WARNING (swap->element, CORE, NEGOTIATION, (NULL),
+        ("the new orchestra runs at another sr, ksmps, nchnls or 0dbfs, "
+            "the running one stays"));
+    gst_csound_instance_release (csound);
+    return FALSE;
+  }
+
+  if (csoundGetSpin (csound) && csoundGetSpin (old))
+    memcpy (csoundGetSpin (csound), csoundGetSpin (old),
+        sizeof (MYFLT) * ksmps * ichannels);
+  memcpy (csoundGetSpout (csound), csoundGetSpout (old),
+      sizeof (MYFLT) * ksmps * ochannels);
+
+  GST_INFO_OBJECT (swap->element, "crossfading over %u blocks",
+      fade_blocks);
+  swap->old = old;
+  swap->fade_blocks = fade_blocks;
+  swap->fade_done = 0;
+  if (fade_blocks == 0)
+    gst_csound_swap_finish (swap);
+
+  return TRUE;
+}
+
+/**
+ * gst_csound_swap_feed:
+ * @spin: the input of the block the new instance is about to perform,
+ *     or %NULL
+ *
+ * Perform the same block on the instance fading out.
+ */
+void
+gst_csound_swap_feed (GstCsoundSwap * swap, const MYFLT * spin)
+{
+  MYFLT *old_spin;
+
+  if (swap->old == NULL)
+    return;
+
+  old_spin = csoundGetSpin (swap->old);
+  if (spin && old_spin)
+    memcpy (old_spin, spin, sizeof (MYFLT) * csoundGetKsmps (swap->old) *
+        csoundGetNchnlsInput (swap->old));
+  csoundPerformKsmps (swap->old);
+}
+
+/**
+ * gst_csound_swap_mix:
+ * @spout: the output of the block the new instance just performed
+ *
+ * Mix the output of the instance fading out into @spout, the gain of the
+ * new one rising linearly frame by frame.
+ */
+void
+gst_csound_swap_mix (GstCsoundSwap * swap, MYFLT * spout)
+{
+  const MYFLT *old_spout;
+  guint ksmps, channels, f, c;
+  gdouble total, pos;
+
+  if (swap->old == NULL)
+    return;
+
+  old_spout = csoundGetSpout (swap->old);
+  ksmps = csoundGetKsmps (swap->old);
+  channels = csoundGetNchnls (swap->old);
+  total = (gdouble) swap->fade_blocks * ksmps;
+  pos = (gdouble) swap->fade_done * ksmps;
+
+  for (f = 0; f < ksmps; f++) {
+    MYFLT gain = (MYFLT) ((pos + f + 1) / total);
+
+    for (c = 0; c < channels; c++, spout++, old_spout++)
+      *spout = *old_spout + gain * (*spout - *old_spout);
+  }
+
+  if (++swap->fade_done == swap->fade_blocks)
+    gst_csound_swap_finish (swap);
+}
@@ -0,0 +1,74 @@
+/* GStreamer
+ * Copyright (C) 2017 Natanael Mojica <neithanmo@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_CSOUND_SWAP_H_
+#define _GST_CSOUND_SWAP_H_
+
+#include <gst/gst.h>
+#include <csound/csound.h>
+#include "gstcsoundinstance.h"
+
+G_BEGIN_DECLS
+
+typedef struct _GstCsoundSwap GstCsoundSwap;
+
+/* a new orchestra compiled on a thread of its own while the running one
+ * keeps playing, then crossfaded in by the thread performing */
+struct _GstCsoundSwap
+{
+  GstElement *element;          /* posts the compile warnings */
+
+  /* under lock, shared with the compile threads */
+  GMutex lock;
+  GCond cond;
+  gboolean active;              /* an instance is running */
+  gboolean reuse;
+  GstCsoundMessageFunc message_func;
+  gpointer host_data;
+  guint compiling;              /* compile threads running */
+  guint serial;                 /* of the last request */
+  CSOUND *ready;                /* compiled, not swapped in yet */
+
+  /* owned by the thread performing */
+  CSOUND *old;                  /* fading out, NULL when not fading */
+  guint fade_blocks;
+  guint fade_done;
+  GThread *releasing;           /* destroying the last faded instance */
+};
+
+#define gst_csound_swap_fading(swap) ((swap)->old != NULL)
+
+GstCsoundSwap *gst_csound_swap_new (GstElement * element);
+void gst_csound_swap_free (GstCsoundSwap * swap);
+
+void gst_csound_swap_activate (GstCsoundSwap * swap, gboolean reuse,
+    GstCsoundMessageFunc message_func, gpointer host_data);
+void gst_csound_swap_reset (GstCsoundSwap * swap);
+gboolean gst_csound_swap_request (GstCsoundSwap * swap,
+    const GstCsoundSource * source, const gchar * options);
+
+CSOUND *gst_csound_swap_take (GstCsoundSwap * swap);
+gboolean gst_csound_swap_begin (GstCsoundSwap * swap, CSOUND * old,
+    CSOUND * csound, guint fade_blocks);
+void gst_csound_swap_feed (GstCsoundSwap * swap, const MYFLT * spin);
+void gst_csound_swap_mix (GstCsoundSwap * swap, MYFLT * spout);
+
+G_END_DECLS
+
+#endif
@@ -26,13 +26,22 @@
 #include "gstcsoundfilter.h"
 #include "gstcsoundsrc.h"
 #include "gstcsoundsink.h"
+#include "gstcsoundrendersink.h"
+#include "gstcsoundmixer.h"
+#include "gstcsoundconvert.h"
+#include "gstcsoundinstance.h"
 
 static gboolean
 plugin_init (GstPlugin * plugin)
 {
+  gst_csound_convert_init ();
+  gst_csound_instance_init ();
+
   return gst_element_register (plugin, "csoundfilter", GST_RANK_NONE, GST_TYPE_CSOUNDFILTER)
          && gst_element_register (plugin, "csoundsrc", GST_RANK_NONE,GST_TYPE_CSOUNDSRC)
-         && gst_element_register (plugin, "csoundsink", GST_RANK_NONE,GST_TYPE_CSOUNDSINK);
+         && gst_element_register (plugin, "csoundsink", GST_RANK_NONE,GST_TYPE_CSOUNDSINK)
+         && gst_element_register (plugin, "csoundrendersink", GST_RANK_NONE,GST_TYPE_CSOUNDRENDERSINK)
+         && gst_element_register (plugin, "csoundmixer", GST_RANK_NONE,GST_TYPE_CSOUNDMIXER);
 
 }
 